@@ -1,6 +1,7 @@
 // © 2021 NVIDIA Corporation
 
 #include "NRI.hlsl"
+#include "RayTracingBoxMaterials.hlsli"
 
 NRI_RESOURCE(Buffer<float2>, vertexBuffers[], t, 0, 1);
 NRI_RESOURCE(Buffer<uint4>, indexBuffers[], t, 0, 2);
@@ -15,8 +16,7 @@ struct IntersectionAttributes
     float2 barycentrics;
 };
 
-[shader( "closesthit" )]
-void closest_hit( inout Payload payload : SV_RayPayload, in IntersectionAttributes intersectionAttributes : SV_IntersectionAttributes )
+float3 Shade( uint material, IntersectionAttributes intersectionAttributes )
 {
     uint instanceID = InstanceID( );
     uint primitiveIndex = PrimitiveIndex( );
@@ -33,5 +33,24 @@ void closest_hit( inout Payload payload : SV_RayPayload, in IntersectionAttribut
 
     float2 texcoords = barycentrics.x * texCoords0 + barycentrics.y * texCoords1 + barycentrics.z * texCoords2;
 
-    payload.hitValue = float3( texcoords, 0 );
+    return ShadeBox( material, texcoords, barycentrics );
+}
+
+// One entry point per hit group
+[shader( "closesthit" )]
+void closest_hit( inout Payload payload : SV_RayPayload, in IntersectionAttributes intersectionAttributes : SV_IntersectionAttributes )
+{
+    payload.hitValue = Shade( BOX_MATERIAL_TEXCOORDS, intersectionAttributes );
+}
+
+[shader( "closesthit" )]
+void closest_hit_barycentrics( inout Payload payload : SV_RayPayload, in IntersectionAttributes intersectionAttributes : SV_IntersectionAttributes )
+{
+    payload.hitValue = Shade( BOX_MATERIAL_BARYCENTRICS, intersectionAttributes );
+}
+
+[shader( "closesthit" )]
+void closest_hit_checker( inout Payload payload : SV_RayPayload, in IntersectionAttributes intersectionAttributes : SV_IntersectionAttributes )
+{
+    payload.hitValue = Shade( BOX_MATERIAL_CHECKER, intersectionAttributes );
 }
@@ -0,0 +1,57 @@
+// © 2021 NVIDIA Corporation
+
+#include "NRI.hlsl"
+#include "RayTracingBoxInstancesStructs.h"
+
+// Matches "nri::TopLevelInstance" (D3D12_RAYTRACING_INSTANCE_DESC / VkAccelerationStructureInstanceKHR)
+struct TopLevelInstance
+{
+    float4 transform[3];
+    uint instanceIdAndMask;
+    uint hitGroupOffsetAndFlags;
+    uint2 accelerationStructureHandle;
+};
+
+NRI_ROOT_CONSTANTS(InstanceGenerationConstants, Constants, 0, 0);
+NRI_RESOURCE(StructuredBuffer<BoxObject>, Objects, t, 0, 0);
+NRI_RESOURCE(StructuredBuffer<uint2>, Handles, t, 1, 0); // [BLAS index][LOD]
+NRI_RESOURCE(RWStructuredBuffer<TopLevelInstance>, Instances, u, 0, 0);
+
+[numthreads(INSTANCE_GENERATION_GROUP_SIZE, 1, 1)]
+void main(uint index : SV_DispatchThreadId)
+{
+    if (index >= Constants.objectNum)
+        return;
+
+    BoxObject object = Objects[index];
+
+    // Boxes spin and bob, each with its own phase
+    float phase = Constants.time + float(index % 97) * 0.1;
+    float sina = sin(phase);
+    float cosa = cos(phase);
+
+    float3 position = float3(object.positionX, object.positionY + sina * 0.25, object.positionZ);
+
+    // Culling: behind the camera or too far (the instance stays, but can't be hit)
+    float3 toObject = position - float3(Constants.cameraPositionX, Constants.cameraPositionY, Constants.cameraPositionZ);
+    float distance = length(toObject);
+
+    uint mask = object.blasIndexMaterialAndMask >> 24;
+    if (toObject.z < 0.0 || distance > Constants.cullDistance)
+        mask = 0;
+
+    // LOD
+    uint lod = min(uint(distance / Constants.lodDistance), BOX_LOD_NUM - 1);
+    uint blasIndex = object.blasIndexMaterialAndMask & 0xFFFF;
+    uint material = (object.blasIndexMaterialAndMask >> 16) & 0xFF;
+
+    TopLevelInstance instance;
+    instance.transform[0] = float4(cosa, 0.0, sina, position.x);
+    instance.transform[1] = float4(0.0, 1.0, 0.0, position.y);
+    instance.transform[2] = float4(-sina, 0.0, cosa, position.z);
+    instance.instanceIdAndMask = index | (mask << 24);
+    instance.hitGroupOffsetAndFlags = material;
+    instance.accelerationStructureHandle = Handles[blasIndex * BOX_LOD_NUM + lod];
+
+    Instances[index] = instance;
+}
@@ -0,0 +1,32 @@
+// © 2021 NVIDIA Corporation
+
+// Shared by "RayTracingBoxInstances.cs.hlsl", "RayTracingBoxMaterials.hlsli" and their CPU counterparts ("RayTracingBoxes.cpp", "RayTracingBoxesScene.h")
+
+#define INSTANCE_GENERATION_GROUP_SIZE 256
+#define BOX_LOD_NUM 2
+
+// Materials (hit groups), see "RayTracingBoxMaterials.hlsli"
+#define BOX_MATERIAL_TEXCOORDS 0
+#define BOX_MATERIAL_BARYCENTRICS 1
+#define BOX_MATERIAL_CHECKER 2
+#define BOX_MATERIAL_NUM 3
+
+struct InstanceGenerationConstants
+{
+    float cameraPositionX;
+    float cameraPositionY;
+    float cameraPositionZ;
+    float time;
+    float cullDistance;
+    float lodDistance;
+    uint32_t objectNum;
+    uint32_t padding;
+};
+
+struct BoxObject
+{
+    float positionX;
+    float positionY;
+    float positionZ;
+    uint32_t blasIndexMaterialAndMask; // BLAS index : 16, material (hit group) : 8, mask : 8
+};
@@ -0,0 +1,20 @@
+// © 2021 NVIDIA Corporation
+
+// Box materials (one hit group per material, selected by "instanceContributionToHitGroupIndex"),
+// shared by "RayTracingBox.rchit.hlsl" and "RayTracingBoxQuery.cs.hlsl"
+
+#include "RayTracingBoxInstancesStructs.h"
+
+float3 ShadeBox(uint material, float2 texcoords, float3 barycentrics)
+{
+    if (material == BOX_MATERIAL_BARYCENTRICS)
+        return barycentrics;
+
+    if (material == BOX_MATERIAL_CHECKER)
+    {
+        uint2 cell = uint2(texcoords * 4.0);
+        return ((cell.x ^ cell.y) & 1) ? float3(0.9, 0.9, 0.9) : float3(0.1, 0.1, 0.1);
+    }
+
+    return float3(texcoords, 0);
+}
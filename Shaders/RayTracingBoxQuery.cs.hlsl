@@ -0,0 +1,75 @@
+// © 2021 NVIDIA Corporation
+
+// Inline ray tracing counterpart of "RayTracingBox.rgen.hlsl" + "RayTracingBox.rchit.hlsl" + "RayTracingBox.rmiss.hlsl"
+// (same resources and output, no shader table)
+
+#include "NRI.hlsl"
+#include "RayTracingBoxMaterials.hlsli"
+
+#define RAY_QUERY_GROUP_SIZE 8
+
+#if (NRI_SHADER_MODEL >= 65)
+
+NRI_FORMAT("rgba8") NRI_RESOURCE(RWTexture2D<float4>, outputImage, u, 0, 0);
+NRI_RESOURCE(RaytracingAccelerationStructure, topLevelAS, t, 1, 0);
+NRI_RESOURCE(Buffer<float2>, vertexBuffers[], t, 0, 1);
+NRI_RESOURCE(Buffer<uint4>, indexBuffers[], t, 0, 2);
+
+[numthreads(RAY_QUERY_GROUP_SIZE, RAY_QUERY_GROUP_SIZE, 1)]
+void main(uint2 pixelPos : SV_DispatchThreadId)
+{
+    uint2 outputSize;
+    outputImage.GetDimensions(outputSize.x, outputSize.y);
+
+    if (any(pixelPos >= outputSize))
+        return;
+
+    const float2 pixelCenter = float2(pixelPos) + float2(0.5, 0.5);
+    const float2 inUV = pixelCenter / float2(outputSize);
+
+    float2 d = inUV * 2.0 - 1.0;
+    float aspectRatio = float(outputSize.x) / float(outputSize.y);
+
+    RayDesc rayDesc;
+    rayDesc.Origin = float3(0, 0, -2.0);
+    rayDesc.Direction = normalize(float3(d.x * aspectRatio, -d.y, 1));
+    rayDesc.TMin = 0.001;
+    rayDesc.TMax = 1000.0;
+
+    // Opaque geometry only, i.e. "Proceed" finds the closest hit in one call
+    RayQuery<RAY_FLAG_FORCE_OPAQUE> rayQuery;
+    rayQuery.TraceRayInline(topLevelAS, RAY_FLAG_NONE, 0xff, rayDesc);
+    rayQuery.Proceed();
+
+    float3 hitValue = float3(0.4, 0.3, 0.35);
+    if (rayQuery.CommittedStatus() == COMMITTED_TRIANGLE_HIT)
+    {
+        uint instanceID = rayQuery.CommittedInstanceID();
+        uint primitiveIndex = rayQuery.CommittedPrimitiveIndex();
+
+        uint3 indices = indexBuffers[NonUniformResourceIndex(instanceID)][primitiveIndex].xyz;
+
+        float2 texCoords0 = vertexBuffers[NonUniformResourceIndex(instanceID)][indices.x];
+        float2 texCoords1 = vertexBuffers[NonUniformResourceIndex(instanceID)][indices.y];
+        float2 texCoords2 = vertexBuffers[NonUniformResourceIndex(instanceID)][indices.z];
+
+        float3 barycentrics;
+        barycentrics.yz = rayQuery.CommittedTriangleBarycentrics();
+        barycentrics.x = 1.0 - barycentrics.y - barycentrics.z;
+
+        float2 texcoords = barycentrics.x * texCoords0 + barycentrics.y * texCoords1 + barycentrics.z * texCoords2;
+
+        hitValue = ShadeBox(rayQuery.CommittedInstanceContributionToHitGroupIndex(), texcoords, barycentrics);
+    }
+
+    outputImage[pixelPos] = float4(hitValue, 0);
+}
+
+#else
+
+[numthreads(RAY_QUERY_GROUP_SIZE, RAY_QUERY_GROUP_SIZE, 1)]
+void main()
+{
+}
+
+#endif
@@ -0,0 +1,33 @@
+// © 2021 NVIDIA Corporation
+
+struct Payload
+{
+    float3 hitValue;
+};
+
+struct IntersectionAttributes
+{
+    float2 barycentrics;
+};
+
+uint Hash( uint x )
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+
+    return x;
+}
+
+[shader( "closesthit" )]
+void closest_hit( inout Payload payload : SV_RayPayload, in IntersectionAttributes intersectionAttributes : SV_IntersectionAttributes )
+{
+    // A color per instance (i.e. per "utils::Instance"), slightly varying per triangle to show the tessellation
+    uint instanceHash = Hash( InstanceIndex() );
+    float3 instanceColor = float3( instanceHash & 0xFF, ( instanceHash >> 8 ) & 0xFF, ( instanceHash >> 16 ) & 0xFF ) / 255.0;
+    float triangleShade = lerp( 0.7, 1.0, float( Hash( PrimitiveIndex() ) & 0xFF ) / 255.0 );
+
+    payload.hitValue = instanceColor * triangleShade;
+}
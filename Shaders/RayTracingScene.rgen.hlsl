@@ -0,0 +1,51 @@
+// © 2021 NVIDIA Corporation
+
+#include "NRI.hlsl"
+
+#include "RayTracingSceneStructs.h"
+
+NRI_ROOT_CONSTANTS(RayTracingSceneConstants, Constants, 0, 0);
+
+NRI_FORMAT("rgba8") NRI_RESOURCE(RWTexture2D<float4>, outputImage, u, 0, 0);
+NRI_RESOURCE(RaytracingAccelerationStructure, topLevelAS, t, 1, 0);
+
+struct Payload
+{
+    float3 hitValue;
+};
+
+[shader( "raygeneration" )]
+void raygen()
+{
+    uint2 dispatchRaysIndex = DispatchRaysIndex().xy;
+    uint2 dispatchRaysDimensions = DispatchRaysDimensions().xy;
+
+    const float2 pixelCenter = float2( dispatchRaysIndex.xy ) + float2( 0.5, 0.5 );
+    const float2 inUV = pixelCenter / float2( dispatchRaysDimensions.xy );
+
+    float2 ndc = inUV * 2.0 - 1.0;
+    ndc.y = -ndc.y;
+
+    // Unproject points on the near plane and further along the view ray
+    float4 nearPoint = mul( Constants.gClipToScene, float4( ndc, 0.0, 1.0 ) );
+    float4 farPoint = mul( Constants.gClipToScene, float4( ndc, 0.5, 1.0 ) );
+    nearPoint.xyz /= nearPoint.w;
+    farPoint.xyz /= farPoint.w;
+
+    RayDesc rayDesc;
+    rayDesc.Origin = nearPoint.xyz;
+    rayDesc.Direction = normalize( farPoint.xyz - nearPoint.xyz );
+    rayDesc.TMin = 0.0;
+    rayDesc.TMax = 1e6;
+
+    uint rayFlags = RAY_FLAG_FORCE_OPAQUE;
+    uint instanceInclusionMask = 0xff;
+    uint rayContributionToHitGroupIndex = 0;
+    uint multiplierForGeometryContributionToHitGroupIndex = 1;
+    uint missShaderIndex = 0;
+
+    Payload payload = (Payload)0;
+    TraceRay( topLevelAS, rayFlags, instanceInclusionMask, rayContributionToHitGroupIndex, multiplierForGeometryContributionToHitGroupIndex, missShaderIndex, rayDesc, payload );
+
+    outputImage[dispatchRaysIndex] = float4( payload.hitValue, 0 );
+}
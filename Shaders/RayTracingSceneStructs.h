@@ -0,0 +1,8 @@
+// © 2021 NVIDIA Corporation
+
+// Shared by "RayTracingScene.rgen.hlsl" and "RayTracingScene.cpp"
+
+struct RayTracingSceneConstants
+{
+    float4x4 gClipToScene; // rays are traced in scene space, instances have no transforms (as in scene viewers)
+};
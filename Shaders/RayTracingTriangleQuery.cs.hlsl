@@ -0,0 +1,58 @@
+// © 2021 NVIDIA Corporation
+
+// Inline ray tracing counterpart of "RayTracingTriangle.rgen.hlsl" + "RayTracingTriangle.rchit.hlsl" + "RayTracingTriangle.rmiss.hlsl"
+// (same resources and output, no shader table)
+
+#include "NRI.hlsl"
+
+#define RAY_QUERY_GROUP_SIZE 8
+
+#if (NRI_SHADER_MODEL >= 65)
+
+NRI_FORMAT("rgba8") NRI_RESOURCE(RWTexture2D<float4>, outputImage, u, 0, 0);
+NRI_RESOURCE(RaytracingAccelerationStructure, topLevelAS, t, 1, 0);
+
+[numthreads(RAY_QUERY_GROUP_SIZE, RAY_QUERY_GROUP_SIZE, 1)]
+void main(uint2 pixelPos : SV_DispatchThreadId)
+{
+    uint2 outputSize;
+    outputImage.GetDimensions(outputSize.x, outputSize.y);
+
+    if (any(pixelPos >= outputSize))
+        return;
+
+    const float2 pixelCenter = float2(pixelPos) + float2(0.5, 0.5);
+    const float2 inUV = pixelCenter / float2(outputSize);
+
+    float2 d = inUV * 2.0 - 1.0;
+    float aspectRatio = float(outputSize.x) / float(outputSize.y);
+
+    RayDesc rayDesc;
+    rayDesc.Origin = float3(0, 0, -2.0);
+    rayDesc.Direction = normalize(float3(d.x * aspectRatio, -d.y, 1));
+    rayDesc.TMin = 0.001;
+    rayDesc.TMax = 100.0;
+
+    // Opaque geometry only, i.e. "Proceed" finds the closest hit in one call
+    RayQuery<RAY_FLAG_FORCE_OPAQUE> rayQuery;
+    rayQuery.TraceRayInline(topLevelAS, RAY_FLAG_NONE, 0xff, rayDesc);
+    rayQuery.Proceed();
+
+    float3 hitValue = float3(0.4, 0.3, 0.35);
+    if (rayQuery.CommittedStatus() == COMMITTED_TRIANGLE_HIT)
+    {
+        float2 barycentrics = rayQuery.CommittedTriangleBarycentrics();
+        hitValue = float3(1.0 - barycentrics.x - barycentrics.y, barycentrics.x, barycentrics.y);
+    }
+
+    outputImage[pixelPos] = float4(hitValue, 0);
+}
+
+#else
+
+[numthreads(RAY_QUERY_GROUP_SIZE, RAY_QUERY_GROUP_SIZE, 1)]
+void main()
+{
+}
+
+#endif
@@ -2,21 +2,71 @@
 
 #include "NRIFramework.h"
 
-#include <array>
+#include "Common/PipelineCache.h"
+#include "Common/RenderGraph.h"
+#include "Common/ShaderArchive.h"
+#include "Common/StartupProfiler.h"
+#include "Common/WorkSplitController.h"
 
 constexpr uint32_t VERTEX_NUM = 100000 * 3;
-
-struct QueuedFrame {
-    nri::CommandAllocator* commandAllocatorGraphics;
-    nri::CommandAllocator* commandAllocatorCompute;
-    std::array<nri::CommandBuffer*, 3> commandBufferGraphics;
-    nri::CommandBuffer* commandBufferCompute;
-};
+constexpr uint32_t CALIBRATION_ITERATION_NUM = 8;   // graphics-compute-graphics round trips, the tightest one wins
+constexpr uint32_t BENCHMARK_WARMUP_FRAME_NUM = 32; // frames skipped after switching the mode
+constexpr uint32_t BENCHMARK_FRAME_NUM = 256;       // measured frames per mode
+constexpr float TIMELINE_WIDTH = 400.0f;
+constexpr float TIMELINE_ROW_HEIGHT = 18.0f;
+constexpr float TIMELINE_LABEL_WIDTH = 70.0f;
 
 struct Vertex {
     float position[3];
 };
 
+// Passes with "begin" and "end" timestamps
+enum TimedPassSlot : uint32_t {
+    COMPUTE_PASS,
+    GRAPHICS_PASS,
+    COMPOSITION_PASS,
+    UI_PASS,
+
+    TIMED_PASS_NUM
+};
+
+enum class BenchmarkPhase : uint8_t {
+    NONE,
+    WARMUP_SYNC,
+    SYNC,
+    WARMUP_ASYNC,
+    ASYNC,
+};
+
+struct TimedPass {
+    const char* name;
+    uint32_t passIndex;
+    RenderGraphQueue queue;
+    bool isCulled;
+};
+
+struct QueuedFrameTiming {
+    std::array<TimedPass, TIMED_PASS_NUM> passes;
+    double cpuFrameTime;
+    float split;
+    BenchmarkPhase benchmarkPhase;
+    bool isRecorded;
+};
+
+struct QueueInterval {
+    const char* name;
+    double begin; // ms, relative to the first timestamp of the frame
+    double end;
+    RenderGraphQueue queue;
+};
+
+struct BenchmarkResult {
+    double gpuFrameTime;
+    double cpuFrameTime;
+    double overlap;
+    uint32_t frameNum;
+};
+
 class Sample : public SampleBase {
 public:
     Sample() {
@@ -29,6 +79,12 @@ public:
     void PrepareFrame(uint32_t frameIndex) override;
     void RenderFrame(uint32_t frameIndex) override;
 
+private:
+    void CalibrateTimestamps();
+    void ResolveTimings(uint32_t queuedFrameIndex);
+    void DrawTimeline();
+    uint32_t AddTimedPass(uint32_t queuedFrameIndex, TimedPassSlot slot, const char* name, RenderGraphPassAffinity affinity, RenderGraphPassCallback callback);
+
 private:
     NRIInterface NRI = {};
     nri::Device* m_Device = nullptr;
@@ -37,7 +93,6 @@ private:
     nri::Queue* m_GraphicsQueue = nullptr;
     nri::Queue* m_ComputeQueue = nullptr;
     nri::Fence* m_FrameFence = nullptr;
-    nri::Fence* m_ComputeFence = nullptr;
     nri::DescriptorPool* m_DescriptorPool = nullptr;
     nri::PipelineLayout* m_SharedPipelineLayout = nullptr;
     nri::Pipeline* m_GraphicsPipeline = nullptr;
@@ -46,10 +101,31 @@ private:
     nri::Texture* m_Texture = nullptr;
     nri::DescriptorSet* m_DescriptorSet = nullptr;
     nri::Descriptor* m_Descriptor = nullptr;
-    std::vector<QueuedFrame> m_QueuedFrames = {};
+    nri::QueryPool* m_QueryPool = nullptr;
+    nri::Buffer* m_ReadbackBuffer = nullptr;
+    nri::Memory* m_ReadbackMemory = nullptr;
+
+    PersistentPipelineCache m_PipelineCache;
+    RenderGraph m_RenderGraph;
+    WorkSplitController m_SplitController;
+
     std::vector<SwapChainTexture> m_SwapChainTextures;
     std::vector<nri::Memory*> m_MemoryAllocations;
+    std::vector<QueuedFrameTiming> m_QueuedFrameTimings;
+    std::vector<QueueInterval> m_Timeline; // the last resolved frame
+    std::array<BenchmarkResult, 2> m_BenchmarkResults = {}; // SYNC, ASYNC
+    uint64_t m_QuerySize = 0;
+    int64_t m_ComputeTimestampOffset = 0; // compute ticks - graphics ticks
+    double m_TimestampPeriod = 0.0;       // ms per tick
+    double m_CalibrationError = 0.0;      // ms
+    double m_TimelineSpan = 0.0;          // ms
+    double m_GpuFrameTime = 0.0;          // ms, smoothed
+    double m_Overlap = 0.0;               // fraction of the compute busy time overlapped with graphics, smoothed
+    double m_PrevFrameTimeStamp = 0.0;
+    BenchmarkPhase m_BenchmarkPhase = BenchmarkPhase::NONE;
+    uint32_t m_BenchmarkFrame = 0;
     bool m_IsAsyncMode = false;
+    bool m_IsAdaptiveSplit = true;
     bool m_HasComputeQueue = false;
 };
 
@@ -57,14 +133,11 @@ Sample::~Sample() {
     if (NRI.HasCore()) {
         NRI.DeviceWaitIdle(m_Device);
 
-        for (QueuedFrame& queuedFrame : m_QueuedFrames) {
-            for (size_t i = 0; i < queuedFrame.commandBufferGraphics.size(); i++)
-                NRI.DestroyCommandBuffer(queuedFrame.commandBufferGraphics[i]);
+        m_RenderGraph.Destroy();
 
-            NRI.DestroyCommandBuffer(queuedFrame.commandBufferCompute);
-            NRI.DestroyCommandAllocator(queuedFrame.commandAllocatorCompute);
-            NRI.DestroyCommandAllocator(queuedFrame.commandAllocatorGraphics);
-        }
+        NRI.DestroyQueryPool(m_QueryPool);
+        NRI.DestroyBuffer(m_ReadbackBuffer);
+        NRI.FreeMemory(m_ReadbackMemory);
 
         for (SwapChainTexture& swapChainTexture : m_SwapChainTextures) {
             NRI.DestroyFence(swapChainTexture.acquireSemaphore);
@@ -77,9 +150,12 @@ Sample::~Sample() {
         NRI.DestroyBuffer(m_GeometryBuffer);
         NRI.DestroyPipeline(m_GraphicsPipeline);
         NRI.DestroyPipeline(m_ComputePipeline);
+
+        m_PipelineCache.Save(NRI);
+        m_PipelineCache.Destroy(NRI);
+
         NRI.DestroyPipelineLayout(m_SharedPipelineLayout);
         NRI.DestroyDescriptorPool(m_DescriptorPool);
-        NRI.DestroyFence(m_ComputeFence);
         NRI.DestroyFence(m_FrameFence);
 
         for (size_t i = 0; i < m_MemoryAllocations.size(); i++)
@@ -98,6 +174,8 @@ Sample::~Sample() {
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -121,13 +199,20 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.vkBindingOffsets = VK_BINDING_OFFSETS;
     deviceCreationDesc.adapterDesc = &adapterDesc[std::min(m_AdapterIndex, adapterDescsNum - 1)];
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
+
+    m_PipelineCache.Preload(graphicsAPI, *deviceCreationDesc.adapterDesc);
+
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    StartupProfilerEnd();
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
 
@@ -151,12 +236,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     m_IsAsyncMode = m_HasComputeQueue;
 
     // Fences
-    NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_ComputeFence));
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
     // Swap chain
     nri::Format swapChainFormat;
     {
+        StartupPhase phase("Swap chain");
+
         nri::SwapChainDesc swapChainDesc = {};
         swapChainDesc.window = GetWindow();
         swapChainDesc.queue = m_GraphicsQueue;
@@ -196,19 +282,45 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         }
     }
 
-    // Queued frames
-    m_QueuedFrames.resize(GetQueuedFrameNum());
-    for (QueuedFrame& queuedFrame : m_QueuedFrames) {
-        NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, queuedFrame.commandAllocatorGraphics));
-        for (size_t i = 0; i < queuedFrame.commandBufferGraphics.size(); i++)
-            NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocatorGraphics, queuedFrame.commandBufferGraphics[i]));
+    // Render graph (owns command buffers of queued frames)
+    m_RenderGraph.Initialize(NRI, *m_Device, *m_GraphicsQueue, m_HasComputeQueue ? m_ComputeQueue : nullptr, GetQueuedFrameNum());
 
-        if (m_HasComputeQueue) {
-            NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_ComputeQueue, queuedFrame.commandAllocatorCompute));
-            NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocatorCompute, queuedFrame.commandBufferCompute));
-        }
+    { // Timestamps ("begin" and "end" per timed pass per queued frame)
+        const uint32_t queryNum = GetQueuedFrameNum() * TIMED_PASS_NUM * 2;
+
+        nri::QueryPoolDesc queryPoolDesc = {};
+        queryPoolDesc.queryType = nri::QueryType::TIMESTAMP;
+        queryPoolDesc.capacity = queryNum;
+        NRI_ABORT_ON_FAILURE(NRI.CreateQueryPool(*m_Device, queryPoolDesc, m_QueryPool));
+
+        m_QuerySize = NRI.GetQuerySize(*m_QueryPool);
+
+        const nri::BufferDesc bufferDesc = {queryNum * m_QuerySize, 0, nri::BufferUsageBits::NONE};
+        NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_ReadbackBuffer));
+
+        nri::MemoryDesc memoryDesc = {};
+        NRI.GetBufferMemoryDesc(*m_ReadbackBuffer, nri::MemoryLocation::HOST_READBACK, memoryDesc);
+
+        nri::AllocateMemoryDesc allocateMemoryDesc = {};
+        allocateMemoryDesc.size = memoryDesc.size;
+        allocateMemoryDesc.type = memoryDesc.type;
+        NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, m_ReadbackMemory));
+
+        const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {m_ReadbackBuffer, m_ReadbackMemory};
+        NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(&bufferMemoryBindingDesc, 1));
+
+        m_TimestampPeriod = 1000.0 / double(deviceDesc.other.timestampFrequencyHz);
+        m_QueuedFrameTimings.resize(GetQueuedFrameNum(), {});
+
+        if (m_HasComputeQueue)
+            CalibrateTimestamps();
     }
 
+    m_SplitController.Initialize({});
+
+    StartupProfilerBegin("Pipelines");
+    m_PipelineCache.Create(NRI, *m_Device);
+
     { // Pipeline layout
         nri::DescriptorRangeDesc descriptorRangeStorage = {0, 1, nri::DescriptorType::STORAGE_TEXTURE, nri::StageBits::COMPUTE_SHADER};
 
@@ -258,12 +370,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         outputMergerDesc.colorNum = 1;
 
         nri::ShaderDesc shaderStages[] = {
-            utils::LoadShader(deviceDesc.graphicsAPI, "Triangles.vs", shaderCodeStorage),
-            utils::LoadShader(deviceDesc.graphicsAPI, "Triangles.fs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "Triangles.vs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "Triangles.fs", shaderCodeStorage),
         };
 
         nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
         graphicsPipelineDesc.pipelineLayout = m_SharedPipelineLayout;
+        graphicsPipelineDesc.cache = m_PipelineCache.Get();
         graphicsPipelineDesc.vertexInput = &vertexInputDesc;
         graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
         graphicsPipelineDesc.rasterization = rasterizationDesc;
@@ -276,18 +389,21 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     { // Compute pipeline
         nri::ComputePipelineDesc computePipelineDesc = {};
         computePipelineDesc.pipelineLayout = m_SharedPipelineLayout;
-        computePipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "Surface.cs", shaderCodeStorage);
+        computePipelineDesc.shader = LoadPackedShader(deviceDesc.graphicsAPI, "Surface.cs", shaderCodeStorage);
         NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, computePipelineDesc, m_ComputePipeline));
     }
 
+    StartupProfilerEnd();
+
     // Storage texture
+    StartupProfilerBegin("Resources");
     constexpr nri::Format storageTextureFormat = nri::Format::RGBA8_UNORM; // TODO: dictated by the shader and "SwapChainFormat"
     {
         nri::TextureDesc textureDesc = {};
         textureDesc.type = nri::TextureType::TEXTURE_2D;
         textureDesc.usage = nri::TextureUsageBits::SHADER_RESOURCE_STORAGE;
         textureDesc.format = storageTextureFormat;
-        textureDesc.width = (uint16_t)GetOutputResolution().x / 2;
+        textureDesc.width = (uint16_t)GetOutputResolution().x; // the split is adaptive
         textureDesc.height = (uint16_t)GetOutputResolution().y;
         textureDesc.mipNum = 1;
 
@@ -310,6 +426,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
     m_MemoryAllocations.resize(NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
     NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data()))
+    StartupProfilerEnd();
 
     { // Descriptor pool
         nri::DescriptorPoolDesc descriptorPoolDesc = {};
@@ -335,6 +452,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     Rng::Hash::Initialize(m_RngState, 567, 57);
 
     { // Upload data
+        StartupPhase phase("Upload");
+
         std::vector<Vertex> geometryBufferData(VERTEX_NUM);
         for (uint32_t i = 0; i < VERTEX_NUM; i += 3) {
             Vertex& v0 = geometryBufferData[i];
@@ -366,22 +485,278 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.UploadData(*m_GraphicsQueue, &textureData, 1, &bufferData, 1));
     }
 
-    return InitImgui(*m_Device);
+    StartupProfilerBegin("UI");
+    bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
+
+    return initialized;
+}
+
+void Sample::CalibrateTimestamps() {
+    // Graphics and compute timestamps are not guaranteed to share a counter. A "graphics - compute - graphics" round trip
+    // through a fence brackets the compute timestamp, the middle of the tightest bracket estimates the offset
+    nri::CommandAllocator* graphicsCommandAllocator = nullptr;
+    nri::CommandAllocator* computeCommandAllocator = nullptr;
+    NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, graphicsCommandAllocator));
+    NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_ComputeQueue, computeCommandAllocator));
+
+    nri::CommandBuffer* commandBuffers[3] = {}; // graphics, compute, graphics
+    NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*graphicsCommandAllocator, commandBuffers[0]));
+    NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*computeCommandAllocator, commandBuffers[1]));
+    NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*graphicsCommandAllocator, commandBuffers[2]));
+
+    nri::Fence* fence = nullptr;
+    NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, fence));
+
+    uint64_t fenceValue = 0;
+    uint64_t bestWindow = uint64_t(-1);
+    int64_t offset = 0;
+
+    for (uint32_t i = 0; i < CALIBRATION_ITERATION_NUM; i++) {
+        NRI.ResetCommandAllocator(*graphicsCommandAllocator);
+        NRI.ResetCommandAllocator(*computeCommandAllocator);
+
+        for (uint32_t j = 0; j < helper::GetCountOf(commandBuffers); j++) {
+            nri::CommandBuffer& commandBuffer = *commandBuffers[j];
+            NRI.BeginCommandBuffer(commandBuffer, nullptr);
+            {
+                if (j == 0)
+                    NRI.CmdResetQueries(commandBuffer, *m_QueryPool, 0, 3);
+
+                NRI.CmdEndQuery(commandBuffer, *m_QueryPool, j);
+
+                if (j == 2)
+                    NRI.CmdCopyQueries(commandBuffer, *m_QueryPool, 0, 3, *m_ReadbackBuffer, 0);
+            }
+            NRI.EndCommandBuffer(commandBuffer);
+
+            nri::FenceSubmitDesc waitFence = {};
+            waitFence.fence = fence;
+            waitFence.value = fenceValue;
+            waitFence.stages = nri::StageBits::ALL;
+
+            nri::FenceSubmitDesc signalFence = {};
+            signalFence.fence = fence;
+            signalFence.value = ++fenceValue;
+
+            nri::QueueSubmitDesc queueSubmitDesc = {};
+            queueSubmitDesc.waitFences = &waitFence;
+            queueSubmitDesc.waitFenceNum = 1;
+            queueSubmitDesc.commandBuffers = &commandBuffers[j];
+            queueSubmitDesc.commandBufferNum = 1;
+            queueSubmitDesc.signalFences = &signalFence;
+            queueSubmitDesc.signalFenceNum = 1;
+
+            NRI.QueueSubmit(j == 1 ? *m_ComputeQueue : *m_GraphicsQueue, queueSubmitDesc);
+        }
+
+        NRI.Wait(*fence, fenceValue);
+
+        const uint8_t* data = (uint8_t*)NRI.MapBuffer(*m_ReadbackBuffer, 0, 3 * m_QuerySize);
+        if (data) {
+            uint64_t graphicsBegin = *(const uint64_t*)data;
+            uint64_t compute = *(const uint64_t*)(data + m_QuerySize);
+            uint64_t graphicsEnd = *(const uint64_t*)(data + 2 * m_QuerySize);
+
+            if (graphicsEnd >= graphicsBegin && graphicsEnd - graphicsBegin < bestWindow) {
+                bestWindow = graphicsEnd - graphicsBegin;
+                offset = int64_t(compute) - int64_t(graphicsBegin + bestWindow / 2);
+            }
+
+            NRI.UnmapBuffer(*m_ReadbackBuffer);
+        }
+    }
+
+    // An offset within the bracket is indistinguishable from a shared counter (the common case)
+    if (bestWindow != uint64_t(-1)) {
+        m_ComputeTimestampOffset = uint64_t(std::abs(offset)) <= bestWindow / 2 ? 0 : offset;
+        m_CalibrationError = double(bestWindow / 2) * m_TimestampPeriod;
+    }
+
+    NRI.DestroyFence(fence);
+    for (nri::CommandBuffer* commandBuffer : commandBuffers)
+        NRI.DestroyCommandBuffer(commandBuffer);
+    NRI.DestroyCommandAllocator(graphicsCommandAllocator);
+    NRI.DestroyCommandAllocator(computeCommandAllocator);
+}
+
+void Sample::ResolveTimings(uint32_t queuedFrameIndex) {
+    QueuedFrameTiming& timing = m_QueuedFrameTimings[queuedFrameIndex];
+    if (!timing.isRecorded)
+        return;
+
+    // Read back timestamps, compute ones are moved to the graphics timebase
+    std::array<int64_t, TIMED_PASS_NUM * 2> ticks = {};
+    {
+        uint64_t queryOffset = queuedFrameIndex * TIMED_PASS_NUM * 2;
+        const uint8_t* data = (uint8_t*)NRI.MapBuffer(*m_ReadbackBuffer, queryOffset * m_QuerySize, TIMED_PASS_NUM * 2 * m_QuerySize);
+        if (!data) {
+            timing = {};
+            return;
+        }
+
+        for (uint32_t i = 0; i < TIMED_PASS_NUM * 2; i++)
+            ticks[i] = *(const int64_t*)(data + i * m_QuerySize);
+
+        NRI.UnmapBuffer(*m_ReadbackBuffer);
+    }
+
+    int64_t frameBegin = INT64_MAX;
+    int64_t frameEnd = INT64_MIN;
+    for (uint32_t i = 0; i < TIMED_PASS_NUM; i++) {
+        TimedPass& timedPass = timing.passes[i];
+        if (!timedPass.name || timedPass.isCulled || ticks[i * 2 + 1] < ticks[i * 2]) {
+            timedPass.isCulled = true;
+            continue;
+        }
+
+        if (timedPass.queue == RenderGraphQueue::COMPUTE) {
+            ticks[i * 2] -= m_ComputeTimestampOffset;
+            ticks[i * 2 + 1] -= m_ComputeTimestampOffset;
+        }
+
+        frameBegin = std::min(frameBegin, ticks[i * 2]);
+        frameEnd = std::max(frameEnd, ticks[i * 2 + 1]);
+    }
+
+    if (frameEnd < frameBegin) {
+        timing = {};
+        return;
+    }
+
+    m_Timeline.clear();
+    for (uint32_t i = 0; i < TIMED_PASS_NUM; i++) {
+        const TimedPass& timedPass = timing.passes[i];
+        if (timedPass.name && !timedPass.isCulled)
+            m_Timeline.push_back({timedPass.name, double(ticks[i * 2] - frameBegin) * m_TimestampPeriod, double(ticks[i * 2 + 1] - frameBegin) * m_TimestampPeriod, timedPass.queue});
+    }
+
+    // Passes on the same queue are serialized, i.e. the overlap is a sum of pairwise "graphics x compute" intersections
+    double busyTime[(size_t)RenderGraphQueue::MAX_NUM] = {};
+    double overlappedTime = 0.0;
+    for (const QueueInterval& a : m_Timeline) {
+        busyTime[(size_t)a.queue] += a.end - a.begin;
+
+        if (a.queue != RenderGraphQueue::GRAPHICS)
+            continue;
+
+        for (const QueueInterval& b : m_Timeline) {
+            if (b.queue == RenderGraphQueue::COMPUTE)
+                overlappedTime += std::max(std::min(a.end, b.end) - std::max(a.begin, b.begin), 0.0);
+        }
+    }
+
+    const double computeBusyTime = busyTime[(size_t)RenderGraphQueue::COMPUTE];
+    const double overlap = computeBusyTime > 0.0 ? overlappedTime / computeBusyTime : 0.0;
+
+    m_TimelineSpan = double(frameEnd - frameBegin) * m_TimestampPeriod;
+    m_GpuFrameTime = m_GpuFrameTime == 0.0 ? m_TimelineSpan : m_GpuFrameTime + (m_TimelineSpan - m_GpuFrameTime) * 0.05;
+    m_Overlap += (overlap - m_Overlap) * 0.05;
+
+    // Balance "Compute" and "Graphics" if they have run in parallel
+    const TimedPass& computePass = timing.passes[COMPUTE_PASS];
+    const TimedPass& graphicsPass = timing.passes[GRAPHICS_PASS];
+    if (m_IsAdaptiveSplit && computePass.queue == RenderGraphQueue::COMPUTE && !computePass.isCulled && !graphicsPass.isCulled) {
+        double computeTime = double(ticks[COMPUTE_PASS * 2 + 1] - ticks[COMPUTE_PASS * 2]) * m_TimestampPeriod;
+        double graphicsTime = double(ticks[GRAPHICS_PASS * 2 + 1] - ticks[GRAPHICS_PASS * 2]) * m_TimestampPeriod;
+
+        m_SplitController.Update(graphicsTime, computeTime, timing.split);
+    }
+
+    // Benchmark
+    if (timing.benchmarkPhase == BenchmarkPhase::SYNC || timing.benchmarkPhase == BenchmarkPhase::ASYNC) {
+        BenchmarkResult& result = m_BenchmarkResults[timing.benchmarkPhase == BenchmarkPhase::ASYNC ? 1 : 0];
+        result.gpuFrameTime += m_TimelineSpan;
+        result.cpuFrameTime += timing.cpuFrameTime;
+        result.overlap += overlap;
+        result.frameNum++;
+
+        if (timing.benchmarkPhase == BenchmarkPhase::ASYNC && result.frameNum == BENCHMARK_FRAME_NUM) {
+            const BenchmarkResult& sync = m_BenchmarkResults[0];
+            const BenchmarkResult& async = m_BenchmarkResults[1];
+
+            printf("AsyncCompute benchmark (%u frames per mode):\n", BENCHMARK_FRAME_NUM);
+            printf("  SYNC:  GPU %.3f ms, CPU %.3f ms, overlap %.1f %%\n", sync.gpuFrameTime / sync.frameNum, sync.cpuFrameTime / sync.frameNum, 100.0 * sync.overlap / sync.frameNum);
+            printf("  ASYNC: GPU %.3f ms, CPU %.3f ms, overlap %.1f %%\n", async.gpuFrameTime / async.frameNum, async.cpuFrameTime / async.frameNum, 100.0 * async.overlap / async.frameNum);
+            printf("  GPU time saved by ASYNC: %.1f %%\n", 100.0 * (1.0 - async.gpuFrameTime / sync.gpuFrameTime));
+        }
+    }
+
+    timing = {};
+}
+
+void Sample::DrawTimeline() {
+    static const char* queueNames[] = {"Graphics", "Compute"};
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    const float x0 = origin.x + TIMELINE_LABEL_WIDTH;
+    const float scale = m_TimelineSpan > 0.0 ? TIMELINE_WIDTH / float(m_TimelineSpan) : 0.0f;
+
+    for (uint32_t i = 0; i < (uint32_t)RenderGraphQueue::MAX_NUM; i++) {
+        const float y = origin.y + i * TIMELINE_ROW_HEIGHT;
+
+        drawList->AddText(ImVec2(origin.x, y), ImGui::GetColorU32(ImGuiCol_Text), queueNames[i]);
+        drawList->AddRectFilled(ImVec2(x0, y + 1.0f), ImVec2(x0 + TIMELINE_WIDTH, y + TIMELINE_ROW_HEIGHT - 1.0f), IM_COL32(40, 40, 40, 255));
+    }
+
+    for (const QueueInterval& interval : m_Timeline) {
+        const float y = origin.y + (uint32_t)interval.queue * TIMELINE_ROW_HEIGHT;
+        const ImVec2 min = ImVec2(x0 + float(interval.begin) * scale, y + 1.0f);
+        const ImVec2 max = ImVec2(std::max(x0 + float(interval.end) * scale, min.x + 1.0f), y + TIMELINE_ROW_HEIGHT - 1.0f);
+        const ImU32 color = interval.queue == RenderGraphQueue::COMPUTE ? IM_COL32(200, 120, 50, 255) : IM_COL32(70, 130, 200, 255);
+
+        drawList->AddRectFilled(min, max, color);
+        drawList->AddRect(min, max, IM_COL32(0, 0, 0, 255));
+
+        if (ImGui::CalcTextSize(interval.name).x + 4.0f < max.x - min.x)
+            drawList->AddText(ImVec2(min.x + 2.0f, min.y), IM_COL32(255, 255, 255, 255), interval.name);
+
+        if (ImGui::IsMouseHoveringRect(min, max))
+            ImGui::SetTooltip("%s: %.3f - %.3f ms (%.3f ms)", interval.name, interval.begin, interval.end, interval.end - interval.begin);
+    }
+
+    ImGui::Dummy(ImVec2(TIMELINE_LABEL_WIDTH + TIMELINE_WIDTH, TIMELINE_ROW_HEIGHT * (float)RenderGraphQueue::MAX_NUM));
+}
+
+uint32_t Sample::AddTimedPass(uint32_t queuedFrameIndex, TimedPassSlot slot, const char* name, RenderGraphPassAffinity affinity, RenderGraphPassCallback callback) {
+    QueuedFrameTiming& timing = m_QueuedFrameTimings[queuedFrameIndex];
+
+    // The pass is bracketed by timestamps on whichever queue the graph picks for it
+    const uint32_t queryOffset = (queuedFrameIndex * TIMED_PASS_NUM + slot) * 2;
+    uint32_t passIndex = m_RenderGraph.AddPass(name, affinity, [this, queryOffset, callback = std::move(callback)](nri::CommandBuffer& commandBuffer) {
+        NRI.CmdResetQueries(commandBuffer, *m_QueryPool, queryOffset, 2);
+        NRI.CmdEndQuery(commandBuffer, *m_QueryPool, queryOffset);
+
+        callback(commandBuffer);
+
+        NRI.CmdEndQuery(commandBuffer, *m_QueryPool, queryOffset + 1);
+        NRI.CmdCopyQueries(commandBuffer, *m_QueryPool, queryOffset, 2, *m_ReadbackBuffer, queryOffset * m_QuerySize);
+    });
+
+    TimedPass& timedPass = timing.passes[slot];
+    timedPass = {name, passIndex, RenderGraphQueue::GRAPHICS, false};
+
+    timing.isRecorded = true;
+
+    return passIndex;
 }
 
 void Sample::LatencySleep(uint32_t frameIndex) {
     uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
-    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
 
     NRI.Wait(*m_FrameFence, frameIndex >= GetQueuedFrameNum() ? 1 + frameIndex - GetQueuedFrameNum() : 0);
-    NRI.ResetCommandAllocator(*queuedFrame.commandAllocatorGraphics);
 
-    if (m_IsAsyncMode)
-        NRI.ResetCommandAllocator(*queuedFrame.commandAllocatorCompute);
+    ResolveTimings(queuedFrameIndex);
+    m_RenderGraph.BeginFrame(queuedFrameIndex);
 }
 
 void Sample::PrepareFrame(uint32_t) {
-    if(IsHalfTimeLimitReached() && m_HasComputeQueue)
+    if (m_BenchmarkPhase != BenchmarkPhase::NONE)
+        m_IsAsyncMode = m_BenchmarkPhase >= BenchmarkPhase::WARMUP_ASYNC;
+    else if (IsHalfTimeLimitReached() && m_HasComputeQueue)
         m_IsAsyncMode = !m_IsAsyncMode;
 
     ImGui::NewFrame();
@@ -391,9 +766,54 @@ void Sample::PrepareFrame(uint32_t) {
         ImGui::Begin("Settings", nullptr, ImGuiWindowFlags_NoResize);
         {
             ImGui::Text("Left - graphics, Right - compute");
-            ImGui::BeginDisabled(!m_HasComputeQueue);
+            ImGui::BeginDisabled(!m_HasComputeQueue || m_BenchmarkPhase != BenchmarkPhase::NONE);
             ImGui::Checkbox("Use ASYNC compute", &m_IsAsyncMode);
             ImGui::EndDisabled();
+
+            ImGui::BeginDisabled(!m_HasComputeQueue);
+            if (ImGui::Checkbox("Adaptive split", &m_IsAdaptiveSplit) && !m_IsAdaptiveSplit)
+                m_SplitController.Reset();
+            ImGui::EndDisabled();
+            ImGui::SameLine();
+            ImGui::Text("%.1f %% compute (imbalance %+.1f %%)", m_SplitController.GetSplit() * 100.0f, m_SplitController.GetImbalance() * 100.0);
+
+            const RenderGraphStats& stats = m_RenderGraph.GetStats();
+            ImGui::Separator();
+            ImGui::Text("Render graph:");
+            ImGui::Text("  Passes: %u (culled %u, async %u)", stats.passNum, stats.culledPassNum, stats.asyncPassNum);
+            ImGui::Text("  Submissions: %u", stats.batchNum);
+            ImGui::Text("  Barriers: %u", stats.barrierNum);
+            ImGui::Text("  Cross-queue waits: %u", stats.crossQueueWaitNum);
+
+            ImGui::Separator();
+            ImGui::Text("Queues:");
+            ImGui::Text("  GPU frame: %.3f ms", m_GpuFrameTime);
+            ImGui::Text("  Overlap: %.1f %% of compute", m_Overlap * 100.0);
+            if (m_HasComputeQueue)
+                ImGui::Text("  Compute timestamp offset: %lld ticks (+/- %.3f ms)", (long long)m_ComputeTimestampOffset, m_CalibrationError);
+            DrawTimeline();
+
+            ImGui::Separator();
+            ImGui::BeginDisabled(!m_HasComputeQueue || m_BenchmarkPhase != BenchmarkPhase::NONE);
+            if (ImGui::Button("Run benchmark")) {
+                m_BenchmarkPhase = BenchmarkPhase::WARMUP_SYNC;
+                m_BenchmarkFrame = 0;
+                m_BenchmarkResults = {};
+                m_IsAsyncMode = false;
+            }
+            ImGui::EndDisabled();
+
+            if (m_BenchmarkPhase != BenchmarkPhase::NONE) {
+                ImGui::SameLine();
+                ImGui::Text("%s (%u)", m_IsAsyncMode ? "ASYNC" : "SYNC", m_BenchmarkFrame);
+            }
+
+            static const char* modeNames[] = {"SYNC", "ASYNC"};
+            for (size_t i = 0; i < m_BenchmarkResults.size(); i++) {
+                const BenchmarkResult& result = m_BenchmarkResults[i];
+                if (result.frameNum == BENCHMARK_FRAME_NUM)
+                    ImGui::Text("  %-5s GPU %.3f ms, CPU %.3f ms, overlap %.1f %%", modeNames[i], result.gpuFrameTime / result.frameNum, result.cpuFrameTime / result.frameNum, 100.0 * result.overlap / result.frameNum);
+            }
         }
         ImGui::End();
     }
@@ -402,10 +822,9 @@ void Sample::PrepareFrame(uint32_t) {
 }
 
 void Sample::RenderFrame(uint32_t frameIndex) {
+    const uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
     const uint32_t windowWidth = GetOutputResolution().x;
     const uint32_t windowHeight = GetOutputResolution().y;
-    uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
-    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
 
     // Acquire a swap chain texture
     uint32_t recycledSemaphoreIndex = frameIndex % (uint32_t)m_SwapChainTextures.size();
@@ -416,48 +835,33 @@ void Sample::RenderFrame(uint32_t frameIndex) {
 
     const SwapChainTexture& swapChainTexture = m_SwapChainTextures[currentSwapChainTextureIndex];
 
-    // Record command buffer #0 (graphics or compute)
-    nri::TextureBarrierDesc textureBarriers[2] = {};
-
-    textureBarriers[0].texture = swapChainTexture.texture;
-    textureBarriers[0].after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT};
-    textureBarriers[0].layerNum = 1;
-    textureBarriers[0].mipNum = 1;
+    // Resources (states are tracked by the graph across frames)
+    uint32_t backBuffer = m_RenderGraph.ImportTexture("Back buffer", *swapChainTexture.texture, {});
+    m_RenderGraph.SetFinalState(backBuffer, {nri::AccessBits::NONE, nri::Layout::PRESENT, nri::StageBits::NONE});
 
-    textureBarriers[1].texture = m_Texture;
-    textureBarriers[1].layerNum = 1;
-    textureBarriers[1].mipNum = 1;
+    uint32_t surface = m_RenderGraph.ImportTexture("Surface", *m_Texture, {nri::AccessBits::NONE, nri::Layout::SHADER_RESOURCE_STORAGE, nri::StageBits::NONE});
 
-    nri::BarrierDesc barrierDesc = {};
-    barrierDesc.textures = textureBarriers;
-
-    nri::CommandBuffer& commandBuffer0 = m_IsAsyncMode ? *queuedFrame.commandBufferCompute : *queuedFrame.commandBufferGraphics[0];
-    NRI.BeginCommandBuffer(commandBuffer0, m_DescriptorPool);
-    {
-        helper::Annotation annotation(NRI, commandBuffer0, "Compute");
+    // Split: graphics renders the left part, compute - the right one
+    const float split = m_SplitController.GetSplit();
+    const uint32_t computeWidth = std::clamp((uint32_t)(windowWidth * split + 0.5f), 1u, windowWidth - 1);
+    const uint32_t graphicsWidth = windowWidth - computeWidth;
 
-        const uint32_t nx = ((windowWidth / 2) + 15) / 16;
+    // Passes (barriers and fences between them are generated by the graph)
+    uint32_t computePass = AddTimedPass(queuedFrameIndex, COMPUTE_PASS, "Compute", RenderGraphPassAffinity::ASYNC_COMPUTE, [&](nri::CommandBuffer& commandBuffer) {
+        const uint32_t nx = (computeWidth + 15) / 16;
         const uint32_t ny = (windowHeight + 15) / 16;
 
-        NRI.CmdSetPipelineLayout(commandBuffer0, nri::BindPoint::COMPUTE, *m_SharedPipelineLayout);
+        NRI.CmdSetPipelineLayout(commandBuffer, nri::BindPoint::COMPUTE, *m_SharedPipelineLayout);
 
         nri::SetDescriptorSetDesc descriptorSet0 = {0, m_DescriptorSet};
-        NRI.CmdSetDescriptorSet(commandBuffer0, descriptorSet0);
+        NRI.CmdSetDescriptorSet(commandBuffer, descriptorSet0);
 
-        NRI.CmdSetPipeline(commandBuffer0, *m_ComputePipeline);
-        NRI.CmdDispatch(commandBuffer0, {nx, ny, 1});
-    }
-    NRI.EndCommandBuffer(commandBuffer0);
-
-    // Record command buffer #1 (graphics)
-    nri::CommandBuffer& commandBuffer1 = *queuedFrame.commandBufferGraphics[1];
-    NRI.BeginCommandBuffer(commandBuffer1, m_DescriptorPool);
-    {
-        helper::Annotation annotation(NRI, commandBuffer1, "Graphics");
-
-        barrierDesc.textureNum = 1;
-        NRI.CmdBarrier(commandBuffer1, barrierDesc);
+        NRI.CmdSetPipeline(commandBuffer, *m_ComputePipeline);
+        NRI.CmdDispatch(commandBuffer, {nx, ny, 1});
+    });
+    m_RenderGraph.Write(computePass, surface, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE, nri::StageBits::COMPUTE_SHADER});
 
+    uint32_t graphicsPass = AddTimedPass(queuedFrameIndex, GRAPHICS_PASS, "Graphics", RenderGraphPassAffinity::GRAPHICS, [&](nri::CommandBuffer& commandBuffer) {
         nri::AttachmentDesc colorAttachmentDesc = {};
         colorAttachmentDesc.descriptor = swapChainTexture.colorAttachment;
 
@@ -465,80 +869,70 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         renderingDesc.colorNum = 1;
         renderingDesc.colors = &colorAttachmentDesc;
 
-        CmdCopyImguiData(commandBuffer1, *m_Streamer);
-
-        NRI.CmdBeginRendering(commandBuffer1, renderingDesc);
+        NRI.CmdBeginRendering(commandBuffer, renderingDesc);
         {
+            // The viewport covers the whole screen (the picture doesn't stretch), the scissor cuts off the compute part
             const nri::Viewport viewport = {0.0f, 0.0f, (float)windowWidth, (float)windowHeight, 0.0f, 1.0f};
-            NRI.CmdSetViewports(commandBuffer1, &viewport, 1);
+            NRI.CmdSetViewports(commandBuffer, &viewport, 1);
 
-            const nri::Rect scissorRect = {0, 0, (nri::Dim_t)windowWidth, (nri::Dim_t)windowHeight};
-            NRI.CmdSetScissors(commandBuffer1, &scissorRect, 1);
+            const nri::Rect scissorRect = {0, 0, (nri::Dim_t)graphicsWidth, (nri::Dim_t)windowHeight};
+            NRI.CmdSetScissors(commandBuffer, &scissorRect, 1);
 
             nri::ClearAttachmentDesc clearDesc = {};
             clearDesc.colorAttachmentIndex = 0;
             clearDesc.planes = nri::PlaneBits::COLOR;
-            NRI.CmdClearAttachments(commandBuffer1, &clearDesc, 1, nullptr, 0);
+            NRI.CmdClearAttachments(commandBuffer, &clearDesc, 1, nullptr, 0);
 
-            NRI.CmdSetPipelineLayout(commandBuffer1, nri::BindPoint::GRAPHICS, *m_SharedPipelineLayout);
+            NRI.CmdSetPipelineLayout(commandBuffer, nri::BindPoint::GRAPHICS, *m_SharedPipelineLayout);
 
             nri::VertexBufferDesc vertexBufferDesc = {};
             vertexBufferDesc.buffer = m_GeometryBuffer;
             vertexBufferDesc.offset = 0;
             vertexBufferDesc.stride = sizeof(Vertex);
-            NRI.CmdSetVertexBuffers(commandBuffer1, 0, &vertexBufferDesc, 1);
+            NRI.CmdSetVertexBuffers(commandBuffer, 0, &vertexBufferDesc, 1);
 
-            NRI.CmdSetIndexBuffer(commandBuffer1, *m_GeometryBuffer, 0, nri::IndexType::UINT16);
+            NRI.CmdSetIndexBuffer(commandBuffer, *m_GeometryBuffer, 0, nri::IndexType::UINT16);
 
-            NRI.CmdSetPipeline(commandBuffer1, *m_GraphicsPipeline);
-            NRI.CmdDraw(commandBuffer1, {VERTEX_NUM, 1, 0, 0});
-
-            CmdDrawImgui(commandBuffer1, swapChainTexture.attachmentFormat, 1.0f, true);
+            NRI.CmdSetPipeline(commandBuffer, *m_GraphicsPipeline);
+            NRI.CmdDraw(commandBuffer, {VERTEX_NUM, 1, 0, 0});
         }
-        NRI.CmdEndRendering(commandBuffer1);
-    }
-    NRI.EndCommandBuffer(commandBuffer1);
-
-    // Record command buffer #2 (graphics)
-    nri::CommandBuffer& commandBuffer2 = *queuedFrame.commandBufferGraphics[2];
-    NRI.BeginCommandBuffer(commandBuffer2, nullptr);
-    {
-        helper::Annotation annotation(NRI, commandBuffer2, "Composition");
-
-        // Resource transitions
-        textureBarriers[0].before = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT};
-        textureBarriers[0].after = {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION, nri::StageBits::COPY};
-
-        textureBarriers[1].before = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE, nri::StageBits::COMPUTE_SHADER};
-        textureBarriers[1].after = {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE, nri::StageBits::COPY};
-
-        barrierDesc.textureNum = 2;
-        NRI.CmdBarrier(commandBuffer2, barrierDesc);
+        NRI.CmdEndRendering(commandBuffer);
+    });
+    m_RenderGraph.Write(graphicsPass, backBuffer, {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT});
 
+    uint32_t compositionPass = AddTimedPass(queuedFrameIndex, COMPOSITION_PASS, "Composition", RenderGraphPassAffinity::GRAPHICS, [&](nri::CommandBuffer& commandBuffer) {
         // Copy texture produced by compute to back buffer
         nri::TextureRegionDesc dstRegion = {};
-        dstRegion.x = (uint16_t)windowWidth / 2;
+        dstRegion.x = (uint16_t)graphicsWidth;
 
         nri::TextureRegionDesc srcRegion = {};
-        srcRegion.width = (uint16_t)windowWidth / 2;
+        srcRegion.width = (uint16_t)computeWidth;
         srcRegion.height = (uint16_t)windowHeight;
         srcRegion.depth = 1;
 
-        NRI.CmdCopyTexture(commandBuffer2, *swapChainTexture.texture, &dstRegion, *m_Texture, &srcRegion);
+        NRI.CmdCopyTexture(commandBuffer, *swapChainTexture.texture, &dstRegion, *m_Texture, &srcRegion);
+    });
+    m_RenderGraph.Read(compositionPass, surface, {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE, nri::StageBits::COPY});
+    m_RenderGraph.Write(compositionPass, backBuffer, {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION, nri::StageBits::COPY});
 
-        // Resource transitions
-        textureBarriers[0].before = {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION, nri::StageBits::COPY};
-        textureBarriers[0].after = {nri::AccessBits::NONE, nri::Layout::PRESENT, nri::StageBits::NONE};
+    // UI goes last, the split can move under it
+    uint32_t uiPass = AddTimedPass(queuedFrameIndex, UI_PASS, "UI", RenderGraphPassAffinity::GRAPHICS, [&](nri::CommandBuffer& commandBuffer) {
+        nri::AttachmentDesc colorAttachmentDesc = {};
+        colorAttachmentDesc.descriptor = swapChainTexture.colorAttachment;
 
-        textureBarriers[1].before = {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE, nri::StageBits::COPY};
-        textureBarriers[1].after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE, nri::StageBits::COMPUTE_SHADER};
+        nri::RenderingDesc renderingDesc = {};
+        renderingDesc.colorNum = 1;
+        renderingDesc.colors = &colorAttachmentDesc;
 
-        barrierDesc.textureNum = 2;
-        NRI.CmdBarrier(commandBuffer2, barrierDesc);
-    }
-    NRI.EndCommandBuffer(commandBuffer2);
+        CmdCopyImguiData(commandBuffer, *m_Streamer);
 
-    nri::CommandBuffer* commandBufferArray[3] = {&commandBuffer0, &commandBuffer1, &commandBuffer2};
+        NRI.CmdBeginRendering(commandBuffer, renderingDesc);
+        {
+            CmdDrawImgui(commandBuffer, swapChainTexture.attachmentFormat, 1.0f, true);
+        }
+        NRI.CmdEndRendering(commandBuffer);
+    });
+    m_RenderGraph.Write(uiPass, backBuffer, {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT});
 
     { // Submit work
         nri::FenceSubmitDesc swapChainAcquired = {};
@@ -548,59 +942,39 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         nri::FenceSubmitDesc swapChainRelease = {};
         swapChainRelease.fence = swapChainTexture.releaseSemaphore;
 
-        if (m_IsAsyncMode) {
-            nri::FenceSubmitDesc computeFinishedFence = {};
-            computeFinishedFence.fence = m_ComputeFence;
-            computeFinishedFence.value = 1 + frameIndex;
-
-            { // Submit the "Compute" task into the "COMPUTE" queue
-                nri::FenceSubmitDesc waitFence = {};
-                waitFence.fence = m_FrameFence;
-                waitFence.value = frameIndex;
-
-                nri::QueueSubmitDesc computeTask = {};
-                computeTask.waitFences = &waitFence; // wait for the previous frame completion before execution
-                computeTask.waitFenceNum = 1;
-                computeTask.commandBuffers = &commandBufferArray[0];
-                computeTask.commandBufferNum = 1;
-                computeTask.signalFences = &computeFinishedFence;
-                computeTask.signalFenceNum = 1;
-
-                NRI.QueueSubmit(*m_ComputeQueue, computeTask);
-            }
+        m_RenderGraph.AddWait(RenderGraphQueue::GRAPHICS, swapChainAcquired);
+        m_RenderGraph.AddSignal(RenderGraphQueue::GRAPHICS, swapChainRelease);
 
-            { // Submit the "Graphics" task into the "GRAPHICS" queue
-                nri::QueueSubmitDesc graphicsTask = {};
-                graphicsTask.waitFences = &swapChainAcquired; // wait for the swap chain acquisition
-                graphicsTask.waitFenceNum = 1;
-                graphicsTask.commandBuffers = &commandBufferArray[1];
-                graphicsTask.commandBufferNum = 1;
+        // In ASYNC mode "Compute" goes to the "COMPUTE" queue, "Composition" waits for it in a separate submission (i.e.
+        // "Graphics" overlaps with "Compute"), the next "Compute" waits for the previous "Composition" (the texture is reused)
+        m_RenderGraph.SetAsyncCompute(m_IsAsyncMode);
+        m_RenderGraph.Execute(m_DescriptorPool);
+    }
 
-                NRI.QueueSubmit(*m_GraphicsQueue, graphicsTask);
-            }
+    { // Remember where timed passes went (resolved when the frame is reused)
+        double timeStamp = m_Timer.GetTimeStamp();
+
+        QueuedFrameTiming& timing = m_QueuedFrameTimings[queuedFrameIndex];
+        for (TimedPass& timedPass : timing.passes) {
+            if (!timedPass.name)
+                continue;
+
+            timedPass.queue = m_RenderGraph.GetPassQueue(timedPass.passIndex);
+            timedPass.isCulled = m_RenderGraph.IsPassCulled(timedPass.passIndex);
+        }
+
+        timing.split = split;
+        timing.cpuFrameTime = m_PrevFrameTimeStamp != 0.0 ? timeStamp - m_PrevFrameTimeStamp : 0.0;
+        timing.benchmarkPhase = m_BenchmarkPhase;
 
-            { // Submit the "Composition" task into the "GRAPHICS" queue
-                nri::QueueSubmitDesc compositionTask = {};
-                compositionTask.waitFences = &computeFinishedFence; // wait for the "Compute" task completion before execution ("Graphics" has been just submitted into the same queue, thus "in order" execution)
-                compositionTask.waitFenceNum = 1;
-                compositionTask.commandBuffers = &commandBufferArray[2];
-                compositionTask.commandBufferNum = 1;
-                compositionTask.signalFences = &swapChainRelease;
-                compositionTask.signalFenceNum = 1;
+        m_PrevFrameTimeStamp = timeStamp;
 
-                NRI.QueueSubmit(*m_GraphicsQueue, compositionTask);
+        if (m_BenchmarkPhase != BenchmarkPhase::NONE) {
+            bool isWarmup = m_BenchmarkPhase == BenchmarkPhase::WARMUP_SYNC || m_BenchmarkPhase == BenchmarkPhase::WARMUP_ASYNC;
+            if (++m_BenchmarkFrame == (isWarmup ? BENCHMARK_WARMUP_FRAME_NUM : BENCHMARK_FRAME_NUM)) {
+                m_BenchmarkPhase = m_BenchmarkPhase == BenchmarkPhase::ASYNC ? BenchmarkPhase::NONE : BenchmarkPhase((uint8_t)m_BenchmarkPhase + 1);
+                m_BenchmarkFrame = 0;
             }
-        } else {
-            // Submit all tasks to the GRAPHICS queue
-            nri::QueueSubmitDesc allTasks = {};
-            allTasks.waitFences = &swapChainAcquired;
-            allTasks.waitFenceNum = 1;
-            allTasks.commandBuffers = commandBufferArray;
-            allTasks.commandBufferNum = helper::GetCountOf(commandBufferArray);
-            allTasks.signalFences = &swapChainRelease;
-            allTasks.signalFenceNum = 1;
-
-            NRI.QueueSubmit(*m_GraphicsQueue, allTasks);
         }
     }
 
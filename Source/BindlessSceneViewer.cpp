@@ -7,6 +7,10 @@
 #include "NRI.hlsl"
 #include "NRIFramework.h"
 
+#include "Common/PipelineCache.h"
+#include "Common/ShaderArchive.h"
+#include "Common/StartupProfiler.h"
+
 #include "../Shaders/SceneViewerBindlessStructs.h"
 
 #include <array>
@@ -79,6 +83,8 @@ private:
     nri::Pipeline* m_Pipeline = nullptr;
     nri::Pipeline* m_ComputePipeline = nullptr;
 
+    PersistentPipelineCache m_PipelineCache;
+
     std::vector<QueuedFrame> m_QueuedFrames = {};
     std::vector<SwapChainTexture> m_SwapChainTextures;
     std::vector<nri::DescriptorSet*> m_DescriptorSets;
@@ -123,6 +129,10 @@ void Sample::Destroy() {
         NRI.DestroyPipeline(m_Pipeline);
         NRI.DestroyPipeline(m_ComputePipeline);
         NRI.DestroyQueryPool(m_QueryPool);
+
+        m_PipelineCache.Save(NRI);
+        m_PipelineCache.Destroy(NRI);
+
         NRI.DestroyPipelineLayout(m_GraphicsPipelineLayout);
         NRI.DestroyPipelineLayout(m_ComputePipelineLayout);
         NRI.DestroyDescriptorPool(m_DescriptorPool);
@@ -148,6 +158,8 @@ void Sample::Destroy() {
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool isFirstTime) {
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -163,13 +175,20 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool isFirstTime) {
     deviceCreationDesc.vkBindingOffsets = VK_BINDING_OFFSETS;
     deviceCreationDesc.adapterDesc = &adapterDesc[std::min(m_AdapterIndex, adapterDescsNum - 1)];
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
+
+    m_PipelineCache.Preload(graphicsAPI, *deviceCreationDesc.adapterDesc);
+
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    StartupProfilerEnd();
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
     if (!deviceDesc.tiers.bindless) {
@@ -199,6 +218,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool isFirstTime) {
     m_DepthFormat = nri::GetSupportedDepthFormat(NRI, *m_Device, 24, false);
 
     { // Swap chain
+        StartupPhase phase("Swap chain");
+
         nri::SwapChainDesc swapChainDesc = {};
         swapChainDesc.window = GetWindow();
         swapChainDesc.queue = m_GraphicsQueue;
@@ -224,6 +245,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool isFirstTime) {
     }
 
     // Pipeline
+    StartupProfilerBegin("Pipelines");
+    m_PipelineCache.Create(NRI, *m_Device);
+
     utils::ShaderCodeStorage shaderCodeStorage;
     {
         {
@@ -334,12 +358,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool isFirstTime) {
         outputMergerDesc.depth.compareOp = CLEAR_DEPTH == 1.0f ? nri::CompareOp::LESS : nri::CompareOp::GREATER;
 
         nri::ShaderDesc shaderStages[] = {
-            utils::LoadShader(deviceDesc.graphicsAPI, "ForwardBindless.vs", shaderCodeStorage),
-            utils::LoadShader(deviceDesc.graphicsAPI, "ForwardBindless.fs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "ForwardBindless.vs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "ForwardBindless.fs", shaderCodeStorage),
         };
 
         nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
         graphicsPipelineDesc.pipelineLayout = m_GraphicsPipelineLayout;
+        graphicsPipelineDesc.cache = m_PipelineCache.Get();
         graphicsPipelineDesc.vertexInput = &vertexInputDesc;
         graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
         graphicsPipelineDesc.rasterization = rasterizationDesc;
@@ -353,11 +378,15 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool isFirstTime) {
     {
         nri::ComputePipelineDesc computePipelineDesc = {};
         computePipelineDesc.pipelineLayout = m_ComputePipelineLayout;
-        computePipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "GenerateSceneDrawCalls.cs", shaderCodeStorage);
+        computePipelineDesc.shader = LoadPackedShader(deviceDesc.graphicsAPI, "GenerateSceneDrawCalls.cs", shaderCodeStorage);
         NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, computePipelineDesc, m_ComputePipeline));
     }
 
+    StartupProfilerEnd();
+
     if (isFirstTime) {
+        StartupPhase phase("Scene");
+
         // Scene
         std::string sceneFile = utils::GetFullPath(m_SceneFile, utils::DataFolder::SCENES);
         NRI_ABORT_ON_FALSE(utils::LoadScene(sceneFile, m_Scene, false));
@@ -370,6 +399,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool isFirstTime) {
     const uint32_t materialNum = (uint32_t)m_Scene.materials.size();
 
     // Textures
+    StartupProfilerBegin("Resources");
     for (const utils::Texture* textureData : m_Scene.textures) {
         nri::TextureDesc textureDesc = {};
         textureDesc.type = nri::TextureType::TEXTURE_2D;
@@ -494,6 +524,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool isFirstTime) {
         NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
     }
 
+    StartupProfilerEnd();
+
     // Create descriptors
     nri::Descriptor* anisotropicSampler = nullptr;
     nri::Descriptor* constantBufferViews[8] = {};
@@ -648,6 +680,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool isFirstTime) {
     }
 
     { // Upload data
+        StartupPhase phase("Upload");
+
         std::vector<nri::TextureUploadDesc> textureData(1 + textureNum);
         std::vector<MaterialData> materialData(m_Scene.materials.size());
         std::vector<InstanceData> instanceData(m_Scene.instances.size());
@@ -768,7 +802,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool isFirstTime) {
 
     m_UseGPUDrawGeneration = deviceDesc.features.drawIndirectCount != 0;
 
-    return InitImgui(*m_Device);
+    StartupProfilerBegin("UI");
+    bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
+
+    return initialized;
 }
 
 void Sample::LatencySleep(uint32_t frameIndex) {
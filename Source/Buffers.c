@@ -11,6 +11,8 @@
 #include "Extensions/NRIDeviceCreation.h"
 #include "Extensions/NRIHelper.h"
 
+#include "Common/StartupProfiler.h"
+
 #if NRI_ENABLE_AGILITY_SDK_SUPPORT
 #    include "NRIAgilitySDK.h"
 #endif
@@ -39,6 +41,8 @@ int main(int argc, char** argv) {
             graphicsAPI = NriGraphicsAPI_VK;
         else if (!strcmp(argv[i], "--api=WGPU"))
             graphicsAPI = NriGraphicsAPI_WGPU;
+        else if (!strcmp(argv[i], "--api=NONE"))
+            graphicsAPI = NriGraphicsAPI_NONE;
         else if (!strcmp(argv[i], "--debugAPI"))
             debugAPI = true;
         else if (!strcmp(argv[i], "--debugNRI"))
@@ -48,6 +52,7 @@ int main(int argc, char** argv) {
     }
 
     // Create device
+    StartupProfilerBegin("Device");
     NriDevice* device = NULL;
     {
         NriAdapterDesc adapterDescs[2] = {0};
@@ -63,8 +68,10 @@ int main(int argc, char** argv) {
             },
             &device));
     }
+    StartupProfilerEnd();
 
     // Query interfaces
+    StartupProfilerBegin("Interfaces");
     NriCoreInterface iCore = {0};
     NriHelperInterface iHelper = {0};
     {
@@ -75,8 +82,10 @@ int main(int argc, char** argv) {
         if (deviceDesc->graphicsAPI == NriGraphicsAPI_D3D11 || !deviceDesc->features.enhancedBarriers)
             useSelfCopies = false; // Vulkan or D3D12 with AgilitySDK required
     }
+    StartupProfilerEnd();
 
     // Create buffers
+    StartupProfilerBegin("Resources");
     NriBuffer* bufferZero = NULL;
     NriBuffer* bufferOne = NULL;
     NriBuffer* bufferReadback = NULL;
@@ -106,7 +115,10 @@ int main(int argc, char** argv) {
             &bufferReadback));
     }
 
+    StartupProfilerEnd();
+
     // Fill buffers
+    StartupProfilerBegin("Upload");
     NriQueue* queue = NULL;
     {
         NRI_ABORT_ON_FAILURE(iCore.GetQueue(device, NriQueueType_GRAPHICS, 0, &queue));
@@ -142,6 +154,10 @@ int main(int argc, char** argv) {
         free(garbageData);
     }
 
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nriGetGraphicsAPIString(graphicsAPI));
+
     // Main
     NriCommandAllocator* commandAllocator = NULL;
     NriCommandBuffer* commandBuffer = NULL;
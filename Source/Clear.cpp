@@ -2,6 +2,8 @@
 
 #include "NRIFramework.h"
 
+#include "Common/StartupProfiler.h"
+
 #include <array>
 
 struct QueuedFrame {
@@ -56,6 +58,8 @@ Sample::~Sample() {
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -73,10 +77,14 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
+    StartupProfilerEnd();
 
     // Command queue
     NRI_ABORT_ON_FAILURE(NRI.GetQueue(*m_Device, nri::QueueType::GRAPHICS, 0, m_GraphicsQueue));
@@ -85,6 +93,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
     { // Swap chain
+        StartupPhase phase("Swap chain");
+
         nri::SwapChainDesc swapChainDesc = {};
         swapChainDesc.window = GetWindow();
         swapChainDesc.queue = m_GraphicsQueue;
@@ -131,6 +141,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBuffer));
     }
 
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
+
     return true;
 }
 
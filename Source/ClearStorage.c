@@ -9,6 +9,8 @@
 
 #include "Extensions/NRIDeviceCreation.h"
 
+#include "Common/StartupProfiler.h"
+
 #if NRI_ENABLE_AGILITY_SDK_SUPPORT
 #    include "NRIAgilitySDK.h"
 #endif
@@ -35,6 +37,8 @@ int main(int argc, char** argv) {
             graphicsAPI = NriGraphicsAPI_VK;
         else if (!strcmp(argv[i], "--api=WGPU"))
             graphicsAPI = NriGraphicsAPI_WGPU;
+        else if (!strcmp(argv[i], "--api=NONE"))
+            graphicsAPI = NriGraphicsAPI_NONE;
         else if (!strcmp(argv[i], "--debugAPI"))
             debugAPI = true;
         else if (!strcmp(argv[i], "--debugNRI"))
@@ -44,6 +48,7 @@ int main(int argc, char** argv) {
     }
 
     // Create device
+    StartupProfilerBegin("Device");
     NriDevice* device = NULL;
     {
         NriAdapterDesc adapterDescs[2] = {0};
@@ -60,12 +65,16 @@ int main(int argc, char** argv) {
             },
             &device));
     }
+    StartupProfilerEnd();
 
     // Query interfaces
+    StartupProfilerBegin("Interfaces");
     NriCoreInterface iCore = {0};
     NRI_ABORT_ON_FAILURE(nriGetInterface(device, NRI_INTERFACE(NriCoreInterface), &iCore));
+    StartupProfilerEnd();
 
     // Create resources
+    StartupProfilerBegin("Resources");
     NriBuffer* buffer = NULL;
     NriTexture* texture = NULL;
     {
@@ -177,6 +186,10 @@ int main(int argc, char** argv) {
     NriQueue* queue = NULL;
     NRI_ABORT_ON_FAILURE(iCore.GetQueue(device, NriQueueType_GRAPHICS, 0, &queue));
 
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nriGetGraphicsAPIString(graphicsAPI));
+
     // Main
     NriCommandAllocator* commandAllocator = NULL;
     NriCommandBuffer* commandBuffer = NULL;
@@ -0,0 +1,463 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Batched acceleration structure builds:
+//  - "AddBottomLevel" / "AddTopLevel" only record requests (geometry descs are copied, input buffers must stay alive until "Wait")
+//  - "Submit" records all BLAS builds as a single "CmdBuildBottomLevelAccelerationStructures" call, a barrier, then all TLAS builds,
+//    sharing one scratch range, and signals a fence (no queue idle waits, several batches can be in flight)
+//  - "Wait" blocks on the fence, "Submit" and "Wait" release resources of completed batches: buffers passed to "AddTransientBuffer",
+//    scratch ranges, command buffers, query pools and readback buffers (all but transient buffers are recycled, i.e. a batch allocates
+//    only if more batches are in flight than ever before or it needs more queries than any previous one)
+// BLAS builds in a batch run concurrently and get disjoint scratch sub-ranges, the TLAS batch reuses the same scratch memory after the barrier
+// Compaction (BLAS built with "ALLOW_COMPACTION"):
+//  - "AddCompactedSizeQuery" writes the compacted size after the BLAS batch, the result is available after "Wait"
+//  - "AddCompaction" copies into a right-sized acceleration structure (created with "optimizedSize") before the BLAS batch,
+//    the original can be released via "AddTransientAccelerationStructure"
+// Scratch memory comes from a "ScratchArena", i.e. repeated builds don't allocate memory
+// With "SetStats" batches report recording, completion and GPU (timestamps after the BLAS and the TLAS phases) times
+
+#include "AccelerationStructureStats.h"
+#include "ScratchArena.h"
+
+#include <chrono>
+#include <vector>
+
+struct AccelerationStructureBottomLevelBuild {
+    nri::AccelerationStructure* dst;
+    uint32_t geometryOffset;
+    uint32_t geometryNum;
+};
+
+struct AccelerationStructureTransientBuffer {
+    nri::Buffer* buffer;
+    nri::Memory* memory;
+};
+
+struct AccelerationStructureTransient {
+    nri::AccelerationStructure* accelerationStructure;
+    nri::Memory* memory;
+};
+
+struct AccelerationStructureCompaction {
+    nri::AccelerationStructure* dst;
+    const nri::AccelerationStructure* src;
+};
+
+// Owned by a batch in flight or free, query pool and readback buffer only grow
+struct AccelerationStructureBuildContext {
+    nri::CommandAllocator* commandAllocator;
+    nri::CommandBuffer* commandBuffer;
+    nri::QueryPool* queryPool;
+    nri::QueryPool* timestampQueryPool;
+    nri::Buffer* readbackBuffer;
+    nri::Memory* readbackMemory;
+    uint64_t readbackSize;
+    uint32_t queryCapacity;
+};
+
+struct AccelerationStructureBuildBatch {
+    AccelerationStructureBuildContext context;
+    std::vector<AccelerationStructureTransientBuffer> transientBuffers;
+    std::vector<AccelerationStructureTransient> transientAccelerationStructures;
+    std::vector<uint64_t*> compactedSizes;
+    std::chrono::steady_clock::time_point submissionTime;
+    uint64_t timestampOffset; // in "readbackBuffer", after compacted sizes
+    uint64_t fenceValue;
+    uint32_t statsBatchIndex;
+    uint32_t timestampNum;
+};
+
+class AccelerationStructureBuildQueue {
+public:
+    inline void Initialize(const nri::CoreInterface& NRI, const nri::RayTracingInterface& rayTracing, nri::Device& device, nri::Queue& queue) {
+        m_NRI = &NRI;
+        m_RayTracing = &rayTracing;
+        m_Device = &device;
+        m_Queue = &queue;
+
+        NRI_ABORT_ON_FAILURE(m_NRI->CreateFence(*m_Device, 0, m_Fence));
+
+        m_ScratchArena.Initialize(NRI, device);
+    }
+
+    inline void Destroy() {
+        if (!m_NRI)
+            return;
+
+        Wait();
+
+        // Never submitted
+        for (AccelerationStructureTransientBuffer& transientBuffer : m_TransientBuffers) {
+            m_NRI->DestroyBuffer(transientBuffer.buffer);
+            m_NRI->FreeMemory(transientBuffer.memory);
+        }
+        m_TransientBuffers.clear();
+
+        for (AccelerationStructureTransient& transient : m_TransientAccelerationStructures) {
+            m_RayTracing->DestroyAccelerationStructure(transient.accelerationStructure);
+            m_NRI->FreeMemory(transient.memory);
+        }
+        m_TransientAccelerationStructures.clear();
+
+        for (AccelerationStructureBuildContext& context : m_FreeContexts) {
+            m_NRI->DestroyCommandBuffer(context.commandBuffer);
+            m_NRI->DestroyCommandAllocator(context.commandAllocator);
+            m_NRI->DestroyQueryPool(context.queryPool);
+            m_NRI->DestroyQueryPool(context.timestampQueryPool);
+            m_NRI->DestroyBuffer(context.readbackBuffer);
+            m_NRI->FreeMemory(context.readbackMemory);
+        }
+        m_FreeContexts.clear();
+
+        m_ScratchArena.Destroy();
+
+        m_NRI->DestroyFence(m_Fence);
+        m_Fence = nullptr;
+    }
+
+    inline void AddBottomLevel(nri::AccelerationStructure& dst, const nri::BottomLevelGeometryDesc* geometries, uint32_t geometryNum) {
+        AccelerationStructureBottomLevelBuild& build = m_BottomLevelBuilds.emplace_back();
+        build.dst = &dst;
+        build.geometryOffset = (uint32_t)m_Geometries.size();
+        build.geometryNum = geometryNum;
+
+        m_Geometries.insert(m_Geometries.end(), geometries, geometries + geometryNum);
+    }
+
+    inline void AddTopLevel(nri::AccelerationStructure& dst, uint32_t instanceNum, nri::Buffer& instanceBuffer, uint64_t instanceOffset = 0) {
+        nri::BuildTopLevelAccelerationStructureDesc& desc = m_TopLevelBuilds.emplace_back();
+        desc = {};
+        desc.dst = &dst;
+        desc.instanceNum = instanceNum;
+        desc.instanceBuffer = &instanceBuffer;
+        desc.instanceOffset = instanceOffset;
+    }
+
+    // "compactedSize" is written when the batch is complete
+    inline void AddCompactedSizeQuery(const nri::AccelerationStructure& accelerationStructure, uint64_t* compactedSize) {
+        m_CompactedSizeQueries.push_back(&accelerationStructure);
+        m_CompactedSizes.push_back(compactedSize);
+    }
+
+    inline void AddCompaction(nri::AccelerationStructure& dst, const nri::AccelerationStructure& src) {
+        m_Compactions.push_back({&dst, &src});
+    }
+
+    // Released in "Wait" following the next "Submit" (i.e. when the GPU is done with it)
+    inline void AddTransientBuffer(nri::Buffer* buffer, nri::Memory* memory) {
+        m_TransientBuffers.push_back({buffer, memory});
+    }
+
+    inline void AddTransientAccelerationStructure(nri::AccelerationStructure* accelerationStructure, nri::Memory* memory) {
+        m_TransientAccelerationStructures.push_back({accelerationStructure, memory});
+    }
+
+    // Optional, must outlive the queue
+    inline void SetStats(AccelerationStructureStats* stats) {
+        m_Stats = stats;
+    }
+
+    inline bool IsEmpty() const {
+        return m_BottomLevelBuilds.empty() && m_TopLevelBuilds.empty() && m_CompactedSizeQueries.empty() && m_Compactions.empty();
+    }
+
+    // The last batch
+    inline uint64_t GetScratchBufferSize() const {
+        return m_ScratchBufferSize;
+    }
+
+    inline const ScratchArena& GetScratchArena() const {
+        return m_ScratchArena;
+    }
+
+    // Returns the fence value to wait for
+    inline uint64_t Submit() {
+        if (IsEmpty())
+            return m_FenceValue;
+
+        Release(m_NRI->GetFenceValue(*m_Fence));
+
+        const auto recordingBegin = std::chrono::steady_clock::now();
+
+        const nri::DeviceDesc& deviceDesc = m_NRI->GetDeviceDesc(*m_Device);
+        const uint64_t scratchAlignment = deviceDesc.memoryAlignment.scratchBufferOffset;
+
+        // Scratch ranges
+        std::vector<nri::BuildBottomLevelAccelerationStructureDesc> bottomLevelDescs(m_BottomLevelBuilds.size());
+
+        uint64_t bottomLevelScratchSize = 0;
+        for (size_t i = 0; i < m_BottomLevelBuilds.size(); i++) {
+            const AccelerationStructureBottomLevelBuild& build = m_BottomLevelBuilds[i];
+
+            nri::BuildBottomLevelAccelerationStructureDesc& desc = bottomLevelDescs[i];
+            desc = {};
+            desc.dst = build.dst;
+            desc.geometries = m_Geometries.data() + build.geometryOffset;
+            desc.geometryNum = build.geometryNum;
+            desc.scratchOffset = bottomLevelScratchSize;
+
+            bottomLevelScratchSize += helper::Align(m_RayTracing->GetAccelerationStructureBuildScratchBufferSize(*build.dst), scratchAlignment);
+        }
+
+        uint64_t topLevelScratchSize = 0;
+        for (nri::BuildTopLevelAccelerationStructureDesc& desc : m_TopLevelBuilds) {
+            desc.scratchOffset = topLevelScratchSize;
+
+            topLevelScratchSize += helper::Align(m_RayTracing->GetAccelerationStructureBuildScratchBufferSize(*desc.dst), scratchAlignment);
+        }
+
+        m_ScratchBufferSize = std::max(bottomLevelScratchSize, topLevelScratchSize);
+
+        // Scratch range
+        nri::Buffer* scratchBuffer = nullptr;
+        uint64_t scratchOffset = 0;
+        if (m_ScratchBufferSize)
+            m_ScratchArena.Allocate(m_ScratchBufferSize, scratchAlignment, scratchBuffer, scratchOffset);
+
+        for (nri::BuildBottomLevelAccelerationStructureDesc& desc : bottomLevelDescs) {
+            desc.scratchBuffer = scratchBuffer;
+            desc.scratchOffset += scratchOffset;
+        }
+
+        for (nri::BuildTopLevelAccelerationStructureDesc& desc : m_TopLevelBuilds) {
+            desc.scratchBuffer = scratchBuffer;
+            desc.scratchOffset += scratchOffset;
+        }
+
+        // Record (begin, after the BLAS phase, after the TLAS phase timestamps)
+        const uint32_t queryNum = (uint32_t)m_CompactedSizeQueries.size();
+        const uint32_t timestampNum = m_Stats ? 3 : 0;
+
+        AccelerationStructureBuildBatch& batch = m_Batches.emplace_back();
+        batch = {};
+        batch.timestampNum = timestampNum;
+        batch.context = AcquireContext(queryNum, timestampNum, batch.timestampOffset);
+
+        const AccelerationStructureBuildContext& context = batch.context;
+        nri::CommandBuffer& commandBuffer = *context.commandBuffer;
+        m_NRI->BeginCommandBuffer(commandBuffer, nullptr);
+        {
+            if (timestampNum) {
+                m_NRI->CmdResetQueries(commandBuffer, *context.timestampQueryPool, 0, timestampNum);
+                m_NRI->CmdEndQuery(commandBuffer, *context.timestampQueryPool, 0);
+            }
+
+            // Compaction (sources are complete, their sizes have been queried in a previous batch)
+            for (const AccelerationStructureCompaction& compaction : m_Compactions)
+                m_RayTracing->CmdCopyAccelerationStructure(commandBuffer, *compaction.dst, *compaction.src, nri::CopyMode::COMPACT);
+
+            if (!bottomLevelDescs.empty())
+                m_RayTracing->CmdBuildBottomLevelAccelerationStructures(commandBuffer, bottomLevelDescs.data(), (uint32_t)bottomLevelDescs.size());
+
+            if (timestampNum)
+                m_NRI->CmdEndQuery(commandBuffer, *context.timestampQueryPool, 1);
+
+            if (!m_TopLevelBuilds.empty() || queryNum) {
+                // BLAS writes (and scratch reuse) must be complete before TLAS builds and size queries
+                if (!bottomLevelDescs.empty() || !m_Compactions.empty()) {
+                    nri::GlobalBarrierDesc accelerationStructureBarrier = {};
+                    accelerationStructureBarrier.before = {nri::AccessBits::ACCELERATION_STRUCTURE_WRITE, nri::StageBits::ACCELERATION_STRUCTURE};
+                    accelerationStructureBarrier.after = {nri::AccessBits::ACCELERATION_STRUCTURE_READ | nri::AccessBits::ACCELERATION_STRUCTURE_WRITE, nri::StageBits::ACCELERATION_STRUCTURE};
+
+                    nri::BarrierDesc barrierDesc = {};
+                    barrierDesc.globalNum = 1;
+                    barrierDesc.globals = &accelerationStructureBarrier;
+
+                    m_NRI->CmdBarrier(commandBuffer, barrierDesc);
+                }
+
+                if (queryNum) {
+                    m_NRI->CmdResetQueries(commandBuffer, *context.queryPool, 0, queryNum);
+                    m_RayTracing->CmdWriteAccelerationStructuresSizes(commandBuffer, m_CompactedSizeQueries.data(), queryNum, *context.queryPool, 0);
+                    m_NRI->CmdCopyQueries(commandBuffer, *context.queryPool, 0, queryNum, *context.readbackBuffer, 0);
+                }
+
+                if (!m_TopLevelBuilds.empty())
+                    m_RayTracing->CmdBuildTopLevelAccelerationStructures(commandBuffer, m_TopLevelBuilds.data(), (uint32_t)m_TopLevelBuilds.size());
+            }
+
+            if (timestampNum) {
+                m_NRI->CmdEndQuery(commandBuffer, *context.timestampQueryPool, 2);
+                m_NRI->CmdCopyQueries(commandBuffer, *context.timestampQueryPool, 0, timestampNum, *context.readbackBuffer, batch.timestampOffset);
+            }
+        }
+        m_NRI->EndCommandBuffer(commandBuffer);
+
+        // Submit
+        nri::FenceSubmitDesc signalFence = {};
+        signalFence.fence = m_Fence;
+        signalFence.value = ++m_FenceValue;
+
+        m_ScratchArena.Retire(m_FenceValue);
+
+        nri::QueueSubmitDesc queueSubmitDesc = {};
+        queueSubmitDesc.commandBuffers = &context.commandBuffer;
+        queueSubmitDesc.commandBufferNum = 1;
+        queueSubmitDesc.signalFences = &signalFence;
+        queueSubmitDesc.signalFenceNum = 1;
+
+        m_NRI->QueueSubmit(*m_Queue, queueSubmitDesc);
+
+        batch.submissionTime = std::chrono::steady_clock::now();
+        if (m_Stats) {
+            double recordingTime = std::chrono::duration<double, std::milli>(batch.submissionTime - recordingBegin).count();
+            batch.statsBatchIndex = m_Stats->AddBatch((uint32_t)bottomLevelDescs.size(), (uint32_t)m_TopLevelBuilds.size(), (uint32_t)m_Compactions.size(), recordingTime);
+        }
+
+        m_BottomLevelBuilds.clear();
+        m_TopLevelBuilds.clear();
+        m_Geometries.clear();
+        m_CompactedSizeQueries.clear();
+        m_Compactions.clear();
+
+        batch.compactedSizes.swap(m_CompactedSizes);
+        batch.transientBuffers.swap(m_TransientBuffers);
+        batch.transientAccelerationStructures.swap(m_TransientAccelerationStructures);
+        batch.fenceValue = m_FenceValue;
+
+        return m_FenceValue;
+    }
+
+    inline void Wait() {
+        if (m_Batches.empty())
+            return;
+
+        m_NRI->Wait(*m_Fence, m_FenceValue);
+
+        Release(m_FenceValue);
+    }
+
+private:
+    // A context of a completed batch or a new one, grown to fit this batch
+    inline AccelerationStructureBuildContext AcquireContext(uint32_t queryNum, uint32_t timestampNum, uint64_t& timestampOffset) {
+        AccelerationStructureBuildContext context = {};
+        if (m_FreeContexts.empty()) {
+            NRI_ABORT_ON_FAILURE(m_NRI->CreateCommandAllocator(*m_Queue, context.commandAllocator));
+            NRI_ABORT_ON_FAILURE(m_NRI->CreateCommandBuffer(*context.commandAllocator, context.commandBuffer));
+        } else {
+            context = m_FreeContexts.back();
+            m_FreeContexts.pop_back();
+
+            m_NRI->ResetCommandAllocator(*context.commandAllocator);
+        }
+
+        if (queryNum > context.queryCapacity) {
+            m_NRI->DestroyQueryPool(context.queryPool);
+
+            nri::QueryPoolDesc queryPoolDesc = {};
+            queryPoolDesc.queryType = nri::QueryType::ACCELERATION_STRUCTURE_COMPACTED_SIZE;
+            queryPoolDesc.capacity = queryNum;
+            NRI_ABORT_ON_FAILURE(m_NRI->CreateQueryPool(*m_Device, queryPoolDesc, context.queryPool));
+
+            context.queryCapacity = queryNum;
+        }
+
+        if (timestampNum && !context.timestampQueryPool) {
+            nri::QueryPoolDesc queryPoolDesc = {};
+            queryPoolDesc.queryType = nri::QueryType::TIMESTAMP;
+            queryPoolDesc.capacity = timestampNum;
+            NRI_ABORT_ON_FAILURE(m_NRI->CreateQueryPool(*m_Device, queryPoolDesc, context.timestampQueryPool));
+        }
+
+        timestampOffset = queryNum ? queryNum * m_NRI->GetQuerySize(*context.queryPool) : 0;
+
+        uint64_t readbackSize = timestampOffset;
+        if (timestampNum)
+            readbackSize += timestampNum * m_NRI->GetQuerySize(*context.timestampQueryPool);
+
+        if (readbackSize > context.readbackSize) {
+            m_NRI->DestroyBuffer(context.readbackBuffer);
+            m_NRI->FreeMemory(context.readbackMemory);
+
+            const nri::BufferDesc bufferDesc = {readbackSize, 0, nri::BufferUsageBits::NONE};
+            NRI_ABORT_ON_FAILURE(m_NRI->CreateBuffer(*m_Device, bufferDesc, context.readbackBuffer));
+
+            nri::MemoryDesc memoryDesc = {};
+            m_NRI->GetBufferMemoryDesc(*context.readbackBuffer, nri::MemoryLocation::HOST_READBACK, memoryDesc);
+
+            nri::AllocateMemoryDesc allocateMemoryDesc = {};
+            allocateMemoryDesc.size = memoryDesc.size;
+            allocateMemoryDesc.type = memoryDesc.type;
+            NRI_ABORT_ON_FAILURE(m_NRI->AllocateMemory(*m_Device, allocateMemoryDesc, context.readbackMemory));
+
+            const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {context.readbackBuffer, context.readbackMemory};
+            NRI_ABORT_ON_FAILURE(m_NRI->BindBufferMemory(&bufferMemoryBindingDesc, 1));
+
+            context.readbackSize = readbackSize;
+        }
+
+        return context;
+    }
+
+    inline void Release(uint64_t completedFenceValue) {
+        size_t i = 0;
+        for (; i < m_Batches.size() && m_Batches[i].fenceValue <= completedFenceValue; i++) {
+            AccelerationStructureBuildBatch& batch = m_Batches[i];
+            const AccelerationStructureBuildContext& context = batch.context;
+
+            if (!batch.compactedSizes.empty() || batch.timestampNum) {
+                const uint8_t* data = (uint8_t*)m_NRI->MapBuffer(*context.readbackBuffer, 0, nri::WHOLE_SIZE);
+
+                if (!batch.compactedSizes.empty()) {
+                    const uint64_t querySize = m_NRI->GetQuerySize(*context.queryPool);
+                    for (size_t j = 0; j < batch.compactedSizes.size(); j++)
+                        *batch.compactedSizes[j] = *(const uint64_t*)(data + j * querySize);
+                }
+
+                if (batch.timestampNum) {
+                    const uint64_t timestampSize = m_NRI->GetQuerySize(*context.timestampQueryPool);
+                    const uint8_t* timestamps = data + batch.timestampOffset;
+                    uint64_t begin = *(const uint64_t*)timestamps;
+                    uint64_t bottomLevelEnd = *(const uint64_t*)(timestamps + timestampSize);
+                    uint64_t topLevelEnd = *(const uint64_t*)(timestamps + 2 * timestampSize);
+
+                    const nri::DeviceDesc& deviceDesc = m_NRI->GetDeviceDesc(*m_Device);
+                    double timestampPeriod = 1000.0 / double(deviceDesc.other.timestampFrequencyHz);
+
+                    // Observed completion, i.e. accurate only if waited for
+                    double completionTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batch.submissionTime).count();
+                    m_Stats->CompleteBatch(batch.statsBatchIndex, completionTime, double(bottomLevelEnd - begin) * timestampPeriod, double(topLevelEnd - bottomLevelEnd) * timestampPeriod);
+                }
+
+                m_NRI->UnmapBuffer(*context.readbackBuffer);
+            }
+
+            m_FreeContexts.push_back(context);
+
+            for (AccelerationStructureTransientBuffer& transientBuffer : batch.transientBuffers) {
+                m_NRI->DestroyBuffer(transientBuffer.buffer);
+                m_NRI->FreeMemory(transientBuffer.memory);
+            }
+
+            for (AccelerationStructureTransient& transient : batch.transientAccelerationStructures) {
+                m_RayTracing->DestroyAccelerationStructure(transient.accelerationStructure);
+                m_NRI->FreeMemory(transient.memory);
+            }
+        }
+
+        m_Batches.erase(m_Batches.begin(), m_Batches.begin() + i);
+        m_ScratchArena.Recycle(completedFenceValue);
+    }
+
+private:
+    std::vector<AccelerationStructureBottomLevelBuild> m_BottomLevelBuilds;
+    std::vector<nri::BuildTopLevelAccelerationStructureDesc> m_TopLevelBuilds;
+    std::vector<nri::BottomLevelGeometryDesc> m_Geometries;
+    std::vector<AccelerationStructureTransientBuffer> m_TransientBuffers;
+    std::vector<AccelerationStructureTransient> m_TransientAccelerationStructures;
+    std::vector<AccelerationStructureCompaction> m_Compactions;
+    std::vector<const nri::AccelerationStructure*> m_CompactedSizeQueries;
+    std::vector<uint64_t*> m_CompactedSizes;
+    std::vector<AccelerationStructureBuildBatch> m_Batches;
+    std::vector<AccelerationStructureBuildContext> m_FreeContexts;
+    ScratchArena m_ScratchArena;
+    AccelerationStructureStats* m_Stats = nullptr;
+    const nri::CoreInterface* m_NRI = nullptr;
+    const nri::RayTracingInterface* m_RayTracing = nullptr;
+    nri::Device* m_Device = nullptr;
+    nri::Queue* m_Queue = nullptr;
+    nri::Fence* m_Fence = nullptr;
+    uint64_t m_FenceValue = 0;
+    uint64_t m_ScratchBufferSize = 0;
+};
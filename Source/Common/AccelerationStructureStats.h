@@ -0,0 +1,271 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Acceleration structure statistics, used to tune "BUILD_FLAGS" trade-offs:
+//  - "Register" records an acceleration structure: its build flags, memory size, build and update scratch sizes
+//  - "SetCompacted" adds the compacted memory size (the size of the right-sized copy)
+//  - build times are per batch, an "AccelerationStructureBuildQueue" with "SetStats" reports them: CPU recording and submission,
+//    CPU submission to completion (observed in "Wait" or the next "Submit") and GPU times of the BLAS and TLAS phases from timestamps
+//  - "DrawImgui" shows a table, "WriteCsv" dumps it (a row per acceleration structure, with times of its batch and phase)
+// An acceleration structure belongs to the batch, which is submitted next after "Register"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+struct AccelerationStructureStatsBatch {
+    uint32_t bottomLevelNum;
+    uint32_t topLevelNum;
+    uint32_t compactionNum;
+    double recordingTime;      // ms, CPU
+    double completionTime;     // ms, CPU (from submission)
+    double bottomLevelGpuTime; // ms, compactions and BLAS builds
+    double topLevelGpuTime;    // ms, TLAS builds
+    bool isComplete;
+};
+
+struct AccelerationStructureStatsEntry {
+    std::string name;
+    nri::AccelerationStructureType type;
+    nri::AccelerationStructureBits flags;
+    uint32_t geometryOrInstanceNum;
+    uint64_t primitiveNum; // triangles (BLAS) or instances (TLAS)
+    uint64_t memorySize;
+    uint64_t compactedMemorySize; // 0 if not compacted
+    uint64_t buildScratchSize;
+    uint64_t updateScratchSize;
+    uint32_t batchIndex;
+};
+
+class AccelerationStructureStats {
+public:
+    inline void Initialize(const nri::CoreInterface& NRI, const nri::RayTracingInterface& rayTracing) {
+        m_NRI = &NRI;
+        m_RayTracing = &rayTracing;
+    }
+
+    // Returns the entry index
+    inline uint32_t Register(const char* name, const nri::AccelerationStructure& accelerationStructure, const nri::AccelerationStructureDesc& accelerationStructureDesc) {
+        AccelerationStructureStatsEntry& entry = m_Entries.emplace_back();
+        entry = {};
+        entry.name = name;
+        entry.type = accelerationStructureDesc.type;
+        entry.flags = accelerationStructureDesc.flags;
+        entry.geometryOrInstanceNum = accelerationStructureDesc.geometryOrInstanceNum;
+        entry.memorySize = GetMemorySize(accelerationStructure);
+        entry.buildScratchSize = m_RayTracing->GetAccelerationStructureBuildScratchBufferSize(accelerationStructure);
+        entry.batchIndex = (uint32_t)m_Batches.size();
+
+        if (accelerationStructureDesc.flags & nri::AccelerationStructureBits::ALLOW_UPDATE)
+            entry.updateScratchSize = m_RayTracing->GetAccelerationStructureUpdateScratchBufferSize(accelerationStructure);
+
+        if (accelerationStructureDesc.type == nri::AccelerationStructureType::TOP_LEVEL)
+            entry.primitiveNum = accelerationStructureDesc.geometryOrInstanceNum;
+        else {
+            for (uint32_t i = 0; i < accelerationStructureDesc.geometryOrInstanceNum; i++) {
+                const nri::BottomLevelGeometryDesc& geometry = accelerationStructureDesc.geometries[i];
+                if (geometry.type == nri::BottomLevelGeometryType::TRIANGLES)
+                    entry.primitiveNum += (geometry.triangles.indexNum ? geometry.triangles.indexNum : geometry.triangles.vertexNum) / 3;
+            }
+        }
+
+        return (uint32_t)m_Entries.size() - 1;
+    }
+
+    inline void SetCompacted(uint32_t entryIndex, const nri::AccelerationStructure& compactedAccelerationStructure) {
+        m_Entries[entryIndex].compactedMemorySize = GetMemorySize(compactedAccelerationStructure);
+    }
+
+    // Called by "AccelerationStructureBuildQueue", returns the batch index
+    inline uint32_t AddBatch(uint32_t bottomLevelNum, uint32_t topLevelNum, uint32_t compactionNum, double recordingTime) {
+        AccelerationStructureStatsBatch& batch = m_Batches.emplace_back();
+        batch = {};
+        batch.bottomLevelNum = bottomLevelNum;
+        batch.topLevelNum = topLevelNum;
+        batch.compactionNum = compactionNum;
+        batch.recordingTime = recordingTime;
+
+        return (uint32_t)m_Batches.size() - 1;
+    }
+
+    inline void CompleteBatch(uint32_t batchIndex, double completionTime, double bottomLevelGpuTime, double topLevelGpuTime) {
+        AccelerationStructureStatsBatch& batch = m_Batches[batchIndex];
+        batch.completionTime = completionTime;
+        batch.bottomLevelGpuTime = bottomLevelGpuTime;
+        batch.topLevelGpuTime = topLevelGpuTime;
+        batch.isComplete = true;
+    }
+
+    inline const std::vector<AccelerationStructureStatsEntry>& GetEntries() const {
+        return m_Entries;
+    }
+
+    inline const std::vector<AccelerationStructureStatsBatch>& GetBatches() const {
+        return m_Batches;
+    }
+
+    // Sums over entries of a type
+    inline uint64_t GetTotalMemorySize(nri::AccelerationStructureType type, bool isCompacted) const {
+        uint64_t size = 0;
+        for (const AccelerationStructureStatsEntry& entry : m_Entries) {
+            if (entry.type == type)
+                size += isCompacted && entry.compactedMemorySize ? entry.compactedMemorySize : entry.memorySize;
+        }
+
+        return size;
+    }
+
+    inline void DrawImgui() const {
+        // Batches
+        if (ImGui::BeginTable("Batches", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+            ImGui::TableSetupColumn("Batch");
+            ImGui::TableSetupColumn("BLAS / TLAS / compactions");
+            ImGui::TableSetupColumn("Recording (CPU)");
+            ImGui::TableSetupColumn("Completion (CPU)");
+            ImGui::TableSetupColumn("BLAS phase (GPU)");
+            ImGui::TableSetupColumn("TLAS phase (GPU)");
+            ImGui::TableHeadersRow();
+
+            for (size_t i = 0; i < m_Batches.size(); i++) {
+                const AccelerationStructureStatsBatch& batch = m_Batches[i];
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", (uint32_t)i);
+                ImGui::TableNextColumn();
+                ImGui::Text("%u / %u / %u", batch.bottomLevelNum, batch.topLevelNum, batch.compactionNum);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f ms", batch.recordingTime);
+
+                if (batch.isComplete) {
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.3f ms", batch.completionTime);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.3f ms", batch.bottomLevelGpuTime);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.3f ms", batch.topLevelGpuTime);
+                }
+            }
+
+            ImGui::EndTable();
+        }
+
+        // Acceleration structures
+        if (ImGui::BeginTable("Acceleration structures", 8, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_ScrollY, ImVec2(0.0f, 300.0f))) {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Name");
+            ImGui::TableSetupColumn("Flags");
+            ImGui::TableSetupColumn("Primitives");
+            ImGui::TableSetupColumn("Memory");
+            ImGui::TableSetupColumn("Compacted");
+            ImGui::TableSetupColumn("Build scratch");
+            ImGui::TableSetupColumn("Update scratch");
+            ImGui::TableSetupColumn("Batch");
+            ImGui::TableHeadersRow();
+
+            ImGuiListClipper clipper;
+            clipper.Begin((int32_t)m_Entries.size());
+            while (clipper.Step()) {
+                for (int32_t i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+                    const AccelerationStructureStatsEntry& entry = m_Entries[i];
+
+                    char flags[128];
+                    GetFlagsString(entry.flags, flags, sizeof(flags));
+
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(entry.name.c_str());
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(flags);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%" PRIu64, entry.primitiveNum);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f KB", entry.memorySize / 1024.0);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f KB", entry.compactedMemorySize / 1024.0);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f KB", entry.buildScratchSize / 1024.0);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f KB", entry.updateScratchSize / 1024.0);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%u", entry.batchIndex);
+                }
+            }
+
+            ImGui::EndTable();
+        }
+    }
+
+    inline bool WriteCsv(const char* path) const {
+        FILE* file = fopen(path, "w");
+        if (!file) {
+            printf("Acceleration structure stats: can't write '%s'\n", path);
+            return false;
+        }
+
+        fprintf(file, "name,type,flags,geometryOrInstanceNum,primitiveNum,memorySize,compactedMemorySize,buildScratchSize,updateScratchSize,batch,recordingMs,completionMs,phaseGpuMs\n");
+
+        for (const AccelerationStructureStatsEntry& entry : m_Entries) {
+            bool isTopLevel = entry.type == nri::AccelerationStructureType::TOP_LEVEL;
+
+            char flags[128];
+            GetFlagsString(entry.flags, flags, sizeof(flags));
+
+            // Times of the batch (and its BLAS or TLAS phase), empty if the batch is not submitted or complete yet
+            char times[128] = ",,";
+            if (entry.batchIndex < m_Batches.size()) {
+                const AccelerationStructureStatsBatch& batch = m_Batches[entry.batchIndex];
+                if (batch.isComplete)
+                    snprintf(times, sizeof(times), "%.4f,%.4f,%.4f", batch.recordingTime, batch.completionTime, isTopLevel ? batch.topLevelGpuTime : batch.bottomLevelGpuTime);
+            }
+
+            fprintf(file, "\"%s\",%s,%s,%u,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%u,%s\n",
+                entry.name.c_str(), isTopLevel ? "TLAS" : "BLAS", flags, entry.geometryOrInstanceNum, entry.primitiveNum,
+                entry.memorySize, entry.compactedMemorySize, entry.buildScratchSize, entry.updateScratchSize, entry.batchIndex, times);
+        }
+
+        fclose(file);
+
+        printf("Acceleration structure stats: saved to '%s'\n", path);
+
+        return true;
+    }
+
+private:
+    inline uint64_t GetMemorySize(const nri::AccelerationStructure& accelerationStructure) const {
+        nri::MemoryDesc memoryDesc = {};
+        m_NRI->GetAccelerationStructureMemoryDesc(accelerationStructure, nri::MemoryLocation::DEVICE, memoryDesc);
+
+        return memoryDesc.size;
+    }
+
+    // "|" separated (CSV friendly)
+    static inline void GetFlagsString(nri::AccelerationStructureBits flags, char* buffer, size_t bufferSize) {
+        buffer[0] = '\0';
+
+        if (flags & nri::AccelerationStructureBits::PREFER_FAST_TRACE)
+            AppendFlag(buffer, bufferSize, "FAST_TRACE");
+        if (flags & nri::AccelerationStructureBits::PREFER_FAST_BUILD)
+            AppendFlag(buffer, bufferSize, "FAST_BUILD");
+        if (flags & nri::AccelerationStructureBits::ALLOW_UPDATE)
+            AppendFlag(buffer, bufferSize, "UPDATE");
+        if (flags & nri::AccelerationStructureBits::ALLOW_COMPACTION)
+            AppendFlag(buffer, bufferSize, "COMPACTION");
+
+        if (!buffer[0])
+            snprintf(buffer, bufferSize, "NONE");
+    }
+
+    static inline void AppendFlag(char* buffer, size_t bufferSize, const char* flag) {
+        size_t length = strlen(buffer);
+        snprintf(buffer + length, bufferSize - length, "%s%s", length ? "|" : "", flag);
+    }
+
+private:
+    std::vector<AccelerationStructureStatsEntry> m_Entries;
+    std::vector<AccelerationStructureStatsBatch> m_Batches;
+    const nri::CoreInterface* m_NRI = nullptr;
+    const nri::RayTracingInterface* m_RayTracing = nullptr;
+};
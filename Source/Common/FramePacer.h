@@ -0,0 +1,299 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Software latency limiter (a fallback for devices without "features.lowLatency"):
+//  - the frame submission signals the pacer's own fence ("GetSubmitSignal"), a watcher thread waits for it value by value
+//    and records CPU times of GPU completions, i.e. the completion history is exact up to the thread wake up latency
+//  - GPU frame time is the busy time "done(N) - max(submit(N), done(N - 1))" (idle gaps excluded), CPU frame time is
+//    "submit(N) - wakeUp(N)", both are smoothed
+//  - "Sleep" predicts when the GPU finishes the last submitted frame and delays the start of the next one so that its
+//    submission lands just before it ("wakeUp = predictedDone - cpuFrameTime - margin"), i.e. the GPU queue stays
+//    (almost) empty, the GPU doesn't starve and input is sampled as late as possible
+//  - sleeping is hybrid: an OS sleep until "spin threshold" before the deadline, then a spin. The spin threshold follows
+//    the worst recent OS oversleep (the OS timer granularity can be coarse)
+//  - latency is "done(N) - wakeUp(N)" (input is sampled right after waking up), its average and jitter (standard deviation)
+//    are reported over a sliding window. Stats are collected even if pacing is disabled
+//  - "OnSimulationEnd" and "OnPresent" are optional markers, "GetCompletedFrames" returns timings of frames completed
+//    since the previous call (a software analog of "nri::LatencyReport")
+// Frame indices must go one by one starting from 0, "Sleep" and "OnSubmit" are called once per frame. "Sleep" and
+// "OnSimulationEnd" can be called from a simulation thread running ahead of the render thread (see "SimulationThread")
+
+#include <math.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct FramePacerDesc {
+    double margin = 0.5;        // ms, extra CPU time (covers prediction errors)
+    double spinThreshold = 1.0; // ms, minimal
+    double smoothing = 0.1;     // weight of a new measurement
+};
+
+struct FramePacerStats {
+    double gpuFrameTime;  // ms, busy time, smoothed
+    double cpuFrameTime;  // ms, wake up to submit, smoothed
+    double sleepTime;     // ms, smoothed
+    double latency;       // ms, wake up to GPU completion, average over the window
+    double latencyJitter; // ms, standard deviation over the window
+    double oversleep;     // ms, recent worst OS sleep overshoot
+};
+
+// ms, CPU times ("steady_clock")
+struct FramePacerFrame {
+    double wakeUpTime;
+    double simulationEndTime;
+    double submitTime;
+    double presentEndTime;
+    double doneTime;
+    uint32_t frameIndex;
+};
+
+class FramePacer {
+public:
+    static constexpr uint32_t HISTORY_SIZE = 64; // must be greater than the number of frames in flight
+    static constexpr uint32_t WINDOW_SIZE = 120; // frames in latency stats
+
+    inline ~FramePacer() {
+        StopThread();
+    }
+
+    inline void Initialize(const nri::CoreInterface& NRI, nri::Device& device, const FramePacerDesc& desc) {
+        m_NRI = &NRI;
+        m_Desc = desc;
+        m_Quit = false;
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateFence(device, 0, m_Fence));
+
+        m_Thread = std::thread(&FramePacer::ThreadEntryPoint, this);
+    }
+
+    // The GPU must be idle
+    inline void Destroy() {
+        StopThread();
+
+        if (m_Fence) {
+            m_NRI->DestroyFence(m_Fence);
+            m_Fence = nullptr;
+        }
+    }
+
+    inline void SetEnabled(bool enabled) {
+        m_IsEnabled = enabled;
+    }
+
+    inline bool IsEnabled() const {
+        return m_IsEnabled;
+    }
+
+    inline FramePacerStats GetStats() {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        return m_Stats;
+    }
+
+    inline void GetCompletedFrames(std::vector<FramePacerFrame>& frames) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        frames.swap(m_CompletedFrames);
+        m_CompletedFrames.clear();
+    }
+
+    // Must be added to the signal fences of the frame submission
+    inline nri::FenceSubmitDesc GetSubmitSignal(uint32_t frameIndex) const {
+        nri::FenceSubmitDesc fenceSubmitDesc = {};
+        fenceSubmitDesc.fence = m_Fence;
+        fenceSubmitDesc.value = 1 + frameIndex;
+
+        return fenceSubmitDesc;
+    }
+
+    // Right before sampling input
+    inline void Sleep(uint32_t frameIndex) {
+        double begin = GetTime();
+        double wakeUpTime = begin;
+        double spinThreshold = m_Desc.spinThreshold;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            UpdateStats();
+            spinThreshold = std::max(spinThreshold, m_Stats.oversleep);
+
+            // Predict when the GPU finishes the last submitted frame
+            if (m_IsEnabled && m_CompletedNum && m_Stats.gpuFrameTime > 0.0) {
+                double doneTime = m_Frames[(m_CompletedNum - 1) % HISTORY_SIZE].doneTime;
+                for (uint32_t i = m_CompletedNum; i < m_SubmittedNum; i++)
+                    doneTime = std::max(doneTime, m_Frames[i % HISTORY_SIZE].submitTime) + m_Stats.gpuFrameTime;
+
+                wakeUpTime = doneTime - m_Stats.cpuFrameTime - m_Desc.margin;
+            }
+        }
+
+        double oversleep = 0.0;
+        if (wakeUpTime > begin)
+            oversleep = SleepUntil(wakeUpTime, spinThreshold);
+
+        double end = GetTime();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            m_Frames[frameIndex % HISTORY_SIZE] = {end, 0.0, 0.0, 0.0, 0.0, frameIndex};
+            m_Stats.sleepTime += (end - begin - m_Stats.sleepTime) * m_Desc.smoothing;
+
+            // The worst oversleep decays slowly, i.e. a rare hiccup doesn't make the spin long forever
+            if (wakeUpTime > begin)
+                m_Stats.oversleep = std::max(oversleep, m_Stats.oversleep * 0.99);
+        }
+    }
+
+    inline void OnSimulationEnd(uint32_t frameIndex) {
+        double now = GetTime();
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Frames[frameIndex % HISTORY_SIZE].simulationEndTime = now;
+    }
+
+    // Right after "QueuePresent"
+    inline void OnPresent(uint32_t frameIndex) {
+        double now = GetTime();
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Frames[frameIndex % HISTORY_SIZE].presentEndTime = now;
+    }
+
+    // Right after "QueueSubmit"
+    inline void OnSubmit(uint32_t frameIndex) {
+        double now = GetTime();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            FramePacerFrame& frame = m_Frames[frameIndex % HISTORY_SIZE];
+            frame.submitTime = now;
+
+            double cpuFrameTime = now - frame.wakeUpTime;
+            m_Stats.cpuFrameTime = m_Stats.cpuFrameTime == 0.0 ? cpuFrameTime : m_Stats.cpuFrameTime + (cpuFrameTime - m_Stats.cpuFrameTime) * m_Desc.smoothing;
+
+            m_SubmittedNum = frameIndex + 1;
+        }
+        m_Condition.notify_one();
+    }
+
+private:
+    static inline double GetTime() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Returns OS sleep overshoot
+    static inline double SleepUntil(double time, double spinThreshold) {
+        double oversleep = 0.0;
+
+        double now = GetTime();
+        double osSleepTime = time - now - spinThreshold;
+        if (osSleepTime > 0.0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(int64_t(osSleepTime * 1000.0)));
+
+            oversleep = GetTime() - (now + osSleepTime);
+        }
+
+        while (GetTime() < time)
+            std::this_thread::yield();
+
+        return oversleep;
+    }
+
+    // Under the lock
+    inline void UpdateStats() {
+        // Not consumed frames are dropped (the consumer is optional)
+        if (m_CompletedFrames.size() > HISTORY_SIZE)
+            m_CompletedFrames.clear();
+
+        for (; m_ProcessedNum < m_CompletedNum; m_ProcessedNum++) {
+            const FramePacerFrame& frame = m_Frames[m_ProcessedNum % HISTORY_SIZE];
+            m_CompletedFrames.push_back(frame);
+
+            double startTime = frame.submitTime;
+            if (m_ProcessedNum)
+                startTime = std::max(startTime, m_Frames[(m_ProcessedNum - 1) % HISTORY_SIZE].doneTime);
+
+            double gpuFrameTime = frame.doneTime - startTime;
+            m_Stats.gpuFrameTime = m_Stats.gpuFrameTime == 0.0 ? gpuFrameTime : m_Stats.gpuFrameTime + (gpuFrameTime - m_Stats.gpuFrameTime) * m_Desc.smoothing;
+
+            m_Latencies[m_LatencyNum % WINDOW_SIZE] = frame.doneTime - frame.wakeUpTime;
+            m_LatencyNum++;
+        }
+
+        uint32_t latencyNum = std::min(m_LatencyNum, WINDOW_SIZE);
+        if (!latencyNum)
+            return;
+
+        double sum = 0.0;
+        double sumSq = 0.0;
+        for (uint32_t i = 0; i < latencyNum; i++) {
+            sum += m_Latencies[i];
+            sumSq += m_Latencies[i] * m_Latencies[i];
+        }
+
+        double mean = sum / latencyNum;
+        m_Stats.latency = mean;
+        m_Stats.latencyJitter = sqrt(std::max(sumSq / latencyNum - mean * mean, 0.0));
+    }
+
+    inline void ThreadEntryPoint() {
+        for (uint32_t frameIndex = 0;; frameIndex++) {
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Condition.wait(lock, [this, frameIndex] { return m_Quit || m_SubmittedNum > frameIndex; });
+
+                // Submitted frames are waited for even on quit (the GPU is idle by then)
+                if (m_SubmittedNum <= frameIndex)
+                    break;
+            }
+
+            m_NRI->Wait(*m_Fence, 1 + frameIndex);
+
+            double now = GetTime();
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Frames[frameIndex % HISTORY_SIZE].doneTime = now;
+                m_CompletedNum = frameIndex + 1;
+            }
+        }
+    }
+
+    inline void StopThread() {
+        if (!m_Thread.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Quit = true;
+        }
+        m_Condition.notify_all();
+
+        m_Thread.join();
+    }
+
+private:
+    std::array<FramePacerFrame, HISTORY_SIZE> m_Frames = {};
+    std::array<double, WINDOW_SIZE> m_Latencies = {};
+    std::vector<FramePacerFrame> m_CompletedFrames;
+    FramePacerDesc m_Desc = {};
+    FramePacerStats m_Stats = {};
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    const nri::CoreInterface* m_NRI = nullptr;
+    nri::Fence* m_Fence = nullptr;
+    uint32_t m_SubmittedNum = 0;
+    uint32_t m_CompletedNum = 0;
+    uint32_t m_ProcessedNum = 0;
+    uint32_t m_LatencyNum = 0;
+    std::atomic<bool> m_IsEnabled = false;
+    bool m_Quit = false;
+};
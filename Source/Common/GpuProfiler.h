@@ -0,0 +1,352 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Hierarchical GPU profiler based on timestamp queries:
+//  - "GpuProfilerScope" replaces "helper::Annotation": it emits the same annotation and a pair of timestamps around the scope
+//  - every queued frame has its own range in the query pool and in the readback buffer, i.e. results are read only after
+//    the frame fence has been waited for ("BeginFrame"), there are no stalls
+//  - "CmdBeginFrame" (resets queries) must be recorded before any scope of the frame, "CmdEndFrame" (copies queries) after
+//    all scopes, both outside of rendering
+//  - scopes can be recorded from several threads (into different command buffers), the hierarchy is restored from timestamps:
+//    a scope nested into another one (in time) is its child
+//  - "DrawImgui" shows the hierarchy of the last resolved frame (smoothed), "WriteChromeTrace" dumps recent frames into
+//    a JSON file for "chrome://tracing" or "ui.perfetto.dev"
+// Timestamps from different queues are not comparable, a profiler is expected to be used with one queue
+// Scope names must be string literals (or outlive the profiler)
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+struct GpuProfilerScopeRecord {
+    const char* name;
+};
+
+struct GpuProfilerScopeResult {
+    const char* name;
+    double begin;    // ms, from the first timestamp of the frame
+    double duration; // ms
+    double smoothedDuration;
+    uint32_t depth;
+};
+
+struct GpuProfilerTraceEvent {
+    const char* name;
+    double begin;    // us, from the first resolved timestamp
+    double duration; // us
+    uint32_t depth;
+    uint32_t frameIndex;
+};
+
+struct GpuProfilerQueuedFrame {
+    std::vector<GpuProfilerScopeRecord> records;
+    std::atomic_uint32_t recordNum;
+    uint32_t frameIndex;
+    bool isRecorded;
+};
+
+class GpuProfiler {
+public:
+    static constexpr uint32_t TRACE_FRAME_NUM = 120;
+
+    inline void Initialize(const nri::CoreInterface& NRI, nri::Device& device, uint32_t queuedFrameNum, uint32_t scopeMaxNum = 256) {
+        m_NRI = &NRI;
+        m_Device = &device;
+        m_ScopeMaxNum = scopeMaxNum;
+
+        const nri::DeviceDesc& deviceDesc = m_NRI->GetDeviceDesc(*m_Device);
+        m_TimestampPeriod = 1000.0 / double(deviceDesc.other.timestampFrequencyHz);
+
+        nri::QueryPoolDesc queryPoolDesc = {};
+        queryPoolDesc.queryType = nri::QueryType::TIMESTAMP;
+        queryPoolDesc.capacity = queuedFrameNum * scopeMaxNum * 2;
+        NRI_ABORT_ON_FAILURE(m_NRI->CreateQueryPool(*m_Device, queryPoolDesc, m_QueryPool));
+
+        m_QuerySize = m_NRI->GetQuerySize(*m_QueryPool);
+
+        const nri::BufferDesc bufferDesc = {queryPoolDesc.capacity * m_QuerySize, 0, nri::BufferUsageBits::NONE};
+        NRI_ABORT_ON_FAILURE(m_NRI->CreateBuffer(*m_Device, bufferDesc, m_ReadbackBuffer));
+
+        nri::MemoryDesc memoryDesc = {};
+        m_NRI->GetBufferMemoryDesc(*m_ReadbackBuffer, nri::MemoryLocation::HOST_READBACK, memoryDesc);
+
+        nri::AllocateMemoryDesc allocateMemoryDesc = {};
+        allocateMemoryDesc.size = memoryDesc.size;
+        allocateMemoryDesc.type = memoryDesc.type;
+        NRI_ABORT_ON_FAILURE(m_NRI->AllocateMemory(*m_Device, allocateMemoryDesc, m_ReadbackMemory));
+
+        const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {m_ReadbackBuffer, m_ReadbackMemory};
+        NRI_ABORT_ON_FAILURE(m_NRI->BindBufferMemory(&bufferMemoryBindingDesc, 1));
+
+        m_QueuedFrames.resize(queuedFrameNum);
+        for (std::unique_ptr<GpuProfilerQueuedFrame>& queuedFrame : m_QueuedFrames) {
+            queuedFrame = std::make_unique<GpuProfilerQueuedFrame>();
+            queuedFrame->records.resize(scopeMaxNum);
+            queuedFrame->recordNum = 0;
+            queuedFrame->frameIndex = 0;
+            queuedFrame->isRecorded = false;
+        }
+    }
+
+    inline void Destroy() {
+        if (!m_NRI)
+            return;
+
+        m_NRI->DestroyQueryPool(m_QueryPool);
+        m_NRI->DestroyBuffer(m_ReadbackBuffer);
+        m_NRI->FreeMemory(m_ReadbackMemory);
+
+        m_QueryPool = nullptr;
+        m_ReadbackBuffer = nullptr;
+        m_ReadbackMemory = nullptr;
+
+        m_QueuedFrames.clear();
+        m_NRI = nullptr;
+    }
+
+    // Call after waiting for the queued frame, resolves its previous results
+    inline void BeginFrame(uint32_t frameIndex, uint32_t queuedFrameIndex) {
+        GpuProfilerQueuedFrame& queuedFrame = *m_QueuedFrames[queuedFrameIndex];
+        if (queuedFrame.isRecorded)
+            Resolve(queuedFrameIndex);
+
+        queuedFrame.recordNum = 0;
+        queuedFrame.frameIndex = frameIndex;
+        queuedFrame.isRecorded = false;
+
+        m_QueuedFrameIndex = queuedFrameIndex;
+    }
+
+    inline void CmdBeginFrame(nri::CommandBuffer& commandBuffer) {
+        m_NRI->CmdResetQueries(commandBuffer, *m_QueryPool, m_QueuedFrameIndex * m_ScopeMaxNum * 2, m_ScopeMaxNum * 2);
+    }
+
+    inline void CmdEndFrame(nri::CommandBuffer& commandBuffer) {
+        GpuProfilerQueuedFrame& queuedFrame = *m_QueuedFrames[m_QueuedFrameIndex];
+
+        uint32_t recordNum = std::min(queuedFrame.recordNum.load(std::memory_order_acquire), m_ScopeMaxNum);
+        if (recordNum) {
+            uint32_t queryOffset = m_QueuedFrameIndex * m_ScopeMaxNum * 2;
+            m_NRI->CmdCopyQueries(commandBuffer, *m_QueryPool, queryOffset, recordNum * 2, *m_ReadbackBuffer, queryOffset * m_QuerySize);
+        }
+
+        queuedFrame.recordNum = recordNum; // scopes recorded after "CmdEndFrame" are lost
+        queuedFrame.isRecorded = true;
+    }
+
+    // Returns the scope index or "uint32_t(-1)" if out of queries, thread safe
+    inline uint32_t CmdBeginScope(nri::CommandBuffer& commandBuffer, const char* name) {
+        GpuProfilerQueuedFrame& queuedFrame = *m_QueuedFrames[m_QueuedFrameIndex];
+
+        uint32_t scopeIndex = queuedFrame.recordNum.fetch_add(1, std::memory_order_relaxed);
+        if (scopeIndex >= m_ScopeMaxNum)
+            return uint32_t(-1);
+
+        queuedFrame.records[scopeIndex].name = name;
+        m_NRI->CmdEndQuery(commandBuffer, *m_QueryPool, (m_QueuedFrameIndex * m_ScopeMaxNum + scopeIndex) * 2);
+
+        return scopeIndex;
+    }
+
+    inline void CmdEndScope(nri::CommandBuffer& commandBuffer, uint32_t scopeIndex) {
+        if (scopeIndex < m_ScopeMaxNum)
+            m_NRI->CmdEndQuery(commandBuffer, *m_QueryPool, (m_QueuedFrameIndex * m_ScopeMaxNum + scopeIndex) * 2 + 1);
+    }
+
+    // The last resolved frame, ordered depth-first
+    inline const std::vector<GpuProfilerScopeResult>& GetResults() const {
+        return m_Results;
+    }
+
+    // ms, from the first "begin" to the last "end"
+    inline double GetFrameTime() const {
+        return m_FrameTime;
+    }
+
+    inline void DrawImgui() {
+        ImGui::Text("GPU frame: %.3f ms", m_FrameTime);
+
+        if (ImGui::BeginTable("GPU scopes", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+            ImGui::TableSetupColumn("Scope");
+            ImGui::TableSetupColumn("Time");
+            ImGui::TableSetupColumn("Frame %");
+            ImGui::TableHeadersRow();
+
+            for (const GpuProfilerScopeResult& result : m_Results) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%*s%s", result.depth * 2, "", result.name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f ms", result.smoothedDuration);
+                ImGui::TableNextColumn();
+                ImGui::ProgressBar(m_FrameTime > 0.0 ? float(result.duration / m_FrameTime) : 0.0f, ImVec2(100.0f, 0.0f));
+            }
+
+            ImGui::EndTable();
+        }
+    }
+
+    // Chrome trace event format ("X" events, nesting is derived from time ranges)
+    inline bool WriteChromeTrace(const char* path) const {
+        FILE* file = fopen(path, "w");
+        if (!file) {
+            printf("GPU profiler: can't write '%s'\n", path);
+            return false;
+        }
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+
+        for (const GpuProfilerTraceEvent& event : m_TraceEvents) {
+            fprintf(file, ",\n{\"name\":\"");
+            for (const char* c = event.name; *c; c++) {
+                if (*c == '"' || *c == '\\')
+                    fputc('\\', file);
+                fputc(*c, file);
+            }
+            fprintf(file, "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u,\"depth\":%u}}", event.begin, event.duration, event.frameIndex, event.depth);
+        }
+
+        fprintf(file, "\n]}\n");
+        fclose(file);
+
+        printf("GPU profiler: saved to '%s'\n", path);
+
+        return true;
+    }
+
+private:
+    struct Interval {
+        uint64_t begin;
+        uint64_t end;
+        uint32_t recordIndex;
+    };
+
+    inline void Resolve(uint32_t queuedFrameIndex) {
+        const GpuProfilerQueuedFrame& queuedFrame = *m_QueuedFrames[queuedFrameIndex];
+        const uint32_t recordNum = queuedFrame.recordNum;
+
+        std::vector<Interval> intervals;
+        intervals.reserve(recordNum);
+
+        if (recordNum) {
+            uint64_t queryOffset = queuedFrameIndex * m_ScopeMaxNum * 2;
+            const uint8_t* data = (uint8_t*)m_NRI->MapBuffer(*m_ReadbackBuffer, queryOffset * m_QuerySize, recordNum * 2 * m_QuerySize);
+            if (data) {
+                for (uint32_t i = 0; i < recordNum; i++) {
+                    uint64_t begin = *(const uint64_t*)(data + (i * 2) * m_QuerySize);
+                    uint64_t end = *(const uint64_t*)(data + (i * 2 + 1) * m_QuerySize);
+                    if (end >= begin)
+                        intervals.push_back({begin, end, i});
+                }
+
+                m_NRI->UnmapBuffer(*m_ReadbackBuffer);
+            }
+        }
+
+        // Parents first: earlier begin, then longer duration
+        std::sort(intervals.begin(), intervals.end(), [](const Interval& a, const Interval& b) {
+            return a.begin != b.begin ? a.begin < b.begin : a.end > b.end;
+        });
+
+        std::vector<GpuProfilerScopeResult> previousResults;
+        previousResults.swap(m_Results);
+
+        m_FrameTime = 0.0;
+        if (intervals.empty())
+            return;
+
+        const uint64_t frameBegin = intervals.front().begin;
+        uint64_t frameEnd = frameBegin;
+
+        if (!m_IsTraceOriginSet) {
+            m_TraceOrigin = frameBegin;
+            m_IsTraceOriginSet = true;
+        }
+
+        // Drop the oldest frame from the trace
+        if (m_TraceFrameNum == TRACE_FRAME_NUM) {
+            uint32_t oldestFrameIndex = m_TraceEvents.front().frameIndex;
+
+            size_t i = 0;
+            while (i < m_TraceEvents.size() && m_TraceEvents[i].frameIndex == oldestFrameIndex)
+                i++;
+
+            m_TraceEvents.erase(m_TraceEvents.begin(), m_TraceEvents.begin() + i);
+            m_TraceFrameNum--;
+        }
+
+        std::vector<uint64_t> stack; // ends of open scopes
+        for (const Interval& interval : intervals) {
+            while (!stack.empty() && interval.begin >= stack.back())
+                stack.pop_back();
+
+            GpuProfilerScopeResult& result = m_Results.emplace_back();
+            result.name = queuedFrame.records[interval.recordIndex].name;
+            result.begin = double(interval.begin - frameBegin) * m_TimestampPeriod;
+            result.duration = double(interval.end - interval.begin) * m_TimestampPeriod;
+            result.depth = (uint32_t)stack.size();
+
+            // Smooth if the hierarchy hasn't changed
+            size_t i = m_Results.size() - 1;
+            bool isSame = i < previousResults.size() && previousResults[i].name == result.name && previousResults[i].depth == result.depth;
+            result.smoothedDuration = isSame ? previousResults[i].smoothedDuration * 0.9 + result.duration * 0.1 : result.duration;
+
+            GpuProfilerTraceEvent& event = m_TraceEvents.emplace_back();
+            event.name = result.name;
+            event.begin = double(interval.begin - m_TraceOrigin) * m_TimestampPeriod * 1000.0;
+            event.duration = result.duration * 1000.0;
+            event.depth = result.depth;
+            event.frameIndex = queuedFrame.frameIndex;
+
+            stack.push_back(interval.end);
+            frameEnd = std::max(frameEnd, interval.end);
+        }
+
+        m_FrameTime = double(frameEnd - frameBegin) * m_TimestampPeriod;
+        m_TraceFrameNum++;
+    }
+
+private:
+    const nri::CoreInterface* m_NRI = nullptr;
+    nri::Device* m_Device = nullptr;
+    nri::QueryPool* m_QueryPool = nullptr;
+    nri::Buffer* m_ReadbackBuffer = nullptr;
+    nri::Memory* m_ReadbackMemory = nullptr;
+    std::vector<std::unique_ptr<GpuProfilerQueuedFrame>> m_QueuedFrames; // "std::atomic" is not movable
+    std::vector<GpuProfilerScopeResult> m_Results;
+    std::vector<GpuProfilerTraceEvent> m_TraceEvents;
+    double m_TimestampPeriod = 0.0; // ms
+    double m_FrameTime = 0.0;
+    uint64_t m_QuerySize = 0;
+    uint64_t m_TraceOrigin = 0;
+    uint32_t m_ScopeMaxNum = 0;
+    uint32_t m_QueuedFrameIndex = 0;
+    uint32_t m_TraceFrameNum = 0;
+    bool m_IsTraceOriginSet = false;
+};
+
+// A drop-in replacement for "helper::Annotation"
+class GpuProfilerScope {
+public:
+    inline GpuProfilerScope(GpuProfiler& profiler, const nri::CoreInterface& NRI, nri::CommandBuffer& commandBuffer, const char* name)
+        : m_Annotation(NRI, commandBuffer, name)
+        , m_Profiler(profiler)
+        , m_CommandBuffer(commandBuffer) {
+        m_ScopeIndex = m_Profiler.CmdBeginScope(m_CommandBuffer, name);
+    }
+
+    inline ~GpuProfilerScope() {
+        m_Profiler.CmdEndScope(m_CommandBuffer, m_ScopeIndex);
+    }
+
+private:
+    helper::Annotation m_Annotation;
+    GpuProfiler& m_Profiler;
+    nri::CommandBuffer& m_CommandBuffer;
+    uint32_t m_ScopeIndex;
+};
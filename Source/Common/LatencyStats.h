@@ -0,0 +1,291 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Rolling latency statistics, tail latency oriented:
+//  - "Add" takes per-frame durations of latency segments (from "nri::LatencyReport" or "FramePacer" timings)
+//  - percentiles (p50, p95, p99), max and mean are computed per segment over the last "window" frames ("SetWindow"), for display
+//    they are refreshed a few times per second, "GetPercentiles" always returns up-to-date values
+//  - "DrawImgui" shows a table and a histogram of the selected segment (up to "max", p99 marked)
+//  - while recording ("SetRecording"), every frame is also logged, "WriteCsv" dumps the log (a row per frame)
+// "group" is a user-defined tag of a frame (for example, a benchmark configuration), it goes into the CSV as is
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <vector>
+
+enum class LatencySegment : uint8_t {
+    INPUT_TO_SIMULATION,
+    SIMULATION_TO_RENDER,
+    RENDER_TO_PRESENT,
+    PRESENT_TO_GPU,
+    TOTAL,
+
+    MAX_NUM
+};
+
+struct LatencyStatsFrame {
+    std::array<float, (size_t)LatencySegment::MAX_NUM> segments; // ms
+    uint32_t frameIndex;
+    uint32_t group;
+};
+
+struct LatencyStatsPercentiles {
+    float p50;
+    float p95;
+    float p99;
+    float max;
+    float mean;
+};
+
+class LatencyStats {
+public:
+    static constexpr uint32_t WINDOW_MAX_SIZE = 10000;
+    static constexpr uint32_t HISTOGRAM_BIN_NUM = 48;
+    static constexpr double UPDATE_PERIOD = 250.0; // ms, for "DrawImgui"
+
+    inline LatencyStats() {
+        m_Window.resize(WINDOW_MAX_SIZE);
+    }
+
+    static inline const char* GetSegmentName(LatencySegment segment) {
+        static const char* names[] = {
+            "Input - Simulation",
+            "Simulation - Render",
+            "Render - Present",
+            "Present - GPU",
+            "Total",
+        };
+        static_assert(sizeof(names) / sizeof(names[0]) == (size_t)LatencySegment::MAX_NUM, "Must match 'LatencySegment'");
+
+        return names[(size_t)segment];
+    }
+
+    inline void SetWindow(uint32_t frameNum) {
+        m_WindowSize = std::clamp(frameNum, 1u, WINDOW_MAX_SIZE);
+        m_IsDirty = true;
+    }
+
+    inline uint32_t GetWindow() const {
+        return m_WindowSize;
+    }
+
+    inline void SetRecording(bool enabled) {
+        m_IsRecording = enabled;
+    }
+
+    inline bool IsRecording() const {
+        return m_IsRecording;
+    }
+
+    inline void ClearRecording() {
+        m_Log.clear();
+    }
+
+    inline uint32_t GetFrameNum() const {
+        return std::min(m_FrameNum, m_WindowSize);
+    }
+
+    // Clears the window (not the log)
+    inline void Reset() {
+        m_FrameNum = 0;
+        m_IsDirty = true;
+    }
+
+    inline void Add(const LatencyStatsFrame& frame) {
+        m_Window[m_FrameNum % WINDOW_MAX_SIZE] = frame;
+        m_FrameNum++;
+        m_IsDirty = true;
+
+        if (m_IsRecording)
+            m_Log.push_back(frame);
+    }
+
+    inline const LatencyStatsPercentiles& GetPercentiles(LatencySegment segment) {
+        Update(true);
+
+        return m_Percentiles[(size_t)segment];
+    }
+
+    inline void DrawImgui() {
+        Update(false);
+
+        uint32_t frameNum = GetFrameNum();
+        ImGui::Text("Frames: %u / %u%s", frameNum, m_WindowSize, m_IsRecording ? " (recording)" : "");
+
+        if (ImGui::BeginTable("Latency", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+            ImGui::TableSetupColumn("Segment (ms)");
+            ImGui::TableSetupColumn("p50");
+            ImGui::TableSetupColumn("p95");
+            ImGui::TableSetupColumn("p99");
+            ImGui::TableSetupColumn("max");
+            ImGui::TableSetupColumn("mean");
+            ImGui::TableHeadersRow();
+
+            for (size_t i = 0; i < (size_t)LatencySegment::MAX_NUM; i++) {
+                const LatencyStatsPercentiles& percentiles = m_Percentiles[i];
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                if (ImGui::Selectable(GetSegmentName((LatencySegment)i), m_HistogramSegment == (LatencySegment)i, ImGuiSelectableFlags_SpanAllColumns)) {
+                    m_HistogramSegment = (LatencySegment)i;
+                    m_IsHistogramDirty = true;
+                }
+                ImGui::TableNextColumn();
+                ImGui::Text("%6.2f", percentiles.p50);
+                ImGui::TableNextColumn();
+                ImGui::Text("%6.2f", percentiles.p95);
+                ImGui::TableNextColumn();
+                ImGui::Text("%6.2f", percentiles.p99);
+                ImGui::TableNextColumn();
+                ImGui::Text("%6.2f", percentiles.max);
+                ImGui::TableNextColumn();
+                ImGui::Text("%6.2f", percentiles.mean);
+            }
+
+            ImGui::EndTable();
+        }
+
+        // Histogram of the selected segment
+        if (m_IsHistogramDirty)
+            UpdateHistogram();
+
+        const LatencyStatsPercentiles& percentiles = m_Percentiles[(size_t)m_HistogramSegment];
+
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "0 - %.2f ms, p99 %.2f ms", percentiles.max, percentiles.p99);
+
+        ImVec2 size = ImVec2(ImGui::GetContentRegionAvail().x, 80.0f);
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        ImGui::PlotHistogram("##Histogram", m_Histogram.data(), HISTOGRAM_BIN_NUM, 0, overlay, 0.0f, FLT_MAX, size);
+
+        if (percentiles.max > 0.0f) {
+            float x = origin.x + size.x * percentiles.p99 / percentiles.max;
+            ImGui::GetWindowDrawList()->AddLine(ImVec2(x, origin.y), ImVec2(x, origin.y + size.y), IM_COL32(255, 60, 60, 255));
+        }
+    }
+
+    inline bool WriteCsv(const char* path) const {
+        FILE* file = fopen(path, "w");
+        if (!file) {
+            printf("Latency stats: can't write '%s'\n", path);
+            return false;
+        }
+
+        fprintf(file, "frame,group");
+        for (size_t i = 0; i < (size_t)LatencySegment::MAX_NUM; i++)
+            fprintf(file, ",\"%s (ms)\"", GetSegmentName((LatencySegment)i));
+        fprintf(file, "\n");
+
+        for (const LatencyStatsFrame& frame : m_Log) {
+            fprintf(file, "%u,%u", frame.frameIndex, frame.group);
+            for (float segment : frame.segments)
+                fprintf(file, ",%.4f", segment);
+            fprintf(file, "\n");
+        }
+
+        fclose(file);
+
+        printf("Latency stats: %u frames saved to '%s'\n", (uint32_t)m_Log.size(), path);
+
+        return true;
+    }
+
+private:
+    // "i = 0" is the oldest frame in the window
+    inline const LatencyStatsFrame& GetWindowFrame(uint32_t i) const {
+        uint32_t frameNum = GetFrameNum();
+
+        return m_Window[(m_FrameNum - frameNum + i) % WINDOW_MAX_SIZE];
+    }
+
+    static inline double GetTime() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    inline void Update(bool force) {
+        if (!m_IsDirty)
+            return;
+
+        double time = GetTime();
+        if (!force && time - m_UpdateTime < UPDATE_PERIOD)
+            return;
+
+        m_UpdateTime = time;
+        m_IsDirty = false;
+        m_IsHistogramDirty = true;
+
+        uint32_t frameNum = GetFrameNum();
+        for (size_t i = 0; i < (size_t)LatencySegment::MAX_NUM; i++) {
+            LatencyStatsPercentiles& percentiles = m_Percentiles[i];
+            percentiles = {};
+
+            if (!frameNum)
+                continue;
+
+            m_Values.resize(frameNum);
+
+            // Max and mean in the same pass
+            double sum = 0.0;
+            float max = -FLT_MAX;
+            for (uint32_t j = 0; j < frameNum; j++) {
+                float value = GetWindowFrame(j).segments[i];
+                m_Values[j] = value;
+                sum += value;
+                max = std::max(max, value);
+            }
+
+            // Nearest rank, no full sort: ranks go in ascending order, each selection partitions only the tail after the previous one
+            uint32_t first = 0;
+            auto percentile = [&](float p) {
+                uint32_t k = std::clamp((uint32_t)ceilf(p * frameNum), 1u, frameNum) - 1;
+                if (k >= first) {
+                    std::nth_element(m_Values.begin() + first, m_Values.begin() + k, m_Values.end());
+                    first = k + 1;
+                }
+
+                return m_Values[k];
+            };
+
+            percentiles.p50 = percentile(0.50f);
+            percentiles.p95 = percentile(0.95f);
+            percentiles.p99 = percentile(0.99f);
+            percentiles.max = max;
+            percentiles.mean = float(sum / frameNum);
+        }
+    }
+
+    inline void UpdateHistogram() {
+        m_IsHistogramDirty = false;
+        m_Histogram = {};
+
+        const LatencyStatsPercentiles& percentiles = m_Percentiles[(size_t)m_HistogramSegment];
+        float binSize = percentiles.max > 0.0f ? percentiles.max / HISTOGRAM_BIN_NUM : 1.0f;
+
+        uint32_t frameNum = GetFrameNum();
+        for (uint32_t i = 0; i < frameNum; i++) {
+            float value = GetWindowFrame(i).segments[(size_t)m_HistogramSegment];
+            uint32_t bin = std::min((uint32_t)(std::max(value, 0.0f) / binSize), HISTOGRAM_BIN_NUM - 1);
+            m_Histogram[bin] += 1.0f;
+        }
+    }
+
+private:
+    std::vector<LatencyStatsFrame> m_Window; // ring
+    std::vector<LatencyStatsFrame> m_Log;
+    std::vector<float> m_Values; // scratch, partially ordered
+    std::array<LatencyStatsPercentiles, (size_t)LatencySegment::MAX_NUM> m_Percentiles = {};
+    std::array<float, HISTOGRAM_BIN_NUM> m_Histogram = {};
+    double m_UpdateTime = 0.0;
+    uint32_t m_WindowSize = 1000;
+    uint32_t m_FrameNum = 0;
+    LatencySegment m_HistogramSegment = LatencySegment::TOTAL;
+    bool m_IsRecording = false;
+    bool m_IsDirty = true;
+    bool m_IsHistogramDirty = true;
+};
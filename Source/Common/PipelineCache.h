@@ -0,0 +1,225 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Persistent pipeline cache, shared by all samples:
+//  - "Preload" starts reading "_Cache/<sample>.<api>.bin" in background right after adapter selection (overlaps with device creation)
+//  - "Create" waits for the blob and creates "nri::PipelineCache" from it (or an empty one, if the blob is missing, foreign or corrupted)
+//  - "Save" writes the blob back atomically (temporary file + rename), "Destroy" releases the cache
+// The blob is prefixed with a header keyed by graphics API, adapter UID, device ID, vendor and driver version,
+// i.e. a blob produced on another adapter or driver is never fed to the driver
+
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+#include <vector>
+
+#define PIPELINE_CACHE_STRINGIFY_(x) #x
+#define PIPELINE_CACHE_STRINGIFY(x)  PIPELINE_CACHE_STRINGIFY_(x)
+
+#ifdef PROJECT_NAME
+#    define PIPELINE_CACHE_SAMPLE_NAME PIPELINE_CACHE_STRINGIFY(PROJECT_NAME)
+#else
+#    define PIPELINE_CACHE_SAMPLE_NAME "Sample"
+#endif
+
+constexpr const char* PIPELINE_CACHE_DIR = "_Cache";
+constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x4349524E; // "NRIC"
+constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+struct PipelineCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t uidLow;
+    uint64_t uidHigh;
+    uint32_t deviceId;
+    uint32_t driverVersion;
+    uint32_t vendor;
+    uint32_t graphicsAPI;
+    uint64_t dataSize;
+    uint64_t checksum;
+};
+
+class PersistentPipelineCache {
+public:
+    inline ~PersistentPipelineCache() {
+        if (m_Preload.valid())
+            m_Preload.wait();
+    }
+
+    inline nri::PipelineCache* Get() const {
+        return m_PipelineCache;
+    }
+
+    inline void Preload(nri::GraphicsAPI graphicsAPI, const nri::AdapterDesc& adapterDesc) {
+        if (m_Preload.valid())
+            m_Preload.wait();
+
+        m_Key = {};
+        m_Key.magic = PIPELINE_CACHE_MAGIC;
+        m_Key.version = PIPELINE_CACHE_VERSION;
+        m_Key.uidLow = adapterDesc.uid.low;
+        m_Key.uidHigh = adapterDesc.uid.high;
+        m_Key.deviceId = adapterDesc.deviceId;
+        m_Key.driverVersion = adapterDesc.driverVersion;
+        m_Key.vendor = (uint32_t)adapterDesc.vendor;
+        m_Key.graphicsAPI = (uint32_t)graphicsAPI;
+
+        m_Path = std::string(PIPELINE_CACHE_DIR) + "/" + PIPELINE_CACHE_SAMPLE_NAME + "." + nri::nriGetGraphicsAPIString(graphicsAPI) + ".bin";
+
+        m_Preload = std::async(std::launch::async, Load, m_Path, m_Key);
+    }
+
+    inline void Create(const nri::CoreInterface& NRI, nri::Device& device) {
+        std::vector<uint8_t> blob;
+        if (m_Preload.valid())
+            blob = m_Preload.get();
+
+        const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(device);
+        if (!deviceDesc.features.pipelineCache) {
+            printf("Pipeline cache: unsupported\n");
+            return;
+        }
+
+        nri::PipelineCacheDesc pipelineCacheDesc = {};
+        pipelineCacheDesc.data = blob.empty() ? nullptr : blob.data();
+        pipelineCacheDesc.size = blob.size();
+
+        nri::Result result = NRI.CreatePipelineCache(device, pipelineCacheDesc, m_PipelineCache);
+        if (result == nri::Result::OUT_OF_DATE) {
+            printf("Pipeline cache: '%s' is rejected by the driver, starting empty\n", m_Path.c_str());
+
+            pipelineCacheDesc = {};
+            result = NRI.CreatePipelineCache(device, pipelineCacheDesc, m_PipelineCache);
+        }
+
+        if (result != nri::Result::SUCCESS)
+            m_PipelineCache = nullptr;
+    }
+
+    inline void Save(const nri::CoreInterface& NRI) const {
+        if (!m_PipelineCache)
+            return;
+
+        // Not fatal, the device can be lost at this point
+        uint64_t size = 0;
+        if (NRI.GetPipelineCacheData(*m_PipelineCache, nullptr, size) != nri::Result::SUCCESS || !size)
+            return;
+
+        std::vector<uint8_t> blob(size);
+        if (NRI.GetPipelineCacheData(*m_PipelineCache, blob.data(), size) != nri::Result::SUCCESS)
+            return;
+
+        PipelineCacheHeader header = m_Key;
+        header.dataSize = size;
+        header.checksum = ComputeChecksum(blob.data(), size);
+
+        // Write to a temporary file first, the previous blob stays valid if the process dies in the middle
+        std::error_code error;
+        std::filesystem::create_directories(PIPELINE_CACHE_DIR, error);
+
+        std::string tmpPath = m_Path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            file.write((const char*)&header, sizeof(header));
+            file.write((const char*)blob.data(), (std::streamsize)size);
+
+            if (!file) {
+                printf("Pipeline cache: can't write '%s'\n", tmpPath.c_str());
+                return;
+            }
+        }
+
+        std::filesystem::rename(tmpPath, m_Path, error);
+        if (error) {
+            printf("Pipeline cache: can't replace '%s' (%s)\n", m_Path.c_str(), error.message().c_str());
+            std::filesystem::remove(tmpPath, error);
+            return;
+        }
+
+        printf("Pipeline cache: saved %" PRIu64 " bytes to '%s'\n", size, m_Path.c_str());
+    }
+
+    inline void Destroy(const nri::CoreInterface& NRI) {
+        if (m_Preload.valid())
+            m_Preload.wait();
+
+        if (m_PipelineCache)
+            NRI.DestroyPipelineCache(m_PipelineCache);
+
+        m_PipelineCache = nullptr;
+    }
+
+private:
+    // FNV-1a
+    static inline uint64_t ComputeChecksum(const uint8_t* data, uint64_t size) {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (uint64_t i = 0; i < size; i++) {
+            hash ^= data[i];
+            hash *= 0x100000001B3ull;
+        }
+
+        return hash;
+    }
+
+    static inline std::vector<uint8_t> Load(std::string path, PipelineCacheHeader key) {
+        std::vector<uint8_t> blob;
+
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            printf("Pipeline cache: '%s' not found, starting empty\n", path.c_str());
+            return blob;
+        }
+
+        uint64_t fileSize = (uint64_t)file.tellg();
+        file.seekg(0);
+
+        PipelineCacheHeader header = {};
+        if (fileSize < sizeof(header) || !file.read((char*)&header, sizeof(header))) {
+            printf("Pipeline cache: '%s' is truncated, starting empty\n", path.c_str());
+            return blob;
+        }
+
+        if (header.magic != key.magic || header.version != key.version) {
+            printf("Pipeline cache: '%s' has unknown format, starting empty\n", path.c_str());
+            return blob;
+        }
+
+        if (header.uidLow != key.uidLow || header.uidHigh != key.uidHigh || header.deviceId != key.deviceId || header.vendor != key.vendor || header.graphicsAPI != key.graphicsAPI) {
+            printf("Pipeline cache: '%s' belongs to another adapter, starting empty\n", path.c_str());
+            return blob;
+        }
+
+        if (header.driverVersion != key.driverVersion) {
+            printf("Pipeline cache: '%s' belongs to another driver, starting empty\n", path.c_str());
+            return blob;
+        }
+
+        if (header.dataSize != fileSize - sizeof(header)) {
+            printf("Pipeline cache: '%s' is truncated, starting empty\n", path.c_str());
+            return blob;
+        }
+
+        blob.resize(header.dataSize);
+        file.read((char*)blob.data(), (std::streamsize)header.dataSize);
+
+        if (!file || ComputeChecksum(blob.data(), header.dataSize) != header.checksum) {
+            printf("Pipeline cache: '%s' is corrupted, starting empty\n", path.c_str());
+            blob.clear();
+            return blob;
+        }
+
+        printf("Pipeline cache: loaded %" PRIu64 " bytes from '%s'\n", header.dataSize, path.c_str());
+
+        return blob;
+    }
+
+private:
+    std::future<std::vector<uint8_t>> m_Preload;
+    std::string m_Path;
+    PipelineCacheHeader m_Key = {};
+    nri::PipelineCache* m_PipelineCache = nullptr;
+};
@@ -0,0 +1,232 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Graphics pipeline compile scheduler:
+//  - "Compile" creates a pipeline immediately (use it for fallbacks), "Submit" hands a pipeline over to worker threads
+//  - "Submit" deep copies the desc (including shader bytecode), i.e. the caller's desc and shader storage can go out of scope
+//  - "Get" returns the pipeline if it's ready, otherwise the ready pipeline down the fallback chain (never blocks), "nullptr"
+//    if nothing is ready, i.e. a draw must be skipped
+//  - a fallback must be interchangeable (same blending, depth state and discard), otherwise don't use a fallback
+// "Submit" and "Get" must not be called concurrently ("Get" can be called from any number of threads)
+// Semantic names in "VertexAttributeDesc" and entry point names in "ShaderDesc" are not copied and must be string literals
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+constexpr uint32_t PIPELINE_COMPILER_NO_FALLBACK = uint32_t(-1);
+constexpr uint32_t PIPELINE_COMPILER_THREAD_MAX_NUM = 8;
+
+struct PipelineCompilerJob {
+    nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
+    nri::VertexInputDesc vertexInputDesc = {};
+    nri::MultisampleDesc multisampleDesc = {};
+    std::vector<nri::VertexAttributeDesc> vertexAttributeDescs;
+    std::vector<nri::VertexStreamDesc> vertexStreamDescs;
+    std::vector<nri::ColorAttachmentDesc> colorAttachmentDescs;
+    std::vector<nri::ShaderDesc> shaderDescs;
+    std::vector<std::vector<uint8_t>> bytecodes;
+    std::atomic<nri::Pipeline*> pipeline = nullptr;
+    uint32_t fallback = PIPELINE_COMPILER_NO_FALLBACK;
+};
+
+class PipelineCompiler {
+public:
+    inline ~PipelineCompiler() {
+        StopThreads();
+    }
+
+    inline void Initialize(const nri::CoreInterface& NRI, nri::Device& device) {
+        m_NRI = &NRI;
+        m_Device = &device;
+        m_Quit = false;
+
+        // Leave one core for the main thread
+        uint32_t threadNum = std::thread::hardware_concurrency();
+        threadNum = threadNum > 1 ? threadNum - 1 : 1;
+        threadNum = threadNum < PIPELINE_COMPILER_THREAD_MAX_NUM ? threadNum : PIPELINE_COMPILER_THREAD_MAX_NUM;
+
+        for (uint32_t i = 0; i < threadNum; i++)
+            m_Threads.emplace_back(&PipelineCompiler::ThreadEntryPoint, this);
+    }
+
+    inline void Destroy() {
+        StopThreads();
+
+        for (std::unique_ptr<PipelineCompilerJob>& job : m_Jobs) {
+            if (job->pipeline)
+                m_NRI->DestroyPipeline(job->pipeline);
+        }
+
+        m_Jobs.clear();
+        m_PendingNum = 0;
+    }
+
+    // Blocking
+    inline uint32_t Compile(const nri::GraphicsPipelineDesc& graphicsPipelineDesc, uint32_t fallback = PIPELINE_COMPILER_NO_FALLBACK) {
+        uint32_t index = AddJob(graphicsPipelineDesc, fallback);
+        CompileJob(*m_Jobs[index]);
+
+        return index;
+    }
+
+    // Non-blocking
+    inline uint32_t Submit(const nri::GraphicsPipelineDesc& graphicsPipelineDesc, uint32_t fallback = PIPELINE_COMPILER_NO_FALLBACK) {
+        uint32_t index = AddJob(graphicsPipelineDesc, fallback);
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Queue.push_back(m_Jobs[index].get());
+            m_PendingNum++;
+        }
+        m_Condition.notify_one();
+
+        return index;
+    }
+
+    inline nri::Pipeline* Get(uint32_t index) const {
+        while (index != PIPELINE_COMPILER_NO_FALLBACK) {
+            const PipelineCompilerJob& job = *m_Jobs[index];
+
+            nri::Pipeline* pipeline = job.pipeline.load(std::memory_order_acquire);
+            if (pipeline)
+                return pipeline;
+
+            index = job.fallback;
+        }
+
+        return nullptr;
+    }
+
+    inline bool IsReady(uint32_t index) const {
+        return m_Jobs[index]->pipeline.load(std::memory_order_acquire) != nullptr;
+    }
+
+    inline uint32_t GetPipelineNum() const {
+        return (uint32_t)m_Jobs.size();
+    }
+
+    inline uint32_t GetPendingNum() const {
+        return m_PendingNum;
+    }
+
+    inline void WaitIdle() {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_IdleCondition.wait(lock, [this] { return m_PendingNum == 0; });
+    }
+
+private:
+    inline uint32_t AddJob(const nri::GraphicsPipelineDesc& graphicsPipelineDesc, uint32_t fallback) {
+        std::unique_ptr<PipelineCompilerJob> job = std::make_unique<PipelineCompilerJob>();
+        job->fallback = fallback;
+
+        nri::GraphicsPipelineDesc& desc = job->graphicsPipelineDesc;
+        desc = graphicsPipelineDesc;
+
+        if (graphicsPipelineDesc.vertexInput) {
+            const nri::VertexInputDesc& vertexInputDesc = *graphicsPipelineDesc.vertexInput;
+
+            job->vertexAttributeDescs.assign(vertexInputDesc.attributes, vertexInputDesc.attributes + vertexInputDesc.attributeNum);
+            job->vertexStreamDescs.assign(vertexInputDesc.streams, vertexInputDesc.streams + vertexInputDesc.streamNum);
+
+            job->vertexInputDesc = vertexInputDesc;
+            job->vertexInputDesc.attributes = job->vertexAttributeDescs.data();
+            job->vertexInputDesc.streams = job->vertexStreamDescs.data();
+
+            desc.vertexInput = &job->vertexInputDesc;
+        }
+
+        if (graphicsPipelineDesc.multisample) {
+            job->multisampleDesc = *graphicsPipelineDesc.multisample;
+            desc.multisample = &job->multisampleDesc;
+        }
+
+        const nri::OutputMergerDesc& outputMergerDesc = graphicsPipelineDesc.outputMerger;
+        job->colorAttachmentDescs.assign(outputMergerDesc.colors, outputMergerDesc.colors + outputMergerDesc.colorNum);
+        desc.outputMerger.colors = job->colorAttachmentDescs.data();
+
+        job->shaderDescs.assign(graphicsPipelineDesc.shaders, graphicsPipelineDesc.shaders + graphicsPipelineDesc.shaderNum);
+        job->bytecodes.resize(graphicsPipelineDesc.shaderNum);
+
+        for (uint32_t i = 0; i < graphicsPipelineDesc.shaderNum; i++) {
+            nri::ShaderDesc& shaderDesc = job->shaderDescs[i];
+
+            const uint8_t* bytecode = (const uint8_t*)shaderDesc.bytecode;
+            job->bytecodes[i].assign(bytecode, bytecode + shaderDesc.size);
+
+            shaderDesc.bytecode = job->bytecodes[i].data();
+        }
+
+        desc.shaders = job->shaderDescs.data();
+
+        m_Jobs.push_back(std::move(job));
+
+        return (uint32_t)m_Jobs.size() - 1;
+    }
+
+    inline void CompileJob(PipelineCompilerJob& job) {
+        nri::Pipeline* pipeline = nullptr;
+        NRI_ABORT_ON_FAILURE(m_NRI->CreateGraphicsPipeline(*m_Device, job.graphicsPipelineDesc, pipeline));
+
+        job.pipeline.store(pipeline, std::memory_order_release);
+
+        // Not needed anymore
+        job.bytecodes.clear();
+        job.bytecodes.shrink_to_fit();
+    }
+
+    inline void ThreadEntryPoint() {
+        while (true) {
+            PipelineCompilerJob* job = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Condition.wait(lock, [this] { return m_Quit || !m_Queue.empty(); });
+
+                if (m_Quit)
+                    break;
+
+                job = m_Queue.front();
+                m_Queue.pop_front();
+            }
+
+            CompileJob(*job);
+
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_PendingNum--;
+            }
+            m_IdleCondition.notify_all();
+        }
+    }
+
+    inline void StopThreads() {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Quit = true;
+            m_Queue.clear(); // pending jobs are abandoned
+        }
+        m_Condition.notify_all();
+
+        for (std::thread& thread : m_Threads)
+            thread.join();
+
+        m_Threads.clear();
+    }
+
+private:
+    std::vector<std::unique_ptr<PipelineCompilerJob>> m_Jobs;
+    std::vector<std::thread> m_Threads;
+    std::deque<PipelineCompilerJob*> m_Queue;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    std::condition_variable m_IdleCondition;
+    std::atomic_uint32_t m_PendingNum = 0;
+    const nri::CoreInterface* m_NRI = nullptr;
+    nri::Device* m_Device = nullptr;
+    bool m_Quit = false;
+};
@@ -0,0 +1,144 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Adaptive queued frame number ("depth"), looks for the lowest depth, which doesn't drop throughput:
+//  - "Update" takes per-frame measurements: frame time, CPU time blocked on the frame fence (waiting for a queued frame to
+//    retire) and GPU idle time (a gap between frames on the GPU timeline), they are averaged over a window of frames
+//  - CPU waits on the fence, GPU doesn't idle: GPU-bound, frames just sit in the queue adding latency, "depth - 1" is tried
+//  - a trial is rejected (the depth is reverted) if the frame time grows by more than "tolerance" or the GPU starts idling,
+//    a rejected depth is not tried again for a backoff period, which doubles on each rejection
+//  - CPU waits on the fence, GPU idles: CPU and GPU are serialized, the depth is too low, "depth + 1"
+//  - GPU idles, CPU doesn't wait: CPU-bound, the depth doesn't matter
+//  - a few frames after each change are skipped (the queue drains or fills)
+//  - there are no GPU dependencies, the controller can be driven by recorded or synthetic traces
+// The caller must be able to switch the depth at any frame (for example, by cycling over "maxDepth" command allocators)
+
+#include <algorithm>
+#include <array>
+
+struct QueuedFrameControllerDesc {
+    uint32_t minDepth = 1;
+    uint32_t maxDepth = 3;
+    uint32_t settleFrameNum = 16;   // skipped after a change
+    uint32_t windowFrameNum = 60;   // averaged
+    uint32_t backoffFrameNum = 600; // initial, doubles on each rejection
+    uint32_t backoffMaxFrameNum = 9600;
+    float waitThreshold = 0.05f; // fraction of the frame time
+    float idleThreshold = 0.05f; // fraction of the frame time
+    float tolerance = 0.03f;     // allowed frame time growth
+};
+
+// ms
+struct QueuedFrameControllerSample {
+    double frameTime;
+    double fenceWaitTime;
+    double gpuIdleTime;
+};
+
+class QueuedFrameController {
+public:
+    static constexpr uint32_t DEPTH_MAX_NUM = 8;
+
+    inline void Initialize(const QueuedFrameControllerDesc& desc) {
+        m_Desc = desc;
+        m_Desc.maxDepth = std::clamp(m_Desc.maxDepth, 1u, DEPTH_MAX_NUM);
+        m_Desc.minDepth = std::clamp(m_Desc.minDepth, 1u, m_Desc.maxDepth);
+
+        Reset(m_Desc.maxDepth);
+    }
+
+    inline void Reset(uint32_t depth) {
+        m_Depth = std::clamp(depth, m_Desc.minDepth, m_Desc.maxDepth);
+        m_Average = {};
+        m_Sum = {};
+        m_FrameNum = 0;
+        m_PhaseFrameNum = 0;
+        m_ReferenceFrameTime = 0.0;
+        m_IsTrial = false;
+
+        m_BackoffEnd.fill(0);
+        m_BackoffFrameNum.fill(m_Desc.backoffFrameNum);
+    }
+
+    inline uint32_t GetDepth() const {
+        return m_Depth;
+    }
+
+    // Averages over the last window
+    inline const QueuedFrameControllerSample& GetAverage() const {
+        return m_Average;
+    }
+
+    inline bool IsTrial() const {
+        return m_IsTrial;
+    }
+
+    inline uint32_t Update(const QueuedFrameControllerSample& sample) {
+        m_FrameNum++;
+        m_PhaseFrameNum++;
+
+        if (m_PhaseFrameNum <= m_Desc.settleFrameNum)
+            return m_Depth;
+
+        m_Sum.frameTime += sample.frameTime;
+        m_Sum.fenceWaitTime += sample.fenceWaitTime;
+        m_Sum.gpuIdleTime += sample.gpuIdleTime;
+
+        if (m_PhaseFrameNum < m_Desc.settleFrameNum + m_Desc.windowFrameNum)
+            return m_Depth;
+
+        m_Average.frameTime = m_Sum.frameTime / m_Desc.windowFrameNum;
+        m_Average.fenceWaitTime = m_Sum.fenceWaitTime / m_Desc.windowFrameNum;
+        m_Average.gpuIdleTime = m_Sum.gpuIdleTime / m_Desc.windowFrameNum;
+
+        m_Sum = {};
+        m_PhaseFrameNum = 0;
+
+        if (m_Average.frameTime <= 0.0)
+            return m_Depth;
+
+        bool isWaiting = m_Average.fenceWaitTime > m_Average.frameTime * m_Desc.waitThreshold;
+        bool isIdling = m_Average.gpuIdleTime > m_Average.frameTime * m_Desc.idleThreshold;
+
+        if (m_IsTrial) {
+            m_IsTrial = false;
+
+            bool isSlower = m_Average.frameTime > m_ReferenceFrameTime * (1.0 + m_Desc.tolerance);
+            if (isSlower || isIdling) {
+                Reject(m_Depth);
+                m_Depth++;
+            } else
+                m_BackoffFrameNum[m_Depth] = m_Desc.backoffFrameNum;
+        } else if (isWaiting && isIdling) {
+            if (m_Depth < m_Desc.maxDepth) {
+                Reject(m_Depth);
+                m_Depth++;
+            }
+        } else if (isWaiting && m_Depth > m_Desc.minDepth && m_FrameNum >= m_BackoffEnd[m_Depth - 1]) {
+            m_ReferenceFrameTime = m_Average.frameTime;
+            m_IsTrial = true;
+            m_Depth--;
+        }
+
+        return m_Depth;
+    }
+
+private:
+    inline void Reject(uint32_t depth) {
+        m_BackoffEnd[depth] = m_FrameNum + m_BackoffFrameNum[depth];
+        m_BackoffFrameNum[depth] = std::min(m_BackoffFrameNum[depth] * 2, m_Desc.backoffMaxFrameNum);
+    }
+
+private:
+    QueuedFrameControllerDesc m_Desc = {};
+    QueuedFrameControllerSample m_Average = {};
+    QueuedFrameControllerSample m_Sum = {};
+    std::array<uint64_t, DEPTH_MAX_NUM + 1> m_BackoffEnd = {}; // frame, per depth
+    std::array<uint32_t, DEPTH_MAX_NUM + 1> m_BackoffFrameNum = {};
+    uint64_t m_FrameNum = 0;
+    double m_ReferenceFrameTime = 0.0;
+    uint32_t m_PhaseFrameNum = 0;
+    uint32_t m_Depth = 3;
+    bool m_IsTrial = false;
+};
@@ -0,0 +1,232 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// "RayTracingBoxes" scene, shared with the CPU reference tracer ("Tools/RayTracingBoxesReference.cpp"):
+//  - a box (12 triangles), instanced BOX_NUM times on a tilted grid
+//  - instance placement and animation, matching "RayTracingBoxInstances.cs.hlsl"
+//  - materials, matching "RayTracingBoxMaterials.hlsli"
+//  - the camera of "RayTracingBox.rgen.hlsl"
+// No NRI dependency
+
+#include <math.h>
+#include <stdint.h>
+
+#include "../../Shaders/RayTracingBoxInstancesStructs.h"
+
+constexpr uint32_t BOX_NUM = 100000;
+constexpr float BOX_HALF_SIZE = 0.5f;
+constexpr float LINE_WIDTH = 120.0f;
+constexpr uint32_t LINE_SIZE = 100;
+constexpr float CAMERA_POSITION[3] = {0.0f, 0.0f, -2.0f};
+constexpr float CAMERA_T_MIN = 0.001f;
+constexpr float CAMERA_T_MAX = 1000.0f;
+constexpr float MISS_COLOR[3] = {0.4f, 0.3f, 0.35f}; // see "RayTracingBox.rmiss.hlsl"
+
+static const float positions[12 * 6] = {
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    -BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+    BOX_HALF_SIZE,
+};
+
+static const float texCoords[12 * 4] = {
+    0.0f,
+    0.0f,
+    1.0f,
+    0.0f,
+    0.0f,
+    1.0f,
+    1.0f,
+    1.0f,
+    0.0f,
+    0.0f,
+    1.0f,
+    0.0f,
+    0.0f,
+    1.0f,
+    1.0f,
+    1.0f,
+    0.0f,
+    0.0f,
+    1.0f,
+    0.0f,
+    0.0f,
+    1.0f,
+    1.0f,
+    1.0f,
+    0.0f,
+    0.0f,
+    1.0f,
+    0.0f,
+    0.0f,
+    1.0f,
+    1.0f,
+    1.0f,
+    0.0f,
+    0.0f,
+    1.0f,
+    0.0f,
+    0.0f,
+    1.0f,
+    1.0f,
+    1.0f,
+    0.0f,
+    0.0f,
+    1.0f,
+    0.0f,
+    0.0f,
+    1.0f,
+    1.0f,
+    1.0f,
+};
+
+static const uint16_t indices[12 * 3] = {
+    0, 1, 2,
+    1, 2, 3,
+    4, 5, 6,
+    5, 6, 7,
+    8, 9, 10,
+    9, 10, 11,
+    12, 13, 14,
+    13, 14, 15,
+    16, 17, 18,
+    17, 18, 19,
+    20, 21, 22,
+    21, 22, 23};
+
+static inline void GetBoxObject(uint32_t index, BoxObject& object) {
+    const float step = LINE_WIDTH / (LINE_SIZE - 1);
+
+    object.positionX = -LINE_WIDTH * 0.5f + (index % LINE_SIZE) * step;
+    object.positionY = -10.0f + (index / LINE_SIZE) * step;
+    object.positionZ = 10.0f + (index / LINE_SIZE) * step;
+
+    // Diagonal stripes of materials
+    uint32_t material = (index % LINE_SIZE + index / LINE_SIZE) % BOX_MATERIAL_NUM;
+    object.blasIndexMaterialAndMask = 0 | (material << 16) | (0xff << 24);
+}
+
+// Row-major 3x4 (as "TopLevelInstance::transform")
+static inline void GetBoxTransform(const BoxObject& object, uint32_t index, float time, float transform[3][4]) {
+    // Boxes spin and bob, each with its own phase
+    float phase = time + float(index % 97) * 0.1f;
+    float sina = sinf(phase);
+    float cosa = cosf(phase);
+
+    transform[0][0] = cosa;
+    transform[0][1] = 0.0f;
+    transform[0][2] = sina;
+    transform[0][3] = object.positionX;
+    transform[1][0] = 0.0f;
+    transform[1][1] = 1.0f;
+    transform[1][2] = 0.0f;
+    transform[1][3] = object.positionY + sina * 0.25f;
+    transform[2][0] = -sina;
+    transform[2][1] = 0.0f;
+    transform[2][2] = cosa;
+    transform[2][3] = object.positionZ;
+}
+
+// "ShadeBox" of "RayTracingBoxMaterials.hlsli" ("material" is the hit group index)
+static inline void GetBoxColor(uint32_t material, const float texcoords[2], const float barycentrics[3], float color[3]) {
+    if (material == BOX_MATERIAL_BARYCENTRICS) {
+        for (uint32_t i = 0; i < 3; i++)
+            color[i] = barycentrics[i];
+    } else if (material == BOX_MATERIAL_CHECKER) {
+        uint32_t cellX = (uint32_t)(texcoords[0] * 4.0f);
+        uint32_t cellY = (uint32_t)(texcoords[1] * 4.0f);
+        float checker = ((cellX ^ cellY) & 1) ? 0.9f : 0.1f;
+
+        for (uint32_t i = 0; i < 3; i++)
+            color[i] = checker;
+    } else {
+        color[0] = texcoords[0];
+        color[1] = texcoords[1];
+        color[2] = 0.0f;
+    }
+}
+
+// Primary ray of "RayTracingBox.rgen.hlsl" (direction is normalized)
+static inline void GetCameraRayDirection(uint32_t x, uint32_t y, uint32_t width, uint32_t height, float direction[3]) {
+    float u = (float(x) + 0.5f) / float(width) * 2.0f - 1.0f;
+    float v = (float(y) + 0.5f) / float(height) * 2.0f - 1.0f;
+    float aspectRatio = float(width) / float(height);
+
+    direction[0] = u * aspectRatio;
+    direction[1] = -v;
+    direction[2] = 1.0f;
+
+    float invLength = 1.0f / sqrtf(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+    direction[0] *= invLength;
+    direction[1] *= invLength;
+    direction[2] *= invLength;
+}
@@ -0,0 +1,623 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Minimal render graph, rebuilt every frame:
+//  - "BeginFrame" resets the command allocators of a queued frame (the caller must have waited for its completion)
+//  - "ImportTexture" / "ImportBuffer" register external resources, their states are tracked across frames (the initial state
+//    is used only when a resource is seen for the first time), "SetFinalState" marks a resource as a graph output
+//  - "AddPass" adds a pass with an execution callback, "Read" / "Write" declare its resource usage
+//  - "Execute" culls passes not contributing to outputs (or not having side effects), moves "ASYNC_COMPUTE" passes to the
+//    compute queue (if enabled and available), splits passes into batches (one command buffer per batch), inserts barriers
+//    and cross-queue waits, records and submits everything in dependency order
+// Synchronization:
+//  - a barrier is emitted only if the layout changes or there is a hazard involving a write, read-after-read with the same
+//    layout is skipped (or widened, if a new access or stage appears)
+//  - cross-queue dependencies are resolved by waiting for the producer batch fence (each queue has a timeline fence), the
+//    transition is recorded on the consumer queue ("before" access and stages are covered by the wait)
+//  - "AddWait" / "AddSignal" attach external fences (i.e. swap chain semaphores) to the first / last batch on a queue
+// Limitations: no transient resources and aliasing, whole resource barriers only, no queue ownership transfers
+
+#include <array>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+enum class RenderGraphQueue : uint8_t {
+    GRAPHICS,
+    COMPUTE,
+
+    MAX_NUM
+};
+
+enum class RenderGraphPassAffinity : uint8_t {
+    GRAPHICS,
+    ASYNC_COMPUTE // uses only compute and copy commands, can run on the compute queue
+};
+
+typedef std::function<void(nri::CommandBuffer&)> RenderGraphPassCallback;
+
+struct RenderGraphResourceState {
+    nri::AccessLayoutStage state;
+    nri::AccessStage lastWrite; // for read-after-read barriers (visibility of the last write for new stages)
+    uint64_t fenceValue;        // of the last batch using the resource
+    uint32_t batchIndex;        // in the current frame or "NONE"
+    RenderGraphQueue queue;
+    bool isWrite;
+};
+
+struct RenderGraphResource {
+    nri::Texture* texture;
+    nri::Buffer* buffer;
+    const char* name;
+    RenderGraphResourceState* state;
+    nri::AccessLayoutStage finalState;
+    nri::Dim_t mipNum;
+    nri::Dim_t layerNum;
+    bool isOutput;
+};
+
+struct RenderGraphUse {
+    uint32_t resourceIndex;
+    nri::AccessLayoutStage state;
+    bool isWrite;
+};
+
+struct RenderGraphPass {
+    const char* name;
+    RenderGraphPassCallback callback;
+    std::vector<RenderGraphUse> uses;
+    std::vector<nri::TextureBarrierDesc> textureBarriers;
+    std::vector<nri::BufferBarrierDesc> bufferBarriers;
+    RenderGraphPassAffinity affinity;
+    RenderGraphQueue queue;
+    bool hasSideEffects;
+    bool isCulled;
+};
+
+struct RenderGraphBatch {
+    std::vector<uint32_t> passes;
+    std::vector<nri::FenceSubmitDesc> waits;
+    std::vector<nri::TextureBarrierDesc> finalTextureBarriers;
+    std::vector<nri::BufferBarrierDesc> finalBufferBarriers;
+    uint64_t fenceValue;
+    RenderGraphQueue queue;
+};
+
+struct RenderGraphCommandBuffers {
+    nri::CommandAllocator* commandAllocator;
+    std::vector<nri::CommandBuffer*> commandBuffers;
+    uint32_t usedNum;
+};
+
+struct RenderGraphStats {
+    uint32_t passNum;
+    uint32_t culledPassNum;
+    uint32_t asyncPassNum;
+    uint32_t batchNum;
+    uint32_t barrierNum;
+    uint32_t crossQueueWaitNum;
+};
+
+class RenderGraph {
+public:
+    static constexpr uint32_t NONE = uint32_t(-1);
+
+    // "computeQueue" is optional
+    inline void Initialize(const nri::CoreInterface& NRI, nri::Device& device, nri::Queue& graphicsQueue, nri::Queue* computeQueue, uint32_t queuedFrameNum) {
+        m_NRI = &NRI;
+        m_Queues[(size_t)RenderGraphQueue::GRAPHICS] = &graphicsQueue;
+        m_Queues[(size_t)RenderGraphQueue::COMPUTE] = computeQueue;
+
+        for (size_t i = 0; i < (size_t)RenderGraphQueue::MAX_NUM; i++) {
+            if (m_Queues[i])
+                NRI_ABORT_ON_FAILURE(m_NRI->CreateFence(device, 0, m_Fences[i]));
+        }
+
+        m_QueuedFrames.resize(queuedFrameNum);
+        for (std::array<RenderGraphCommandBuffers, (size_t)RenderGraphQueue::MAX_NUM>& queuedFrame : m_QueuedFrames) {
+            for (size_t i = 0; i < (size_t)RenderGraphQueue::MAX_NUM; i++) {
+                queuedFrame[i] = {};
+                if (m_Queues[i])
+                    NRI_ABORT_ON_FAILURE(m_NRI->CreateCommandAllocator(*m_Queues[i], queuedFrame[i].commandAllocator));
+            }
+        }
+    }
+
+    inline void Destroy() {
+        if (!m_NRI)
+            return;
+
+        for (std::array<RenderGraphCommandBuffers, (size_t)RenderGraphQueue::MAX_NUM>& queuedFrame : m_QueuedFrames) {
+            for (RenderGraphCommandBuffers& commandBuffers : queuedFrame) {
+                for (nri::CommandBuffer* commandBuffer : commandBuffers.commandBuffers)
+                    m_NRI->DestroyCommandBuffer(commandBuffer);
+
+                m_NRI->DestroyCommandAllocator(commandBuffers.commandAllocator);
+            }
+        }
+        m_QueuedFrames.clear();
+
+        for (nri::Fence*& fence : m_Fences) {
+            m_NRI->DestroyFence(fence);
+            fence = nullptr;
+        }
+
+        m_States.clear();
+        m_NRI = nullptr;
+    }
+
+    inline void SetAsyncCompute(bool isEnabled) {
+        m_IsAsyncCompute = isEnabled;
+    }
+
+    inline bool HasComputeQueue() const {
+        return m_Queues[(size_t)RenderGraphQueue::COMPUTE] != nullptr;
+    }
+
+    // The last "Execute"
+    inline const RenderGraphStats& GetStats() const {
+        return m_Stats;
+    }
+
+    // Valid after "Execute"
+    inline RenderGraphQueue GetPassQueue(uint32_t passIndex) const {
+        return m_Passes[passIndex].queue;
+    }
+
+    inline bool IsPassCulled(uint32_t passIndex) const {
+        return m_Passes[passIndex].isCulled;
+    }
+
+    inline void BeginFrame(uint32_t queuedFrameIndex) {
+        m_QueuedFrameIndex = queuedFrameIndex;
+
+        for (size_t i = 0; i < (size_t)RenderGraphQueue::MAX_NUM; i++) {
+            RenderGraphCommandBuffers& commandBuffers = m_QueuedFrames[queuedFrameIndex][i];
+            if (commandBuffers.commandAllocator)
+                m_NRI->ResetCommandAllocator(*commandBuffers.commandAllocator);
+
+            commandBuffers.usedNum = 0;
+        }
+
+        m_Resources.clear();
+        m_Passes.clear();
+        m_Batches.clear();
+        m_SubmissionOrder.clear();
+        m_ExternalWaits.clear();
+        m_ExternalSignals.clear();
+    }
+
+    inline uint32_t ImportTexture(const char* name, nri::Texture& texture, const nri::AccessLayoutStage& initialState) {
+        const nri::TextureDesc& textureDesc = m_NRI->GetTextureDesc(texture);
+
+        RenderGraphResource& resource = m_Resources.emplace_back();
+        resource = {};
+        resource.texture = &texture;
+        resource.name = name;
+        resource.state = &GetState(&texture, initialState);
+        resource.mipNum = textureDesc.mipNum;
+        resource.layerNum = textureDesc.layerNum;
+
+        return (uint32_t)m_Resources.size() - 1;
+    }
+
+    inline uint32_t ImportBuffer(const char* name, nri::Buffer& buffer, const nri::AccessStage& initialState) {
+        RenderGraphResource& resource = m_Resources.emplace_back();
+        resource = {};
+        resource.buffer = &buffer;
+        resource.name = name;
+        resource.state = &GetState(&buffer, {initialState.access, nri::Layout::UNDEFINED, initialState.stages});
+
+        return (uint32_t)m_Resources.size() - 1;
+    }
+
+    // The resource is transitioned to "finalState" after the last pass using it (and is a graph output)
+    inline void SetFinalState(uint32_t resourceIndex, const nri::AccessLayoutStage& finalState) {
+        RenderGraphResource& resource = m_Resources[resourceIndex];
+        resource.finalState = finalState;
+        resource.isOutput = true;
+    }
+
+    // Used outside of the graph, i.e. the producers can't be culled
+    inline void SetOutput(uint32_t resourceIndex) {
+        m_Resources[resourceIndex].isOutput = true;
+    }
+
+    inline uint32_t AddPass(const char* name, RenderGraphPassAffinity affinity, RenderGraphPassCallback callback, bool hasSideEffects = false) {
+        RenderGraphPass& pass = m_Passes.emplace_back();
+        pass.name = name;
+        pass.callback = std::move(callback);
+        pass.affinity = affinity;
+        pass.queue = RenderGraphQueue::GRAPHICS;
+        pass.hasSideEffects = hasSideEffects;
+        pass.isCulled = false;
+
+        return (uint32_t)m_Passes.size() - 1;
+    }
+
+    // "layout" is ignored for buffers
+    inline void Read(uint32_t passIndex, uint32_t resourceIndex, const nri::AccessLayoutStage& state) {
+        m_Passes[passIndex].uses.push_back({resourceIndex, state, false});
+    }
+
+    inline void Write(uint32_t passIndex, uint32_t resourceIndex, const nri::AccessLayoutStage& state) {
+        m_Passes[passIndex].uses.push_back({resourceIndex, state, true});
+    }
+
+    // Attached to the first (waits) or the last (signals) batch submitted to the queue
+    inline void AddWait(RenderGraphQueue queue, const nri::FenceSubmitDesc& fenceSubmitDesc) {
+        m_ExternalWaits.push_back({queue, fenceSubmitDesc});
+    }
+
+    inline void AddSignal(RenderGraphQueue queue, const nri::FenceSubmitDesc& fenceSubmitDesc) {
+        m_ExternalSignals.push_back({queue, fenceSubmitDesc});
+    }
+
+    inline void Execute(nri::DescriptorPool* descriptorPool) {
+        m_Stats = {};
+        m_Stats.passNum = (uint32_t)m_Passes.size();
+
+        Cull();
+        Schedule();
+        Submit(descriptorPool);
+
+        // Batch indices are valid only within the frame
+        for (RenderGraphResource& resource : m_Resources)
+            resource.state->batchIndex = NONE;
+    }
+
+private:
+    struct ExternalFence {
+        RenderGraphQueue queue;
+        nri::FenceSubmitDesc fenceSubmitDesc;
+    };
+
+    static inline bool IsSubset(uint32_t bits, uint32_t superset) {
+        return (bits & ~superset) == 0;
+    }
+
+    inline RenderGraphResourceState& GetState(const void* key, const nri::AccessLayoutStage& initialState) {
+        auto it = m_States.find(key);
+        if (it == m_States.end()) {
+            RenderGraphResourceState state = {};
+            state.state = initialState;
+            state.batchIndex = NONE;
+            state.queue = RenderGraphQueue::GRAPHICS;
+
+            it = m_States.insert({key, state}).first;
+        }
+
+        return it->second;
+    }
+
+    // Backwards: a pass is alive if it has side effects or writes a resource needed by an output or an alive pass
+    inline void Cull() {
+        std::vector<bool> isNeeded(m_Resources.size());
+        for (size_t i = 0; i < m_Resources.size(); i++)
+            isNeeded[i] = m_Resources[i].isOutput;
+
+        for (size_t i = m_Passes.size(); i > 0; i--) {
+            RenderGraphPass& pass = m_Passes[i - 1];
+
+            bool isAlive = pass.hasSideEffects;
+            for (const RenderGraphUse& use : pass.uses)
+                isAlive = isAlive || (use.isWrite && isNeeded[use.resourceIndex]);
+
+            pass.isCulled = !isAlive;
+            if (pass.isCulled) {
+                m_Stats.culledPassNum++;
+                continue;
+            }
+
+            // Writes stay needed: earlier writers may produce other parts of the resource
+            for (const RenderGraphUse& use : pass.uses)
+                isNeeded[use.resourceIndex] = true;
+        }
+    }
+
+    inline uint32_t OpenBatch(RenderGraphQueue queue, std::array<uint32_t, (size_t)RenderGraphQueue::MAX_NUM>& openBatches) {
+        uint32_t& batchIndex = openBatches[(size_t)queue];
+        if (batchIndex == NONE) {
+            RenderGraphBatch& batch = m_Batches.emplace_back();
+            batch.queue = queue;
+            batch.fenceValue = ++m_FenceValues[(size_t)queue];
+
+            batchIndex = (uint32_t)m_Batches.size() - 1;
+        }
+
+        return batchIndex;
+    }
+
+    inline void CloseBatch(RenderGraphQueue queue, std::array<uint32_t, (size_t)RenderGraphQueue::MAX_NUM>& openBatches) {
+        uint32_t& batchIndex = openBatches[(size_t)queue];
+        if (batchIndex != NONE) {
+            m_SubmissionOrder.push_back(batchIndex);
+            batchIndex = NONE;
+        }
+    }
+
+    inline void AddBarrier(const RenderGraphResource& resource, const nri::AccessLayoutStage& before, const nri::AccessLayoutStage& after,
+        std::vector<nri::TextureBarrierDesc>& textureBarriers, std::vector<nri::BufferBarrierDesc>& bufferBarriers) {
+        if (resource.texture) {
+            nri::TextureBarrierDesc& textureBarrier = textureBarriers.emplace_back();
+            textureBarrier = {};
+            textureBarrier.texture = resource.texture;
+            textureBarrier.before = before;
+            textureBarrier.after = after;
+            textureBarrier.mipNum = resource.mipNum;
+            textureBarrier.layerNum = resource.layerNum;
+        } else {
+            nri::BufferBarrierDesc& bufferBarrier = bufferBarriers.emplace_back();
+            bufferBarrier = {};
+            bufferBarrier.buffer = resource.buffer;
+            bufferBarrier.before = {before.access, before.stages};
+            bufferBarrier.after = {after.access, after.stages};
+        }
+
+        m_Stats.barrierNum++;
+    }
+
+    // Forward: queue assignment, batches, barriers and cross-queue waits
+    inline void Schedule() {
+        const bool isAsyncCompute = m_IsAsyncCompute && HasComputeQueue();
+
+        std::array<uint32_t, (size_t)RenderGraphQueue::MAX_NUM> openBatches;
+        openBatches.fill(NONE);
+
+        for (uint32_t passIndex = 0; passIndex < (uint32_t)m_Passes.size(); passIndex++) {
+            RenderGraphPass& pass = m_Passes[passIndex];
+            if (pass.isCulled)
+                continue;
+
+            pass.queue = (isAsyncCompute && pass.affinity == RenderGraphPassAffinity::ASYNC_COMPUTE) ? RenderGraphQueue::COMPUTE : RenderGraphQueue::GRAPHICS;
+
+            // Cross-queue producers
+            std::array<uint64_t, (size_t)RenderGraphQueue::MAX_NUM> waitValues = {};
+            for (const RenderGraphUse& use : pass.uses) {
+                const RenderGraphResourceState& state = *m_Resources[use.resourceIndex].state;
+                if (state.queue == pass.queue || !state.fenceValue)
+                    continue;
+
+                // A producer batch can't receive more work once someone waits for it, otherwise queues could wait for each other
+                if (state.batchIndex != NONE && openBatches[(size_t)state.queue] == state.batchIndex)
+                    CloseBatch(state.queue, openBatches);
+
+                uint64_t& waitValue = waitValues[(size_t)state.queue];
+                waitValue = std::max(waitValue, state.fenceValue);
+            }
+
+            bool hasWaits = false;
+            for (uint64_t waitValue : waitValues)
+                hasWaits = hasWaits || waitValue != 0;
+
+            // Waits apply to the whole batch, start a new one to not delay already added passes
+            uint32_t openBatchIndex = openBatches[(size_t)pass.queue];
+            if (hasWaits && openBatchIndex != NONE && !m_Batches[openBatchIndex].passes.empty())
+                CloseBatch(pass.queue, openBatches);
+
+            uint32_t batchIndex = OpenBatch(pass.queue, openBatches);
+            RenderGraphBatch& batch = m_Batches[batchIndex];
+            batch.passes.push_back(passIndex);
+
+            for (size_t i = 0; i < waitValues.size(); i++) {
+                if (!waitValues[i])
+                    continue;
+
+                nri::FenceSubmitDesc& wait = batch.waits.emplace_back();
+                wait = {};
+                wait.fence = m_Fences[i];
+                wait.value = waitValues[i];
+                wait.stages = nri::StageBits::ALL;
+
+                m_Stats.crossQueueWaitNum++;
+            }
+
+            // Barriers
+            for (const RenderGraphUse& use : pass.uses) {
+                const RenderGraphResource& resource = m_Resources[use.resourceIndex];
+                RenderGraphResourceState& state = *resource.state;
+
+                const bool isCrossQueue = state.queue != pass.queue;
+                const bool isSameLayout = !resource.texture || state.state.layout == use.state.layout;
+                const bool isReadAfterRead = !use.isWrite && !state.isWrite && isSameLayout;
+
+                if (isCrossQueue) {
+                    nri::AccessLayoutStage before = {nri::AccessBits::NONE, state.state.layout, nri::StageBits::NONE};
+                    AddBarrier(resource, before, use.state, pass.textureBarriers, pass.bufferBarriers);
+
+                    state.state = use.state;
+                } else if (isReadAfterRead) {
+                    if (IsSubset((uint32_t)use.state.access, (uint32_t)state.state.access) && IsSubset((uint32_t)use.state.stages, (uint32_t)state.state.stages))
+                        continue;
+
+                    nri::AccessLayoutStage before = {state.lastWrite.access, state.state.layout, state.lastWrite.stages};
+                    AddBarrier(resource, before, use.state, pass.textureBarriers, pass.bufferBarriers);
+
+                    state.state.access = state.state.access | use.state.access;
+                    state.state.stages = state.state.stages | use.state.stages;
+                } else {
+                    AddBarrier(resource, state.state, use.state, pass.textureBarriers, pass.bufferBarriers);
+
+                    state.state = use.state;
+                }
+
+                if (use.isWrite)
+                    state.lastWrite = {use.state.access, use.state.stages};
+
+                state.isWrite = use.isWrite;
+                state.queue = pass.queue;
+                state.fenceValue = batch.fenceValue;
+                state.batchIndex = batchIndex;
+            }
+
+            if (pass.queue == RenderGraphQueue::COMPUTE)
+                m_Stats.asyncPassNum++;
+        }
+
+        // Final states, recorded at the end of the batch using a resource last
+        for (const RenderGraphResource& resource : m_Resources) {
+            RenderGraphResourceState& state = *resource.state;
+            if (!resource.isOutput || state.batchIndex == NONE)
+                continue;
+
+            const nri::AccessLayoutStage& finalState = resource.finalState;
+            if (finalState.access == nri::AccessBits::NONE && finalState.layout == nri::Layout::UNDEFINED && finalState.stages == nri::StageBits::NONE)
+                continue; // "SetOutput"
+
+            RenderGraphBatch& batch = m_Batches[state.batchIndex];
+            AddBarrier(resource, state.state, finalState, batch.finalTextureBarriers, batch.finalBufferBarriers);
+
+            state.state = finalState;
+            state.isWrite = true;
+        }
+
+        for (uint32_t batchIndex : openBatches) {
+            if (batchIndex != NONE)
+                m_SubmissionOrder.push_back(batchIndex);
+        }
+
+        m_Stats.batchNum = (uint32_t)m_Batches.size();
+    }
+
+    inline nri::CommandBuffer& GetCommandBuffer(RenderGraphQueue queue) {
+        RenderGraphCommandBuffers& commandBuffers = m_QueuedFrames[m_QueuedFrameIndex][(size_t)queue];
+        if (commandBuffers.usedNum == commandBuffers.commandBuffers.size()) {
+            nri::CommandBuffer* commandBuffer = nullptr;
+            NRI_ABORT_ON_FAILURE(m_NRI->CreateCommandBuffer(*commandBuffers.commandAllocator, commandBuffer));
+
+            commandBuffers.commandBuffers.push_back(commandBuffer);
+        }
+
+        return *commandBuffers.commandBuffers[commandBuffers.usedNum++];
+    }
+
+    inline void Submit(nri::DescriptorPool* descriptorPool) {
+        std::array<uint32_t, (size_t)RenderGraphQueue::MAX_NUM> firstBatches;
+        std::array<uint32_t, (size_t)RenderGraphQueue::MAX_NUM> lastBatches;
+        firstBatches.fill(NONE);
+        lastBatches.fill(NONE);
+
+        for (uint32_t batchIndex : m_SubmissionOrder) {
+            size_t queueIndex = (size_t)m_Batches[batchIndex].queue;
+            if (firstBatches[queueIndex] == NONE)
+                firstBatches[queueIndex] = batchIndex;
+
+            lastBatches[queueIndex] = batchIndex;
+        }
+
+        std::vector<nri::FenceSubmitDesc> waits;
+        std::vector<nri::FenceSubmitDesc> signals;
+
+        for (uint32_t batchIndex : m_SubmissionOrder) {
+            const RenderGraphBatch& batch = m_Batches[batchIndex];
+
+            // Record
+            nri::CommandBuffer& commandBuffer = GetCommandBuffer(batch.queue);
+            m_NRI->BeginCommandBuffer(commandBuffer, descriptorPool);
+            {
+                for (uint32_t passIndex : batch.passes) {
+                    const RenderGraphPass& pass = m_Passes[passIndex];
+
+                    helper::Annotation annotation(*m_NRI, commandBuffer, pass.name);
+
+                    if (!pass.textureBarriers.empty() || !pass.bufferBarriers.empty()) {
+                        nri::BarrierDesc barrierDesc = {};
+                        barrierDesc.textures = pass.textureBarriers.data();
+                        barrierDesc.textureNum = (uint32_t)pass.textureBarriers.size();
+                        barrierDesc.buffers = pass.bufferBarriers.data();
+                        barrierDesc.bufferNum = (uint32_t)pass.bufferBarriers.size();
+
+                        m_NRI->CmdBarrier(commandBuffer, barrierDesc);
+                    }
+
+                    pass.callback(commandBuffer);
+                }
+
+                if (!batch.finalTextureBarriers.empty() || !batch.finalBufferBarriers.empty()) {
+                    nri::BarrierDesc barrierDesc = {};
+                    barrierDesc.textures = batch.finalTextureBarriers.data();
+                    barrierDesc.textureNum = (uint32_t)batch.finalTextureBarriers.size();
+                    barrierDesc.buffers = batch.finalBufferBarriers.data();
+                    barrierDesc.bufferNum = (uint32_t)batch.finalBufferBarriers.size();
+
+                    m_NRI->CmdBarrier(commandBuffer, barrierDesc);
+                }
+            }
+            m_NRI->EndCommandBuffer(commandBuffer);
+
+            // Submit
+            waits = batch.waits;
+            signals.clear();
+
+            nri::FenceSubmitDesc& signal = signals.emplace_back();
+            signal = {};
+            signal.fence = m_Fences[(size_t)batch.queue];
+            signal.value = batch.fenceValue;
+
+            AppendExternalFences(batch.queue, batchIndex == firstBatches[(size_t)batch.queue], batchIndex == lastBatches[(size_t)batch.queue], waits, signals);
+
+            nri::CommandBuffer* commandBufferPtr = &commandBuffer;
+
+            nri::QueueSubmitDesc queueSubmitDesc = {};
+            queueSubmitDesc.waitFences = waits.data();
+            queueSubmitDesc.waitFenceNum = (uint32_t)waits.size();
+            queueSubmitDesc.commandBuffers = &commandBufferPtr;
+            queueSubmitDesc.commandBufferNum = 1;
+            queueSubmitDesc.signalFences = signals.data();
+            queueSubmitDesc.signalFenceNum = (uint32_t)signals.size();
+
+            m_NRI->QueueSubmit(*m_Queues[(size_t)batch.queue], queueSubmitDesc);
+        }
+
+        // External fences on queues without work
+        for (size_t i = 0; i < (size_t)RenderGraphQueue::MAX_NUM; i++) {
+            if (firstBatches[i] != NONE)
+                continue;
+
+            waits.clear();
+            signals.clear();
+            AppendExternalFences((RenderGraphQueue)i, true, true, waits, signals);
+
+            if (waits.empty() && signals.empty())
+                continue;
+
+            nri::QueueSubmitDesc queueSubmitDesc = {};
+            queueSubmitDesc.waitFences = waits.data();
+            queueSubmitDesc.waitFenceNum = (uint32_t)waits.size();
+            queueSubmitDesc.signalFences = signals.data();
+            queueSubmitDesc.signalFenceNum = (uint32_t)signals.size();
+
+            m_NRI->QueueSubmit(*m_Queues[i], queueSubmitDesc);
+        }
+    }
+
+    inline void AppendExternalFences(RenderGraphQueue queue, bool isFirst, bool isLast, std::vector<nri::FenceSubmitDesc>& waits, std::vector<nri::FenceSubmitDesc>& signals) const {
+        for (const ExternalFence& externalWait : m_ExternalWaits) {
+            if (isFirst && externalWait.queue == queue)
+                waits.push_back(externalWait.fenceSubmitDesc);
+        }
+
+        for (const ExternalFence& externalSignal : m_ExternalSignals) {
+            if (isLast && externalSignal.queue == queue)
+                signals.push_back(externalSignal.fenceSubmitDesc);
+        }
+    }
+
+private:
+    const nri::CoreInterface* m_NRI = nullptr;
+    std::array<nri::Queue*, (size_t)RenderGraphQueue::MAX_NUM> m_Queues = {};
+    std::array<nri::Fence*, (size_t)RenderGraphQueue::MAX_NUM> m_Fences = {};
+    std::array<uint64_t, (size_t)RenderGraphQueue::MAX_NUM> m_FenceValues = {};
+    std::vector<std::array<RenderGraphCommandBuffers, (size_t)RenderGraphQueue::MAX_NUM>> m_QueuedFrames;
+    std::unordered_map<const void*, RenderGraphResourceState> m_States; // persistent, the key is "nri::Texture*" or "nri::Buffer*"
+    std::vector<RenderGraphResource> m_Resources;
+    std::vector<RenderGraphPass> m_Passes;
+    std::vector<RenderGraphBatch> m_Batches;
+    std::vector<uint32_t> m_SubmissionOrder;
+    std::vector<ExternalFence> m_ExternalWaits;
+    std::vector<ExternalFence> m_ExternalSignals;
+    RenderGraphStats m_Stats = {};
+    uint32_t m_QueuedFrameIndex = 0;
+    bool m_IsAsyncCompute = true;
+};
@@ -0,0 +1,360 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Lazy resource state tracking and barrier batching:
+//  - "RegisterTexture" / "RegisterBuffer" set the initial state, textures are tracked per subresource (mip, layer)
+//  - "RequireState" records the state needed by the next command, nothing is recorded until "Flush"
+//  - "Flush" emits all pending transitions as a single "CmdBarrier" call (call it right before the commands using the resources)
+// Transitions:
+//  - no-op transitions are elided (the same layout, no writes involved and the requested access and stages are already covered)
+//  - several requests for the same subresource between flushes collapse into one transition (reads in the same layout are merged)
+//  - read-after-read in the same layout with new access or stages synchronizes with the last write only
+//  - subresources with identical transitions are merged into one barrier (whole texture in the common case)
+//  - "Discard" drops the contents, i.e. the next transition starts from "UNDEFINED"
+// Single queue only, states of resources used on several queues must be re-registered
+
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+#include <vector>
+
+struct ResourceStateTrackerSubresource {
+    nri::AccessLayoutStage state;
+    nri::AccessLayoutStage pending;
+    nri::AccessStage lastWrite;
+    bool hasPending;
+};
+
+struct ResourceStateTrackerTexture {
+    nri::Texture* texture;
+    std::vector<ResourceStateTrackerSubresource> subresources; // layer-major
+    nri::Mip_t mipNum;
+    nri::Dim_t layerNum;
+    bool isDirty;
+};
+
+struct ResourceStateTrackerBuffer {
+    nri::Buffer* buffer;
+    ResourceStateTrackerSubresource state; // "layout" is unused
+    bool isDirty;
+};
+
+struct ResourceStateTrackerStats {
+    uint32_t flushNum;      // non-empty "CmdBarrier" calls
+    uint32_t barrierNum;    // emitted barrier descs
+    uint32_t transitionNum; // subresource transitions (i.e. before merging)
+    uint32_t elidedNum;     // no-op requests
+};
+
+class ResourceStateTracker {
+public:
+    static constexpr uint32_t REMAINING = uint32_t(-1);
+
+    inline void Initialize(const nri::CoreInterface& NRI) {
+        m_NRI = &NRI;
+    }
+
+    inline void Destroy() {
+        m_Textures.clear();
+        m_Buffers.clear();
+        m_DirtyTextures.clear();
+        m_DirtyBuffers.clear();
+        m_NRI = nullptr;
+    }
+
+    inline void RegisterTexture(nri::Texture& texture, const nri::AccessLayoutStage& initialState) {
+        const nri::TextureDesc& textureDesc = m_NRI->GetTextureDesc(texture);
+
+        ResourceStateTrackerSubresource subresource = {};
+        subresource.state = initialState;
+
+        ResourceStateTrackerTexture& entry = m_Textures[&texture];
+        entry = {};
+        entry.texture = &texture;
+        entry.mipNum = textureDesc.mipNum;
+        entry.layerNum = textureDesc.layerNum;
+        entry.subresources.resize(textureDesc.mipNum * textureDesc.layerNum, subresource);
+    }
+
+    inline void RegisterBuffer(nri::Buffer& buffer, const nri::AccessStage& initialState) {
+        ResourceStateTrackerBuffer& entry = m_Buffers[&buffer];
+        entry = {};
+        entry.buffer = &buffer;
+        entry.state.state = {initialState.access, nri::Layout::UNDEFINED, initialState.stages};
+    }
+
+    // Pending transitions are dropped
+    inline void Unregister(const nri::Texture& texture) {
+        auto it = m_Textures.find(&texture);
+        if (it == m_Textures.end())
+            return;
+
+        if (it->second.isDirty)
+            m_DirtyTextures.erase(std::find(m_DirtyTextures.begin(), m_DirtyTextures.end(), &it->second));
+
+        m_Textures.erase(it);
+    }
+
+    inline void Unregister(const nri::Buffer& buffer) {
+        auto it = m_Buffers.find(&buffer);
+        if (it == m_Buffers.end())
+            return;
+
+        if (it->second.isDirty)
+            m_DirtyBuffers.erase(std::find(m_DirtyBuffers.begin(), m_DirtyBuffers.end(), &it->second));
+
+        m_Buffers.erase(it);
+    }
+
+    inline void Discard(const nri::Texture& texture) {
+        ResourceStateTrackerTexture& entry = GetTexture(texture);
+        for (ResourceStateTrackerSubresource& subresource : entry.subresources) {
+            subresource.state = {nri::AccessBits::NONE, nri::Layout::UNDEFINED, nri::StageBits::NONE};
+            subresource.lastWrite = {};
+        }
+    }
+
+    inline void RequireState(const nri::Texture& texture, const nri::AccessLayoutStage& state, uint32_t mipOffset = 0, uint32_t mipNum = REMAINING, uint32_t layerOffset = 0, uint32_t layerNum = REMAINING) {
+        ResourceStateTrackerTexture& entry = GetTexture(texture);
+
+        if (mipNum == REMAINING)
+            mipNum = entry.mipNum - mipOffset;
+        if (layerNum == REMAINING)
+            layerNum = entry.layerNum - layerOffset;
+
+        bool isDirty = false;
+        for (uint32_t layer = layerOffset; layer < layerOffset + layerNum; layer++) {
+            for (uint32_t mip = mipOffset; mip < mipOffset + mipNum; mip++)
+                isDirty |= Require(entry.subresources[layer * entry.mipNum + mip], state, true);
+        }
+
+        if (isDirty && !entry.isDirty) {
+            entry.isDirty = true;
+            m_DirtyTextures.push_back(&entry);
+        }
+    }
+
+    inline void RequireState(const nri::Buffer& buffer, const nri::AccessStage& state) {
+        auto it = m_Buffers.find(&buffer);
+        assert(it != m_Buffers.end() && "Not registered");
+
+        ResourceStateTrackerBuffer& entry = it->second;
+        bool isDirty = Require(entry.state, {state.access, nri::Layout::UNDEFINED, state.stages}, false);
+
+        if (isDirty && !entry.isDirty) {
+            entry.isDirty = true;
+            m_DirtyBuffers.push_back(&entry);
+        }
+    }
+
+    // The state after the last "Flush"
+    inline const nri::AccessLayoutStage& GetState(const nri::Texture& texture, uint32_t mip = 0, uint32_t layer = 0) {
+        ResourceStateTrackerTexture& entry = GetTexture(texture);
+
+        return entry.subresources[layer * entry.mipNum + mip].state;
+    }
+
+    inline bool HasPendingTransitions() const {
+        return !m_DirtyTextures.empty() || !m_DirtyBuffers.empty();
+    }
+
+    inline const ResourceStateTrackerStats& GetStats() const {
+        return m_Stats;
+    }
+
+    inline void ResetStats() {
+        m_Stats = {};
+    }
+
+    // Moves pending transitions into barrier descs, the tracked state becomes the requested one
+    inline void CollectBarriers(std::vector<nri::TextureBarrierDesc>& textureBarriers, std::vector<nri::BufferBarrierDesc>& bufferBarriers) {
+        for (ResourceStateTrackerTexture* entry : m_DirtyTextures) {
+            const size_t textureBarrierOffset = textureBarriers.size();
+
+            for (uint32_t layer = 0; layer < entry->layerNum; layer++) {
+                for (uint32_t mip = 0; mip < entry->mipNum;) {
+                    ResourceStateTrackerSubresource& first = entry->subresources[layer * entry->mipNum + mip];
+                    if (!first.hasPending) {
+                        mip++;
+                        continue;
+                    }
+
+                    const nri::AccessLayoutStage before = GetBefore(first);
+                    const nri::AccessLayoutStage after = first.pending;
+
+                    // A run of mips with the same transition
+                    uint32_t mipEnd = mip;
+                    for (; mipEnd < entry->mipNum; mipEnd++) {
+                        ResourceStateTrackerSubresource& subresource = entry->subresources[layer * entry->mipNum + mipEnd];
+                        if (!subresource.hasPending || !IsEqual(GetBefore(subresource), before) || !IsEqual(subresource.pending, after))
+                            break;
+
+                        Apply(subresource);
+                    }
+
+                    // Extend a barrier ending at the previous layer if it covers the same mips
+                    nri::TextureBarrierDesc* previous = nullptr;
+                    for (size_t i = textureBarrierOffset; i < textureBarriers.size() && !previous; i++) {
+                        nri::TextureBarrierDesc& textureBarrier = textureBarriers[i];
+                        if (textureBarrier.mipOffset == mip && textureBarrier.mipNum == mipEnd - mip && textureBarrier.layerOffset + textureBarrier.layerNum == layer && IsEqual(textureBarrier.before, before) && IsEqual(textureBarrier.after, after))
+                            previous = &textureBarrier;
+                    }
+
+                    if (previous)
+                        previous->layerNum++;
+                    else {
+                        nri::TextureBarrierDesc& textureBarrier = textureBarriers.emplace_back();
+                        textureBarrier = {};
+                        textureBarrier.texture = entry->texture;
+                        textureBarrier.before = before;
+                        textureBarrier.after = after;
+                        textureBarrier.mipOffset = (nri::Mip_t)mip;
+                        textureBarrier.mipNum = (nri::Mip_t)(mipEnd - mip);
+                        textureBarrier.layerOffset = (nri::Dim_t)layer;
+                        textureBarrier.layerNum = 1;
+                    }
+
+                    m_Stats.transitionNum += mipEnd - mip;
+                    mip = mipEnd;
+                }
+            }
+
+            entry->isDirty = false;
+        }
+
+        for (ResourceStateTrackerBuffer* entry : m_DirtyBuffers) {
+            entry->isDirty = false;
+            if (!entry->state.hasPending)
+                continue;
+
+            const nri::AccessLayoutStage before = GetBefore(entry->state);
+
+            nri::BufferBarrierDesc& bufferBarrier = bufferBarriers.emplace_back();
+            bufferBarrier = {};
+            bufferBarrier.buffer = entry->buffer;
+            bufferBarrier.before = {before.access, before.stages};
+            bufferBarrier.after = {entry->state.pending.access, entry->state.pending.stages};
+
+            Apply(entry->state);
+
+            m_Stats.transitionNum++;
+        }
+
+        m_DirtyTextures.clear();
+        m_DirtyBuffers.clear();
+    }
+
+    inline void Flush(nri::CommandBuffer& commandBuffer) {
+        if (!HasPendingTransitions())
+            return;
+
+        m_TextureBarriers.clear();
+        m_BufferBarriers.clear();
+        CollectBarriers(m_TextureBarriers, m_BufferBarriers);
+
+        if (m_TextureBarriers.empty() && m_BufferBarriers.empty())
+            return;
+
+        nri::BarrierDesc barrierDesc = {};
+        barrierDesc.textures = m_TextureBarriers.data();
+        barrierDesc.textureNum = (uint32_t)m_TextureBarriers.size();
+        barrierDesc.buffers = m_BufferBarriers.data();
+        barrierDesc.bufferNum = (uint32_t)m_BufferBarriers.size();
+
+        m_NRI->CmdBarrier(commandBuffer, barrierDesc);
+
+        m_Stats.flushNum++;
+        m_Stats.barrierNum += barrierDesc.textureNum + barrierDesc.bufferNum;
+    }
+
+    static inline bool IsWrite(nri::AccessBits access) {
+        constexpr uint32_t writeBits = (uint32_t)(nri::AccessBits::COLOR_ATTACHMENT | nri::AccessBits::DEPTH_STENCIL_ATTACHMENT_WRITE | nri::AccessBits::SHADER_RESOURCE_STORAGE
+            | nri::AccessBits::COPY_DESTINATION | nri::AccessBits::RESOLVE_DESTINATION | nri::AccessBits::ACCELERATION_STRUCTURE_WRITE);
+
+        return ((uint32_t)access & writeBits) != 0;
+    }
+
+private:
+    static inline bool IsSubset(uint32_t bits, uint32_t superset) {
+        return (bits & ~superset) == 0;
+    }
+
+    static inline bool IsEqual(const nri::AccessLayoutStage& a, const nri::AccessLayoutStage& b) {
+        return a.access == b.access && a.layout == b.layout && a.stages == b.stages;
+    }
+
+    static inline bool IsMergeableRead(const nri::AccessLayoutStage& a, const nri::AccessLayoutStage& b, bool hasLayout) {
+        return !IsWrite(a.access) && !IsWrite(b.access) && (!hasLayout || a.layout == b.layout);
+    }
+
+    static inline bool IsCovered(const nri::AccessLayoutStage& current, const nri::AccessLayoutStage& requested, bool hasLayout) {
+        return IsMergeableRead(current, requested, hasLayout) && IsSubset((uint32_t)requested.access, (uint32_t)current.access) && IsSubset((uint32_t)requested.stages, (uint32_t)current.stages);
+    }
+
+    inline ResourceStateTrackerTexture& GetTexture(const nri::Texture& texture) {
+        auto it = m_Textures.find(&texture);
+        assert(it != m_Textures.end() && "Not registered");
+
+        return it->second;
+    }
+
+    // Returns "true" if a transition becomes pending
+    inline bool Require(ResourceStateTrackerSubresource& subresource, const nri::AccessLayoutStage& state, bool hasLayout) {
+        if (subresource.hasPending) {
+            // Nothing has been recorded since the previous request
+            if (IsMergeableRead(subresource.pending, state, hasLayout)) {
+                subresource.pending.access = subresource.pending.access | state.access;
+                subresource.pending.stages = subresource.pending.stages | state.stages;
+            } else
+                subresource.pending = state;
+
+            // Back to the current state (the texture stays in the dirty list, "CollectBarriers" skips it)
+            if (IsCovered(subresource.state, subresource.pending, hasLayout))
+                subresource.hasPending = false;
+
+            return false;
+        }
+
+        if (IsCovered(subresource.state, state, hasLayout)) {
+            m_Stats.elidedNum++;
+            return false;
+        }
+
+        subresource.pending = state;
+        subresource.hasPending = true;
+
+        return true;
+    }
+
+    static inline nri::AccessLayoutStage GetBefore(const ResourceStateTrackerSubresource& subresource) {
+        // Reads are not hazards for reads: wait only for the last write
+        if (IsMergeableRead(subresource.state, subresource.pending, true))
+            return {subresource.lastWrite.access, subresource.state.layout, subresource.lastWrite.stages};
+
+        return subresource.state;
+    }
+
+    static inline void Apply(ResourceStateTrackerSubresource& subresource) {
+        if (IsMergeableRead(subresource.state, subresource.pending, true)) {
+            subresource.state.access = subresource.state.access | subresource.pending.access;
+            subresource.state.stages = subresource.state.stages | subresource.pending.stages;
+        } else
+            subresource.state = subresource.pending;
+
+        if (IsWrite(subresource.pending.access))
+            subresource.lastWrite = {subresource.pending.access, subresource.pending.stages};
+
+        subresource.hasPending = false;
+    }
+
+private:
+    const nri::CoreInterface* m_NRI = nullptr;
+    std::unordered_map<const nri::Texture*, ResourceStateTrackerTexture> m_Textures;
+    std::unordered_map<const nri::Buffer*, ResourceStateTrackerBuffer> m_Buffers;
+    std::vector<ResourceStateTrackerTexture*> m_DirtyTextures;
+    std::vector<ResourceStateTrackerBuffer*> m_DirtyBuffers;
+    std::vector<nri::TextureBarrierDesc> m_TextureBarriers;
+    std::vector<nri::BufferBarrierDesc> m_BufferBarriers;
+    ResourceStateTrackerStats m_Stats = {};
+};
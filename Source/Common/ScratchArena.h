@@ -0,0 +1,136 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Scratch memory arena for acceleration structure builds:
+//  - "Allocate" suballocates an aligned range from a few large DEVICE buffers (linear allocation per block)
+//  - a new block is created if no block has enough space left (at least "blockSize", or bigger for a large request)
+//  - "Retire" tags all ranges allocated since the previous "Retire" with a fence value
+//  - "Recycle" rewinds blocks, which are not used by any build still in flight
+// Blocks are never freed before "Destroy", i.e. rebuilding every frame causes no allocation churn once the arena is warmed up
+
+#include <vector>
+
+constexpr uint64_t SCRATCH_ARENA_BLOCK_SIZE = 32 * 1024 * 1024;
+
+struct ScratchArenaBlock {
+    nri::Buffer* buffer;
+    nri::Memory* memory;
+    uint64_t size;
+    uint64_t offset;
+    uint64_t fenceValue; // the last fence value using this block
+    bool isPending;      // has ranges not retired yet
+};
+
+class ScratchArena {
+public:
+    inline void Initialize(const nri::CoreInterface& NRI, nri::Device& device, uint64_t blockSize = SCRATCH_ARENA_BLOCK_SIZE) {
+        m_NRI = &NRI;
+        m_Device = &device;
+        m_BlockSize = blockSize;
+    }
+
+    inline void Destroy() {
+        for (ScratchArenaBlock& block : m_Blocks) {
+            m_NRI->DestroyBuffer(block.buffer);
+            m_NRI->FreeMemory(block.memory);
+        }
+
+        m_Blocks.clear();
+        m_Usage = 0;
+    }
+
+    inline void Allocate(uint64_t size, uint64_t alignment, nri::Buffer*& buffer, uint64_t& offset) {
+        alignment = alignment ? alignment : 1;
+
+        ScratchArenaBlock* block = nullptr;
+        for (ScratchArenaBlock& candidate : m_Blocks) {
+            if (helper::Align(candidate.offset, alignment) + size <= candidate.size) {
+                block = &candidate;
+                break;
+            }
+        }
+
+        if (!block)
+            block = &CreateBlock(size > m_BlockSize ? size : m_BlockSize);
+
+        uint64_t alignedOffset = helper::Align(block->offset, alignment);
+        m_Usage += alignedOffset + size - block->offset;
+        m_PeakUsage = m_Usage > m_PeakUsage ? m_Usage : m_PeakUsage;
+
+        block->offset = alignedOffset + size;
+        block->isPending = true;
+
+        buffer = block->buffer;
+        offset = alignedOffset;
+    }
+
+    inline void Retire(uint64_t fenceValue) {
+        for (ScratchArenaBlock& block : m_Blocks) {
+            if (block.isPending) {
+                block.fenceValue = fenceValue;
+                block.isPending = false;
+            }
+        }
+    }
+
+    inline void Recycle(uint64_t completedFenceValue) {
+        for (ScratchArenaBlock& block : m_Blocks) {
+            if (!block.isPending && block.fenceValue <= completedFenceValue) {
+                m_Usage -= block.offset;
+                block.offset = 0;
+            }
+        }
+    }
+
+    inline uint64_t GetUsage() const {
+        return m_Usage;
+    }
+
+    inline uint64_t GetPeakUsage() const {
+        return m_PeakUsage;
+    }
+
+    inline uint64_t GetCapacity() const {
+        uint64_t capacity = 0;
+        for (const ScratchArenaBlock& block : m_Blocks)
+            capacity += block.size;
+
+        return capacity;
+    }
+
+    inline uint32_t GetBlockNum() const {
+        return (uint32_t)m_Blocks.size();
+    }
+
+private:
+    inline ScratchArenaBlock& CreateBlock(uint64_t size) {
+        ScratchArenaBlock& block = m_Blocks.emplace_back();
+        block = {};
+        block.size = size;
+
+        const nri::BufferDesc bufferDesc = {size, 0, nri::BufferUsageBits::SCRATCH_BUFFER};
+        NRI_ABORT_ON_FAILURE(m_NRI->CreateBuffer(*m_Device, bufferDesc, block.buffer));
+
+        nri::MemoryDesc memoryDesc = {};
+        m_NRI->GetBufferMemoryDesc(*block.buffer, nri::MemoryLocation::DEVICE, memoryDesc);
+
+        nri::AllocateMemoryDesc allocateMemoryDesc = {};
+        allocateMemoryDesc.size = memoryDesc.size;
+        allocateMemoryDesc.type = memoryDesc.type;
+        NRI_ABORT_ON_FAILURE(m_NRI->AllocateMemory(*m_Device, allocateMemoryDesc, block.memory));
+
+        const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {block.buffer, block.memory};
+        NRI_ABORT_ON_FAILURE(m_NRI->BindBufferMemory(&bufferMemoryBindingDesc, 1));
+
+        return block;
+    }
+
+private:
+    std::vector<ScratchArenaBlock> m_Blocks;
+    const nri::CoreInterface* m_NRI = nullptr;
+    nri::Device* m_Device = nullptr;
+    uint64_t m_BlockSize = SCRATCH_ARENA_BLOCK_SIZE;
+    uint64_t m_Usage = 0;
+    uint64_t m_PeakUsage = 0;
+};
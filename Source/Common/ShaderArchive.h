@@ -0,0 +1,220 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Memory-mapped shader archive produced by "ShaderPacker" (see "ShaderArchiveFormat.h"):
+//  - the archive is mapped once, on the first "LoadPackedShader" call, and stays mapped until exit
+//  - "ShaderDesc::bytecode" points directly into the mapping (zero-copy)
+//  - if the archive or a shader in it is missing, "utils::LoadShader" is used as a fallback
+
+#include "ShaderArchiveFormat.h"
+
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+class ShaderArchive {
+public:
+    inline ~ShaderArchive() {
+        Close();
+    }
+
+    inline bool Open(const std::string& path) {
+        Close();
+
+#ifdef _WIN32
+        m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_File == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize = {};
+        GetFileSizeEx(m_File, &fileSize);
+        m_Size = (uint64_t)fileSize.QuadPart;
+
+        m_Mapping = m_Size ? CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        m_Data = m_Mapping ? (const uint8_t*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat fileStat = {};
+        fstat(fd, &fileStat);
+        m_Size = (uint64_t)fileStat.st_size;
+
+        void* data = m_Size ? mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        m_Data = data == MAP_FAILED ? nullptr : (const uint8_t*)data;
+
+        close(fd); // the mapping keeps the file alive
+#endif
+
+        if (!m_Data || !Validate()) {
+            printf("Shader archive: '%s' is invalid, ignored\n", path.c_str());
+            Close();
+
+            return false;
+        }
+
+        return true;
+    }
+
+    inline void Close() {
+#ifdef _WIN32
+        if (m_Data)
+            UnmapViewOfFile(m_Data);
+
+        if (m_Mapping)
+            CloseHandle(m_Mapping);
+
+        if (m_File != INVALID_HANDLE_VALUE)
+            CloseHandle(m_File);
+
+        m_Mapping = nullptr;
+        m_File = INVALID_HANDLE_VALUE;
+#else
+        if (m_Data)
+            munmap((void*)m_Data, m_Size);
+#endif
+
+        m_Data = nullptr;
+        m_Size = 0;
+    }
+
+    inline bool IsOpen() const {
+        return m_Data != nullptr;
+    }
+
+    // Binary search (entries are sorted by name)
+    inline bool Find(const char* name, const uint8_t*& bytecode, uint64_t& size) const {
+        if (!m_Data)
+            return false;
+
+        const ShaderArchiveHeader* header = (const ShaderArchiveHeader*)m_Data;
+        const ShaderArchiveEntry* entries = (const ShaderArchiveEntry*)(header + 1);
+
+        uint32_t begin = 0;
+        uint32_t end = header->entryNum;
+        while (begin < end) {
+            uint32_t middle = (begin + end) / 2;
+            int cmp = strncmp(entries[middle].name, name, SHADER_ARCHIVE_NAME_MAX_LENGTH);
+
+            if (cmp == 0) {
+                bytecode = m_Data + entries[middle].offset;
+                size = entries[middle].size;
+
+                return true;
+            }
+
+            if (cmp < 0)
+                begin = middle + 1;
+            else
+                end = middle;
+        }
+
+        return false;
+    }
+
+private:
+    inline bool Validate() const {
+        if (m_Size < sizeof(ShaderArchiveHeader))
+            return false;
+
+        const ShaderArchiveHeader* header = (const ShaderArchiveHeader*)m_Data;
+        if (header->magic != SHADER_ARCHIVE_MAGIC || header->version != SHADER_ARCHIVE_VERSION)
+            return false;
+
+        uint64_t tableEnd = sizeof(ShaderArchiveHeader) + (uint64_t)header->entryNum * sizeof(ShaderArchiveEntry);
+        if (tableEnd > m_Size)
+            return false;
+
+        const ShaderArchiveEntry* entries = (const ShaderArchiveEntry*)(header + 1);
+        for (uint32_t i = 0; i < header->entryNum; i++) {
+            const ShaderArchiveEntry& entry = entries[i];
+            if (entry.name[SHADER_ARCHIVE_NAME_MAX_LENGTH - 1] != '\0')
+                return false;
+
+            // "offset + size" can wrap around for a corrupted entry
+            if (entry.offset < tableEnd || entry.offset > m_Size || entry.size > m_Size - entry.offset)
+                return false;
+        }
+
+        return true;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE m_File = INVALID_HANDLE_VALUE;
+    HANDLE m_Mapping = nullptr;
+#endif
+    const uint8_t* m_Data = nullptr;
+    uint64_t m_Size = 0;
+};
+
+static inline bool GetPackedShaderStage(const std::string& shaderName, nri::StageBits& stage) {
+    struct StageExt {
+        const char* ext;
+        nri::StageBits stage;
+    };
+
+    static const StageExt stageExts[] = {
+        {".vs", nri::StageBits::VERTEX_SHADER},
+        {".gs", nri::StageBits::GEOMETRY_SHADER},
+        {".fs", nri::StageBits::FRAGMENT_SHADER},
+        {".cs", nri::StageBits::COMPUTE_SHADER},
+        {".rgen", nri::StageBits::RAYGEN_SHADER},
+        {".rmiss", nri::StageBits::MISS_SHADER},
+        {".rchit", nri::StageBits::CLOSEST_HIT_SHADER},
+        {".rahit", nri::StageBits::ANY_HIT_SHADER},
+        {".rint", nri::StageBits::INTERSECTION_SHADER},
+        {".rcall", nri::StageBits::CALLABLE_SHADER},
+    };
+
+    size_t dot = shaderName.rfind('.');
+    if (dot == std::string::npos)
+        return false;
+
+    for (const StageExt& stageExt : stageExts) {
+        if (!strcmp(shaderName.c_str() + dot, stageExt.ext)) {
+            stage = stageExt.stage;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Drop-in replacement for "utils::LoadShader"
+static inline nri::ShaderDesc LoadPackedShader(nri::GraphicsAPI graphicsAPI, const std::string& shaderName, utils::ShaderCodeStorage& storage, const char* entryPointName = nullptr) {
+    static ShaderArchive s_ShaderArchive;
+    static const bool s_IsOpen = s_ShaderArchive.Open(utils::GetFullPath(SHADER_ARCHIVE_FILE_NAME, utils::DataFolder::SHADERS)); // thread safe
+
+    const char* ext = ".spirv";
+    if (graphicsAPI == nri::GraphicsAPI::D3D11)
+        ext = ".dxbc";
+    else if (graphicsAPI == nri::GraphicsAPI::D3D12)
+        ext = ".dxil";
+
+    nri::StageBits stage = nri::StageBits::NONE;
+    const uint8_t* bytecode = nullptr;
+    uint64_t size = 0;
+
+    if (s_IsOpen && graphicsAPI != nri::GraphicsAPI::NONE && GetPackedShaderStage(shaderName, stage) && s_ShaderArchive.Find((shaderName + ext).c_str(), bytecode, size)) {
+        nri::ShaderDesc shaderDesc = {};
+        shaderDesc.stage = stage;
+        shaderDesc.bytecode = bytecode;
+        shaderDesc.size = size;
+        shaderDesc.entryPointName = entryPointName;
+
+        return shaderDesc;
+    }
+
+    return utils::LoadShader(graphicsAPI, shaderName, storage, entryPointName);
+}
@@ -0,0 +1,27 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Shader archive layout, shared by "ShaderPacker" tool and "ShaderArchive.h" loader
+
+#include <stdint.h>
+
+#define SHADER_ARCHIVE_MAGIC           0x5253524E // "NRSR"
+#define SHADER_ARCHIVE_VERSION         1
+#define SHADER_ARCHIVE_NAME_MAX_LENGTH 64
+#define SHADER_ARCHIVE_ALIGNMENT       16
+#define SHADER_ARCHIVE_FILE_NAME       "Shaders.pack"
+
+typedef struct ShaderArchiveHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryNum;
+    uint32_t reserved;
+} ShaderArchiveHeader;
+
+// Name is the file name produced by "ShaderMake", i.e. "<shader>.<stage>.<dxbc|dxil|spirv>"
+typedef struct ShaderArchiveEntry {
+    char name[SHADER_ARCHIVE_NAME_MAX_LENGTH];
+    uint64_t offset;
+    uint64_t size;
+} ShaderArchiveEntry;
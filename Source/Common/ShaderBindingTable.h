@@ -0,0 +1,175 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Shader binding table builder:
+//  - "AddRecord" appends a record (a shader group of the pipeline and optional local data) to a region: raygen, miss, hit group or callable,
+//    and returns its index in the region (i.e. hit group record indices are what "instanceContributionToHitGroupIndex" selects)
+//  - "ComputeLayout" is CPU-only math: a record is the shader group identifier followed by its local data, the stride of a region
+//    fits the largest record aligned to "memoryAlignment.shaderBindingTable" (also a valid record alignment), regions start aligned
+//  - "Create" writes identifiers and local data into one buffer and uploads it at once
+// The buffer is left in "AccessBits::NONE" state, a barrier to "SHADER_BINDING_TABLE" is needed before the first use
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+enum class ShaderTableRegion : uint8_t {
+    RAYGEN,
+    MISS,
+    HIT_GROUP,
+    CALLABLE,
+
+    MAX_NUM
+};
+
+struct ShaderTableRecord {
+    uint32_t shaderGroupIndex;
+    uint32_t localDataOffset; // in "m_LocalData"
+    uint32_t localDataSize;
+};
+
+struct ShaderTableRegionLayout {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t stride;
+};
+
+class ShaderBindingTable {
+public:
+    inline uint32_t AddRecord(ShaderTableRegion region, uint32_t shaderGroupIndex, const void* localData = nullptr, uint32_t localDataSize = 0) {
+        ShaderTableRecord record = {};
+        record.shaderGroupIndex = shaderGroupIndex;
+        record.localDataOffset = (uint32_t)m_LocalData.size();
+        record.localDataSize = localDataSize;
+
+        const uint8_t* bytes = (const uint8_t*)localData;
+        m_LocalData.insert(m_LocalData.end(), bytes, bytes + localDataSize);
+
+        std::vector<ShaderTableRecord>& records = m_Records[(size_t)region];
+        records.push_back(record);
+
+        return (uint32_t)records.size() - 1;
+    }
+
+    // Returns the table size
+    inline uint64_t ComputeLayout(uint64_t identifierSize, uint64_t alignment) {
+        m_IdentifierSize = identifierSize;
+
+        uint64_t offset = 0;
+        for (size_t i = 0; i < (size_t)ShaderTableRegion::MAX_NUM; i++) {
+            uint32_t localDataMaxSize = 0;
+            for (const ShaderTableRecord& record : m_Records[i])
+                localDataMaxSize = std::max(localDataMaxSize, record.localDataSize);
+
+            ShaderTableRegionLayout& layout = m_Layouts[i];
+            layout.offset = offset;
+            layout.stride = m_Records[i].empty() ? 0 : helper::Align(identifierSize + localDataMaxSize, alignment);
+            layout.size = layout.stride * m_Records[i].size();
+
+            offset = helper::Align(offset + layout.size, alignment);
+        }
+
+        m_Size = offset;
+
+        return m_Size;
+    }
+
+    inline void Create(const nri::CoreInterface& NRI, const nri::HelperInterface& helperInterface, const nri::RayTracingInterface& rayTracing, nri::Device& device, nri::Queue& queue, const nri::Pipeline& pipeline) {
+        m_NRI = &NRI;
+
+        const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(device);
+        ComputeLayout(deviceDesc.shaderStage.rayTracing.shaderGroupIdentifierSize, deviceDesc.memoryAlignment.shaderBindingTable);
+
+        const nri::BufferDesc bufferDesc = {m_Size, 0, nri::BufferUsageBits::SHADER_BINDING_TABLE};
+        NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(device, bufferDesc, m_Buffer));
+
+        nri::MemoryDesc memoryDesc = {};
+        NRI.GetBufferMemoryDesc(*m_Buffer, nri::MemoryLocation::DEVICE, memoryDesc);
+
+        nri::AllocateMemoryDesc allocateMemoryDesc = {};
+        allocateMemoryDesc.size = memoryDesc.size;
+        allocateMemoryDesc.type = memoryDesc.type;
+        NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(device, allocateMemoryDesc, m_Memory));
+
+        const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {m_Buffer, m_Memory};
+        NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(&bufferMemoryBindingDesc, 1));
+
+        // Content
+        std::vector<uint8_t> content((size_t)m_Size, 0);
+        for (size_t i = 0; i < (size_t)ShaderTableRegion::MAX_NUM; i++) {
+            const ShaderTableRegionLayout& layout = m_Layouts[i];
+
+            for (size_t j = 0; j < m_Records[i].size(); j++) {
+                const ShaderTableRecord& record = m_Records[i][j];
+                uint8_t* dst = content.data() + layout.offset + j * layout.stride;
+
+                rayTracing.WriteShaderGroupIdentifiers(pipeline, record.shaderGroupIndex, 1, dst);
+
+                if (record.localDataSize)
+                    memcpy(dst + m_IdentifierSize, m_LocalData.data() + record.localDataOffset, record.localDataSize);
+            }
+        }
+
+        nri::BufferUploadDesc dataDesc = {};
+        dataDesc.data = content.data();
+        dataDesc.buffer = m_Buffer;
+        dataDesc.after = {nri::AccessBits::NONE};
+        NRI_ABORT_ON_FAILURE(helperInterface.UploadData(queue, nullptr, 0, &dataDesc, 1));
+    }
+
+    inline void Destroy() {
+        if (!m_NRI)
+            return;
+
+        m_NRI->DestroyBuffer(m_Buffer);
+        m_NRI->FreeMemory(m_Memory);
+
+        m_Buffer = nullptr;
+        m_Memory = nullptr;
+    }
+
+    inline void FillDispatchRaysDesc(nri::DispatchRaysDesc& dispatchRaysDesc, uint32_t raygenRecordIndex = 0) const {
+        const ShaderTableRegionLayout& raygen = GetRegionLayout(ShaderTableRegion::RAYGEN);
+        const ShaderTableRegionLayout& miss = GetRegionLayout(ShaderTableRegion::MISS);
+        const ShaderTableRegionLayout& hitGroup = GetRegionLayout(ShaderTableRegion::HIT_GROUP);
+        const ShaderTableRegionLayout& callable = GetRegionLayout(ShaderTableRegion::CALLABLE);
+
+        // A single raygen record per dispatch
+        dispatchRaysDesc.raygenShader = {m_Buffer, raygen.offset + raygenRecordIndex * raygen.stride, raygen.stride, raygen.stride};
+
+        if (miss.size)
+            dispatchRaysDesc.missShaders = {m_Buffer, miss.offset, miss.size, miss.stride};
+        if (hitGroup.size)
+            dispatchRaysDesc.hitShaderGroups = {m_Buffer, hitGroup.offset, hitGroup.size, hitGroup.stride};
+        if (callable.size)
+            dispatchRaysDesc.callableShaders = {m_Buffer, callable.offset, callable.size, callable.stride};
+    }
+
+    inline const ShaderTableRegionLayout& GetRegionLayout(ShaderTableRegion region) const {
+        return m_Layouts[(size_t)region];
+    }
+
+    inline uint32_t GetRecordNum(ShaderTableRegion region) const {
+        return (uint32_t)m_Records[(size_t)region].size();
+    }
+
+    inline uint64_t GetSize() const {
+        return m_Size;
+    }
+
+    inline nri::Buffer* GetBuffer() const {
+        return m_Buffer;
+    }
+
+private:
+    std::vector<ShaderTableRecord> m_Records[(size_t)ShaderTableRegion::MAX_NUM];
+    ShaderTableRegionLayout m_Layouts[(size_t)ShaderTableRegion::MAX_NUM] = {};
+    std::vector<uint8_t> m_LocalData;
+    const nri::CoreInterface* m_NRI = nullptr;
+    nri::Buffer* m_Buffer = nullptr;
+    nri::Memory* m_Memory = nullptr;
+    uint64_t m_IdentifierSize = 0;
+    uint64_t m_Size = 0;
+};
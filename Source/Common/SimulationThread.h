@@ -0,0 +1,141 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Decoupled simulation (frame pipelining):
+//  - "Start" launches a thread, which calls the simulation callback for frames "firstFrameIndex, firstFrameIndex + 1, ..."
+//  - simulated frames go through a bounded handoff queue: the simulation can't run more than "queueSize" frames ahead of
+//    the render thread, i.e. latency stays bounded (1 - simulation of frame "N + 1" overlaps rendering of frame "N")
+//  - "Pop" (render thread) blocks until the requested frame is simulated and returns a copy of it (the thread must be running)
+//  - waits on both sides are measured: "render waits" - the simulation is the bottleneck, "simulation waits" - the queue
+//    is full, i.e. rendering is the bottleneck
+//  - "Stop" discards frames not popped yet (including the one being simulated)
+// Frame indices must go one by one, "Start", "Stop" and "Pop" are called from one (render) thread
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct SimulationThreadStats {
+    double renderWaitTime;     // ms, smoothed
+    double simulationWaitTime; // ms, smoothed
+};
+
+template <typename T>
+class SimulationThread {
+public:
+    typedef std::function<void(uint32_t frameIndex, T& frame)> Callback;
+
+    static constexpr uint32_t QUEUE_MAX_SIZE = 4;
+
+    inline ~SimulationThread() {
+        Stop();
+    }
+
+    inline void Start(uint32_t firstFrameIndex, uint32_t queueSize, const Callback& callback) {
+        Stop();
+
+        m_Callback = callback;
+        m_QueueSize = std::clamp(queueSize, 1u, QUEUE_MAX_SIZE);
+        m_SimulatedEnd = firstFrameIndex;
+        m_PoppedEnd = firstFrameIndex;
+        m_Stats = {};
+        m_Quit = false;
+
+        m_Thread = std::thread(&SimulationThread::ThreadEntryPoint, this, firstFrameIndex);
+    }
+
+    inline void Stop() {
+        if (!m_Thread.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Quit = true;
+        }
+        m_Condition.notify_all();
+
+        m_Thread.join();
+    }
+
+    inline bool IsRunning() const {
+        return m_Thread.joinable();
+    }
+
+    inline uint32_t GetQueueSize() const {
+        return m_QueueSize;
+    }
+
+    inline SimulationThreadStats GetStats() {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        return m_Stats;
+    }
+
+    inline T Pop(uint32_t frameIndex) {
+        double begin = GetTime();
+
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Condition.wait(lock, [this, frameIndex] { return m_SimulatedEnd > frameIndex; });
+
+        T frame = m_Frames[frameIndex % QUEUE_MAX_SIZE];
+        m_PoppedEnd = frameIndex + 1;
+
+        Smooth(m_Stats.renderWaitTime, GetTime() - begin);
+
+        lock.unlock();
+        m_Condition.notify_all();
+
+        return frame;
+    }
+
+private:
+    static inline double GetTime() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static inline void Smooth(double& value, double measurement) {
+        value += (measurement - value) * 0.1;
+    }
+
+    inline void ThreadEntryPoint(uint32_t firstFrameIndex) {
+        for (uint32_t frameIndex = firstFrameIndex;; frameIndex++) {
+            {
+                double begin = GetTime();
+
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Condition.wait(lock, [this, frameIndex] { return m_Quit || frameIndex - m_PoppedEnd < m_QueueSize; });
+
+                if (m_Quit)
+                    break;
+
+                Smooth(m_Stats.simulationWaitTime, GetTime() - begin);
+            }
+
+            // The slot is not visible to the render thread until "m_SimulatedEnd" is bumped
+            m_Callback(frameIndex, m_Frames[frameIndex % QUEUE_MAX_SIZE]);
+
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_SimulatedEnd = frameIndex + 1;
+            }
+            m_Condition.notify_all();
+        }
+    }
+
+private:
+    std::array<T, QUEUE_MAX_SIZE> m_Frames = {};
+    Callback m_Callback;
+    SimulationThreadStats m_Stats = {};
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    uint32_t m_QueueSize = 1;
+    uint32_t m_SimulatedEnd = 0;
+    uint32_t m_PoppedEnd = 0;
+    bool m_Quit = false;
+};
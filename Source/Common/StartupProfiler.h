@@ -0,0 +1,217 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Lightweight startup phase profiler, shared by C and C++ samples:
+//  - "StartupProfilerBegin" / "StartupProfilerEnd" (or "StartupPhase" scope in C++) around initialization phases, phases can be nested
+//  - "StartupProfilerReport" prints a sorted breakdown and, if "NRI_STARTUP_PROFILE_DIR" environment variable is set, writes "<dir>/<sample>.<api>.json"
+// No window or device is needed, i.e. it works in headless runs and with "NONE" backend
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+#    include <chrono>
+#elif defined(_WIN32)
+#    include <windows.h>
+#else
+#    include <time.h>
+#endif
+
+#define STARTUP_PROFILER_PHASE_MAX_NUM 64
+#define STARTUP_PROFILER_DEPTH_MAX_NUM 8
+#define STARTUP_PROFILER_NO_PARENT     0xFFFFFFFF
+
+#define STARTUP_PROFILER_STRINGIFY_(x) #x
+#define STARTUP_PROFILER_STRINGIFY(x)  STARTUP_PROFILER_STRINGIFY_(x)
+
+#ifdef PROJECT_NAME
+#    define STARTUP_PROFILER_SAMPLE_NAME STARTUP_PROFILER_STRINGIFY(PROJECT_NAME)
+#else
+#    define STARTUP_PROFILER_SAMPLE_NAME "Sample"
+#endif
+
+typedef struct StartupProfilerPhase {
+    const char* name;
+    double beginMs;
+    double durationMs;
+    uint32_t parent;
+    uint32_t depth;
+} StartupProfilerPhase;
+
+typedef struct StartupProfiler {
+    StartupProfilerPhase phases[STARTUP_PROFILER_PHASE_MAX_NUM];
+    uint32_t stack[STARTUP_PROFILER_DEPTH_MAX_NUM];
+    uint32_t phaseNum;
+    uint32_t depth;
+    double originMs;
+} StartupProfiler;
+
+static StartupProfiler g_StartupProfiler;
+
+// Monotonic (wall clock can jump, i.e. NTP adjustments)
+static inline double StartupProfilerGetTimeMs(void) {
+#ifdef __cplusplus
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#elif defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec * 1e-6;
+#endif
+}
+
+static inline void StartupProfilerBegin(const char* name) {
+    StartupProfiler* profiler = &g_StartupProfiler;
+
+    double timeMs = StartupProfilerGetTimeMs();
+    if (profiler->phaseNum == 0 && profiler->depth == 0)
+        profiler->originMs = timeMs;
+
+    // Overflow is not fatal, only the phase is lost (but nesting remains balanced)
+    uint32_t phaseIndex = STARTUP_PROFILER_NO_PARENT;
+    if (profiler->phaseNum < STARTUP_PROFILER_PHASE_MAX_NUM && profiler->depth < STARTUP_PROFILER_DEPTH_MAX_NUM) {
+        phaseIndex = profiler->phaseNum++;
+
+        StartupProfilerPhase* phase = &profiler->phases[phaseIndex];
+        phase->name = name;
+        phase->beginMs = timeMs;
+        phase->durationMs = 0.0;
+        phase->parent = profiler->depth ? profiler->stack[profiler->depth - 1] : STARTUP_PROFILER_NO_PARENT;
+        phase->depth = profiler->depth;
+    }
+
+    if (profiler->depth < STARTUP_PROFILER_DEPTH_MAX_NUM)
+        profiler->stack[profiler->depth] = phaseIndex;
+
+    profiler->depth++;
+}
+
+static inline void StartupProfilerEnd(void) {
+    StartupProfiler* profiler = &g_StartupProfiler;
+    if (!profiler->depth)
+        return;
+
+    profiler->depth--;
+
+    if (profiler->depth < STARTUP_PROFILER_DEPTH_MAX_NUM) {
+        uint32_t phaseIndex = profiler->stack[profiler->depth];
+        if (phaseIndex != STARTUP_PROFILER_NO_PARENT) {
+            StartupProfilerPhase* phase = &profiler->phases[phaseIndex];
+            phase->durationMs = StartupProfilerGetTimeMs() - phase->beginMs;
+        }
+    }
+}
+
+static inline int StartupProfilerCompare(const void* a, const void* b) {
+    const StartupProfilerPhase* phaseA = *(const StartupProfilerPhase* const*)a;
+    const StartupProfilerPhase* phaseB = *(const StartupProfilerPhase* const*)b;
+
+    if (phaseA->durationMs > phaseB->durationMs)
+        return -1;
+
+    return phaseA->durationMs < phaseB->durationMs ? 1 : 0;
+}
+
+static inline void StartupProfilerPrintChildren(uint32_t parent, double totalMs) {
+    StartupProfiler* profiler = &g_StartupProfiler;
+
+    const StartupProfilerPhase* children[STARTUP_PROFILER_PHASE_MAX_NUM];
+    uint32_t childNum = 0;
+    for (uint32_t i = 0; i < profiler->phaseNum; i++) {
+        if (profiler->phases[i].parent == parent)
+            children[childNum++] = &profiler->phases[i];
+    }
+
+    qsort(children, childNum, sizeof(children[0]), StartupProfilerCompare);
+
+    for (uint32_t i = 0; i < childNum; i++) {
+        const StartupProfilerPhase* phase = children[i];
+        double percentage = totalMs > 0.0 ? 100.0 * phase->durationMs / totalMs : 0.0;
+
+        printf("  %*s%-*s %10.3f ms %6.1f%%\n", phase->depth * 2, "", 32 - phase->depth * 2, phase->name, phase->durationMs, percentage);
+
+        StartupProfilerPrintChildren((uint32_t)(phase - profiler->phases), totalMs);
+    }
+}
+
+static inline void StartupProfilerWriteJson(const char* graphicsAPIName, double totalMs) {
+    StartupProfiler* profiler = &g_StartupProfiler;
+
+    const char* dir = getenv("NRI_STARTUP_PROFILE_DIR");
+    if (!dir || !dir[0])
+        return;
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.%s.json", dir, STARTUP_PROFILER_SAMPLE_NAME, graphicsAPIName);
+
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Startup profile: can't write '%s'\n", path);
+        return;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"sample\": \"%s\",\n", STARTUP_PROFILER_SAMPLE_NAME);
+    fprintf(file, "  \"api\": \"%s\",\n", graphicsAPIName);
+    fprintf(file, "  \"totalMs\": %.3f,\n", totalMs);
+    fprintf(file, "  \"phases\": [\n");
+
+    for (uint32_t i = 0; i < profiler->phaseNum; i++) {
+        const StartupProfilerPhase* phase = &profiler->phases[i];
+        int parent = phase->parent == STARTUP_PROFILER_NO_PARENT ? -1 : (int)phase->parent;
+
+        fprintf(file, "    {\"name\": \"%s\", \"parent\": %d, \"depth\": %u, \"beginMs\": %.3f, \"durationMs\": %.3f}%s\n",
+            phase->name, parent, phase->depth, phase->beginMs - profiler->originMs, phase->durationMs, i + 1 < profiler->phaseNum ? "," : "");
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+    fclose(file);
+
+    printf("Startup profile: saved to '%s'\n", path);
+}
+
+// Closes all open phases, prints the breakdown (sorted by duration at each nesting level) and optionally writes JSON
+static inline void StartupProfilerReport(const char* graphicsAPIName) {
+    StartupProfiler* profiler = &g_StartupProfiler;
+
+    while (profiler->depth)
+        StartupProfilerEnd();
+
+    double totalMs = profiler->phaseNum ? StartupProfilerGetTimeMs() - profiler->originMs : 0.0;
+
+    printf("Startup profile (%s, %s): %.3f ms\n", STARTUP_PROFILER_SAMPLE_NAME, graphicsAPIName, totalMs);
+    StartupProfilerPrintChildren(STARTUP_PROFILER_NO_PARENT, totalMs);
+
+    StartupProfilerWriteJson(graphicsAPIName, totalMs);
+
+    // Ready for the next report (a device can be recreated)
+    memset(profiler, 0, sizeof(*profiler));
+}
+
+#ifdef __cplusplus
+
+class StartupPhase {
+public:
+    inline StartupPhase(const char* name) {
+        StartupProfilerBegin(name);
+    }
+
+    inline ~StartupPhase() {
+        StartupProfilerEnd();
+    }
+
+    StartupPhase(const StartupPhase&) = delete;
+    StartupPhase& operator=(const StartupPhase&) = delete;
+};
+
+#endif
@@ -0,0 +1,100 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Balances work between two queues running in parallel from measured GPU times:
+//  - "split" is the fraction of the work given to the second ("compute") queue, the rest goes to the first ("graphics") one
+//  - "Update" takes times measured for a frame and the split this frame was rendered with (results arrive with a latency
+//    of several queued frames), the cost of the whole work on each queue is estimated from them and smoothed (EMA)
+//  - the target split equalizes estimated times, i.e. both queues finish together, the split moves towards it by no more
+//    than "maxStep" per update
+//  - hysteresis: adjustment starts when the predicted imbalance exceeds "hysteresis" and stops when it drops below a half
+//    of it, i.e. noise doesn't make the split jitter
+//  - there are no GPU dependencies, the controller can be driven by synthetic timing traces
+// Costs are assumed proportional to the work size, fixed costs don't move the balance point (only slow down convergence)
+
+#include <math.h>
+
+#include <algorithm>
+
+struct WorkSplitControllerDesc {
+    float initialSplit = 0.5f;
+    float minSplit = 0.1f;
+    float maxSplit = 0.9f;
+    float maxStep = 0.02f;    // per update
+    float hysteresis = 0.05f; // relative imbalance
+    float smoothing = 0.1f;   // weight of a new measurement
+};
+
+class WorkSplitController {
+public:
+    inline void Initialize(const WorkSplitControllerDesc& desc) {
+        m_Desc = desc;
+
+        Reset();
+    }
+
+    inline void Reset() {
+        m_Split = std::clamp(m_Desc.initialSplit, m_Desc.minSplit, m_Desc.maxSplit);
+        m_GraphicsCost = 0.0;
+        m_ComputeCost = 0.0;
+        m_Imbalance = 0.0;
+        m_IsAdjusting = false;
+    }
+
+    inline float GetSplit() const {
+        return m_Split;
+    }
+
+    // Positive - compute is slower
+    inline double GetImbalance() const {
+        return m_Imbalance;
+    }
+
+    inline bool IsAdjusting() const {
+        return m_IsAdjusting;
+    }
+
+    inline float Update(double graphicsTime, double computeTime, float split) {
+        if (graphicsTime <= 0.0 || computeTime <= 0.0 || split <= 0.0f || split >= 1.0f)
+            return m_Split;
+
+        // Cost of the whole work on each queue
+        double graphicsCost = graphicsTime / (1.0 - split);
+        double computeCost = computeTime / split;
+
+        if (m_GraphicsCost == 0.0) {
+            m_GraphicsCost = graphicsCost;
+            m_ComputeCost = computeCost;
+        } else {
+            m_GraphicsCost += (graphicsCost - m_GraphicsCost) * m_Desc.smoothing;
+            m_ComputeCost += (computeCost - m_ComputeCost) * m_Desc.smoothing;
+        }
+
+        // Imbalance predicted for the current split
+        double predictedGraphicsTime = m_GraphicsCost * (1.0 - m_Split);
+        double predictedComputeTime = m_ComputeCost * m_Split;
+        m_Imbalance = (predictedComputeTime - predictedGraphicsTime) / std::max(predictedGraphicsTime, predictedComputeTime);
+
+        double threshold = m_IsAdjusting ? m_Desc.hysteresis * 0.5 : m_Desc.hysteresis;
+        m_IsAdjusting = fabs(m_Imbalance) > threshold;
+
+        if (m_IsAdjusting) {
+            // "graphicsCost * (1 - split) = computeCost * split"
+            float target = float(m_GraphicsCost / (m_GraphicsCost + m_ComputeCost));
+            float step = std::clamp(target - m_Split, -m_Desc.maxStep, m_Desc.maxStep);
+
+            m_Split = std::clamp(m_Split + step, m_Desc.minSplit, m_Desc.maxSplit);
+        }
+
+        return m_Split;
+    }
+
+private:
+    WorkSplitControllerDesc m_Desc = {};
+    double m_GraphicsCost = 0.0; // smoothed time of the whole work on "graphics"
+    double m_ComputeCost = 0.0;  // smoothed time of the whole work on "compute"
+    double m_Imbalance = 0.0;
+    float m_Split = 0.5f;
+    bool m_IsAdjusting = false;
+};
@@ -2,6 +2,9 @@
 
 #include "NRIFramework.h"
 
+#include "Common/ShaderArchive.h"
+#include "Common/StartupProfiler.h"
+
 #include <array>
 
 constexpr uint32_t RESOURCE_NUM = 16; // more than needed
@@ -88,6 +91,8 @@ Sample::~Sample() {
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -105,10 +110,14 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    StartupProfilerEnd();
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
     if (!deviceDesc.tiers.bindless) {
@@ -120,6 +129,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     NRI_ABORT_ON_FAILURE(NRI.GetQueue(*m_Device, nri::QueueType::GRAPHICS, 0, m_GraphicsQueue));
 
     { // Swap chain
+        StartupPhase phase("Swap chain");
+
         nri::SwapChainDesc swapChainDesc = {};
         swapChainDesc.window = GetWindow();
         swapChainDesc.queue = m_GraphicsQueue;
@@ -168,6 +179,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
+    StartupProfilerBegin("Resources");
+
     { // Output
         nri::TextureDesc textureDesc = {};
         textureDesc.type = nri::TextureType::TEXTURE_2D;
@@ -193,7 +206,11 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, m_Buffer_Constant));
     }
 
+    StartupProfilerEnd();
+
     { // Texture 0
+        StartupPhase phase("Texture 0");
+
         utils::Texture textureData;
         std::string path = utils::GetFullPath("svbbbdi4_2.jpg", utils::DataFolder::TEXTURES);
         if (!utils::LoadTexture(path, textureData))
@@ -223,6 +240,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     { // Texture 1
+        StartupPhase phase("Texture 1");
+
         utils::Texture textureData;
         std::string path = utils::GetFullPath("svbbbdi4_normal.jpg", utils::DataFolder::TEXTURES);
         if (!utils::LoadTexture(path, textureData))
@@ -256,6 +275,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateSampler(*m_Device, {{nri::Filter::NEAREST, nri::Filter::NEAREST}}, m_Nearest_Sampler));
     }
 
+    StartupProfilerBegin("Pipelines");
+
     { // Pipeline layout
         nri::DescriptorRangeDesc heaps[2] = {
             { // Resource heap
@@ -290,11 +311,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
         nri::ComputePipelineDesc computePipelineDesc = {};
         computePipelineDesc.pipelineLayout = m_PipelineLayout;
-        computePipelineDesc.shader = utils::LoadShader(graphicsAPI, "DescriptorHeapIndexing.cs", shaderCodeStorage);
+        computePipelineDesc.shader = LoadPackedShader(graphicsAPI, "DescriptorHeapIndexing.cs", shaderCodeStorage);
 
         NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, computePipelineDesc, m_ComputePipeline));
     }
 
+    StartupProfilerEnd();
+
     { // Descriptor pool (ala resource heap) and a descriptor set, working as "an interface" for updating descriptors in the heap
         nri::DescriptorPoolDesc descriptorPoolDesc = {};
         descriptorPoolDesc.mutableMaxNum = RESOURCE_NUM;
@@ -340,6 +363,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI.UpdateDescriptorRanges(updateDescriptorRangeDesc, helper::GetCountOf(updateDescriptorRangeDesc));
     }
 
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
+
     return true;
 }
 
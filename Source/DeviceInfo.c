@@ -17,6 +17,8 @@
 #include "Extensions/NRIDeviceCreation.h"
 #include "Extensions/NRIHelper.h"
 
+#include "Common/StartupProfiler.h"
+
 static const char* vendors[] = {
     "unknown",
     "NVIDIA",
@@ -75,9 +77,12 @@ int main(int argc, char** argv) {
             graphicsAPI = NriGraphicsAPI_VK;
         else if (!strcmp(argv[i], "--api=WGPU"))
             graphicsAPI = NriGraphicsAPI_WGPU;
+        else if (!strcmp(argv[i], "--api=NONE"))
+            graphicsAPI = NriGraphicsAPI_NONE;
     }
 
     // Query adapters number
+    StartupProfilerBegin("Adapters");
     uint32_t adaptersNum = 0;
     NRI_ABORT_ON_FAILURE(nriEnumerateAdapters(
         NULL, &adaptersNum));
@@ -88,6 +93,8 @@ int main(int argc, char** argv) {
     NRI_ABORT_ON_FAILURE(nriEnumerateAdapters(
         adapterDescs, &adaptersNum));
 
+    StartupProfilerEnd();
+
     // Print adapters info
     printf("nriEnumerateAdapters: %u adapters reported\n", adaptersNum);
 
@@ -111,6 +118,8 @@ int main(int argc, char** argv) {
         printf("\n");
 
         // Print formats info
+        StartupProfilerBegin("Device");
+
         NriDevice* device = NULL;
         NriResult result = nriCreateDevice(
             &(NriDeviceCreationDesc){
@@ -119,6 +128,9 @@ int main(int argc, char** argv) {
                 .callbackInterface.MessageCallback = SilencePlease,
             },
             &device);
+
+        StartupProfilerEnd();
+
         if (result != NriResult_SUCCESS) {
             printf("\n\t'%s' device creation failed\n", nriGetGraphicsAPIString(graphicsAPI));
             continue;
@@ -166,5 +178,7 @@ int main(int argc, char** argv) {
         nriDestroyDevice(device);
     }
 
+    StartupProfilerReport(nriGetGraphicsAPIString(graphicsAPI));
+
     return 0;
 }
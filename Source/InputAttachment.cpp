@@ -2,6 +2,10 @@
 
 #include "NRIFramework.h"
 
+#include "Common/PipelineCache.h"
+#include "Common/ShaderArchive.h"
+#include "Common/StartupProfiler.h"
+
 constexpr nri::Format GBUFFER_FORMAT = nri::Format::RGBA8_UNORM;
 
 struct ConstantBufferLayout {
@@ -27,6 +31,8 @@ public:
 
 private:
     NRIInterface NRI = {};
+    PersistentPipelineCache m_PipelineCache;
+
     std::vector<QueuedFrame> m_QueuedFrames = {};
     std::vector<SwapChainTexture> m_SwapChainTextures;
     nri::Device* m_Device = nullptr;
@@ -65,6 +71,10 @@ Sample::~Sample() {
 
         NRI.DestroyPipeline(m_GbufferFill);
         NRI.DestroyPipeline(m_GbufferUse);
+
+        m_PipelineCache.Save(NRI);
+        m_PipelineCache.Destroy(NRI);
+
         NRI.DestroyPipelineLayout(m_PipelineLayout);
         NRI.DestroyDescriptor(m_Buffer_Constant);
         NRI.DestroyDescriptor(m_Material_ShaderResource);
@@ -88,6 +98,8 @@ Sample::~Sample() {
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -103,13 +115,20 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.vkBindingOffsets = VK_BINDING_OFFSETS;
     deviceCreationDesc.adapterDesc = &adapterDesc[std::min(m_AdapterIndex, adapterDescsNum - 1)];
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
+
+    m_PipelineCache.Preload(graphicsAPI, *deviceCreationDesc.adapterDesc);
+
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    StartupProfilerEnd();
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
     if (!deviceDesc.shaderFeatures.inputAttachments) {
@@ -135,6 +154,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     // Swap chain
     nri::Format swapChainFormat;
     {
+        StartupPhase phase("Swap chain");
+
         nri::SwapChainDesc swapChainDesc = {};
         swapChainDesc.window = GetWindow();
         swapChainDesc.queue = m_GraphicsQueue;
@@ -181,6 +202,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBuffer));
     }
 
+    StartupProfilerBegin("Pipelines");
+    m_PipelineCache.Create(NRI, *m_Device);
+
     { // Pipeline layout
         nri::SamplerDesc samplerDesc = {};
         samplerDesc.addressModes = {nri::AddressMode::MIRRORED_REPEAT, nri::AddressMode::MIRRORED_REPEAT};
@@ -231,12 +255,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         outputMergerDesc.colorNum = helper::GetCountOf(colorAttachmentDescs);
 
         nri::ShaderDesc shaderStages[] = {
-            utils::LoadShader(deviceDesc.graphicsAPI, "ScreenQuad.vs", shaderCodeStorage),
-            utils::LoadShader(deviceDesc.graphicsAPI, "GbufferFill.fs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "ScreenQuad.vs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "GbufferFill.fs", shaderCodeStorage),
         };
 
         nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
         graphicsPipelineDesc.pipelineLayout = m_PipelineLayout;
+        graphicsPipelineDesc.cache = m_PipelineCache.Get();
         graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
         graphicsPipelineDesc.rasterization = rasterizationDesc;
         graphicsPipelineDesc.outputMerger = outputMergerDesc;
@@ -248,19 +273,27 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         colorAttachmentDescs[0].colorWriteMask = nri::ColorWriteBits::RGBA;
         colorAttachmentDescs[1].colorWriteMask = nri::ColorWriteBits::NONE;
 
-        shaderStages[1] = utils::LoadShader(deviceDesc.graphicsAPI, "GbufferUse.fs", shaderCodeStorage);
+        shaderStages[1] = LoadPackedShader(deviceDesc.graphicsAPI, "GbufferUse.fs", shaderCodeStorage);
 
         NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, m_GbufferUse));
     }
 
+    StartupProfilerEnd();
+
     // Load texture
     utils::Texture materialTexture;
-    std::string path = utils::GetFullPath("svbbbdi4_normal.jpg", utils::DataFolder::TEXTURES);
-    if (!utils::LoadTexture(path, materialTexture))
-        return false;
+    {
+        StartupPhase startupPhase("Textures"); // also closed on the error path
+
+        std::string path = utils::GetFullPath("svbbbdi4_normal.jpg", utils::DataFolder::TEXTURES);
+        if (!utils::LoadTexture(path, materialTexture))
+            return false;
+    }
 
     // Resources
     {
+        StartupPhase phase("Resources");
+
         { // Material
             nri::TextureDesc textureDesc = {};
             textureDesc.type = nri::TextureType::TEXTURE_2D;
@@ -333,6 +366,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     { // Upload data
+        StartupPhase phase("Upload");
+
         std::array<nri::TextureSubresourceUploadDesc, 16> subresources;
         for (uint32_t mip = 0; mip < materialTexture.GetMipNum(); mip++)
             materialTexture.GetSubresource(subresources[mip], mip);
@@ -345,6 +380,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.UploadData(*m_GraphicsQueue, &textureData, 1, nullptr, 0));
     }
 
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
+
     return true;
 }
 
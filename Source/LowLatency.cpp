@@ -2,6 +2,13 @@
 
 #include "NRIFramework.h"
 
+#include "Common/FramePacer.h"
+#include "Common/LatencyStats.h"
+#include "Common/QueuedFrameController.h"
+#include "Common/ShaderArchive.h"
+#include "Common/SimulationThread.h"
+#include "Common/StartupProfiler.h"
+
 // Tweakables, which must be set only once
 constexpr bool ALLOW_LOW_LATENCY = true;
 constexpr bool WAITABLE_SWAP_CHAIN = false;
@@ -14,12 +21,25 @@ constexpr uint32_t WORKLOAD_ELEMENT_SIZE = 2 * sizeof(float);
 constexpr uint32_t COLOR_LATENCY_SLEEP = NriBgra(255, 0, 0);
 constexpr uint32_t COLOR_SIMULATION = NriBgra(0, 255, 0);
 constexpr uint32_t COLOR_RENDER = NriBgra(0, 0, 255);
+constexpr double BENCHMARK_WARMUP_TIME = 1000.0; // ms, frames queued with the previous setting must leave the pipeline
+constexpr const char* LATENCY_CSV_FILE = "LowLatencyStats.csv";
 
 struct QueuedFrame {
     nri::CommandAllocator* commandAllocator;
     nri::CommandBuffer* commandBuffer;
 };
 
+// The latest input, published by the main thread ("PublishInput", GLFW is main thread only) at several points of a frame
+// and latched by the simulation at the start of each simulated frame (on the simulation thread if pipelined)
+struct SimulationInput {
+    ImVec2 mousePos;
+    float cpuWorkload;
+};
+
+struct SimulationFrame {
+    ImVec2 mousePos; // sampled input
+};
+
 class Sample : public SampleBase {
 public:
     Sample() {
@@ -30,9 +50,16 @@ public:
 
     bool Initialize(nri::GraphicsAPI graphicsAPI, bool) override;
     void LatencySleep(uint32_t) override;
-    void PrepareFrame(uint32_t) override;
+    void PrepareFrame(uint32_t frameIndex) override;
     void RenderFrame(uint32_t frameIndex) override;
 
+private:
+    void PublishInput();
+    void Simulate(SimulationFrame& simulationFrame);
+    void CollectLatencies(const nri::LatencyReport& latencyReport);
+    void UpdateBenchmark();
+    void UpdateQueuedFrameNum();
+
 private:
     NRIInterface NRI = {};
     nri::Device* m_Device = nullptr;
@@ -48,6 +75,14 @@ private:
     nri::Memory* m_Memory = nullptr;
     nri::Descriptor* m_BufferStorage = nullptr;
 
+    FramePacer m_FramePacer;
+    QueuedFrameController m_QueuedFrameController;
+    SimulationThread<SimulationFrame> m_SimulationThread;
+    LatencyStats m_LatencyStats;
+    std::vector<FramePacerFrame> m_PacerFrames;
+    std::mutex m_SimulationMutex;
+    SimulationInput m_SimulationInput = {};
+    std::array<LatencyStatsPercentiles, QUEUED_FRAMES_MAX_NUM> m_BenchmarkResults = {}; // "Total" per "queued frame num"
     std::vector<QueuedFrame> m_QueuedFrames = {};
     std::vector<SwapChainTexture> m_SwapChainTextures;
     float m_CpuWorkload = 4.0f;                        // ms
@@ -55,12 +90,30 @@ private:
     uint32_t m_QueuedFrameNum = QUEUED_FRAMES_MAX_NUM; // [1; QUEUED_FRAMES_MAX_NUM]
     bool m_AllowLowLatency = false;
     bool m_EnableLowLatency = false;
+    uint64_t m_LastInputSampleTimeUs = 0;
+    double m_FenceWaitTime = 0.0;                      // ms, this frame
+    double m_LastFrameTimeStamp = 0.0;                 // ms
+    double m_LastGpuDoneTime = 0.0;                    // ms
+    uint32_t m_LatencyReportNum = 0;
+    double m_BenchmarkPhaseEnd = 0.0;                  // ms
+    float m_BenchmarkDuration = 5.0f;                  // s, per setting
+    uint32_t m_BenchmarkQueuedFrameNum = 0;            // 0 - not running
+    uint32_t m_SimulationQueueSize = 1;                // frames the simulation can run ahead of rendering
+    bool m_EnableFramePacer = false;
+    bool m_EnableSimulationThread = false;
+    bool m_EnableAdaptiveQueuedFrames = false;
+    bool m_IsBenchmarkWarmup = false;
+    bool m_IsAdaptiveQueuedFrames = false; // the controller is driving "m_QueuedFrameNum"
 };
 
 Sample::~Sample() {
+    m_SimulationThread.Stop();
+
     if (NRI.HasCore()) {
         NRI.DeviceWaitIdle(m_Device);
 
+        m_FramePacer.Destroy();
+
         for (QueuedFrame& queuedFrame : m_QueuedFrames) {
             NRI.DestroyCommandBuffer(queuedFrame.commandBuffer);
             NRI.DestroyCommandAllocator(queuedFrame.commandAllocator);
@@ -94,6 +147,8 @@ Sample::~Sample() {
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -111,11 +166,15 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    StartupProfilerEnd();
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
 
@@ -133,6 +192,14 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     if (m_AllowLowLatency)
         NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::LowLatencyInterface), (nri::LowLatencyInterface*)&NRI));
 
+    // Software latency limiter (enabled by default if there is no vendor low latency support)
+    m_EnableFramePacer = !m_AllowLowLatency;
+    m_FramePacer.Initialize(NRI, *m_Device, {});
+
+    QueuedFrameControllerDesc queuedFrameControllerDesc = {};
+    queuedFrameControllerDesc.maxDepth = QUEUED_FRAMES_MAX_NUM;
+    m_QueuedFrameController.Initialize(queuedFrameControllerDesc);
+
     // Command queue
     NRI_ABORT_ON_FAILURE(NRI.GetQueue(*m_Device, nri::QueueType::GRAPHICS, 0, m_GraphicsQueue));
 
@@ -140,6 +207,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
     { // Swap chain
+        StartupPhase phase("Swap chain");
+
         nri::SwapChainDesc swapChainDesc = {};
         swapChainDesc.window = GetWindow();
         swapChainDesc.queue = m_GraphicsQueue;
@@ -188,6 +257,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     { // Buffer
+        StartupPhase phase("Resources");
+
         nri::BufferDesc bufferDesc = {};
         bufferDesc.size = CTA_NUM * 256 * WORKLOAD_ELEMENT_SIZE;
         bufferDesc.usage = nri::BufferUsageBits::SHADER_RESOURCE_STORAGE;
@@ -211,6 +282,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     { // Compute pipeline
+        StartupPhase phase("Pipelines");
+
         utils::ShaderCodeStorage shaderCodeStorage;
 
         nri::DescriptorRangeDesc descriptorRangeStorage = {0, 1, nri::DescriptorType::STORAGE_STRUCTURED_BUFFER, nri::StageBits::COMPUTE_SHADER};
@@ -224,7 +297,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
         nri::ComputePipelineDesc computePipelineDesc = {};
         computePipelineDesc.pipelineLayout = m_PipelineLayout;
-        computePipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "Compute.cs", shaderCodeStorage);
+        computePipelineDesc.shader = LoadPackedShader(deviceDesc.graphicsAPI, "Compute.cs", shaderCodeStorage);
         NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, computePipelineDesc, m_Pipeline));
     }
 
@@ -246,7 +319,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBuffer));
     }
 
-    return InitImgui(*m_Device);
+    StartupProfilerBegin("UI");
+    bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
+
+    return initialized;
 }
 
 void Sample::LatencySleep(uint32_t frameIndex) {
@@ -262,46 +341,207 @@ void Sample::LatencySleep(uint32_t frameIndex) {
 
     // Preserve frame queue (optimal place for "non-waitable" swap chain)
     if constexpr (WAITABLE_SWAP_CHAIN == EMULATE_BAD_PRACTICE) {
-        const QueuedFrame& queuedFrame = m_QueuedFrames[frameIndex % m_QueuedFrameNum];
+        const QueuedFrame& queuedFrame = m_QueuedFrames[frameIndex % QUEUED_FRAMES_MAX_NUM];
 
+        double waitBegin = m_Timer.GetTimeStamp();
         NRI.Wait(*m_FrameFence, frameIndex >= m_QueuedFrameNum ? 1 + frameIndex - m_QueuedFrameNum : 0);
+        m_FenceWaitTime += m_Timer.GetTimeStamp() - waitBegin;
+
         NRI.ResetCommandAllocator(*queuedFrame.commandAllocator);
     }
 
     // Sleep just before sampling input
+    // (NRI latency markers have no frame index, they belong to the frame to be presented next. With the simulation thread
+    // they stay here only to drive "LatencySleep", while input sample and simulation end of each simulated frame are recorded
+    // by the simulation thread via "FramePacer" markers, which are the source of latency stats in this mode)
     if (m_AllowLowLatency) {
         NRI.LatencySleep(*m_SwapChain);
         NRI.SetLatencyMarker(*m_SwapChain, nri::LatencyMarker::INPUT_SAMPLE);
     }
 
+    // Software latency limiter (also collects latency stats if disabled)
+    m_FramePacer.SetEnabled(m_EnableFramePacer && !m_EnableLowLatency);
+    if (!m_SimulationThread.IsRunning())
+        m_FramePacer.Sleep(frameIndex);
+
     nri::nriEndAnnotation();
 }
 
-void Sample::PrepareFrame(uint32_t) {
-    nri::nriBeginAnnotation("Simulation", COLOR_SIMULATION);
+void Sample::PublishInput() {
+    // No event pumping (it belongs to the framework), the cursor position is queried as is
+    double x = 0.0;
+    double y = 0.0;
+    glfwGetCursorPos(m_Window, &x, &y);
+
+    std::lock_guard<std::mutex> lock(m_SimulationMutex);
+    m_SimulationInput.mousePos = ImVec2((float)x, (float)y);
+    m_SimulationInput.cpuWorkload = m_CpuWorkload;
+}
+
+void Sample::Simulate(SimulationFrame& simulationFrame) {
+    // Latch input (right after "FramePacer::Sleep", i.e. "wakeUpTime" is the input sample time)
+    SimulationInput input = {};
+    {
+        std::lock_guard<std::mutex> lock(m_SimulationMutex);
+        input = m_SimulationInput;
+    }
+
+    simulationFrame.mousePos = input.mousePos;
 
     // Emulate CPU workload
-    double begin = m_Timer.GetTimeStamp() + m_CpuWorkload;
+    double begin = m_Timer.GetTimeStamp() + input.cpuWorkload;
     while (m_Timer.GetTimeStamp() < begin)
         ;
+}
+
+void Sample::CollectLatencies(const nri::LatencyReport& latencyReport) {
+    // Frames queued with the previous setting are still in flight
+    if (m_IsBenchmarkWarmup)
+        return;
+
+    // The report can't describe frames simulated ahead (its input and simulation markers are set on the render thread)
+    if (m_AllowLowLatency && !m_SimulationThread.IsRunning()) {
+        // The report describes the latest completed frame, i.e. the same frame can be reported several times
+        if (!latencyReport.inputSampleTimeUs || latencyReport.inputSampleTimeUs == m_LastInputSampleTimeUs || latencyReport.gpuRenderEndTimeUs < latencyReport.inputSampleTimeUs)
+            return;
+
+        m_LastInputSampleTimeUs = latencyReport.inputSampleTimeUs;
+
+        auto getDuration = [](uint64_t from, uint64_t to) {
+            return (int64_t)(to - from) / 1000.0f;
+        };
+
+        LatencyStatsFrame frame = {};
+        frame.segments[(size_t)LatencySegment::INPUT_TO_SIMULATION] = getDuration(latencyReport.inputSampleTimeUs, latencyReport.simulationEndTimeUs);
+        frame.segments[(size_t)LatencySegment::SIMULATION_TO_RENDER] = getDuration(latencyReport.simulationEndTimeUs, latencyReport.renderSubmitEndTimeUs);
+        frame.segments[(size_t)LatencySegment::RENDER_TO_PRESENT] = getDuration(latencyReport.renderSubmitEndTimeUs, latencyReport.presentEndTimeUs);
+        frame.segments[(size_t)LatencySegment::PRESENT_TO_GPU] = getDuration(latencyReport.presentEndTimeUs, latencyReport.gpuRenderEndTimeUs);
+        frame.segments[(size_t)LatencySegment::TOTAL] = getDuration(latencyReport.inputSampleTimeUs, latencyReport.gpuRenderEndTimeUs);
+        frame.frameIndex = m_LatencyReportNum++;
+        frame.group = m_QueuedFrameNum;
+
+        m_LatencyStats.Add(frame);
+    } else {
+        // Software timings of frames completed since the last "Sleep"
+        for (const FramePacerFrame& pacerFrame : m_PacerFrames) {
+            LatencyStatsFrame frame = {};
+            frame.segments[(size_t)LatencySegment::INPUT_TO_SIMULATION] = float(pacerFrame.simulationEndTime - pacerFrame.wakeUpTime);
+            frame.segments[(size_t)LatencySegment::SIMULATION_TO_RENDER] = float(pacerFrame.submitTime - pacerFrame.simulationEndTime);
+            frame.segments[(size_t)LatencySegment::RENDER_TO_PRESENT] = float(pacerFrame.presentEndTime - pacerFrame.submitTime);
+            frame.segments[(size_t)LatencySegment::PRESENT_TO_GPU] = float(pacerFrame.doneTime - pacerFrame.presentEndTime);
+            frame.segments[(size_t)LatencySegment::TOTAL] = float(pacerFrame.doneTime - pacerFrame.wakeUpTime);
+            frame.frameIndex = pacerFrame.frameIndex;
+            frame.group = m_QueuedFrameNum;
+
+            m_LatencyStats.Add(frame);
+        }
+    }
+}
+
+void Sample::UpdateBenchmark() {
+    // "BENCHMARK_WARMUP_TIME" + "m_BenchmarkDuration" per "queued frame num" setting
+    double now = m_Timer.GetTimeStamp();
+    if (!m_BenchmarkQueuedFrameNum || now < m_BenchmarkPhaseEnd)
+        return;
+
+    if (m_IsBenchmarkWarmup) {
+        m_IsBenchmarkWarmup = false;
+        m_BenchmarkPhaseEnd = now + m_BenchmarkDuration * 1000.0;
+        m_LatencyStats.Reset();
+
+        return;
+    }
+
+    const LatencyStatsPercentiles& total = m_LatencyStats.GetPercentiles(LatencySegment::TOTAL);
+    m_BenchmarkResults[m_BenchmarkQueuedFrameNum - 1] = total;
+
+    printf("Latency benchmark: queued frames = %u, frames = %u, total latency (ms): p50 = %.2f, p95 = %.2f, p99 = %.2f, max = %.2f\n",
+        m_BenchmarkQueuedFrameNum, m_LatencyStats.GetFrameNum(), total.p50, total.p95, total.p99, total.max);
+
+    if (m_BenchmarkQueuedFrameNum == QUEUED_FRAMES_MAX_NUM) {
+        m_BenchmarkQueuedFrameNum = 0;
+
+        m_LatencyStats.SetRecording(false);
+        m_LatencyStats.WriteCsv(LATENCY_CSV_FILE);
+    } else {
+        m_BenchmarkQueuedFrameNum++;
+        m_QueuedFrameNum = m_BenchmarkQueuedFrameNum;
+        m_IsBenchmarkWarmup = true;
+        m_BenchmarkPhaseEnd = now + BENCHMARK_WARMUP_TIME;
+    }
+}
+
+void Sample::UpdateQueuedFrameNum() {
+    double now = m_Timer.GetTimeStamp();
+
+    // GPU idle time between frames completed since the previous frame (CPU-side approximation)
+    QueuedFrameControllerSample sample = {};
+    sample.frameTime = m_LastFrameTimeStamp != 0.0 ? now - m_LastFrameTimeStamp : 0.0;
+    sample.fenceWaitTime = m_FenceWaitTime;
+
+    for (const FramePacerFrame& pacerFrame : m_PacerFrames) {
+        if (m_LastGpuDoneTime != 0.0)
+            sample.gpuIdleTime += std::max(pacerFrame.submitTime - m_LastGpuDoneTime, 0.0);
+
+        m_LastGpuDoneTime = pacerFrame.doneTime;
+    }
+
+    m_LastFrameTimeStamp = now;
+    m_FenceWaitTime = 0.0;
+
+    // The benchmark sets the number of queued frames on its own. The manual setting can't change while adaptive, i.e.
+    // the controller restarts from the current depth only when switched on
+    bool isAdaptiveQueuedFrames = m_EnableAdaptiveQueuedFrames && !m_BenchmarkQueuedFrameNum;
+    if (isAdaptiveQueuedFrames) {
+        if (!m_IsAdaptiveQueuedFrames)
+            m_QueuedFrameController.Reset(m_QueuedFrameNum);
+
+        m_QueuedFrameNum = m_QueuedFrameController.Update(sample);
+    }
+
+    m_IsAdaptiveQueuedFrames = isAdaptiveQueuedFrames;
+}
+
+void Sample::PrepareFrame(uint32_t frameIndex) {
+    nri::nriBeginAnnotation("Simulation", COLOR_SIMULATION);
+
+    PublishInput();
+
+    // Simulate or take the frame simulated by the simulation thread (while the previous frame was rendered)
+    bool isPipelined = m_SimulationThread.IsRunning();
+
+    SimulationFrame simulationFrame = {};
+    if (isPipelined)
+        simulationFrame = m_SimulationThread.Pop(frameIndex);
+    else
+        Simulate(simulationFrame);
 
     bool enableLowLatencyPrev = m_EnableLowLatency;
-    uint32_t queuedFrameNumPrev = m_QueuedFrameNum;
 
-    if(IsHalfTimeLimitReached() && m_AllowLowLatency)
-        m_EnableLowLatency = !m_EnableLowLatency;
+    // Stats
+    nri::LatencyReport latencyReport = {};
+    if (m_AllowLowLatency)
+        NRI.GetLatencyReport(*m_SwapChain, latencyReport);
+
+    m_FramePacer.GetCompletedFrames(m_PacerFrames);
+
+    CollectLatencies(latencyReport);
+    UpdateBenchmark();
+    UpdateQueuedFrameNum();
+
+    if (IsHalfTimeLimitReached() && !m_BenchmarkQueuedFrameNum) {
+        if (m_AllowLowLatency)
+            m_EnableLowLatency = !m_EnableLowLatency;
+        else
+            m_EnableFramePacer = !m_EnableFramePacer;
+    }
 
     ImGui::NewFrame();
     {
-        // Lagometer
-        ImVec2 p = ImGui::GetIO().MousePos;
+        // Lagometer (input seen by the simulation)
+        ImVec2 p = simulationFrame.mousePos;
         ImGui::GetForegroundDrawList()->AddRectFilled(p, ImVec2(p.x + 20, p.y + 20), IM_COL32(128, 10, 10, 255));
 
-        // Stats
-        nri::LatencyReport latencyReport = {};
-        if (m_AllowLowLatency)
-            NRI.GetLatencyReport(*m_SwapChain, latencyReport);
-
         ImGui::SetNextWindowPos(ImVec2(30, 30), ImGuiCond_Once);
         ImGui::SetNextWindowSize(ImVec2(0, 0));
         ImGui::Begin("Low latency");
@@ -319,6 +559,15 @@ void Sample::PrepareFrame(uint32_t) {
             ImGui::Text("Frame time         : %6.2f ms", m_Timer.GetSmoothedFrameTime());
             ImGui::Separator();
 
+            FramePacerStats framePacerStats = m_FramePacer.GetStats();
+            ImGui::Text("GPU done - Input   = %6.2f ms", framePacerStats.latency);
+            ImGui::Text("  Jitter           : %6.2f ms", framePacerStats.latencyJitter);
+            ImGui::Text("  GPU frame        : %6.2f ms", framePacerStats.gpuFrameTime);
+            ImGui::Text("  CPU frame        : %6.2f ms", framePacerStats.cpuFrameTime);
+            ImGui::Text("  Sleep            : %6.2f ms", framePacerStats.sleepTime);
+            ImGui::Text("  OS oversleep     : %6.2f ms", framePacerStats.oversleep);
+            ImGui::Separator();
+
             ImGui::Text("CPU workload (ms):");
             ImGui::SetNextItemWidth(210.0f);
             ImGui::SliderFloat("##CPU", &m_CpuWorkload, 0.0f, 1000.0f / 30.0f, "%.1f", ImGuiSliderFlags_NoInput);
@@ -327,7 +576,19 @@ void Sample::PrepareFrame(uint32_t) {
             ImGui::SliderInt("##GPU", (int32_t*)&m_GpuWorkload, 1, 20, "%d", ImGuiSliderFlags_NoInput);
             ImGui::Text("Queued frames:");
             ImGui::SetNextItemWidth(210.0f);
+            ImGui::BeginDisabled(m_BenchmarkQueuedFrameNum != 0 || m_EnableAdaptiveQueuedFrames);
             ImGui::SliderInt("##Frames", (int32_t*)&m_QueuedFrameNum, 1, QUEUED_FRAMES_MAX_NUM, "%d", ImGuiSliderFlags_NoInput);
+            ImGui::EndDisabled();
+            ImGui::SameLine();
+            ImGui::Checkbox("Adaptive (F4)", &m_EnableAdaptiveQueuedFrames);
+            if (IsKeyToggled(Key::F4))
+                m_EnableAdaptiveQueuedFrames = !m_EnableAdaptiveQueuedFrames;
+
+            if (m_EnableAdaptiveQueuedFrames) {
+                const QueuedFrameControllerSample& average = m_QueuedFrameController.GetAverage();
+                ImGui::Text("  Fence wait       : %6.2f ms", average.fenceWaitTime);
+                ImGui::Text("  GPU idle         : %6.2f ms%s", average.gpuIdleTime, m_QueuedFrameController.IsTrial() ? " (trial)" : "");
+            }
 
             ImGui::BeginDisabled(!m_AllowLowLatency);
             ImGui::Checkbox("Low latency (F1)", &m_EnableLowLatency);
@@ -335,6 +596,26 @@ void Sample::PrepareFrame(uint32_t) {
                 m_EnableLowLatency = !m_EnableLowLatency;
             ImGui::EndDisabled();
 
+            ImGui::BeginDisabled(m_EnableLowLatency);
+            ImGui::Checkbox("Software latency limiter (F2)", &m_EnableFramePacer);
+            if (!m_EnableLowLatency && IsKeyToggled(Key::F2))
+                m_EnableFramePacer = !m_EnableFramePacer;
+            ImGui::EndDisabled();
+
+            ImGui::Checkbox("Simulation thread (F3)", &m_EnableSimulationThread);
+            if (IsKeyToggled(Key::F3))
+                m_EnableSimulationThread = !m_EnableSimulationThread;
+
+            if (m_EnableSimulationThread) {
+                ImGui::SameLine();
+                ImGui::SetNextItemWidth(60.0f);
+                ImGui::SliderInt("Ahead", (int32_t*)&m_SimulationQueueSize, 1, SimulationThread<SimulationFrame>::QUEUE_MAX_SIZE, "%d", ImGuiSliderFlags_NoInput);
+
+                SimulationThreadStats simulationStats = m_SimulationThread.GetStats();
+                ImGui::Text("  Render waits     : %6.2f ms", simulationStats.renderWaitTime);
+                ImGui::Text("  Simulation waits : %6.2f ms", simulationStats.simulationWaitTime);
+            }
+
             char s[64];
             snprintf(s, sizeof(s), "Waitable swapchain (%u)", WAITABLE_SWAP_CHAIN_MAX_FRAME_LATENCY);
 
@@ -344,6 +625,54 @@ void Sample::PrepareFrame(uint32_t) {
             bool badPractice = EMULATE_BAD_PRACTICE;
             ImGui::Checkbox("Bad practice", &badPractice);
             ImGui::EndDisabled();
+
+            if (ImGui::CollapsingHeader("Latency statistics")) {
+                ImGui::BeginDisabled(m_BenchmarkQueuedFrameNum != 0);
+                {
+                    int32_t window = (int32_t)m_LatencyStats.GetWindow();
+                    ImGui::SetNextItemWidth(210.0f);
+                    if (ImGui::SliderInt("Window (frames)", &window, 60, LatencyStats::WINDOW_MAX_SIZE, "%d", ImGuiSliderFlags_Logarithmic))
+                        m_LatencyStats.SetWindow((uint32_t)window);
+
+                    bool isRecording = m_LatencyStats.IsRecording();
+                    if (ImGui::Checkbox("Record", &isRecording))
+                        m_LatencyStats.SetRecording(isRecording);
+                    ImGui::SameLine();
+                    if (ImGui::Button("Save CSV"))
+                        m_LatencyStats.WriteCsv(LATENCY_CSV_FILE);
+                    ImGui::SameLine();
+                    if (ImGui::Button("Clear"))
+                        m_LatencyStats.ClearRecording();
+
+                    ImGui::SetNextItemWidth(210.0f);
+                    ImGui::SliderFloat("Seconds per setting", &m_BenchmarkDuration, 1.0f, 30.0f, "%.0f");
+                    if (ImGui::Button("Benchmark queued frames")) {
+                        m_BenchmarkResults = {};
+                        m_BenchmarkQueuedFrameNum = 1;
+                        m_BenchmarkPhaseEnd = m_Timer.GetTimeStamp() + BENCHMARK_WARMUP_TIME;
+                        m_IsBenchmarkWarmup = true;
+                        m_QueuedFrameNum = 1;
+
+                        m_LatencyStats.SetWindow(LatencyStats::WINDOW_MAX_SIZE);
+                        m_LatencyStats.ClearRecording();
+                        m_LatencyStats.SetRecording(true);
+                    }
+                }
+                ImGui::EndDisabled();
+
+                if (m_BenchmarkQueuedFrameNum) {
+                    ImGui::SameLine();
+                    ImGui::Text("%u / %u%s", m_BenchmarkQueuedFrameNum, QUEUED_FRAMES_MAX_NUM, m_IsBenchmarkWarmup ? " (warm up)" : "");
+                }
+
+                for (uint32_t i = 0; i < QUEUED_FRAMES_MAX_NUM; i++) {
+                    const LatencyStatsPercentiles& result = m_BenchmarkResults[i];
+                    if (result.max > 0.0f)
+                        ImGui::Text("  %u queued: p50 %6.2f, p95 %6.2f, p99 %6.2f, max %6.2f", i + 1, result.p50, result.p95, result.p99, result.max);
+                }
+
+                m_LatencyStats.DrawImgui();
+            }
         }
         ImGui::End();
     }
@@ -358,27 +687,49 @@ void Sample::PrepareFrame(uint32_t) {
         NRI.SetLatencySleepMode(*m_SwapChain, sleepMode);
     }
 
-    if (queuedFrameNumPrev != m_QueuedFrameNum)
-        NRI.QueueWaitIdle(m_GraphicsQueue);
+    // (Re)start or stop the simulation thread, it takes over starting from the next frame
+    if (m_EnableSimulationThread != isPipelined || (isPipelined && m_SimulationQueueSize != m_SimulationThread.GetQueueSize())) {
+        m_SimulationThread.Stop();
+
+        if (m_EnableSimulationThread) {
+            m_SimulationThread.Start(frameIndex + 1, m_SimulationQueueSize, [this](uint32_t simulationFrameIndex, SimulationFrame& frame) {
+                m_FramePacer.Sleep(simulationFrameIndex);
+                Simulate(frame);
+                m_FramePacer.OnSimulationEnd(simulationFrameIndex);
+            });
+        }
+    }
 
     // Marker
     if (m_AllowLowLatency)
         NRI.SetLatencyMarker(*m_SwapChain, nri::LatencyMarker::SIMULATION_END);
 
+    if (!isPipelined)
+        m_FramePacer.OnSimulationEnd(frameIndex);
+
     nri::nriEndAnnotation();
 }
 
 void Sample::RenderFrame(uint32_t frameIndex) {
     nri::nriBeginAnnotation("Render", COLOR_RENDER);
 
-    const QueuedFrame& queuedFrame = m_QueuedFrames[frameIndex % m_QueuedFrameNum];
+    // Allocators are cycled over all slots, i.e. the slot was last used by frame "frameIndex - QUEUED_FRAMES_MAX_NUM", which
+    // is already waited for with any "m_QueuedFrameNum": the number of queued frames can change at any frame without draining
+    const QueuedFrame& queuedFrame = m_QueuedFrames[frameIndex % QUEUED_FRAMES_MAX_NUM];
 
     // Preserve frame queue (optimal place for "waitable" swapchain)
     if constexpr (WAITABLE_SWAP_CHAIN != EMULATE_BAD_PRACTICE) {
+        double waitBegin = m_Timer.GetTimeStamp();
         NRI.Wait(*m_FrameFence, frameIndex >= m_QueuedFrameNum ? 1 + frameIndex - m_QueuedFrameNum : 0);
+        m_FenceWaitTime += m_Timer.GetTimeStamp() - waitBegin;
+
         NRI.ResetCommandAllocator(*queuedFrame.commandAllocator);
     }
 
+    // Fresh input for the simulation thread, which is about to start the next frame
+    if (m_SimulationThread.IsRunning())
+        PublishInput();
+
     // Acquire a swap chain texture
     uint32_t recycledSemaphoreIndex = frameIndex % (uint32_t)m_SwapChainTextures.size();
     nri::Fence* swapChainAcquireSemaphore = m_SwapChainTextures[recycledSemaphoreIndex].acquireSemaphore;
@@ -481,7 +832,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         nri::FenceSubmitDesc renderingFinishedFence = {};
         renderingFinishedFence.fence = swapChainTexture.releaseSemaphore;
 
-        nri::FenceSubmitDesc signalFences[] = {renderingFinishedFence, frameFence};
+        nri::FenceSubmitDesc signalFences[] = {renderingFinishedFence, frameFence, m_FramePacer.GetSubmitSignal(frameIndex)};
 
         nri::QueueSubmitDesc queueSubmitDesc = {};
         queueSubmitDesc.waitFences = &textureAcquiredFence;
@@ -499,6 +850,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         }
 
         NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
+        m_FramePacer.OnSubmit(frameIndex);
 
         if (m_AllowLowLatency)
             NRI.SetLatencyMarker(*m_SwapChain, nri::LatencyMarker::RENDER_SUBMIT_END);
@@ -508,6 +860,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
 
     // Present
     NRI.QueuePresent(*m_SwapChain, *swapChainTexture.releaseSemaphore);
+    m_FramePacer.OnPresent(frameIndex);
 
     nri::nriEndAnnotation();
 }
@@ -6,6 +6,11 @@
 
 #include "NRIFramework.h"
 
+#include "Common/PipelineCache.h"
+#include "Common/PipelineCompiler.h"
+#include "Common/ShaderArchive.h"
+#include "Common/StartupProfiler.h"
+
 #include <array>
 #include <atomic>
 #include <thread>
@@ -33,7 +38,7 @@ struct Vertex {
 struct Box {
     uint32_t dynamicConstantBufferOffset;
     nri::DescriptorSet* descriptorSet;
-    nri::Pipeline* pipeline;
+    uint32_t pipelineIndex;
 };
 
 struct QueuedFrame {
@@ -81,7 +86,9 @@ private:
 
 private:
     std::array<ThreadContext, THREAD_MAX_NUM> m_ThreadContexts = {};
-    std::vector<nri::Pipeline*> m_Pipelines;
+    PersistentPipelineCache m_PipelineCache;
+    PipelineCompiler m_PipelineCompiler;
+
     std::vector<nri::Texture*> m_Textures;
     std::vector<nri::Descriptor*> m_TextureViews;
     std::vector<nri::Descriptor*> m_FakeConstantBufferViews;
@@ -158,8 +165,7 @@ Sample::~Sample() {
         for (size_t i = 0; i < m_FakeConstantBufferViews.size(); i++)
             NRI.DestroyDescriptor(m_FakeConstantBufferViews[i]);
 
-        for (size_t i = 0; i < m_Pipelines.size(); i++)
-            NRI.DestroyPipeline(m_Pipelines[i]);
+        m_PipelineCompiler.Destroy();
 
         NRI.DestroyDescriptor(m_Sampler);
         NRI.DestroyDescriptor(m_DepthTextureView);
@@ -171,6 +177,10 @@ Sample::~Sample() {
         NRI.DestroyBuffer(m_FakeConstantBuffer);
         NRI.DestroyBuffer(m_VertexBuffer);
         NRI.DestroyBuffer(m_IndexBuffer);
+
+        m_PipelineCache.Save(NRI);
+        m_PipelineCache.Destroy(NRI);
+
         NRI.DestroyPipelineLayout(m_PipelineLayout);
         NRI.DestroyDescriptorPool(m_DescriptorPool);
         NRI.DestroyFence(m_FrameFence);
@@ -200,6 +210,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     m_Boxes.resize(std::max(BOX_NUM, m_ThreadNum));
     m_BoxesPerThread = (uint32_t)m_Boxes.size() / (uint32_t)m_ThreadNum;
 
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -215,13 +227,20 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.vkBindingOffsets = VK_BINDING_OFFSETS;
     deviceCreationDesc.adapterDesc = &adapterDesc[std::min(m_AdapterIndex, adapterDescsNum - 1)];
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
+
+    m_PipelineCache.Preload(graphicsAPI, *deviceCreationDesc.adapterDesc);
+
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    StartupProfilerEnd();
 
     // Create streamer
     nri::StreamerDesc streamerDesc = {};
@@ -235,15 +254,30 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
     m_DepthFormat = nri::GetSupportedDepthFormat(NRI, *m_Device, 24, false);
+
+    StartupProfilerBegin("Swap chain");
     nri::Format swapChainFormat = CreateSwapChain();
+    StartupProfilerEnd();
 
     CreateCommandBuffers();
     CreateDepthTexture();
+
+    StartupProfilerBegin("Pipelines");
+    m_PipelineCache.Create(NRI, *m_Device);
+    m_PipelineCompiler.Initialize(NRI, *m_Device);
     CreatePipeline(swapChainFormat);
+    StartupProfilerEnd();
+
+    StartupProfilerBegin("Textures");
     CreateTextures();
+    StartupProfilerEnd();
+
+    StartupProfilerBegin("Resources");
     CreateFakeConstantBuffers();
     CreateViewConstantBuffer();
     CreateVertexBuffer();
+    StartupProfilerEnd();
+
     CreateDescriptorPool();
     CreateTransformConstantBuffer();
     CreateDescriptorSets();
@@ -253,7 +287,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
             m_ThreadContexts[i].thread = std::thread(&Sample::ThreadEntryPoint, this, i);
     }
 
-    return InitImgui(*m_Device);
+    StartupProfilerBegin("UI");
+    bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
+
+    return initialized;
 }
 
 void Sample::LatencySleep(uint32_t frameIndex) {
@@ -553,7 +593,12 @@ void Sample::RenderBoxes(nri::CommandBuffer& commandBuffer, uint32_t offset, uin
     for (uint32_t i = 0; i < number; i++) {
         const Box& box = m_Boxes[offset + i];
 
-        NRI.CmdSetPipeline(commandBuffer, *box.pipeline);
+        // Pipelines differ only in the fragment shader, the first one (the fallback) is compiled upfront
+        nri::Pipeline* pipeline = m_PipelineCompiler.Get(box.pipelineIndex);
+        if (!pipeline)
+            continue;
+
+        NRI.CmdSetPipeline(commandBuffer, *pipeline);
 
         nri::SetDescriptorSetDesc descriptorSet0 = {0, box.descriptorSet};
         NRI.CmdSetDescriptorSet(commandBuffer, descriptorSet0);
@@ -717,9 +762,9 @@ void Sample::CreatePipeline(nri::Format swapChainFormat) {
     utils::ShaderCodeStorage shaderCodeStorage;
 
     nri::ShaderDesc shaders[1 + pipelineNum];
-    shaders[0] = utils::LoadShader(deviceDesc.graphicsAPI, "Box.vs", shaderCodeStorage);
+    shaders[0] = LoadPackedShader(deviceDesc.graphicsAPI, "Box.vs", shaderCodeStorage);
     for (uint32_t i = 0; i < pipelineNum; i++)
-        shaders[1 + i] = utils::LoadShader(deviceDesc.graphicsAPI, "Box" + std::to_string(i) + ".fs", shaderCodeStorage);
+        shaders[1 + i] = LoadPackedShader(deviceDesc.graphicsAPI, "Box" + std::to_string(i) + ".fs", shaderCodeStorage);
 
     nri::VertexStreamDesc vertexStreamDesc = {};
     vertexStreamDesc.bindingSlot = 0;
@@ -771,19 +816,24 @@ void Sample::CreatePipeline(nri::Format swapChainFormat) {
 
     nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
     graphicsPipelineDesc.pipelineLayout = m_PipelineLayout;
+    graphicsPipelineDesc.cache = m_PipelineCache.Get();
     graphicsPipelineDesc.vertexInput = &vertexInputDesc;
     graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
     graphicsPipelineDesc.rasterization = rasterizationDesc;
     graphicsPipelineDesc.outputMerger = outputMergerDesc;
 
-    m_Pipelines.resize(pipelineNum);
+    // The first pipeline is compiled right away, it's used as a fallback for others until they are compiled in background
+    uint32_t fallback = PIPELINE_COMPILER_NO_FALLBACK;
 
-    for (size_t i = 0; i < m_Pipelines.size(); i++) {
+    for (uint32_t i = 0; i < pipelineNum; i++) {
         nri::ShaderDesc shaderStages[] = {shaders[0], shaders[1 + i]};
         graphicsPipelineDesc.shaders = shaderStages;
         graphicsPipelineDesc.shaderNum = helper::GetCountOf(shaderStages);
 
-        NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, m_Pipelines[i]));
+        if (i == 0)
+            fallback = m_PipelineCompiler.Compile(graphicsPipelineDesc);
+        else
+            m_PipelineCompiler.Submit(graphicsPipelineDesc, fallback);
     }
 }
 
@@ -953,7 +1003,7 @@ void Sample::CreateDescriptorSets() {
         for (size_t i = 0; i < m_Boxes.size(); i++) {
             Box& box = m_Boxes[i];
 
-            box.pipeline = m_Pipelines[(i / DRAW_CALLS_PER_PIPELINE) % m_Pipelines.size()];
+            box.pipelineIndex = (uint32_t)((i / DRAW_CALLS_PER_PIPELINE) % m_PipelineCompiler.GetPipelineNum());
             box.descriptorSet = descriptorSets[i];
 
             nri::Descriptor* constantBuffers[] = {
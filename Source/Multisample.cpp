@@ -2,6 +2,11 @@
 
 #include "NRIFramework.h"
 
+#include "Common/PipelineCache.h"
+#include "Common/ResourceStateTracker.h"
+#include "Common/ShaderArchive.h"
+#include "Common/StartupProfiler.h"
+
 struct ConstantBufferLayout {
     float color[3];
     float scale;
@@ -57,7 +62,9 @@ private:
     nri::Buffer* m_GeometryBuffer = nullptr;
     nri::Texture* m_Texture = nullptr;
     nri::Texture* m_TextureMsaa = nullptr;
-    nri::AccessLayoutStage m_TextureMsaaLastState = {};
+
+    PersistentPipelineCache m_PipelineCache;
+    ResourceStateTracker m_StateTracker;
 
     std::vector<QueuedFrame> m_QueuedFrames = {};
     std::vector<SwapChainTexture> m_SwapChainTextures;
@@ -85,6 +92,10 @@ Sample::~Sample() {
         }
 
         NRI.DestroyPipeline(m_Pipeline);
+
+        m_PipelineCache.Save(NRI);
+        m_PipelineCache.Destroy(NRI);
+
         NRI.DestroyPipelineLayout(m_PipelineLayout);
         NRI.DestroyDescriptor(m_TextureShaderResource);
         NRI.DestroyDescriptor(m_AttachmentMsaa);
@@ -111,6 +122,8 @@ Sample::~Sample() {
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -126,13 +139,20 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.vkBindingOffsets = VK_BINDING_OFFSETS;
     deviceCreationDesc.adapterDesc = &adapterDesc[std::min(m_AdapterIndex, adapterDescsNum - 1)];
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
+
+    m_PipelineCache.Preload(graphicsAPI, *deviceCreationDesc.adapterDesc);
+
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    StartupProfilerEnd();
 
     // Create streamer
     nri::StreamerDesc streamerDesc = {};
@@ -151,6 +171,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     // Swap chain
     nri::Format swapChainFormat;
     {
+        StartupPhase phase("Swap chain");
+
         nri::SwapChainDesc swapChainDesc = {};
         swapChainDesc.window = GetWindow();
         swapChainDesc.queue = m_GraphicsQueue;
@@ -190,6 +212,10 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         }
     }
 
+    m_StateTracker.Initialize(NRI);
+    for (const SwapChainTexture& swapChainTexture : m_SwapChainTextures)
+        m_StateTracker.RegisterTexture(*swapChainTexture.texture, {});
+
     // Multisampling support
     nri::FormatSupportBits formatSupportBits = NRI.GetFormatSupport(*m_Device, swapChainFormat);
     nri::Sample_t sampleNum = 1;
@@ -212,6 +238,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBuffer));
     }
 
+    StartupProfilerBegin("Pipelines");
+    m_PipelineCache.Create(NRI, *m_Device);
+
     { // Pipeline layout
         nri::SamplerDesc samplerDesc = {};
         samplerDesc.addressModes = {nri::AddressMode::MIRRORED_REPEAT, nri::AddressMode::MIRRORED_REPEAT};
@@ -289,8 +318,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         outputMergerDesc.colorNum = 1;
 
         nri::ShaderDesc shaderStages[] = {
-            utils::LoadShader(deviceDesc.graphicsAPI, "TriangleFlexibleMultiview.vs", shaderCodeStorage),
-            utils::LoadShader(deviceDesc.graphicsAPI, "Triangle.fs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "TriangleFlexibleMultiview.vs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "Triangle.fs", shaderCodeStorage),
         };
 
         nri::MultisampleDesc multisampleDesc = {};
@@ -300,6 +329,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
         nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
         graphicsPipelineDesc.pipelineLayout = m_PipelineLayout;
+        graphicsPipelineDesc.cache = m_PipelineCache.Get();
         graphicsPipelineDesc.vertexInput = &vertexInputDesc;
         graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
         graphicsPipelineDesc.rasterization = rasterizationDesc;
@@ -311,6 +341,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, m_Pipeline));
     }
 
+    StartupProfilerEnd();
+
     { // Descriptor pool
         nri::DescriptorPoolDesc descriptorPoolDesc = {};
         descriptorPoolDesc.descriptorSetMaxNum = GetQueuedFrameNum() + 1;
@@ -323,11 +355,16 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
     // Load texture
     utils::Texture texture;
-    std::string path = utils::GetFullPath("wood.dds", utils::DataFolder::TEXTURES);
-    if (!utils::LoadTexture(path, texture))
-        return false;
+    {
+        StartupPhase startupPhase("Textures"); // also closed on the error path
+
+        std::string path = utils::GetFullPath("wood.dds", utils::DataFolder::TEXTURES);
+        if (!utils::LoadTexture(path, texture))
+            return false;
+    }
 
     // Resources
+    StartupProfilerBegin("Resources");
     const uint32_t constantBufferSize = helper::Align((uint32_t)sizeof(ConstantBufferLayout), deviceDesc.memoryAlignment.constantBufferOffset);
     constexpr uint64_t indexDataSize = sizeof(g_IndexData);
     constexpr uint64_t indexDataAlignedSize = helper::Align(indexDataSize, 16);
@@ -395,8 +432,12 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
         m_MemoryAllocations.resize(1 + NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
         NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + 1));
+
+        m_StateTracker.RegisterTexture(*m_TextureMsaa, {});
     }
 
+    StartupProfilerEnd();
+
     // Descriptors
     {
         { // Attachment MSAA
@@ -442,6 +483,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     { // Upload data
+        StartupPhase phase("Upload");
+
         std::vector<uint8_t> geometryBufferData(indexDataAlignedSize + vertexDataSize);
         memcpy(&geometryBufferData[0], g_IndexData, indexDataSize);
         memcpy(&geometryBufferData[indexDataAlignedSize], g_VertexData, vertexDataSize);
@@ -464,7 +507,11 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     // User interface
+    StartupProfilerBegin("UI");
     bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
 
     return initialized;
 }
@@ -549,24 +596,11 @@ void Sample::RenderFrame(uint32_t frameIndex) {
             resolveDstState.stages = nri::StageBits::RESOLVE;
         }
 
-        { // Barriers
-            nri::TextureBarrierDesc textureBarriers[2] = {};
-
-            textureBarriers[0].texture = swapChainTexture.texture;
-            textureBarriers[0].after = resolveDstState;
-
-            textureBarriers[1].texture = m_TextureMsaa;
-            textureBarriers[1].before = m_TextureMsaaLastState;
-            textureBarriers[1].after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT};
-
-            bool isAlreadyAttachment = m_TextureMsaaLastState.access == textureBarriers[1].after.access;
-            m_TextureMsaaLastState = textureBarriers[1].after;
-
-            nri::BarrierDesc barrierGroup = {};
-            barrierGroup.textureNum = isAlreadyAttachment ? 1 : 2;
-            barrierGroup.textures = textureBarriers;
-
-            NRI.CmdBarrier(*commandBuffer, barrierGroup);
+        { // Barriers (the swap chain texture is fully overwritten)
+            m_StateTracker.Discard(*swapChainTexture.texture);
+            m_StateTracker.RequireState(*swapChainTexture.texture, resolveDstState);
+            m_StateTracker.RequireState(*m_TextureMsaa, {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT});
+            m_StateTracker.Flush(*commandBuffer);
         }
 
         { // Multisampling rendering
@@ -623,36 +657,17 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         }
 
         if (!m_RenderPassResolve) {
-            { // Barriers: prepare MSAA target for manual resolve
-                nri::TextureBarrierDesc textureBarrier = {};
-                textureBarrier.texture = m_TextureMsaa;
-                textureBarrier.before = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT};
-                textureBarrier.after = {nri::AccessBits::RESOLVE_SOURCE, nri::Layout::RESOLVE_SOURCE, nri::StageBits::RESOLVE}; // Sync to explicit resolve stage
-                m_TextureMsaaLastState = textureBarrier.after;
-
-                nri::BarrierDesc barrierGroup = {};
-                barrierGroup.textureNum = 1;
-                barrierGroup.textures = &textureBarrier;
-
-                NRI.CmdBarrier(*commandBuffer, barrierGroup);
-            }
+            // Barriers: prepare MSAA target for manual resolve
+            m_StateTracker.RequireState(*m_TextureMsaa, {nri::AccessBits::RESOLVE_SOURCE, nri::Layout::RESOLVE_SOURCE, nri::StageBits::RESOLVE}); // Sync to explicit resolve stage
+            m_StateTracker.Flush(*commandBuffer);
 
             // Resolve (slow, off chip)
             NRI.CmdResolveTexture(*commandBuffer, *swapChainTexture.texture, nullptr, *m_TextureMsaa, nullptr, (nri::ResolveOp)m_ResolveMode);
         }
 
-        { // Barriers: prepare Swap Chain for Composition
-            nri::TextureBarrierDesc textureBarrier = {};
-            textureBarrier.texture = swapChainTexture.texture;
-            textureBarrier.before = resolveDstState;
-            textureBarrier.after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT};
-
-            nri::BarrierDesc barrierGroup = {};
-            barrierGroup.textureNum = 1;
-            barrierGroup.textures = &textureBarrier;
-
-            NRI.CmdBarrier(*commandBuffer, barrierGroup);
-        }
+        // Barriers: prepare Swap Chain for Composition
+        m_StateTracker.RequireState(*swapChainTexture.texture, {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT});
+        m_StateTracker.Flush(*commandBuffer);
 
         { // Composition
             nri::AttachmentDesc colorAttachmentDesc = {};
@@ -673,18 +688,9 @@ void Sample::RenderFrame(uint32_t frameIndex) {
             NRI.CmdEndRendering(*commandBuffer);
         }
 
-        { // Barriers: transition to present
-            nri::TextureBarrierDesc textureBarrier = {};
-            textureBarrier.texture = swapChainTexture.texture;
-            textureBarrier.before = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT};
-            textureBarrier.after = {nri::AccessBits::NONE, nri::Layout::PRESENT, nri::StageBits::NONE};
-
-            nri::BarrierDesc barrierGroup = {};
-            barrierGroup.textureNum = 1;
-            barrierGroup.textures = &textureBarrier;
-
-            NRI.CmdBarrier(*commandBuffer, barrierGroup);
-        }
+        // Barriers: transition to present
+        m_StateTracker.RequireState(*swapChainTexture.texture, {nri::AccessBits::NONE, nri::Layout::PRESENT, nri::StageBits::NONE});
+        m_StateTracker.Flush(*commandBuffer);
     }
     NRI.EndCommandBuffer(*commandBuffer);
 
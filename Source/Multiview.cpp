@@ -2,6 +2,10 @@
 
 #include "NRIFramework.h"
 
+#include "Common/PipelineCache.h"
+#include "Common/ShaderArchive.h"
+#include "Common/StartupProfiler.h"
+
 constexpr uint32_t VIEW_NUM = 2;
 constexpr nri::Color32f COLOR_0 = {1.0f, 1.0f, 0.0f, 1.0f};
 constexpr nri::Color32f COLOR_1 = {0.46f, 0.72f, 0.0f, 1.0f};
@@ -62,6 +66,8 @@ private:
     nri::Texture* m_Texture = nullptr;
     nri::Texture* m_MultiviewTexture = nullptr;
 
+    PersistentPipelineCache m_PipelineCache;
+
     std::vector<QueuedFrame> m_QueuedFrames = {};
     std::vector<SwapChainTexture> m_SwapChainTextures;
     std::vector<nri::Memory*> m_MemoryAllocations;
@@ -88,6 +94,10 @@ Sample::~Sample() {
         }
 
         NRI.DestroyPipeline(m_Pipeline);
+
+        m_PipelineCache.Save(NRI);
+        m_PipelineCache.Destroy(NRI);
+
         NRI.DestroyPipelineLayout(m_PipelineLayout);
         NRI.DestroyDescriptor(m_MultiviewAttachment);
         NRI.DestroyDescriptor(m_TextureShaderResource);
@@ -114,6 +124,8 @@ Sample::~Sample() {
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -129,13 +141,20 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.vkBindingOffsets = VK_BINDING_OFFSETS;
     deviceCreationDesc.adapterDesc = &adapterDesc[std::min(m_AdapterIndex, adapterDescsNum - 1)];
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
+
+    m_PipelineCache.Preload(graphicsAPI, *deviceCreationDesc.adapterDesc);
+
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    StartupProfilerEnd();
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
     if (!deviceDesc.features.layerBasedMultiview) {
@@ -160,6 +179,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     // Swap chain
     nri::Format swapChainFormat;
     {
+        StartupPhase phase("Swap chain");
+
         nri::SwapChainDesc swapChainDesc = {};
         swapChainDesc.window = GetWindow();
         swapChainDesc.queue = m_GraphicsQueue;
@@ -206,6 +227,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBuffer));
     }
 
+    StartupProfilerBegin("Pipelines");
+    m_PipelineCache.Create(NRI, *m_Device);
+
     { // Pipeline layout
         nri::SamplerDesc samplerDesc = {};
         samplerDesc.addressModes = {nri::AddressMode::MIRRORED_REPEAT, nri::AddressMode::MIRRORED_REPEAT};
@@ -284,12 +308,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         outputMergerDesc.multiview = nri::Multiview::LAYER_BASED;
 
         nri::ShaderDesc shaderStages[] = {
-            utils::LoadShader(deviceDesc.graphicsAPI, "Triangle.vs", shaderCodeStorage),
-            utils::LoadShader(deviceDesc.graphicsAPI, "Triangle.fs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "Triangle.vs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "Triangle.fs", shaderCodeStorage),
         };
 
         nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
         graphicsPipelineDesc.pipelineLayout = m_PipelineLayout;
+        graphicsPipelineDesc.cache = m_PipelineCache.Get();
         graphicsPipelineDesc.vertexInput = &vertexInputDesc;
         graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
         graphicsPipelineDesc.rasterization = rasterizationDesc;
@@ -300,6 +325,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, m_Pipeline));
     }
 
+    StartupProfilerEnd();
+
     { // Descriptor pool
         nri::DescriptorPoolDesc descriptorPoolDesc = {};
         descriptorPoolDesc.descriptorSetMaxNum = GetQueuedFrameNum() + 1;
@@ -312,11 +339,16 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
     // Load texture
     utils::Texture texture;
-    std::string path = utils::GetFullPath("wood.dds", utils::DataFolder::TEXTURES);
-    if (!utils::LoadTexture(path, texture))
-        return false;
+    {
+        StartupPhase startupPhase("Textures"); // also closed on the error path
+
+        std::string path = utils::GetFullPath("wood.dds", utils::DataFolder::TEXTURES);
+        if (!utils::LoadTexture(path, texture))
+            return false;
+    }
 
     // Resources
+    StartupProfilerBegin("Resources");
     const uint32_t constantBufferSize = helper::Align((uint32_t)sizeof(ConstantBufferLayout), deviceDesc.memoryAlignment.constantBufferOffset);
     const uint64_t indexDataSize = sizeof(g_IndexData);
     const uint64_t indexDataAlignedSize = helper::Align(indexDataSize, 16);
@@ -381,6 +413,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     m_MemoryAllocations.resize(1 + NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
     NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + 1));
 
+    StartupProfilerEnd();
+
     {     // Descriptors
         { // Read-only texture
             nri::TextureViewDesc textureViewDesc = {m_Texture, nri::TextureView::TEXTURE, texture.GetFormat()};
@@ -422,6 +456,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     { // Upload data
+        StartupPhase phase("Upload");
+
         std::vector<uint8_t> geometryBufferData(indexDataAlignedSize + vertexDataSize);
         memcpy(&geometryBufferData[0], g_IndexData, indexDataSize);
         memcpy(&geometryBufferData[indexDataAlignedSize], g_VertexData, vertexDataSize);
@@ -444,7 +480,11 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     // User interface
+    StartupProfilerBegin("UI");
     bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
 
     return initialized;
 }
@@ -1,156 +1,75 @@
 ﻿// © 2021 NVIDIA Corporation
 
+#include "NRI.hlsl"
 #include "NRIFramework.h"
 
+#include "Common/AccelerationStructureBuildQueue.h"
+#include "Common/AccelerationStructureStats.h"
+#include "Common/RayTracingBoxesScene.h"
+#include "Common/ShaderArchive.h"
+#include "Common/ShaderBindingTable.h"
+#include "Common/StartupProfiler.h"
+
 #include <array>
+#include <atomic>
+#include <thread>
+
+// Found in sse2neon
+// _mm_pause is already defined in sse2neon.h for ARM platforms
+#if !(defined(__arm__) || defined(__aarch64__) || defined(_M_ARM64) || defined(_M_ARM))
+#    include <xmmintrin.h>
+#endif
 
 constexpr auto BUILD_FLAGS = nri::AccelerationStructureBits::PREFER_FAST_TRACE;
-constexpr uint32_t BOX_NUM = 100000;
-constexpr float BOX_HALF_SIZE = 0.5f;
-
-static const float positions[12 * 6] = {
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    -BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
-    BOX_HALF_SIZE,
+constexpr float TRANSFORM_TOLERANCE = 1e-4f; // CPU and GPU "sin" / "cos" differ slightly
+constexpr float CULL_DISTANCE = 2000.0f;
+constexpr float LOD_DISTANCE = 100.0f;
+constexpr const char* STATS_FILE = "RayTracingBoxesAS.csv";
+
+constexpr size_t THREAD_MAX_NUM = 32;
+constexpr uint32_t INSTANCES_PER_THREAD_MIN_NUM = 1024;
+constexpr uint32_t TLAS_REBUILD_PERIOD = 64; // frames
+constexpr uint32_t TIMESTAMPS_PER_FRAME = 4; // TLAS update and tracing (begin, end)
+constexpr uint32_t RAY_QUERY_GROUP_SIZE = 8; // must match "RayTracingBoxQuery.cs.hlsl"
+
+constexpr uint32_t HALT = 0;
+constexpr uint32_t GO = 1;
+constexpr uint32_t STOP = 2;
+
+enum class TLASUpdate : uint8_t {
+    NONE,
+    REFIT,
+    REBUILD
 };
 
-static const float texCoords[12 * 4] = {
-    0.0f,
-    0.0f,
-    1.0f,
-    0.0f,
-    0.0f,
-    1.0f,
-    1.0f,
-    1.0f,
-    0.0f,
-    0.0f,
-    1.0f,
-    0.0f,
-    0.0f,
-    1.0f,
-    1.0f,
-    1.0f,
-    0.0f,
-    0.0f,
-    1.0f,
-    0.0f,
-    0.0f,
-    1.0f,
-    1.0f,
-    1.0f,
-    0.0f,
-    0.0f,
-    1.0f,
-    0.0f,
-    0.0f,
-    1.0f,
-    1.0f,
-    1.0f,
-    0.0f,
-    0.0f,
-    1.0f,
-    0.0f,
-    0.0f,
-    1.0f,
-    1.0f,
-    1.0f,
-    0.0f,
-    0.0f,
-    1.0f,
-    0.0f,
-    0.0f,
-    1.0f,
-    1.0f,
-    1.0f,
+enum TLASUpdatePolicy : int32_t {
+    TLAS_UPDATE_POLICY_REFIT,
+    TLAS_UPDATE_POLICY_REBUILD,
+    TLAS_UPDATE_POLICY_REFIT_WITH_PERIODIC_REBUILD
 };
 
-static const uint16_t indices[12 * 3] = {
-    0, 1, 2,
-    1, 2, 3,
-    4, 5, 6,
-    5, 6, 7,
-    8, 9, 10,
-    9, 10, 11,
-    12, 13, 14,
-    13, 14, 15,
-    16, 17, 18,
-    17, 18, 19,
-    20, 21, 22,
-    21, 22, 23};
+enum TraceMode : int32_t {
+    TRACE_MODE_PIPELINE, // "TraceRay" through the shader table
+    TRACE_MODE_RAY_QUERY // inline "RayQuery" in a compute shader
+};
 
 struct QueuedFrame {
     nri::CommandAllocator* commandAllocator;
     nri::CommandBuffer* commandBuffer;
+
+    // Animated mode
+    nri::Buffer* instanceBuffer;
+    nri::TopLevelInstance* instances; // persistently mapped
+    TLASUpdate tlasUpdate;            // recorded in this frame, timestamps are read back when the frame is reused
+
+    // Tracing timing
+    int32_t traceMode;
+    bool isTraced;
+};
+
+struct ThreadContext {
+    std::thread thread;
+    std::atomic_uint32_t control;
 };
 
 class Sample : public SampleBase {
@@ -163,37 +82,55 @@ public:
 private:
     bool Initialize(nri::GraphicsAPI graphicsAPI, bool) override;
     void LatencySleep(uint32_t frameIndex) override;
+    void PrepareFrame(uint32_t frameIndex) override;
     void RenderFrame(uint32_t frameIndex) override;
 
+    void UpdateSmoothedTime(const uint8_t* timestamps, double& smoothedTime) const;
+
     void CreateSwapChain(nri::Format& swapChainFormat);
     void CreateCommandBuffers();
     void CreateRayTracingPipeline();
+    void CreateRayQueryPipeline();
     void CreateRayTracingOutput(nri::Format swapChainFormat);
     void CreateDescriptorSets();
     void CreateBottomLevelAccelerationStructure();
+    void CompactBottomLevelAccelerationStructure();
     void CreateTopLevelAccelerationStructure();
+    void CreateTopLevelAccelerationStructureUpdateResources();
     void CreateShaderTable();
     void CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, nri::Memory*& memory);
-    void CreateScratchBuffer(nri::AccelerationStructure& accelerationStructure, nri::Buffer*& buffer, nri::Memory*& memory);
-    void BuildBottomLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, const nri::BottomLevelGeometryDesc* objects, const uint32_t objectNum);
-    void BuildTopLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, uint32_t instanceNum, nri::Buffer& instanceBuffer);
     void CreateShaderResources();
+    void CreateInstanceGeneration();
+    void VerifyInstanceGeneration();
+    void CmdGenerateInstances(nri::CommandBuffer& commandBuffer);
+    nri::TopLevelInstance GenerateInstance(uint32_t index) const;
+    void WriteInstances(nri::TopLevelInstance* instances, uint32_t offset, uint32_t number) const;
+
+    void ThreadEntryPoint(uint32_t threadIndex);
+    void StartThreads();
+    void StopThreads();
+
+    // Workers exist only while instances are written on the CPU (they spin while waiting for work)
+    inline bool IsCPUInstanceWrite() const {
+        return m_Animated && !m_GPUInstanceGeneration;
+    }
 
     NRIInterface NRI = {};
     nri::Device* m_Device = nullptr;
+    nri::Streamer* m_Streamer = nullptr;
     nri::SwapChain* m_SwapChain = nullptr;
     nri::Queue* m_GraphicsQueue = nullptr;
     nri::Fence* m_FrameFence = nullptr;
+    AccelerationStructureBuildQueue m_AccelerationStructureBuildQueue;
+    AccelerationStructureStats m_AccelerationStructureStats;
 
     std::vector<QueuedFrame> m_QueuedFrames = {};
 
     nri::PipelineLayout* m_PipelineLayout = nullptr;
     nri::Pipeline* m_Pipeline = nullptr;
+    nri::Pipeline* m_RayQueryPipeline = nullptr; // same layout and descriptor sets
 
-    nri::Buffer* m_ShaderTable = nullptr;
-    uint64_t m_ShaderGroupIdentifierSize = 0;
-    uint64_t m_MissShaderOffset = 0;
-    uint64_t m_HitShaderGroupOffset = 0;
+    ShaderBindingTable m_ShaderBindingTable;
 
     nri::Texture* m_RayTracingOutput = nullptr;
     nri::Descriptor* m_RayTracingOutputView = nullptr;
@@ -207,8 +144,50 @@ private:
     nri::DescriptorSet* m_DescriptorSets[3] = {};
 
     nri::AccelerationStructure* m_BLAS = nullptr;
+    nri::Memory* m_BLASMemory = nullptr;
+    uint64_t m_BLASCompactedSize = 0;
+    uint64_t m_BLASMemorySize = 0;
+    uint64_t m_BLASCompactedMemorySize = 0;
+    uint32_t m_BLASStatsIndex = 0;
     nri::AccelerationStructure* m_TLAS = nullptr;
     nri::Descriptor* m_TLASDescriptor = nullptr;
+    uint64_t m_BLASHandles[BOX_LOD_NUM] = {}; // [BLAS index][LOD]
+
+    // Animated mode
+    std::array<ThreadContext, THREAD_MAX_NUM> m_ThreadContexts;
+    nri::Buffer* m_TLASScratchBuffer = nullptr;
+    nri::QueryPool* m_TimestampQueryPool = nullptr;
+    nri::Buffer* m_TimestampReadbackBuffer = nullptr;
+    nri::TopLevelInstance* m_Instances = nullptr; // the current queued frame
+    InstanceGenerationConstants m_InstanceGenerationConstants = {};
+    uint64_t m_TimestampSize = 0;
+    double m_TimestampPeriod = 0.0; // ms
+    double m_InstanceWriteTime = 0.0;
+    double m_TLASRefitTime = 0.0;
+    double m_TLASRebuildTime = 0.0;
+    double m_TraceTimes[2] = {}; // [TraceMode]
+    uint32_t m_ThreadNum = 1;
+    uint32_t m_InstancesPerThread = BOX_NUM;
+    uint32_t m_FramesSinceRebuild = 0;
+    int32_t m_TLASUpdatePolicy = TLAS_UPDATE_POLICY_REFIT_WITH_PERIODIC_REBUILD;
+    std::atomic_uint32_t m_ReadyCount;
+    int32_t m_TraceMode = TRACE_MODE_PIPELINE;
+    bool m_Animated = true;
+    bool m_IsRayQuerySupported = false;
+
+    // GPU instance generation (objects are expanded into "m_InstanceBuffer" by a compute shader)
+    std::vector<BoxObject> m_BoxObjects;
+    nri::PipelineLayout* m_ComputePipelineLayout = nullptr;
+    nri::Pipeline* m_ComputePipeline = nullptr;
+    nri::DescriptorSet* m_ComputeDescriptorSet = nullptr;
+    nri::Buffer* m_ObjectBuffer = nullptr;
+    nri::Buffer* m_HandleBuffer = nullptr;
+    nri::Buffer* m_InstanceBuffer = nullptr;
+    nri::Descriptor* m_ObjectBufferView = nullptr;
+    nri::Descriptor* m_HandleBufferView = nullptr;
+    nri::Descriptor* m_InstanceBufferStorage = nullptr;
+    uint32_t m_InstanceMismatchNum = 0;
+    bool m_GPUInstanceGeneration = true;
 
     const SwapChainTexture* m_BackBuffer = nullptr;
     std::vector<SwapChainTexture> m_SwapChainTextures;
@@ -216,9 +195,14 @@ private:
 };
 
 Sample::~Sample() {
+    StopThreads();
+
     if (NRI.HasCore()) {
         NRI.DeviceWaitIdle(m_Device);
 
+        m_AccelerationStructureBuildQueue.Destroy();
+        m_ShaderBindingTable.Destroy();
+
         if (NRI.HasRayTracing()) {
             NRI.DestroyAccelerationStructure(m_BLAS);
             NRI.DestroyAccelerationStructure(m_TLAS);
@@ -227,6 +211,10 @@ Sample::~Sample() {
         for (QueuedFrame& queuedFrame : m_QueuedFrames) {
             NRI.DestroyCommandBuffer(queuedFrame.commandBuffer);
             NRI.DestroyCommandAllocator(queuedFrame.commandAllocator);
+
+            if (queuedFrame.instances)
+                NRI.UnmapBuffer(*queuedFrame.instanceBuffer);
+            NRI.DestroyBuffer(queuedFrame.instanceBuffer);
         }
 
         for (SwapChainTexture& swapChainTexture : m_SwapChainTextures) {
@@ -239,33 +227,52 @@ Sample::~Sample() {
         NRI.DestroyDescriptor(m_TexCoordBufferView);
         NRI.DestroyDescriptor(m_IndexBufferView);
         NRI.DestroyDescriptor(m_TLASDescriptor);
+        NRI.DestroyDescriptor(m_ObjectBufferView);
+        NRI.DestroyDescriptor(m_HandleBufferView);
+        NRI.DestroyDescriptor(m_InstanceBufferStorage);
 
         NRI.DestroyTexture(m_RayTracingOutput);
 
         NRI.DestroyDescriptorPool(m_DescriptorPool);
 
-        NRI.DestroyBuffer(m_ShaderTable);
         NRI.DestroyBuffer(m_TexCoordBuffer);
         NRI.DestroyBuffer(m_IndexBuffer);
+        NRI.DestroyBuffer(m_TLASScratchBuffer);
+        NRI.DestroyBuffer(m_TimestampReadbackBuffer);
+        NRI.DestroyBuffer(m_ObjectBuffer);
+        NRI.DestroyBuffer(m_HandleBuffer);
+        NRI.DestroyBuffer(m_InstanceBuffer);
+
+        NRI.DestroyQueryPool(m_TimestampQueryPool);
 
         NRI.DestroyPipeline(m_Pipeline);
+        NRI.DestroyPipeline(m_RayQueryPipeline);
+        NRI.DestroyPipeline(m_ComputePipeline);
         NRI.DestroyPipelineLayout(m_PipelineLayout);
+        NRI.DestroyPipelineLayout(m_ComputePipelineLayout);
 
         NRI.DestroyFence(m_FrameFence);
 
         for (size_t i = 0; i < m_MemoryAllocations.size(); i++)
             NRI.FreeMemory(m_MemoryAllocations[i]);
+
+        NRI.FreeMemory(m_BLASMemory); // not compacted
     }
 
     if (NRI.HasSwapChain())
         NRI.DestroySwapChain(m_SwapChain);
 
+    if (NRI.HasStreamer())
+        NRI.DestroyStreamer(m_Streamer);
+
     DestroyImgui();
 
     nri::nriDestroyDevice(m_Device);
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -280,6 +287,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
@@ -291,37 +301,217 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::RayTracingInterface), (nri::RayTracingInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
+    NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
+    StartupProfilerEnd();
+
+    // Create streamer
+    nri::StreamerDesc streamerDesc = {};
+    streamerDesc.dynamicBufferMemoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+    streamerDesc.dynamicBufferDesc = {0, 0, nri::BufferUsageBits::VERTEX_BUFFER | nri::BufferUsageBits::INDEX_BUFFER};
+    streamerDesc.constantBufferMemoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+    streamerDesc.queuedFrameNum = GetQueuedFrameNum();
+    NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
 
     NRI_ABORT_ON_FAILURE(NRI.GetQueue(*m_Device, nri::QueueType::GRAPHICS, 0, m_GraphicsQueue));
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
     CreateCommandBuffers();
 
+    StartupProfilerBegin("Swap chain");
     nri::Format swapChainFormat = nri::Format::UNKNOWN;
     CreateSwapChain(swapChainFormat);
+    StartupProfilerEnd();
 
+    StartupProfilerBegin("Pipelines");
     CreateRayTracingPipeline();
+    CreateRayQueryPipeline();
+    StartupProfilerEnd();
+
     CreateDescriptorSets();
     CreateRayTracingOutput(swapChainFormat);
+
+    // Acceleration structures: BLAS build and compacted size query, then compaction and TLAS build (waited for at the end of initialization)
+    StartupProfilerBegin("Acceleration structures");
+    m_AccelerationStructureStats.Initialize(NRI, NRI);
+    m_AccelerationStructureBuildQueue.Initialize(NRI, NRI, *m_Device, *m_GraphicsQueue);
+    m_AccelerationStructureBuildQueue.SetStats(&m_AccelerationStructureStats);
     CreateBottomLevelAccelerationStructure();
+    m_AccelerationStructureBuildQueue.Submit();
+    m_AccelerationStructureBuildQueue.Wait();
+
+    CompactBottomLevelAccelerationStructure();
     CreateTopLevelAccelerationStructure();
+    m_AccelerationStructureBuildQueue.Submit();
+    CreateTopLevelAccelerationStructureUpdateResources();
+    StartupProfilerEnd();
+
+    StartupProfilerBegin("Shader table");
     CreateShaderTable();
+    StartupProfilerEnd();
+    StartupProfilerBegin("Resources");
     CreateShaderResources();
+    StartupProfilerEnd();
+
+    m_AccelerationStructureBuildQueue.Wait();
+
+    StartupProfilerBegin("Instance generation");
+    CreateInstanceGeneration();
+    VerifyInstanceGeneration();
+    StartupProfilerEnd();
 
-    return true;
+    const ScratchArena& scratchArena = m_AccelerationStructureBuildQueue.GetScratchArena();
+    printf("Scratch arena: peak usage %" PRIu64 " bytes (%u block(s), %" PRIu64 " bytes)\n", scratchArena.GetPeakUsage(), scratchArena.GetBlockNum(), scratchArena.GetCapacity());
+
+    // Instance writers: the main thread writes the first chunk
+    uint32_t concurrentThreadMaxNum = std::thread::hardware_concurrency();
+    m_ThreadNum = std::max(std::min((concurrentThreadMaxNum * 3) / 4, (uint32_t)THREAD_MAX_NUM), 1u);
+    m_ThreadNum = std::min(m_ThreadNum, (BOX_NUM + INSTANCES_PER_THREAD_MIN_NUM - 1) / INSTANCES_PER_THREAD_MIN_NUM);
+    m_InstancesPerThread = (BOX_NUM + m_ThreadNum - 1) / m_ThreadNum;
+
+    if (IsCPUInstanceWrite())
+        StartThreads();
+
+    StartupProfilerBegin("UI");
+    bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
+
+    return initialized;
 }
 
 void Sample::LatencySleep(uint32_t frameIndex) {
     uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
-    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
+    QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
 
     NRI.Wait(*m_FrameFence, frameIndex >= GetQueuedFrameNum() ? 1 + frameIndex - GetQueuedFrameNum() : 0);
     NRI.ResetCommandAllocator(*queuedFrame.commandAllocator);
+
+    // TLAS update and tracing timings of the frame, which used this queued frame previously
+    if (queuedFrame.tlasUpdate != TLASUpdate::NONE || queuedFrame.isTraced) {
+        const uint8_t* data = (uint8_t*)NRI.MapBuffer(*m_TimestampReadbackBuffer, queuedFrameIndex * TIMESTAMPS_PER_FRAME * m_TimestampSize, TIMESTAMPS_PER_FRAME * m_TimestampSize);
+        if (data) {
+            if (queuedFrame.tlasUpdate != TLASUpdate::NONE) {
+                double& smoothedTime = queuedFrame.tlasUpdate == TLASUpdate::REFIT ? m_TLASRefitTime : m_TLASRebuildTime;
+                UpdateSmoothedTime(data, smoothedTime);
+            }
+
+            if (queuedFrame.isTraced)
+                UpdateSmoothedTime(data + 2 * m_TimestampSize, m_TraceTimes[queuedFrame.traceMode]);
+
+            NRI.UnmapBuffer(*m_TimestampReadbackBuffer);
+        }
+
+        queuedFrame.tlasUpdate = TLASUpdate::NONE;
+        queuedFrame.isTraced = false;
+    }
+}
+
+void Sample::PrepareFrame(uint32_t) {
+    bool isCPUInstanceWritePrev = IsCPUInstanceWrite();
+
+    ImGui::NewFrame();
+    {
+        ImGui::SetNextWindowPos(ImVec2(30, 30), ImGuiCond_Once);
+        ImGui::SetNextWindowSize(ImVec2(0, 0));
+        ImGui::Begin("Acceleration structures", nullptr, ImGuiWindowFlags_NoResize);
+        {
+            ImGui::Text("BLAS memory (before)  : %.1f KB", m_BLASMemorySize / 1024.0);
+            ImGui::Text("BLAS compacted size   : %.1f KB", m_BLASCompactedSize / 1024.0);
+            ImGui::Text("BLAS memory (after)   : %.1f KB", m_BLASCompactedMemorySize / 1024.0);
+            ImGui::Text("Saved                 : %.1f%%", m_BLASMemorySize ? 100.0 * (1.0 - double(m_BLASCompactedMemorySize) / double(m_BLASMemorySize)) : 0.0);
+
+            if (ImGui::CollapsingHeader("Build stats")) {
+                m_AccelerationStructureStats.DrawImgui();
+
+                if (ImGui::Button("Save CSV"))
+                    m_AccelerationStructureStats.WriteCsv(STATS_FILE);
+            }
+
+            ImGui::Separator();
+            ImGui::Checkbox("Animated", &m_Animated);
+            ImGui::BeginDisabled(!m_Animated);
+            {
+                static const char* policies[] = {"Refit", "Rebuild", "Refit + periodic rebuild"};
+                ImGui::Combo("TLAS update", &m_TLASUpdatePolicy, policies, helper::GetCountOf(policies));
+
+                ImGui::Checkbox("GPU instance generation", &m_GPUInstanceGeneration);
+                ImGui::SliderFloat("Cull distance", &m_InstanceGenerationConstants.cullDistance, 10.0f, CULL_DISTANCE, "%.0f");
+                ImGui::SliderFloat("LOD distance", &m_InstanceGenerationConstants.lodDistance, 1.0f, CULL_DISTANCE, "%.0f");
+
+                if (m_GPUInstanceGeneration)
+                    ImGui::Text("Instance writes       : GPU (CPU reference: %u mismatches)", m_InstanceMismatchNum);
+                else
+                    ImGui::Text("Instance writes       : %.2f ms (%u threads)", m_InstanceWriteTime, m_ThreadNum);
+                ImGui::Text("TLAS refit (GPU)      : %.3f ms", m_TLASRefitTime);
+                ImGui::Text("TLAS rebuild (GPU)    : %.3f ms", m_TLASRebuildTime);
+            }
+            ImGui::EndDisabled();
+
+            ImGui::Separator();
+            ImGui::BeginDisabled(!m_IsRayQuerySupported);
+            {
+                static const char* traceModes[] = {"Ray tracing pipeline", "Inline ray query"};
+                ImGui::Combo("Tracing", &m_TraceMode, traceModes, helper::GetCountOf(traceModes));
+            }
+            ImGui::EndDisabled();
+            ImGui::Text("TraceRay (GPU)        : %.3f ms", m_TraceTimes[TRACE_MODE_PIPELINE]);
+            ImGui::Text("RayQuery (GPU)        : %.3f ms", m_TraceTimes[TRACE_MODE_RAY_QUERY]);
+            if (m_TraceTimes[TRACE_MODE_PIPELINE] != 0.0 && m_TraceTimes[TRACE_MODE_RAY_QUERY] != 0.0)
+                ImGui::Text("RayQuery speedup      : %.2fx", m_TraceTimes[TRACE_MODE_PIPELINE] / m_TraceTimes[TRACE_MODE_RAY_QUERY]);
+        }
+        ImGui::End();
+    }
+    ImGui::EndFrame();
+    ImGui::Render();
+
+    if (IsCPUInstanceWrite() != isCPUInstanceWritePrev) {
+        if (IsCPUInstanceWrite())
+            StartThreads();
+        else
+            StopThreads();
+    }
 }
 
 void Sample::RenderFrame(uint32_t frameIndex) {
     uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
-    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
+    QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
+
+    // Write instances of this queued frame (the GPU is done with them), or let the GPU generate them
+    TLASUpdate tlasUpdate = TLASUpdate::NONE;
+    if (m_Animated) {
+        double begin = m_Timer.GetTimeStamp();
+
+        m_InstanceGenerationConstants.time = float(begin * 0.001);
+
+        if (!m_GPUInstanceGeneration) {
+            m_Instances = queuedFrame.instances;
+
+            // Pass "GO" to workers
+            m_ReadyCount.store(0, std::memory_order_seq_cst);
+
+            for (uint32_t i = 1; i < m_ThreadNum; i++) {
+                ThreadContext& threadContext = m_ThreadContexts[i];
+                threadContext.control.store(GO, std::memory_order_relaxed);
+            }
+
+            WriteInstances(m_Instances, 0, std::min(m_InstancesPerThread, BOX_NUM));
+
+            // Wait for completion
+            while (m_ReadyCount.load(std::memory_order_acquire) != m_ThreadNum - 1)
+                _mm_pause();
+        }
+
+        m_InstanceWriteTime = m_Timer.GetTimeStamp() - begin;
+
+        // Refit is cheap, but the quality of the TLAS degrades as instances move away from the built state
+        bool isRebuild = m_TLASUpdatePolicy == TLAS_UPDATE_POLICY_REBUILD;
+        if (m_TLASUpdatePolicy == TLAS_UPDATE_POLICY_REFIT_WITH_PERIODIC_REBUILD)
+            isRebuild = m_FramesSinceRebuild >= TLAS_REBUILD_PERIOD;
+
+        tlasUpdate = isRebuild ? TLASUpdate::REBUILD : TLASUpdate::REFIT;
+        m_FramesSinceRebuild = isRebuild ? 0 : m_FramesSinceRebuild + 1;
+    }
 
     // Acquire a swap chain texture
     uint32_t recycledSemaphoreIndex = frameIndex % (uint32_t)m_SwapChainTextures.size();
@@ -358,7 +548,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
 
         nri::BufferBarrierDesc bufferBarrier = {};
         if (frameIndex == 0) {
-            bufferBarrier.buffer = m_ShaderTable;
+            bufferBarrier.buffer = m_ShaderBindingTable.GetBuffer();
             bufferBarrier.after = {nri::AccessBits::SHADER_BINDING_TABLE, nri::StageBits::RAYGEN_SHADER};
 
             barrierDesc.bufferNum = 1;
@@ -366,22 +556,80 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         }
 
         NRI.CmdBarrier(commandBuffer, barrierDesc);
-        NRI.CmdSetPipelineLayout(commandBuffer, nri::BindPoint::RAY_TRACING, *m_PipelineLayout);
-        NRI.CmdSetPipeline(commandBuffer, *m_Pipeline);
+
+        // TLAS update
+        if (tlasUpdate != TLASUpdate::NONE) {
+            uint32_t queryOffset = queuedFrameIndex * TIMESTAMPS_PER_FRAME;
+
+            if (m_GPUInstanceGeneration)
+                CmdGenerateInstances(commandBuffer);
+
+            // Ray tracing of the previous frame and the previous update (scratch) must be done
+            nri::GlobalBarrierDesc accelerationStructureBarrier = {};
+            accelerationStructureBarrier.before = {nri::AccessBits::ACCELERATION_STRUCTURE_READ | nri::AccessBits::ACCELERATION_STRUCTURE_WRITE, nri::StageBits::RAYGEN_SHADER | nri::StageBits::COMPUTE_SHADER | nri::StageBits::ACCELERATION_STRUCTURE};
+            accelerationStructureBarrier.after = {nri::AccessBits::ACCELERATION_STRUCTURE_WRITE, nri::StageBits::ACCELERATION_STRUCTURE};
+
+            nri::BarrierDesc accelerationStructureBarrierDesc = {};
+            accelerationStructureBarrierDesc.globalNum = 1;
+            accelerationStructureBarrierDesc.globals = &accelerationStructureBarrier;
+
+            NRI.CmdBarrier(commandBuffer, accelerationStructureBarrierDesc);
+            NRI.CmdResetQueries(commandBuffer, *m_TimestampQueryPool, queryOffset, 2);
+            NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset);
+
+            nri::BuildTopLevelAccelerationStructureDesc buildDesc = {};
+            buildDesc.dst = m_TLAS;
+            buildDesc.src = tlasUpdate == TLASUpdate::REFIT ? m_TLAS : nullptr;
+            buildDesc.instanceNum = BOX_NUM;
+            buildDesc.instanceBuffer = m_GPUInstanceGeneration ? m_InstanceBuffer : queuedFrame.instanceBuffer;
+            buildDesc.scratchBuffer = m_TLASScratchBuffer;
+
+            NRI.CmdBuildTopLevelAccelerationStructures(commandBuffer, &buildDesc, 1);
+            NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset + 1);
+            NRI.CmdCopyQueries(commandBuffer, *m_TimestampQueryPool, queryOffset, 2, *m_TimestampReadbackBuffer, queryOffset * m_TimestampSize);
+
+            accelerationStructureBarrier.before = accelerationStructureBarrier.after;
+            accelerationStructureBarrier.after = {nri::AccessBits::ACCELERATION_STRUCTURE_READ, nri::StageBits::RAYGEN_SHADER | nri::StageBits::COMPUTE_SHADER};
+
+            NRI.CmdBarrier(commandBuffer, accelerationStructureBarrierDesc);
+
+            queuedFrame.tlasUpdate = tlasUpdate;
+        }
+
+        // Tracing (the same output, TLAS and descriptor sets in both modes)
+        int32_t traceMode = m_IsRayQuerySupported ? m_TraceMode : TRACE_MODE_PIPELINE;
+        nri::BindPoint bindPoint = traceMode == TRACE_MODE_RAY_QUERY ? nri::BindPoint::COMPUTE : nri::BindPoint::RAY_TRACING;
+        uint32_t queryOffset = queuedFrameIndex * TIMESTAMPS_PER_FRAME + 2;
+
+        NRI.CmdResetQueries(commandBuffer, *m_TimestampQueryPool, queryOffset, 2);
+        NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset);
+
+        NRI.CmdSetPipelineLayout(commandBuffer, bindPoint, *m_PipelineLayout);
+        NRI.CmdSetPipeline(commandBuffer, traceMode == TRACE_MODE_RAY_QUERY ? *m_RayQueryPipeline : *m_Pipeline);
 
         for (uint32_t i = 0; i < helper::GetCountOf(m_DescriptorSets); i++) {
             nri::SetDescriptorSetDesc descriptorSet = {i, m_DescriptorSets[i]};
             NRI.CmdSetDescriptorSet(commandBuffer, descriptorSet);
         }
 
-        nri::DispatchRaysDesc dispatchRaysDesc = {};
-        dispatchRaysDesc.raygenShader = {m_ShaderTable, 0, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.missShaders = {m_ShaderTable, m_MissShaderOffset, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.hitShaderGroups = {m_ShaderTable, m_HitShaderGroupOffset, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.x = (uint16_t)GetOutputResolution().x;
-        dispatchRaysDesc.y = (uint16_t)GetOutputResolution().y;
-        dispatchRaysDesc.z = 1;
-        NRI.CmdDispatchRays(commandBuffer, dispatchRaysDesc);
+        if (traceMode == TRACE_MODE_RAY_QUERY) {
+            uint32_t nx = (GetOutputResolution().x + RAY_QUERY_GROUP_SIZE - 1) / RAY_QUERY_GROUP_SIZE;
+            uint32_t ny = (GetOutputResolution().y + RAY_QUERY_GROUP_SIZE - 1) / RAY_QUERY_GROUP_SIZE;
+            NRI.CmdDispatch(commandBuffer, {nx, ny, 1});
+        } else {
+            nri::DispatchRaysDesc dispatchRaysDesc = {};
+            m_ShaderBindingTable.FillDispatchRaysDesc(dispatchRaysDesc);
+            dispatchRaysDesc.x = (uint16_t)GetOutputResolution().x;
+            dispatchRaysDesc.y = (uint16_t)GetOutputResolution().y;
+            dispatchRaysDesc.z = 1;
+            NRI.CmdDispatchRays(commandBuffer, dispatchRaysDesc);
+        }
+
+        NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset + 1);
+        NRI.CmdCopyQueries(commandBuffer, *m_TimestampQueryPool, queryOffset, 2, *m_TimestampReadbackBuffer, queryOffset * m_TimestampSize);
+
+        queuedFrame.traceMode = traceMode;
+        queuedFrame.isTraced = true;
 
         // Copy
         textureTransitions[1].before = textureTransitions[1].after;
@@ -394,6 +642,30 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.CmdBarrier(commandBuffer, barrierDesc);
         NRI.CmdCopyTexture(commandBuffer, *m_BackBuffer->texture, nullptr, *m_RayTracingOutput, nullptr);
 
+        // UI
+        CmdCopyImguiData(commandBuffer, *m_Streamer);
+
+        textureTransitions[0].before = textureTransitions[0].after;
+        textureTransitions[0].after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT};
+
+        barrierDesc.textures = textureTransitions;
+        barrierDesc.textureNum = 1;
+
+        NRI.CmdBarrier(commandBuffer, barrierDesc);
+
+        nri::AttachmentDesc colorAttachmentDesc = {};
+        colorAttachmentDesc.descriptor = m_BackBuffer->colorAttachment;
+
+        nri::RenderingDesc renderingDesc = {};
+        renderingDesc.colorNum = 1;
+        renderingDesc.colors = &colorAttachmentDesc;
+
+        NRI.CmdBeginRendering(commandBuffer, renderingDesc);
+        {
+            CmdDrawImgui(commandBuffer, m_BackBuffer->attachmentFormat, 1.0f, true);
+        }
+        NRI.CmdEndRendering(commandBuffer);
+
         // Present
         textureTransitions[0].before = textureTransitions[0].after;
         textureTransitions[0].after = {nri::AccessBits::NONE, nri::Layout::PRESENT, nri::StageBits::NONE};
@@ -430,10 +702,20 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
     }
 
+    NRI.EndStreamerFrame(*m_Streamer);
+
     // Present
     NRI.QueuePresent(*m_SwapChain, *swapChainTexture.releaseSemaphore);
 }
 
+void Sample::UpdateSmoothedTime(const uint8_t* timestamps, double& smoothedTime) const {
+    uint64_t begin = *(const uint64_t*)timestamps;
+    uint64_t end = *(const uint64_t*)(timestamps + m_TimestampSize);
+    double time = double(end - begin) * m_TimestampPeriod;
+
+    smoothedTime = smoothedTime == 0.0 ? time : smoothedTime * 0.9 + time * 0.1;
+}
+
 void Sample::CreateSwapChain(nri::Format& swapChainFormat) {
     nri::SwapChainDesc swapChainDesc = {};
     swapChainDesc.window = GetWindow();
@@ -486,9 +768,9 @@ void Sample::CreateCommandBuffers() {
 
 void Sample::CreateRayTracingPipeline() {
     nri::DescriptorRangeDesc descriptorRanges[] = {
-        {0, 1, nri::DescriptorType::STORAGE_TEXTURE, nri::StageBits::RAYGEN_SHADER},
-        {1, 1, nri::DescriptorType::ACCELERATION_STRUCTURE, nri::StageBits::RAYGEN_SHADER},
-        {0, BOX_NUM, nri::DescriptorType::BUFFER, nri::StageBits::CLOSEST_HIT_SHADER, nri::DescriptorRangeBits::VARIABLE_SIZED_ARRAY | nri::DescriptorRangeBits::PARTIALLY_BOUND},
+        {0, 1, nri::DescriptorType::STORAGE_TEXTURE, nri::StageBits::RAYGEN_SHADER | nri::StageBits::COMPUTE_SHADER},
+        {1, 1, nri::DescriptorType::ACCELERATION_STRUCTURE, nri::StageBits::RAYGEN_SHADER | nri::StageBits::COMPUTE_SHADER},
+        {0, BOX_NUM, nri::DescriptorType::BUFFER, nri::StageBits::CLOSEST_HIT_SHADER | nri::StageBits::COMPUTE_SHADER, nri::DescriptorRangeBits::VARIABLE_SIZED_ARRAY | nri::DescriptorRangeBits::PARTIALLY_BOUND},
     };
 
     nri::DescriptorSetDesc descriptorSetDescs[] = {
@@ -500,23 +782,26 @@ void Sample::CreateRayTracingPipeline() {
     nri::PipelineLayoutDesc pipelineLayoutDesc = {};
     pipelineLayoutDesc.descriptorSets = descriptorSetDescs;
     pipelineLayoutDesc.descriptorSetNum = helper::GetCountOf(descriptorSetDescs);
-    pipelineLayoutDesc.shaderStages = nri::StageBits::RAYGEN_SHADER | nri::StageBits::CLOSEST_HIT_SHADER;
+    pipelineLayoutDesc.shaderStages = nri::StageBits::RAYGEN_SHADER | nri::StageBits::CLOSEST_HIT_SHADER | nri::StageBits::COMPUTE_SHADER; // + inline ray query
 
     NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_PipelineLayout));
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
     utils::ShaderCodeStorage shaderCodeStorage;
     nri::ShaderDesc shaders[] = {
-        utils::LoadShader(deviceDesc.graphicsAPI, "RayTracingBox.rgen", shaderCodeStorage, "raygen"),
-        utils::LoadShader(deviceDesc.graphicsAPI, "RayTracingBox.rmiss", shaderCodeStorage, "miss"),
-        utils::LoadShader(deviceDesc.graphicsAPI, "RayTracingBox.rchit", shaderCodeStorage, "closest_hit"),
+        LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingBox.rgen", shaderCodeStorage, "raygen"),
+        LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingBox.rmiss", shaderCodeStorage, "miss"),
+        LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingBox.rchit", shaderCodeStorage, "closest_hit"),
+        LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingBox.rchit", shaderCodeStorage, "closest_hit_barycentrics"),
+        LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingBox.rchit", shaderCodeStorage, "closest_hit_checker"),
     };
 
     nri::ShaderLibraryDesc shaderLibrary = {};
     shaderLibrary.shaders = shaders;
     shaderLibrary.shaderNum = helper::GetCountOf(shaders);
 
-    const nri::ShaderGroupDesc shaderGroupDescs[] = {{1}, {2}, {3}};
+    // Raygen, miss, a hit group per material
+    const nri::ShaderGroupDesc shaderGroupDescs[] = {{1}, {2}, {3}, {4}, {5}};
 
     nri::RayTracingPipelineDesc pipelineDesc = {};
     pipelineDesc.recursionMaxDepth = 1;
@@ -530,6 +815,24 @@ void Sample::CreateRayTracingPipeline() {
     NRI_ABORT_ON_FAILURE(NRI.CreateRayTracingPipeline(*m_Device, pipelineDesc, m_Pipeline));
 }
 
+void Sample::CreateRayQueryPipeline() {
+    // Inline ray tracing requires DXR 1.1 / "VK_KHR_ray_query"
+    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+    m_IsRayQuerySupported = deviceDesc.tiers.rayTracing >= 2;
+    if (!m_IsRayQuerySupported) {
+        printf("Inline ray tracing is not supported, only the ray tracing pipeline is available\n");
+        return;
+    }
+
+    utils::ShaderCodeStorage shaderCodeStorage;
+
+    nri::ComputePipelineDesc computePipelineDesc = {};
+    computePipelineDesc.pipelineLayout = m_PipelineLayout;
+    computePipelineDesc.shader = LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingBoxQuery.cs", shaderCodeStorage);
+
+    NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, computePipelineDesc, m_RayQueryPipeline));
+}
+
 void Sample::CreateRayTracingOutput(nri::Format swapChainFormat) {
     nri::TextureDesc rayTracingOutputDesc = {};
     rayTracingOutputDesc.type = nri::TextureType::TEXTURE_2D;
@@ -569,7 +872,9 @@ void Sample::CreateDescriptorSets() {
     descriptorPoolDesc.storageTextureMaxNum = 1;
     descriptorPoolDesc.accelerationStructureMaxNum = 1;
     descriptorPoolDesc.bufferMaxNum = BOX_NUM * 2;
-    descriptorPoolDesc.descriptorSetMaxNum = helper::GetCountOf(m_DescriptorSets);
+    descriptorPoolDesc.structuredBufferMaxNum = 2;
+    descriptorPoolDesc.storageStructuredBufferMaxNum = 1;
+    descriptorPoolDesc.descriptorSetMaxNum = helper::GetCountOf(m_DescriptorSets) + 1;
 
     NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_Device, descriptorPoolDesc, m_DescriptorPool));
     NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 0, &m_DescriptorSets[0], 1, 0));
@@ -667,7 +972,7 @@ void Sample::CreateBottomLevelAccelerationStructure() {
 
     nri::AccelerationStructureDesc accelerationStructureDesc = {};
     accelerationStructureDesc.type = nri::AccelerationStructureType::BOTTOM_LEVEL;
-    accelerationStructureDesc.flags = BUILD_FLAGS;
+    accelerationStructureDesc.flags = BUILD_FLAGS | nri::AccelerationStructureBits::ALLOW_COMPACTION;
     accelerationStructureDesc.geometryOrInstanceNum = 1;
     accelerationStructureDesc.geometries = &object;
 
@@ -680,23 +985,58 @@ void Sample::CreateBottomLevelAccelerationStructure() {
     allocateMemoryDesc.size = memoryDesc.size;
     allocateMemoryDesc.type = memoryDesc.type;
 
+    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, m_BLASMemory));
+    m_BLASMemorySize = memoryDesc.size;
+
+    const nri::BindAccelerationStructureMemoryDesc memoryBindingDesc = {m_BLAS, m_BLASMemory};
+    NRI_ABORT_ON_FAILURE(NRI.BindAccelerationStructureMemory(&memoryBindingDesc, 1));
+
+    m_BLASStatsIndex = m_AccelerationStructureStats.Register("Box", *m_BLAS, accelerationStructureDesc);
+
+    // "object" is copied, the geometry buffer is released when the build is done
+    m_AccelerationStructureBuildQueue.AddBottomLevel(*m_BLAS, &object, 1);
+    m_AccelerationStructureBuildQueue.AddCompactedSizeQuery(*m_BLAS, &m_BLASCompactedSize);
+    m_AccelerationStructureBuildQueue.AddTransientBuffer(buffer, memory);
+}
+
+void Sample::CompactBottomLevelAccelerationStructure() {
+    nri::AccelerationStructureDesc accelerationStructureDesc = {};
+    accelerationStructureDesc.type = nri::AccelerationStructureType::BOTTOM_LEVEL;
+    accelerationStructureDesc.flags = BUILD_FLAGS;
+    accelerationStructureDesc.optimizedSize = m_BLASCompactedSize;
+
+    nri::AccelerationStructure* compactedBLAS = nullptr;
+    NRI_ABORT_ON_FAILURE(NRI.CreateAccelerationStructure(*m_Device, accelerationStructureDesc, compactedBLAS));
+
+    nri::MemoryDesc memoryDesc = {};
+    NRI.GetAccelerationStructureMemoryDesc(*compactedBLAS, nri::MemoryLocation::DEVICE, memoryDesc);
+
+    nri::AllocateMemoryDesc allocateMemoryDesc = {};
+    allocateMemoryDesc.size = memoryDesc.size;
+    allocateMemoryDesc.type = memoryDesc.type;
+
     nri::Memory* ASMemory = nullptr;
     NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, ASMemory));
     m_MemoryAllocations.push_back(ASMemory);
+    m_BLASCompactedMemorySize = memoryDesc.size;
 
-    const nri::BindAccelerationStructureMemoryDesc memoryBindingDesc = {m_BLAS, ASMemory};
+    const nri::BindAccelerationStructureMemoryDesc memoryBindingDesc = {compactedBLAS, ASMemory};
     NRI_ABORT_ON_FAILURE(NRI.BindAccelerationStructureMemory(&memoryBindingDesc, 1));
 
-    BuildBottomLevelAccelerationStructure(*m_BLAS, &object, 1);
+    m_AccelerationStructureStats.SetCompacted(m_BLASStatsIndex, *compactedBLAS);
 
-    NRI.DestroyBuffer(buffer);
-    NRI.FreeMemory(memory);
+    // The original is released when the copy is done
+    m_AccelerationStructureBuildQueue.AddCompaction(*compactedBLAS, *m_BLAS);
+    m_AccelerationStructureBuildQueue.AddTransientAccelerationStructure(m_BLAS, m_BLASMemory);
+
+    m_BLAS = compactedBLAS;
+    m_BLASMemory = nullptr;
 }
 
 void Sample::CreateTopLevelAccelerationStructure() {
     nri::AccelerationStructureDesc accelerationStructureDesc = {};
     accelerationStructureDesc.type = nri::AccelerationStructureType::TOP_LEVEL;
-    accelerationStructureDesc.flags = BUILD_FLAGS;
+    accelerationStructureDesc.flags = BUILD_FLAGS | nri::AccelerationStructureBits::ALLOW_UPDATE;
     accelerationStructureDesc.geometryOrInstanceNum = BOX_NUM;
 
     NRI_ABORT_ON_FAILURE(NRI.CreateAccelerationStructure(*m_Device, accelerationStructureDesc, m_TLAS));
@@ -715,24 +1055,26 @@ void Sample::CreateTopLevelAccelerationStructure() {
     const nri::BindAccelerationStructureMemoryDesc memoryBindingDesc = {m_TLAS, ASMemory};
     NRI_ABORT_ON_FAILURE(NRI.BindAccelerationStructureMemory(&memoryBindingDesc, 1));
 
-    std::vector<nri::TopLevelInstance> geometryObjectInstances(BOX_NUM, nri::TopLevelInstance{});
+    m_AccelerationStructureStats.Register("TLAS", *m_TLAS, accelerationStructureDesc);
 
-    const float lineWidth = 120.0f;
-    const uint32_t lineSize = 100;
-    const float step = lineWidth / (lineSize - 1);
-
-    for (uint32_t i = 0; i < geometryObjectInstances.size(); i++) {
-        nri::TopLevelInstance& instance = geometryObjectInstances[i];
-        instance.accelerationStructureHandle = NRI.GetAccelerationStructureHandle(*m_BLAS);
-        instance.instanceId = i;
-        instance.transform[0][0] = 1.0f;
-        instance.transform[1][1] = 1.0f;
-        instance.transform[2][2] = 1.0f;
-        instance.transform[0][3] = -lineWidth * 0.5f + (i % lineSize) * step;
-        instance.transform[1][3] = -10.0f + (i / lineSize) * step;
-        instance.transform[2][3] = 10.0f + (i / lineSize) * step;
-        instance.mask = 0xff;
-    }
+    // The box has no simpler geometry, all LODs reference the same BLAS
+    for (uint64_t& handle : m_BLASHandles)
+        handle = NRI.GetAccelerationStructureHandle(*m_BLAS);
+
+    // Objects
+    m_BoxObjects.resize(BOX_NUM);
+    for (uint32_t i = 0; i < BOX_NUM; i++)
+        GetBoxObject(i, m_BoxObjects[i]);
+
+    m_InstanceGenerationConstants.cameraPositionX = CAMERA_POSITION[0];
+    m_InstanceGenerationConstants.cameraPositionY = CAMERA_POSITION[1];
+    m_InstanceGenerationConstants.cameraPositionZ = CAMERA_POSITION[2];
+    m_InstanceGenerationConstants.cullDistance = CULL_DISTANCE;
+    m_InstanceGenerationConstants.lodDistance = LOD_DISTANCE;
+    m_InstanceGenerationConstants.objectNum = BOX_NUM;
+
+    std::vector<nri::TopLevelInstance> geometryObjectInstances(BOX_NUM, nri::TopLevelInstance{});
+    WriteInstances(geometryObjectInstances.data(), 0, BOX_NUM);
 
     nri::Buffer* buffer = nullptr;
     nri::Memory* memory = nullptr;
@@ -742,10 +1084,8 @@ void Sample::CreateTopLevelAccelerationStructure() {
     memcpy(data, geometryObjectInstances.data(), helper::GetByteSizeOf(geometryObjectInstances));
     NRI.UnmapBuffer(*buffer);
 
-    BuildTopLevelAccelerationStructure(*m_TLAS, (uint32_t)geometryObjectInstances.size(), *buffer);
-
-    NRI.DestroyBuffer(buffer);
-    NRI.FreeMemory(memory);
+    m_AccelerationStructureBuildQueue.AddTopLevel(*m_TLAS, (uint32_t)geometryObjectInstances.size(), *buffer);
+    m_AccelerationStructureBuildQueue.AddTransientBuffer(buffer, memory);
 
     NRI_ABORT_ON_FAILURE(NRI.CreateAccelerationStructureDescriptor(*m_TLAS, m_TLASDescriptor));
 
@@ -753,145 +1093,374 @@ void Sample::CreateTopLevelAccelerationStructure() {
     NRI.UpdateDescriptorRanges(&updateDescriptorRangeDesc, 1);
 }
 
-void Sample::CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, nri::Memory*& memory) {
-    const nri::BufferDesc bufferDesc = {size, 0, usage};
-    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+void Sample::CreateTopLevelAccelerationStructureUpdateResources() {
+    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+
+    // Instance buffers (one per queued frame, written by the CPU while the GPU uses the others)
+    for (QueuedFrame& queuedFrame : m_QueuedFrames) {
+        nri::Memory* memory = nullptr;
+        CreateUploadBuffer(BOX_NUM * sizeof(nri::TopLevelInstance), nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_INPUT, queuedFrame.instanceBuffer, memory);
+        m_MemoryAllocations.push_back(memory);
+
+        queuedFrame.instances = (nri::TopLevelInstance*)NRI.MapBuffer(*queuedFrame.instanceBuffer, 0, nri::WHOLE_SIZE);
+        queuedFrame.tlasUpdate = TLASUpdate::NONE;
+        queuedFrame.isTraced = false;
+    }
+
+    // Scratch (shared by all frames, updates are serialized on the queue)
+    uint64_t buildScratchSize = NRI.GetAccelerationStructureBuildScratchBufferSize(*m_TLAS);
+    uint64_t updateScratchSize = NRI.GetAccelerationStructureUpdateScratchBufferSize(*m_TLAS);
+
+    const nri::BufferDesc scratchBufferDesc = {std::max(buildScratchSize, updateScratchSize), 0, nri::BufferUsageBits::SCRATCH_BUFFER};
+    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, scratchBufferDesc, m_TLASScratchBuffer));
 
     nri::MemoryDesc memoryDesc = {};
-    NRI.GetBufferMemoryDesc(*buffer, nri::MemoryLocation::HOST_UPLOAD, memoryDesc);
+    NRI.GetBufferMemoryDesc(*m_TLASScratchBuffer, nri::MemoryLocation::DEVICE, memoryDesc);
 
     nri::AllocateMemoryDesc allocateMemoryDesc = {};
     allocateMemoryDesc.size = memoryDesc.size;
     allocateMemoryDesc.type = memoryDesc.type;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
 
-    const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {buffer, memory};
+    nri::Memory* scratchMemory = nullptr;
+    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, scratchMemory));
+    m_MemoryAllocations.push_back(scratchMemory);
+
+    const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {m_TLASScratchBuffer, scratchMemory};
     NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(&bufferMemoryBindingDesc, 1));
+
+    // Timestamps (before and after the update and the tracing)
+    nri::QueryPoolDesc queryPoolDesc = {};
+    queryPoolDesc.queryType = nri::QueryType::TIMESTAMP;
+    queryPoolDesc.capacity = GetQueuedFrameNum() * TIMESTAMPS_PER_FRAME;
+    NRI_ABORT_ON_FAILURE(NRI.CreateQueryPool(*m_Device, queryPoolDesc, m_TimestampQueryPool));
+
+    m_TimestampSize = NRI.GetQuerySize(*m_TimestampQueryPool);
+    m_TimestampPeriod = 1000.0 / double(deviceDesc.other.timestampFrequencyHz);
+
+    const nri::BufferDesc readbackBufferDesc = {queryPoolDesc.capacity * m_TimestampSize, 0, nri::BufferUsageBits::NONE};
+    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, readbackBufferDesc, m_TimestampReadbackBuffer));
+
+    NRI.GetBufferMemoryDesc(*m_TimestampReadbackBuffer, nri::MemoryLocation::HOST_READBACK, memoryDesc);
+
+    allocateMemoryDesc.size = memoryDesc.size;
+    allocateMemoryDesc.type = memoryDesc.type;
+
+    nri::Memory* readbackMemory = nullptr;
+    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, readbackMemory));
+    m_MemoryAllocations.push_back(readbackMemory);
+
+    const nri::BindBufferMemoryDesc readbackMemoryBindingDesc = {m_TimestampReadbackBuffer, readbackMemory};
+    NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(&readbackMemoryBindingDesc, 1));
 }
 
-void Sample::CreateScratchBuffer(nri::AccelerationStructure& accelerationStructure, nri::Buffer*& buffer, nri::Memory*& memory) {
-    const uint64_t scratchBufferSize = NRI.GetAccelerationStructureBuildScratchBufferSize(accelerationStructure);
+void Sample::CreateInstanceGeneration() {
+    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+
+    { // Pipeline
+        nri::DescriptorRangeDesc descriptorRanges[] = {
+            {0, 2, nri::DescriptorType::STRUCTURED_BUFFER, nri::StageBits::COMPUTE_SHADER},
+            {0, 1, nri::DescriptorType::STORAGE_STRUCTURED_BUFFER, nri::StageBits::COMPUTE_SHADER},
+        };
 
-    const nri::BufferDesc bufferDesc = {scratchBufferSize, 0, nri::BufferUsageBits::SCRATCH_BUFFER};
-    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+        nri::DescriptorSetDesc descriptorSetDesc = {0, descriptorRanges, helper::GetCountOf(descriptorRanges)};
+
+        nri::RootConstantDesc rootConstantDesc = {};
+        rootConstantDesc.registerIndex = 0;
+        rootConstantDesc.shaderStages = nri::StageBits::COMPUTE_SHADER;
+        rootConstantDesc.size = sizeof(InstanceGenerationConstants);
+
+        nri::PipelineLayoutDesc pipelineLayoutDesc = {};
+        pipelineLayoutDesc.rootConstantNum = 1;
+        pipelineLayoutDesc.rootConstants = &rootConstantDesc;
+        pipelineLayoutDesc.descriptorSetNum = 1;
+        pipelineLayoutDesc.descriptorSets = &descriptorSetDesc;
+        pipelineLayoutDesc.shaderStages = nri::StageBits::COMPUTE_SHADER;
+
+        NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_ComputePipelineLayout));
+
+        utils::ShaderCodeStorage shaderCodeStorage;
+
+        nri::ComputePipelineDesc computePipelineDesc = {};
+        computePipelineDesc.pipelineLayout = m_ComputePipelineLayout;
+        computePipelineDesc.shader = LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingBoxInstances.cs", shaderCodeStorage);
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, computePipelineDesc, m_ComputePipeline));
+    }
+
+    { // Buffers
+        static_assert(sizeof(nri::TopLevelInstance) == 64, "Must match 'TopLevelInstance' in 'RayTracingBoxInstances.cs.hlsl'");
+
+        nri::BufferDesc bufferDesc = {};
+        bufferDesc.size = helper::GetByteSizeOf(m_BoxObjects);
+        bufferDesc.structureStride = sizeof(BoxObject);
+        bufferDesc.usage = nri::BufferUsageBits::SHADER_RESOURCE;
+        NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_ObjectBuffer));
+
+        bufferDesc.size = sizeof(m_BLASHandles);
+        bufferDesc.structureStride = sizeof(uint64_t);
+        NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_HandleBuffer));
+
+        bufferDesc.size = BOX_NUM * sizeof(nri::TopLevelInstance);
+        bufferDesc.structureStride = sizeof(nri::TopLevelInstance);
+        bufferDesc.usage = nri::BufferUsageBits::SHADER_RESOURCE_STORAGE | nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_INPUT;
+        NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_InstanceBuffer));
+
+        nri::Buffer* buffers[] = {m_ObjectBuffer, m_HandleBuffer, m_InstanceBuffer};
+
+        nri::ResourceGroupDesc resourceGroupDesc = {};
+        resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
+        resourceGroupDesc.bufferNum = helper::GetCountOf(buffers);
+        resourceGroupDesc.buffers = buffers;
+
+        const size_t baseAllocation = m_MemoryAllocations.size();
+        m_MemoryAllocations.resize(baseAllocation + NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
+        NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+
+        nri::BufferUploadDesc dataDescArray[] = {
+            {m_BoxObjects.data(), m_ObjectBuffer, {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::COMPUTE_SHADER}},
+            {m_BLASHandles, m_HandleBuffer, {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::COMPUTE_SHADER}},
+        };
+        NRI_ABORT_ON_FAILURE(NRI.UploadData(*m_GraphicsQueue, nullptr, 0, dataDescArray, helper::GetCountOf(dataDescArray)));
+    }
+
+    { // Descriptors
+        nri::BufferViewDesc bufferViewDesc = {};
+        bufferViewDesc.type = nri::BufferView::STRUCTURED_BUFFER;
+        bufferViewDesc.size = nri::WHOLE_SIZE;
+
+        bufferViewDesc.buffer = m_ObjectBuffer;
+        NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, m_ObjectBufferView));
+
+        bufferViewDesc.buffer = m_HandleBuffer;
+        NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, m_HandleBufferView));
+
+        bufferViewDesc.type = nri::BufferView::STORAGE_STRUCTURED_BUFFER;
+        bufferViewDesc.buffer = m_InstanceBuffer;
+        NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, m_InstanceBufferStorage));
+
+        NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_ComputePipelineLayout, 0, &m_ComputeDescriptorSet, 1, 0));
+
+        nri::Descriptor* resources[] = {m_ObjectBufferView, m_HandleBufferView};
+
+        const nri::UpdateDescriptorRangeDesc updateDescriptorRangeDescs[] = {
+            {m_ComputeDescriptorSet, 0, 0, resources, helper::GetCountOf(resources)},
+            {m_ComputeDescriptorSet, 1, 0, &m_InstanceBufferStorage, 1},
+        };
+        NRI.UpdateDescriptorRanges(updateDescriptorRangeDescs, helper::GetCountOf(updateDescriptorRangeDescs));
+    }
+}
+
+void Sample::VerifyInstanceGeneration() {
+    // Generate instances on the GPU once and compare them with the CPU reference
+    nri::Buffer* readbackBuffer = nullptr;
+    const nri::BufferDesc readbackBufferDesc = {BOX_NUM * sizeof(nri::TopLevelInstance), 0, nri::BufferUsageBits::NONE};
+    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, readbackBufferDesc, readbackBuffer));
 
     nri::MemoryDesc memoryDesc = {};
-    NRI.GetBufferMemoryDesc(*buffer, nri::MemoryLocation::DEVICE, memoryDesc);
+    NRI.GetBufferMemoryDesc(*readbackBuffer, nri::MemoryLocation::HOST_READBACK, memoryDesc);
 
     nri::AllocateMemoryDesc allocateMemoryDesc = {};
     allocateMemoryDesc.size = memoryDesc.size;
     allocateMemoryDesc.type = memoryDesc.type;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
 
-    const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {buffer, memory};
+    nri::Memory* readbackMemory = nullptr;
+    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, readbackMemory));
+
+    const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {readbackBuffer, readbackMemory};
     NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(&bufferMemoryBindingDesc, 1));
-}
 
-void Sample::BuildBottomLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, const nri::BottomLevelGeometryDesc* objects, const uint32_t objectNum) {
-    nri::Buffer* scratchBuffer = nullptr;
-    nri::Memory* scratchBufferMemory = nullptr;
-    CreateScratchBuffer(accelerationStructure, scratchBuffer, scratchBufferMemory);
+    const QueuedFrame& queuedFrame = m_QueuedFrames[0];
+    nri::CommandBuffer& commandBuffer = *queuedFrame.commandBuffer;
+    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
+    {
+        CmdGenerateInstances(commandBuffer);
+
+        nri::BufferBarrierDesc bufferBarrier = {};
+        bufferBarrier.buffer = m_InstanceBuffer;
+        bufferBarrier.before = {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::ACCELERATION_STRUCTURE};
+        bufferBarrier.after = {nri::AccessBits::COPY_SOURCE, nri::StageBits::COPY};
+
+        nri::BarrierDesc barrierDesc = {};
+        barrierDesc.bufferNum = 1;
+        barrierDesc.buffers = &bufferBarrier;
+
+        NRI.CmdBarrier(commandBuffer, barrierDesc);
+        NRI.CmdCopyBuffer(commandBuffer, *readbackBuffer, 0, *m_InstanceBuffer, 0, nri::WHOLE_SIZE);
 
-    nri::CommandAllocator* commandAllocator = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, commandAllocator));
+        // Back to the state expected by "CmdGenerateInstances"
+        bufferBarrier.before = bufferBarrier.after;
+        bufferBarrier.after = {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::ACCELERATION_STRUCTURE};
 
-    nri::CommandBuffer* commandBuffer = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*commandAllocator, commandBuffer));
+        NRI.CmdBarrier(commandBuffer, barrierDesc);
+    }
+    NRI.EndCommandBuffer(commandBuffer);
 
     nri::QueueSubmitDesc queueSubmitDesc = {};
-    queueSubmitDesc.commandBuffers = &commandBuffer;
+    queueSubmitDesc.commandBuffers = &queuedFrame.commandBuffer;
     queueSubmitDesc.commandBufferNum = 1;
 
-    NRI.BeginCommandBuffer(*commandBuffer, nullptr);
-    {
-        nri::BuildBottomLevelAccelerationStructureDesc desc = {};
-        desc.dst = &accelerationStructure;
-        desc.geometries = objects;
-        desc.geometryNum = objectNum;
-        desc.scratchBuffer = scratchBuffer;
+    NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
+    NRI.DeviceWaitIdle(m_Device);
+    NRI.ResetCommandAllocator(*queuedFrame.commandAllocator);
+
+    m_InstanceMismatchNum = 0;
+
+    const nri::TopLevelInstance* instances = (nri::TopLevelInstance*)NRI.MapBuffer(*readbackBuffer, 0, nri::WHOLE_SIZE);
+    for (uint32_t i = 0; i < BOX_NUM; i++) {
+        const nri::TopLevelInstance& gpu = instances[i];
+        nri::TopLevelInstance cpu = GenerateInstance(i);
+
+        bool isEqual = gpu.accelerationStructureHandle == cpu.accelerationStructureHandle && gpu.instanceId == cpu.instanceId && gpu.mask == cpu.mask
+            && gpu.instanceContributionToHitGroupIndex == cpu.instanceContributionToHitGroupIndex && gpu.flags == cpu.flags;
 
-        NRI.CmdBuildBottomLevelAccelerationStructures(*commandBuffer, &desc, 1);
+        for (uint32_t j = 0; j < 12 && isEqual; j++)
+            isEqual = fabsf(gpu.transform[j / 4][j % 4] - cpu.transform[j / 4][j % 4]) <= TRANSFORM_TOLERANCE;
+
+        if (!isEqual)
+            m_InstanceMismatchNum++;
     }
-    NRI.EndCommandBuffer(*commandBuffer);
+    NRI.UnmapBuffer(*readbackBuffer);
 
-    NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
-    NRI.QueueWaitIdle(m_GraphicsQueue);
+    NRI.DestroyBuffer(readbackBuffer);
+    NRI.FreeMemory(readbackMemory);
 
-    NRI.DestroyCommandBuffer(commandBuffer);
-    NRI.DestroyCommandAllocator(commandAllocator);
+    printf("GPU instance generation: %u of %u instances differ from the CPU reference\n", m_InstanceMismatchNum, BOX_NUM);
+}
+
+void Sample::CmdGenerateInstances(nri::CommandBuffer& commandBuffer) {
+    // The previous TLAS update (or copy) is done with the instances
+    nri::BufferBarrierDesc bufferBarrier = {};
+    bufferBarrier.buffer = m_InstanceBuffer;
+    bufferBarrier.before = {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::ACCELERATION_STRUCTURE};
+    bufferBarrier.after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::StageBits::COMPUTE_SHADER};
+
+    nri::BarrierDesc barrierDesc = {};
+    barrierDesc.bufferNum = 1;
+    barrierDesc.buffers = &bufferBarrier;
 
-    NRI.DestroyBuffer(scratchBuffer);
-    NRI.FreeMemory(scratchBufferMemory);
+    NRI.CmdBarrier(commandBuffer, barrierDesc);
+
+    NRI.CmdSetPipelineLayout(commandBuffer, nri::BindPoint::COMPUTE, *m_ComputePipelineLayout);
+    NRI.CmdSetPipeline(commandBuffer, *m_ComputePipeline);
+
+    nri::SetDescriptorSetDesc descriptorSet = {0, m_ComputeDescriptorSet};
+    NRI.CmdSetDescriptorSet(commandBuffer, descriptorSet);
+
+    nri::SetRootConstantsDesc rootConstants = {0, &m_InstanceGenerationConstants, sizeof(m_InstanceGenerationConstants)};
+    NRI.CmdSetRootConstants(commandBuffer, rootConstants);
+
+    NRI.CmdDispatch(commandBuffer, {(BOX_NUM + INSTANCE_GENERATION_GROUP_SIZE - 1) / INSTANCE_GENERATION_GROUP_SIZE, 1, 1});
+
+    // Instances are consumed by the TLAS build
+    bufferBarrier.before = bufferBarrier.after;
+    bufferBarrier.after = {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::ACCELERATION_STRUCTURE};
+
+    NRI.CmdBarrier(commandBuffer, barrierDesc);
 }
 
-void Sample::BuildTopLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, uint32_t instanceNum, nri::Buffer& instanceBuffer) {
-    nri::Buffer* scratchBuffer = nullptr;
-    nri::Memory* scratchBufferMemory = nullptr;
-    CreateScratchBuffer(accelerationStructure, scratchBuffer, scratchBufferMemory);
+// CPU reference of "RayTracingBoxInstances.cs.hlsl"
+nri::TopLevelInstance Sample::GenerateInstance(uint32_t index) const {
+    const BoxObject& object = m_BoxObjects[index];
+    const InstanceGenerationConstants& constants = m_InstanceGenerationConstants;
 
-    nri::CommandAllocator* commandAllocator = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, commandAllocator));
+    nri::TopLevelInstance instance = {};
+    GetBoxTransform(object, index, constants.time, instance.transform);
 
-    nri::CommandBuffer* commandBuffer = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*commandAllocator, commandBuffer));
+    float position[3] = {instance.transform[0][3], instance.transform[1][3], instance.transform[2][3]};
 
-    nri::QueueSubmitDesc queueSubmitDesc = {};
-    queueSubmitDesc.commandBuffers = &commandBuffer;
-    queueSubmitDesc.commandBufferNum = 1;
+    // Culling: behind the camera or too far (the instance stays, but can't be hit)
+    float toObject[3] = {position[0] - constants.cameraPositionX, position[1] - constants.cameraPositionY, position[2] - constants.cameraPositionZ};
+    float distance = sqrtf(toObject[0] * toObject[0] + toObject[1] * toObject[1] + toObject[2] * toObject[2]);
 
-    NRI.BeginCommandBuffer(*commandBuffer, nullptr);
-    {
-        nri::BuildTopLevelAccelerationStructureDesc desc = {};
-        desc.dst = &accelerationStructure;
-        desc.instanceNum = instanceNum;
-        desc.instanceBuffer = &instanceBuffer;
-        desc.scratchBuffer = scratchBuffer;
+    uint32_t mask = object.blasIndexMaterialAndMask >> 24;
+    if (toObject[2] < 0.0f || distance > constants.cullDistance)
+        mask = 0;
 
-        NRI.CmdBuildTopLevelAccelerationStructures(*commandBuffer, &desc, 1);
-    }
-    NRI.EndCommandBuffer(*commandBuffer);
+    // LOD
+    uint32_t lod = std::min((uint32_t)(distance / constants.lodDistance), (uint32_t)BOX_LOD_NUM - 1);
+    uint32_t blasIndex = object.blasIndexMaterialAndMask & 0xFFFF;
+    uint32_t material = (object.blasIndexMaterialAndMask >> 16) & 0xFF;
 
-    NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
-    NRI.QueueWaitIdle(m_GraphicsQueue);
+    instance.accelerationStructureHandle = m_BLASHandles[blasIndex * BOX_LOD_NUM + lod];
+    instance.instanceId = index;
+    instance.mask = mask;
+    instance.instanceContributionToHitGroupIndex = material;
 
-    NRI.DestroyCommandBuffer(commandBuffer);
-    NRI.DestroyCommandAllocator(commandAllocator);
+    return instance;
+}
 
-    NRI.DestroyBuffer(scratchBuffer);
-    NRI.FreeMemory(scratchBufferMemory);
+void Sample::WriteInstances(nri::TopLevelInstance* instances, uint32_t offset, uint32_t number) const {
+    // Built on the stack and copied as a whole, "instances" can be write-combined memory
+    for (uint32_t i = offset; i < offset + number; i++)
+        instances[i] = GenerateInstance(i);
 }
 
-void Sample::CreateShaderTable() {
-    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
-    const uint64_t identifierSize = deviceDesc.shaderStage.rayTracing.shaderGroupIdentifierSize;
-    const uint64_t tableAlignment = deviceDesc.memoryAlignment.shaderBindingTable;
+void Sample::ThreadEntryPoint(uint32_t threadIndex) {
+    ThreadContext& threadContext = m_ThreadContexts[threadIndex];
 
-    m_ShaderGroupIdentifierSize = identifierSize;
-    m_MissShaderOffset = helper::Align(identifierSize, tableAlignment);
-    m_HitShaderGroupOffset = helper::Align(m_MissShaderOffset + identifierSize, tableAlignment);
-    const uint64_t shaderTableSize = helper::Align(m_HitShaderGroupOffset + identifierSize, tableAlignment);
+    while (true) {
+        uint32_t control = threadContext.control.load(std::memory_order_relaxed);
+        if (control == HALT) {
+            _mm_pause();
+            continue;
+        } else if (control == STOP)
+            break;
 
-    const nri::BufferDesc bufferDesc = {shaderTableSize, 0, nri::BufferUsageBits::SHADER_BINDING_TABLE};
-    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_ShaderTable));
+        threadContext.control.store(HALT, std::memory_order_seq_cst);
 
-    nri::ResourceGroupDesc resourceGroupDesc = {};
-    resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
-    resourceGroupDesc.bufferNum = 1;
-    resourceGroupDesc.buffers = &m_ShaderTable;
+        uint32_t offset = std::min(threadIndex * m_InstancesPerThread, BOX_NUM);
+        uint32_t number = std::min(m_InstancesPerThread, BOX_NUM - offset);
 
-    const size_t baseAllocation = m_MemoryAllocations.size();
-    m_MemoryAllocations.resize(baseAllocation + 1, nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+        WriteInstances(m_Instances, offset, number);
+
+        // Signal "done" and stay in "HALT" mode (wait for instructions from the main thread)
+        m_ReadyCount.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void Sample::StartThreads() {
+    for (uint32_t i = 1; i < m_ThreadNum; i++) {
+        ThreadContext& threadContext = m_ThreadContexts[i];
+        threadContext.control.store(HALT);
+        threadContext.thread = std::thread(&Sample::ThreadEntryPoint, this, i);
+    }
+}
+
+void Sample::StopThreads() {
+    for (uint32_t i = 1; i < m_ThreadNum; i++) {
+        ThreadContext& threadContext = m_ThreadContexts[i];
+        if (threadContext.thread.joinable()) {
+            threadContext.control.store(STOP);
+            threadContext.thread.join();
+        }
+    }
+}
+
+void Sample::CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, nri::Memory*& memory) {
+    const nri::BufferDesc bufferDesc = {size, 0, usage};
+    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+
+    nri::MemoryDesc memoryDesc = {};
+    NRI.GetBufferMemoryDesc(*buffer, nri::MemoryLocation::HOST_UPLOAD, memoryDesc);
+
+    nri::AllocateMemoryDesc allocateMemoryDesc = {};
+    allocateMemoryDesc.size = memoryDesc.size;
+    allocateMemoryDesc.type = memoryDesc.type;
+    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
+
+    const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {buffer, memory};
+    NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(&bufferMemoryBindingDesc, 1));
+}
+
+void Sample::CreateShaderTable() {
+    // Shader group indices match "CreateRayTracingPipeline", hit group record "i" shades material "i"
+    m_ShaderBindingTable.AddRecord(ShaderTableRegion::RAYGEN, 0);
+    m_ShaderBindingTable.AddRecord(ShaderTableRegion::MISS, 1);
 
-    std::vector<uint8_t> content((size_t)shaderTableSize, 0);
-    for (uint32_t i = 0; i < 3; i++)
-        NRI.WriteShaderGroupIdentifiers(*m_Pipeline, i, 1, content.data() + i * helper::Align(identifierSize, tableAlignment));
+    for (uint32_t i = 0; i < BOX_MATERIAL_NUM; i++)
+        m_ShaderBindingTable.AddRecord(ShaderTableRegion::HIT_GROUP, 2 + i);
 
-    nri::BufferUploadDesc dataDesc = {};
-    dataDesc.data = content.data();
-    dataDesc.buffer = m_ShaderTable;
-    dataDesc.after = {nri::AccessBits::NONE};
-    NRI_ABORT_ON_FAILURE(NRI.UploadData(*m_GraphicsQueue, nullptr, 0, &dataDesc, 1));
+    m_ShaderBindingTable.Create(NRI, NRI, NRI, *m_Device, *m_GraphicsQueue, *m_Pipeline);
 }
 
 SAMPLE_MAIN(Sample, 0);
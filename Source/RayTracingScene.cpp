@@ -0,0 +1,788 @@
+// © 2021 NVIDIA Corporation
+
+#include "NRI.hlsl"
+#include "NRIFramework.h"
+
+#include "Common/AccelerationStructureBuildQueue.h"
+#include "Common/AccelerationStructureStats.h"
+#include "Common/ShaderArchive.h"
+#include "Common/ShaderBindingTable.h"
+#include "Common/StartupProfiler.h"
+
+#include "../Shaders/RayTracingSceneStructs.h"
+
+constexpr auto BUILD_FLAGS = nri::AccelerationStructureBits::PREFER_FAST_TRACE;
+constexpr const char* STATS_FILE = "RayTracingSceneAS.csv";
+
+struct QueuedFrame {
+    nri::CommandAllocator* commandAllocator;
+    nri::CommandBuffer* commandBuffer;
+};
+
+// A BLAS per "utils::Mesh"
+struct MeshBLAS {
+    nri::AccelerationStructure* accelerationStructure;
+    nri::Memory* memory;
+    uint64_t compactedSize;
+    uint32_t statsIndex;
+};
+
+class Sample : public SampleBase {
+public:
+    Sample() {
+    }
+
+    ~Sample();
+
+private:
+    bool Initialize(nri::GraphicsAPI graphicsAPI, bool) override;
+    void LatencySleep(uint32_t frameIndex) override;
+    void PrepareFrame(uint32_t frameIndex) override;
+    void RenderFrame(uint32_t frameIndex) override;
+
+    void CreateSwapChain(nri::Format& swapChainFormat);
+    void CreateCommandBuffers();
+    void CreateRayTracingPipeline();
+    void CreateRayTracingOutput(nri::Format swapChainFormat);
+    void CreateDescriptorSet();
+    void CreateBottomLevelAccelerationStructures();
+    void CompactBottomLevelAccelerationStructures();
+    void CreateTopLevelAccelerationStructure();
+    void CreateShaderTable();
+    void CreateBuffer(uint64_t size, nri::BufferUsageBits usage, nri::MemoryLocation memoryLocation, nri::Buffer*& buffer, nri::Memory*& memory);
+
+    NRIInterface NRI = {};
+    nri::Device* m_Device = nullptr;
+    nri::Streamer* m_Streamer = nullptr;
+    nri::SwapChain* m_SwapChain = nullptr;
+    nri::Queue* m_GraphicsQueue = nullptr;
+    nri::Fence* m_FrameFence = nullptr;
+    AccelerationStructureBuildQueue m_AccelerationStructureBuildQueue;
+    AccelerationStructureStats m_AccelerationStructureStats;
+
+    std::vector<QueuedFrame> m_QueuedFrames = {};
+
+    nri::Pipeline* m_Pipeline = nullptr;
+    nri::PipelineLayout* m_PipelineLayout = nullptr;
+
+    ShaderBindingTable m_ShaderBindingTable;
+
+    nri::Texture* m_RayTracingOutput = nullptr;
+    nri::Descriptor* m_RayTracingOutputView = nullptr;
+
+    nri::DescriptorPool* m_DescriptorPool = nullptr;
+    nri::DescriptorSet* m_DescriptorSet = nullptr;
+
+    std::vector<MeshBLAS> m_BLASes;
+    nri::AccelerationStructure* m_TLAS = nullptr;
+    nri::Descriptor* m_TLASDescriptor = nullptr;
+    nri::Memory* m_TLASMemory = nullptr;
+
+    // Acceleration structure stats
+    uint64_t m_TriangleNum = 0;
+    uint64_t m_BLASMemorySize = 0;
+    uint64_t m_BLASCompactedMemorySize = 0;
+    uint64_t m_TLASMemorySize = 0;
+    double m_BLASBuildTime = 0.0;         // ms, CPU wait for the BLAS batch
+    double m_CompactionAndTLASTime = 0.0; // ms, CPU wait for the compaction and TLAS batch
+
+    utils::Scene m_Scene;
+
+    const SwapChainTexture* m_BackBuffer = nullptr;
+    std::vector<SwapChainTexture> m_SwapChainTextures;
+    std::vector<nri::Memory*> m_MemoryAllocations;
+};
+
+Sample::~Sample() {
+    if (NRI.HasCore()) {
+        NRI.DeviceWaitIdle(m_Device);
+
+        m_AccelerationStructureBuildQueue.Destroy();
+        m_ShaderBindingTable.Destroy();
+
+        if (NRI.HasRayTracing()) {
+            for (MeshBLAS& blas : m_BLASes)
+                NRI.DestroyAccelerationStructure(blas.accelerationStructure);
+
+            NRI.DestroyAccelerationStructure(m_TLAS);
+        }
+
+        for (QueuedFrame& queuedFrame : m_QueuedFrames) {
+            NRI.DestroyCommandBuffer(queuedFrame.commandBuffer);
+            NRI.DestroyCommandAllocator(queuedFrame.commandAllocator);
+        }
+
+        for (SwapChainTexture& swapChainTexture : m_SwapChainTextures) {
+            NRI.DestroyFence(swapChainTexture.acquireSemaphore);
+            NRI.DestroyFence(swapChainTexture.releaseSemaphore);
+            NRI.DestroyDescriptor(swapChainTexture.colorAttachment);
+        }
+
+        NRI.DestroyDescriptor(m_RayTracingOutputView);
+        NRI.DestroyDescriptor(m_TLASDescriptor);
+
+        NRI.DestroyTexture(m_RayTracingOutput);
+
+        NRI.DestroyDescriptorPool(m_DescriptorPool);
+
+        NRI.DestroyPipeline(m_Pipeline);
+        NRI.DestroyPipelineLayout(m_PipelineLayout);
+
+        NRI.DestroyFence(m_FrameFence);
+
+        for (size_t i = 0; i < m_MemoryAllocations.size(); i++)
+            NRI.FreeMemory(m_MemoryAllocations[i]);
+
+        for (MeshBLAS& blas : m_BLASes)
+            NRI.FreeMemory(blas.memory);
+
+        NRI.FreeMemory(m_TLASMemory);
+    }
+
+    if (NRI.HasSwapChain())
+        NRI.DestroySwapChain(m_SwapChain);
+
+    if (NRI.HasStreamer())
+        NRI.DestroyStreamer(m_Streamer);
+
+    DestroyImgui();
+
+    nri::nriDestroyDevice(m_Device);
+}
+
+bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
+
+    // Adapters
+    nri::AdapterDesc adapterDesc[2] = {};
+    uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
+    NRI_ABORT_ON_FAILURE(nri::nriEnumerateAdapters(adapterDesc, adapterDescsNum));
+
+    nri::DeviceCreationDesc deviceCreationDesc = {};
+    deviceCreationDesc.graphicsAPI = graphicsAPI;
+    deviceCreationDesc.enableGraphicsAPIValidation = m_DebugAPI;
+    deviceCreationDesc.enableNRIValidation = m_DebugNRI;
+    deviceCreationDesc.vkBindingOffsets = VK_BINDING_OFFSETS;
+    deviceCreationDesc.adapterDesc = &adapterDesc[std::min(m_AdapterIndex, adapterDescsNum - 1)];
+    deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
+    NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
+
+    StartupProfilerEnd();
+
+    StartupProfilerBegin("Interfaces");
+    NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
+
+    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+    if (deviceDesc.tiers.rayTracing == 0) {
+        printf("Ray tracing is not supported!\n");
+        exit(0);
+    }
+
+    NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::RayTracingInterface), (nri::RayTracingInterface*)&NRI));
+    NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
+    NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
+    StartupProfilerEnd();
+
+    // Create streamer
+    nri::StreamerDesc streamerDesc = {};
+    streamerDesc.dynamicBufferMemoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+    streamerDesc.dynamicBufferDesc = {0, 0, nri::BufferUsageBits::VERTEX_BUFFER | nri::BufferUsageBits::INDEX_BUFFER};
+    streamerDesc.constantBufferMemoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+    streamerDesc.queuedFrameNum = GetQueuedFrameNum();
+    NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
+
+    NRI_ABORT_ON_FAILURE(NRI.GetQueue(*m_Device, nri::QueueType::GRAPHICS, 0, m_GraphicsQueue));
+    NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
+
+    CreateCommandBuffers();
+
+    StartupProfilerBegin("Swap chain");
+    nri::Format swapChainFormat = nri::Format::UNKNOWN;
+    CreateSwapChain(swapChainFormat);
+    StartupProfilerEnd();
+
+    { // Scene
+        StartupPhase phase("Scene");
+
+        std::string sceneFile = utils::GetFullPath(m_SceneFile, utils::DataFolder::SCENES);
+        NRI_ABORT_ON_FALSE(utils::LoadScene(sceneFile, m_Scene, false));
+
+        // Camera
+        m_Camera.Initialize(m_Scene.aabb.GetCenter(), m_Scene.aabb.vMin, false);
+    }
+
+    StartupProfilerBegin("Pipeline");
+    CreateRayTracingPipeline();
+    StartupProfilerEnd();
+
+    CreateDescriptorSet();
+    CreateRayTracingOutput(swapChainFormat);
+
+    // Acceleration structures: BLAS builds and compacted size queries, then compaction and TLAS build
+    StartupProfilerBegin("Acceleration structures");
+    m_AccelerationStructureStats.Initialize(NRI, NRI);
+    m_AccelerationStructureBuildQueue.Initialize(NRI, NRI, *m_Device, *m_GraphicsQueue);
+    m_AccelerationStructureBuildQueue.SetStats(&m_AccelerationStructureStats);
+    CreateBottomLevelAccelerationStructures();
+
+    double begin = m_Timer.GetTimeStamp();
+    m_AccelerationStructureBuildQueue.Submit();
+    m_AccelerationStructureBuildQueue.Wait();
+    m_BLASBuildTime = m_Timer.GetTimeStamp() - begin;
+
+    CompactBottomLevelAccelerationStructures();
+    CreateTopLevelAccelerationStructure();
+
+    begin = m_Timer.GetTimeStamp();
+    m_AccelerationStructureBuildQueue.Submit();
+    m_AccelerationStructureBuildQueue.Wait();
+    m_CompactionAndTLASTime = m_Timer.GetTimeStamp() - begin;
+    StartupProfilerEnd();
+
+    StartupProfilerBegin("Shader table");
+    CreateShaderTable();
+    StartupProfilerEnd();
+
+    const ScratchArena& scratchArena = m_AccelerationStructureBuildQueue.GetScratchArena();
+    printf("BLAS: %u (%" PRIu64 " triangles), build %.2f ms, memory %.1f MB (%.1f MB compacted)\n", (uint32_t)m_BLASes.size(), m_TriangleNum, m_BLASBuildTime, m_BLASMemorySize / (1024.0 * 1024.0), m_BLASCompactedMemorySize / (1024.0 * 1024.0));
+    printf("TLAS: %u instances, compaction + build %.2f ms, memory %.1f KB\n", (uint32_t)m_Scene.instances.size(), m_CompactionAndTLASTime, m_TLASMemorySize / 1024.0);
+
+    // Batches: BLAS builds, then compaction and TLAS build
+    const std::vector<AccelerationStructureStatsBatch>& batches = m_AccelerationStructureStats.GetBatches();
+    printf("GPU: BLAS builds %.3f ms, compaction %.3f ms, TLAS build %.3f ms\n", batches[0].bottomLevelGpuTime, batches[1].bottomLevelGpuTime, batches[1].topLevelGpuTime);
+    printf("Scratch arena: peak usage %" PRIu64 " bytes (%u block(s), %" PRIu64 " bytes)\n", scratchArena.GetPeakUsage(), scratchArena.GetBlockNum(), scratchArena.GetCapacity());
+
+    StartupProfilerBegin("UI");
+    bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
+
+    return initialized;
+}
+
+void Sample::LatencySleep(uint32_t frameIndex) {
+    uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
+    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
+
+    NRI.Wait(*m_FrameFence, frameIndex >= GetQueuedFrameNum() ? 1 + frameIndex - GetQueuedFrameNum() : 0);
+    NRI.ResetCommandAllocator(*queuedFrame.commandAllocator);
+}
+
+void Sample::PrepareFrame(uint32_t frameIndex) {
+    ImGui::NewFrame();
+    {
+        ImGui::SetNextWindowPos(ImVec2(30, 30), ImGuiCond_Once);
+        ImGui::SetNextWindowSize(ImVec2(0, 0));
+        ImGui::Begin("Acceleration structures", nullptr, ImGuiWindowFlags_NoResize);
+        {
+            ImGui::Text("BLAS (meshes)         : %u", (uint32_t)m_BLASes.size());
+            ImGui::Text("Triangles             : %" PRIu64, m_TriangleNum);
+            ImGui::Text("BLAS build (CPU wait) : %.2f ms", m_BLASBuildTime);
+            ImGui::Text("BLAS build (GPU)      : %.3f ms", m_AccelerationStructureStats.GetBatches()[0].bottomLevelGpuTime);
+            ImGui::Text("BLAS memory (before)  : %.1f MB", m_BLASMemorySize / (1024.0 * 1024.0));
+            ImGui::Text("BLAS memory (after)   : %.1f MB", m_BLASCompactedMemorySize / (1024.0 * 1024.0));
+            ImGui::Text("Saved                 : %.1f%%", m_BLASMemorySize ? 100.0 * (1.0 - double(m_BLASCompactedMemorySize) / double(m_BLASMemorySize)) : 0.0);
+
+            ImGui::Separator();
+            ImGui::Text("TLAS instances        : %u", (uint32_t)m_Scene.instances.size());
+            ImGui::Text("Compaction + TLAS     : %.2f ms", m_CompactionAndTLASTime);
+            ImGui::Text("TLAS memory           : %.1f KB", m_TLASMemorySize / 1024.0);
+
+            if (ImGui::CollapsingHeader("Details")) {
+                m_AccelerationStructureStats.DrawImgui();
+
+                if (ImGui::Button("Save CSV"))
+                    m_AccelerationStructureStats.WriteCsv(STATS_FILE);
+            }
+        }
+        ImGui::End();
+    }
+    ImGui::EndFrame();
+    ImGui::Render();
+
+    CameraDesc desc = {};
+    desc.aspectRatio = float(GetOutputResolution().x) / float(GetOutputResolution().y);
+    desc.horizontalFov = 90.0f;
+    desc.nearZ = 0.1f;
+    desc.isReversedZ = false; // "RayTracingScene.rgen.hlsl" unprojects the near plane at "z = 0"
+    GetCameraDescFromInputDevices(desc);
+
+    m_Camera.Update(desc, frameIndex);
+}
+
+void Sample::RenderFrame(uint32_t frameIndex) {
+    uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
+    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
+
+    // Acquire a swap chain texture
+    uint32_t recycledSemaphoreIndex = frameIndex % (uint32_t)m_SwapChainTextures.size();
+    nri::Fence* swapChainAcquireSemaphore = m_SwapChainTextures[recycledSemaphoreIndex].acquireSemaphore;
+
+    uint32_t currentSwapChainTextureIndex = 0;
+    NRI.AcquireNextTexture(*m_SwapChain, *swapChainAcquireSemaphore, currentSwapChainTextureIndex);
+
+    const SwapChainTexture& swapChainTexture = m_SwapChainTextures[currentSwapChainTextureIndex];
+
+    m_BackBuffer = &m_SwapChainTextures[currentSwapChainTextureIndex];
+
+    // Constants
+    RayTracingSceneConstants constants = {};
+    constants.gClipToScene = m_Camera.state.mWorldToClip * m_Scene.mSceneToWorld;
+    constants.gClipToScene.Invert();
+
+    // Record
+    nri::TextureBarrierDesc textureTransitions[2] = {};
+    nri::BarrierDesc barrierDesc = {};
+
+    nri::CommandBuffer& commandBuffer = *queuedFrame.commandBuffer;
+    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
+    {
+        // Rendering
+        textureTransitions[0].texture = m_BackBuffer->texture;
+        textureTransitions[0].after = {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION};
+        textureTransitions[0].layerNum = 1;
+        textureTransitions[0].mipNum = 1;
+
+        textureTransitions[1].texture = m_RayTracingOutput;
+        textureTransitions[1].before = {frameIndex == 0 ? nri::AccessBits::NONE : nri::AccessBits::COPY_SOURCE, frameIndex == 0 ? nri::Layout::UNDEFINED : nri::Layout::COPY_SOURCE};
+        textureTransitions[1].after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE};
+        textureTransitions[1].layerNum = 1;
+        textureTransitions[1].mipNum = 1;
+
+        barrierDesc.textures = textureTransitions;
+        barrierDesc.textureNum = 2;
+
+        nri::BufferBarrierDesc bufferBarrier = {};
+        if (frameIndex == 0) {
+            bufferBarrier.buffer = m_ShaderBindingTable.GetBuffer();
+            bufferBarrier.after = {nri::AccessBits::SHADER_BINDING_TABLE, nri::StageBits::RAYGEN_SHADER};
+
+            barrierDesc.bufferNum = 1;
+            barrierDesc.buffers = &bufferBarrier;
+        }
+
+        NRI.CmdBarrier(commandBuffer, barrierDesc);
+
+        NRI.CmdSetPipelineLayout(commandBuffer, nri::BindPoint::RAY_TRACING, *m_PipelineLayout);
+        NRI.CmdSetPipeline(commandBuffer, *m_Pipeline);
+
+        nri::SetDescriptorSetDesc descriptorSet = {0, m_DescriptorSet};
+        NRI.CmdSetDescriptorSet(commandBuffer, descriptorSet);
+
+        nri::SetRootConstantsDesc rootConstants = {0, &constants, sizeof(constants)};
+        NRI.CmdSetRootConstants(commandBuffer, rootConstants);
+
+        nri::DispatchRaysDesc dispatchRaysDesc = {};
+        m_ShaderBindingTable.FillDispatchRaysDesc(dispatchRaysDesc);
+        dispatchRaysDesc.x = (uint16_t)GetOutputResolution().x;
+        dispatchRaysDesc.y = (uint16_t)GetOutputResolution().y;
+        dispatchRaysDesc.z = 1;
+        NRI.CmdDispatchRays(commandBuffer, dispatchRaysDesc);
+
+        // Copy
+        textureTransitions[1].before = textureTransitions[1].after;
+        textureTransitions[1].after = {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE};
+
+        barrierDesc.textures = textureTransitions + 1;
+        barrierDesc.textureNum = 1;
+        barrierDesc.bufferNum = 0;
+
+        NRI.CmdBarrier(commandBuffer, barrierDesc);
+        NRI.CmdCopyTexture(commandBuffer, *m_BackBuffer->texture, nullptr, *m_RayTracingOutput, nullptr);
+
+        // UI
+        CmdCopyImguiData(commandBuffer, *m_Streamer);
+
+        textureTransitions[0].before = textureTransitions[0].after;
+        textureTransitions[0].after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT};
+
+        barrierDesc.textures = textureTransitions;
+        barrierDesc.textureNum = 1;
+
+        NRI.CmdBarrier(commandBuffer, barrierDesc);
+
+        nri::AttachmentDesc colorAttachmentDesc = {};
+        colorAttachmentDesc.descriptor = m_BackBuffer->colorAttachment;
+
+        nri::RenderingDesc renderingDesc = {};
+        renderingDesc.colorNum = 1;
+        renderingDesc.colors = &colorAttachmentDesc;
+
+        NRI.CmdBeginRendering(commandBuffer, renderingDesc);
+        {
+            CmdDrawImgui(commandBuffer, m_BackBuffer->attachmentFormat, 1.0f, true);
+        }
+        NRI.CmdEndRendering(commandBuffer);
+
+        // Present
+        textureTransitions[0].before = textureTransitions[0].after;
+        textureTransitions[0].after = {nri::AccessBits::NONE, nri::Layout::PRESENT, nri::StageBits::NONE};
+
+        barrierDesc.textures = textureTransitions;
+        barrierDesc.textureNum = 1;
+
+        NRI.CmdBarrier(commandBuffer, barrierDesc);
+    }
+    NRI.EndCommandBuffer(commandBuffer);
+
+    { // Submit
+        nri::FenceSubmitDesc frameFence = {};
+        frameFence.fence = m_FrameFence;
+        frameFence.value = 1 + frameIndex;
+
+        nri::FenceSubmitDesc textureAcquiredFence = {};
+        textureAcquiredFence.fence = swapChainAcquireSemaphore;
+        textureAcquiredFence.stages = nri::StageBits::ALL;
+
+        nri::FenceSubmitDesc renderingFinishedFence = {};
+        renderingFinishedFence.fence = swapChainTexture.releaseSemaphore;
+
+        nri::FenceSubmitDesc signalFences[] = {renderingFinishedFence, frameFence};
+
+        nri::QueueSubmitDesc queueSubmitDesc = {};
+        queueSubmitDesc.waitFences = &textureAcquiredFence;
+        queueSubmitDesc.waitFenceNum = 1;
+        queueSubmitDesc.commandBuffers = &queuedFrame.commandBuffer;
+        queueSubmitDesc.commandBufferNum = 1;
+        queueSubmitDesc.signalFences = signalFences;
+        queueSubmitDesc.signalFenceNum = helper::GetCountOf(signalFences);
+
+        NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
+    }
+
+    NRI.EndStreamerFrame(*m_Streamer);
+
+    // Present
+    NRI.QueuePresent(*m_SwapChain, *swapChainTexture.releaseSemaphore);
+}
+
+void Sample::CreateSwapChain(nri::Format& swapChainFormat) {
+    nri::SwapChainDesc swapChainDesc = {};
+    swapChainDesc.window = GetWindow();
+    swapChainDesc.queue = m_GraphicsQueue;
+    swapChainDesc.format = nri::SwapChainFormat::BT709_G22_8BIT;
+    swapChainDesc.flags = (m_Vsync ? nri::SwapChainBits::VSYNC : nri::SwapChainBits::NONE) | nri::SwapChainBits::ALLOW_TEARING;
+    swapChainDesc.width = (uint16_t)GetOutputResolution().x;
+    swapChainDesc.height = (uint16_t)GetOutputResolution().y;
+    swapChainDesc.textureNum = GetOptimalSwapChainTextureNum();
+    swapChainDesc.queuedFrameNum = GetQueuedFrameNum();
+
+    NRI_ABORT_ON_FAILURE(NRI.CreateSwapChain(*m_Device, swapChainDesc, m_SwapChain));
+
+    uint32_t swapChainTextureNum = 0;
+    nri::Texture* const* swapChainTextures = NRI.GetSwapChainTextures(*m_SwapChain, swapChainTextureNum);
+
+    swapChainFormat = NRI.GetTextureDesc(*swapChainTextures[0]).format;
+
+    m_SwapChainTextures.clear();
+    for (uint32_t i = 0; i < swapChainTextureNum; i++) {
+        nri::TextureViewDesc textureViewDesc = {swapChainTextures[i], nri::TextureView::COLOR_ATTACHMENT, swapChainFormat};
+
+        nri::Descriptor* colorAttachment = nullptr;
+        NRI_ABORT_ON_FAILURE(NRI.CreateTextureView(textureViewDesc, colorAttachment));
+
+        nri::Fence* acquireSemaphore = nullptr;
+        NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, nri::SWAPCHAIN_SEMAPHORE, acquireSemaphore));
+
+        nri::Fence* releaseSemaphore = nullptr;
+        NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, nri::SWAPCHAIN_SEMAPHORE, releaseSemaphore));
+
+        SwapChainTexture& swapChainTexture = m_SwapChainTextures.emplace_back();
+
+        swapChainTexture = {};
+        swapChainTexture.acquireSemaphore = acquireSemaphore;
+        swapChainTexture.releaseSemaphore = releaseSemaphore;
+        swapChainTexture.texture = swapChainTextures[i];
+        swapChainTexture.colorAttachment = colorAttachment;
+        swapChainTexture.attachmentFormat = swapChainFormat;
+    }
+}
+
+void Sample::CreateCommandBuffers() {
+    m_QueuedFrames.resize(GetQueuedFrameNum());
+    for (QueuedFrame& queuedFrame : m_QueuedFrames) {
+        NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, queuedFrame.commandAllocator));
+        NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBuffer));
+    }
+}
+
+void Sample::CreateRayTracingPipeline() {
+    nri::DescriptorRangeDesc descriptorRanges[] = {
+        {0, 1, nri::DescriptorType::STORAGE_TEXTURE, nri::StageBits::RAYGEN_SHADER},
+        {1, 1, nri::DescriptorType::ACCELERATION_STRUCTURE, nri::StageBits::RAYGEN_SHADER},
+    };
+
+    nri::DescriptorSetDesc descriptorSetDesc = {0, descriptorRanges, helper::GetCountOf(descriptorRanges)};
+
+    nri::RootConstantDesc rootConstant = {0, sizeof(RayTracingSceneConstants), nri::StageBits::RAYGEN_SHADER};
+
+    nri::PipelineLayoutDesc pipelineLayoutDesc = {};
+    pipelineLayoutDesc.descriptorSets = &descriptorSetDesc;
+    pipelineLayoutDesc.descriptorSetNum = 1;
+    pipelineLayoutDesc.rootConstants = &rootConstant;
+    pipelineLayoutDesc.rootConstantNum = 1;
+    pipelineLayoutDesc.shaderStages = nri::StageBits::RAYGEN_SHADER;
+
+    NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_PipelineLayout));
+
+    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+    utils::ShaderCodeStorage shaderCodeStorage;
+    nri::ShaderDesc shaders[] = {
+        LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingScene.rgen", shaderCodeStorage, "raygen"),
+        LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingScene.rmiss", shaderCodeStorage, "miss"),
+        LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingScene.rchit", shaderCodeStorage, "closest_hit"),
+    };
+
+    nri::ShaderLibraryDesc shaderLibrary = {};
+    shaderLibrary.shaders = shaders;
+    shaderLibrary.shaderNum = helper::GetCountOf(shaders);
+
+    const nri::ShaderGroupDesc shaderGroupDescs[] = {{1}, {2}, {3}};
+
+    nri::RayTracingPipelineDesc pipelineDesc = {};
+    pipelineDesc.recursionMaxDepth = 1;
+    pipelineDesc.rayPayloadMaxSize = 3 * sizeof(float);
+    pipelineDesc.rayHitAttributeMaxSize = 2 * sizeof(float);
+    pipelineDesc.pipelineLayout = m_PipelineLayout;
+    pipelineDesc.shaderGroups = shaderGroupDescs;
+    pipelineDesc.shaderGroupNum = helper::GetCountOf(shaderGroupDescs);
+    pipelineDesc.shaderLibrary = &shaderLibrary;
+
+    NRI_ABORT_ON_FAILURE(NRI.CreateRayTracingPipeline(*m_Device, pipelineDesc, m_Pipeline));
+}
+
+void Sample::CreateRayTracingOutput(nri::Format swapChainFormat) {
+    nri::TextureDesc rayTracingOutputDesc = {};
+    rayTracingOutputDesc.type = nri::TextureType::TEXTURE_2D;
+    rayTracingOutputDesc.format = swapChainFormat;
+    rayTracingOutputDesc.width = (uint16_t)GetOutputResolution().x;
+    rayTracingOutputDesc.height = (uint16_t)GetOutputResolution().y;
+    rayTracingOutputDesc.depth = 1;
+    rayTracingOutputDesc.layerNum = 1;
+    rayTracingOutputDesc.mipNum = 1;
+    rayTracingOutputDesc.sampleNum = 1;
+    rayTracingOutputDesc.usage = nri::TextureUsageBits::SHADER_RESOURCE_STORAGE;
+    NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, rayTracingOutputDesc, m_RayTracingOutput));
+
+    nri::MemoryDesc memoryDesc = {};
+    NRI.GetTextureMemoryDesc(*m_RayTracingOutput, nri::MemoryLocation::DEVICE, memoryDesc);
+
+    nri::AllocateMemoryDesc allocateMemoryDesc = {};
+    allocateMemoryDesc.size = memoryDesc.size;
+    allocateMemoryDesc.type = memoryDesc.type;
+
+    nri::Memory* memory = nullptr;
+    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
+    m_MemoryAllocations.push_back(memory);
+
+    const nri::BindTextureMemoryDesc memoryBindingDesc = {m_RayTracingOutput, memory};
+    NRI_ABORT_ON_FAILURE(NRI.BindTextureMemory(&memoryBindingDesc, 1));
+
+    nri::TextureViewDesc textureViewDesc = {m_RayTracingOutput, nri::TextureView::STORAGE_TEXTURE, swapChainFormat};
+    NRI_ABORT_ON_FAILURE(NRI.CreateTextureView(textureViewDesc, m_RayTracingOutputView));
+
+    const nri::UpdateDescriptorRangeDesc updateDescriptorRangeDesc = {m_DescriptorSet, 0, 0, &m_RayTracingOutputView, 1};
+    NRI.UpdateDescriptorRanges(&updateDescriptorRangeDesc, 1);
+}
+
+void Sample::CreateDescriptorSet() {
+    nri::DescriptorPoolDesc descriptorPoolDesc = {};
+    descriptorPoolDesc.storageTextureMaxNum = 1;
+    descriptorPoolDesc.accelerationStructureMaxNum = 1;
+    descriptorPoolDesc.descriptorSetMaxNum = 1;
+
+    NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_Device, descriptorPoolDesc, m_DescriptorPool));
+    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 0, &m_DescriptorSet, 1, 0));
+}
+
+void Sample::CreateBottomLevelAccelerationStructures() {
+    // Geometry (shared by all BLAS builds, released when the BLAS batch is done)
+    nri::Buffer* vertexBuffer = nullptr;
+    nri::Memory* vertexMemory = nullptr;
+    CreateBuffer(helper::GetByteSizeOf(m_Scene.vertices), nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_INPUT, nri::MemoryLocation::DEVICE, vertexBuffer, vertexMemory);
+
+    nri::Buffer* indexBuffer = nullptr;
+    nri::Memory* indexMemory = nullptr;
+    CreateBuffer(helper::GetByteSizeOf(m_Scene.indices), nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_INPUT, nri::MemoryLocation::DEVICE, indexBuffer, indexMemory);
+
+    nri::BufferUploadDesc dataDescArray[] = {
+        {m_Scene.vertices.data(), vertexBuffer, {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::ACCELERATION_STRUCTURE}},
+        {m_Scene.indices.data(), indexBuffer, {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::ACCELERATION_STRUCTURE}},
+    };
+    NRI_ABORT_ON_FAILURE(NRI.UploadData(*m_GraphicsQueue, nullptr, 0, dataDescArray, helper::GetCountOf(dataDescArray)));
+
+    m_AccelerationStructureBuildQueue.AddTransientBuffer(vertexBuffer, vertexMemory);
+    m_AccelerationStructureBuildQueue.AddTransientBuffer(indexBuffer, indexMemory);
+
+    // A BLAS per mesh (indices are relative to "vertexOffset")
+    m_BLASes.resize(m_Scene.meshes.size(), MeshBLAS{});
+    for (size_t i = 0; i < m_Scene.meshes.size(); i++) {
+        const utils::Mesh& mesh = m_Scene.meshes[i];
+        MeshBLAS& blas = m_BLASes[i];
+
+        nri::BottomLevelGeometryDesc object = {};
+        object.type = nri::BottomLevelGeometryType::TRIANGLES;
+        object.flags = nri::BottomLevelGeometryBits::OPAQUE_GEOMETRY;
+        object.triangles.vertexBuffer = vertexBuffer;
+        object.triangles.vertexOffset = mesh.vertexOffset * sizeof(utils::Vertex) + offsetof(utils::Vertex, pos);
+        object.triangles.vertexFormat = nri::Format::RGB32_SFLOAT;
+        object.triangles.vertexNum = mesh.vertexNum;
+        object.triangles.vertexStride = sizeof(utils::Vertex);
+        object.triangles.indexBuffer = indexBuffer;
+        object.triangles.indexOffset = mesh.indexOffset * sizeof(utils::Index);
+        object.triangles.indexNum = mesh.indexNum;
+        object.triangles.indexType = sizeof(utils::Index) == 2 ? nri::IndexType::UINT16 : nri::IndexType::UINT32;
+
+        nri::AccelerationStructureDesc accelerationStructureDesc = {};
+        accelerationStructureDesc.type = nri::AccelerationStructureType::BOTTOM_LEVEL;
+        accelerationStructureDesc.flags = BUILD_FLAGS | nri::AccelerationStructureBits::ALLOW_COMPACTION;
+        accelerationStructureDesc.geometryOrInstanceNum = 1;
+        accelerationStructureDesc.geometries = &object;
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateAccelerationStructure(*m_Device, accelerationStructureDesc, blas.accelerationStructure));
+
+        nri::MemoryDesc memoryDesc = {};
+        NRI.GetAccelerationStructureMemoryDesc(*blas.accelerationStructure, nri::MemoryLocation::DEVICE, memoryDesc);
+
+        nri::AllocateMemoryDesc allocateMemoryDesc = {};
+        allocateMemoryDesc.size = memoryDesc.size;
+        allocateMemoryDesc.type = memoryDesc.type;
+
+        NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, blas.memory));
+        m_BLASMemorySize += memoryDesc.size;
+
+        const nri::BindAccelerationStructureMemoryDesc memoryBindingDesc = {blas.accelerationStructure, blas.memory};
+        NRI_ABORT_ON_FAILURE(NRI.BindAccelerationStructureMemory(&memoryBindingDesc, 1));
+
+        char name[32];
+        snprintf(name, sizeof(name), "Mesh %u", (uint32_t)i);
+        blas.statsIndex = m_AccelerationStructureStats.Register(name, *blas.accelerationStructure, accelerationStructureDesc);
+
+        m_AccelerationStructureBuildQueue.AddBottomLevel(*blas.accelerationStructure, &object, 1);
+        m_AccelerationStructureBuildQueue.AddCompactedSizeQuery(*blas.accelerationStructure, &blas.compactedSize);
+
+        m_TriangleNum += mesh.indexNum / 3;
+    }
+}
+
+void Sample::CompactBottomLevelAccelerationStructures() {
+    for (MeshBLAS& blas : m_BLASes) {
+        nri::AccelerationStructureDesc accelerationStructureDesc = {};
+        accelerationStructureDesc.type = nri::AccelerationStructureType::BOTTOM_LEVEL;
+        accelerationStructureDesc.flags = BUILD_FLAGS;
+        accelerationStructureDesc.optimizedSize = blas.compactedSize;
+
+        nri::AccelerationStructure* compactedBLAS = nullptr;
+        NRI_ABORT_ON_FAILURE(NRI.CreateAccelerationStructure(*m_Device, accelerationStructureDesc, compactedBLAS));
+
+        nri::MemoryDesc memoryDesc = {};
+        NRI.GetAccelerationStructureMemoryDesc(*compactedBLAS, nri::MemoryLocation::DEVICE, memoryDesc);
+
+        nri::AllocateMemoryDesc allocateMemoryDesc = {};
+        allocateMemoryDesc.size = memoryDesc.size;
+        allocateMemoryDesc.type = memoryDesc.type;
+
+        nri::Memory* compactedMemory = nullptr;
+        NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, compactedMemory));
+        m_BLASCompactedMemorySize += memoryDesc.size;
+
+        const nri::BindAccelerationStructureMemoryDesc memoryBindingDesc = {compactedBLAS, compactedMemory};
+        NRI_ABORT_ON_FAILURE(NRI.BindAccelerationStructureMemory(&memoryBindingDesc, 1));
+
+        m_AccelerationStructureStats.SetCompacted(blas.statsIndex, *compactedBLAS);
+
+        // The original is released when the copy is done
+        m_AccelerationStructureBuildQueue.AddCompaction(*compactedBLAS, *blas.accelerationStructure);
+        m_AccelerationStructureBuildQueue.AddTransientAccelerationStructure(blas.accelerationStructure, blas.memory);
+
+        blas.accelerationStructure = compactedBLAS;
+        blas.memory = compactedMemory;
+    }
+}
+
+void Sample::CreateTopLevelAccelerationStructure() {
+    const uint32_t instanceNum = (uint32_t)m_Scene.instances.size();
+
+    nri::AccelerationStructureDesc accelerationStructureDesc = {};
+    accelerationStructureDesc.type = nri::AccelerationStructureType::TOP_LEVEL;
+    accelerationStructureDesc.flags = BUILD_FLAGS;
+    accelerationStructureDesc.geometryOrInstanceNum = instanceNum;
+
+    NRI_ABORT_ON_FAILURE(NRI.CreateAccelerationStructure(*m_Device, accelerationStructureDesc, m_TLAS));
+
+    nri::MemoryDesc memoryDesc = {};
+    NRI.GetAccelerationStructureMemoryDesc(*m_TLAS, nri::MemoryLocation::DEVICE, memoryDesc);
+
+    nri::AllocateMemoryDesc allocateMemoryDesc = {};
+    allocateMemoryDesc.size = memoryDesc.size;
+    allocateMemoryDesc.type = memoryDesc.type;
+
+    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, m_TLASMemory));
+    m_TLASMemorySize = memoryDesc.size;
+
+    const nri::BindAccelerationStructureMemoryDesc memoryBindingDesc = {m_TLAS, m_TLASMemory};
+    NRI_ABORT_ON_FAILURE(NRI.BindAccelerationStructureMemory(&memoryBindingDesc, 1));
+
+    m_AccelerationStructureStats.Register("TLAS", *m_TLAS, accelerationStructureDesc);
+
+    // An instance per "utils::Instance", referencing the BLAS of its mesh. Scene viewers draw meshes in scene space,
+    // i.e. with identity transforms, "mSceneToWorld" is folded into the camera matrix instead
+    nri::Buffer* buffer = nullptr;
+    nri::Memory* memory = nullptr;
+    CreateBuffer(instanceNum * sizeof(nri::TopLevelInstance), nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_INPUT, nri::MemoryLocation::HOST_UPLOAD, buffer, memory);
+
+    nri::TopLevelInstance* instances = (nri::TopLevelInstance*)NRI.MapBuffer(*buffer, 0, nri::WHOLE_SIZE);
+    for (uint32_t i = 0; i < instanceNum; i++) {
+        const utils::Instance& instance = m_Scene.instances[i];
+        uint32_t meshIndex = m_Scene.meshInstances[instance.meshInstanceIndex].meshIndex;
+
+        nri::TopLevelInstance topLevelInstance = {};
+        topLevelInstance.accelerationStructureHandle = NRI.GetAccelerationStructureHandle(*m_BLASes[meshIndex].accelerationStructure);
+        topLevelInstance.transform[0][0] = 1.0f;
+        topLevelInstance.transform[1][1] = 1.0f;
+        topLevelInstance.transform[2][2] = 1.0f;
+        topLevelInstance.instanceId = i;
+        topLevelInstance.mask = 0xFF;
+        topLevelInstance.flags = nri::TopLevelInstanceBits::FORCE_OPAQUE;
+
+        instances[i] = topLevelInstance;
+    }
+    NRI.UnmapBuffer(*buffer);
+
+    m_AccelerationStructureBuildQueue.AddTopLevel(*m_TLAS, instanceNum, *buffer);
+    m_AccelerationStructureBuildQueue.AddTransientBuffer(buffer, memory);
+
+    NRI_ABORT_ON_FAILURE(NRI.CreateAccelerationStructureDescriptor(*m_TLAS, m_TLASDescriptor));
+
+    const nri::UpdateDescriptorRangeDesc updateDescriptorRangeDesc = {m_DescriptorSet, 1, 0, &m_TLASDescriptor, 1};
+    NRI.UpdateDescriptorRanges(&updateDescriptorRangeDesc, 1);
+}
+
+void Sample::CreateShaderTable() {
+    // Shader group indices match "CreateRayTracingPipeline"
+    m_ShaderBindingTable.AddRecord(ShaderTableRegion::RAYGEN, 0);
+    m_ShaderBindingTable.AddRecord(ShaderTableRegion::MISS, 1);
+    m_ShaderBindingTable.AddRecord(ShaderTableRegion::HIT_GROUP, 2);
+
+    m_ShaderBindingTable.Create(NRI, NRI, NRI, *m_Device, *m_GraphicsQueue, *m_Pipeline);
+}
+
+void Sample::CreateBuffer(uint64_t size, nri::BufferUsageBits usage, nri::MemoryLocation memoryLocation, nri::Buffer*& buffer, nri::Memory*& memory) {
+    const nri::BufferDesc bufferDesc = {size, 0, usage};
+    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+
+    nri::MemoryDesc memoryDesc = {};
+    NRI.GetBufferMemoryDesc(*buffer, memoryLocation, memoryDesc);
+
+    nri::AllocateMemoryDesc allocateMemoryDesc = {};
+    allocateMemoryDesc.size = memoryDesc.size;
+    allocateMemoryDesc.type = memoryDesc.type;
+    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
+
+    const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {buffer, memory};
+    NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(&bufferMemoryBindingDesc, 1));
+}
+
+SAMPLE_MAIN(Sample, 0);
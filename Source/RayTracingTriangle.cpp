@@ -2,13 +2,28 @@
 
 #include "NRIFramework.h"
 
+#include "Common/AccelerationStructureBuildQueue.h"
+#include "Common/ShaderArchive.h"
+#include "Common/StartupProfiler.h"
+
 #include <array>
 
 constexpr auto BUILD_FLAGS = nri::AccelerationStructureBits::PREFER_FAST_TRACE;
+constexpr uint32_t TIMESTAMPS_PER_FRAME = 2;  // tracing (begin, end)
+constexpr uint32_t RAY_QUERY_GROUP_SIZE = 8; // must match "RayTracingTriangleQuery.cs.hlsl"
+
+enum TraceMode : int32_t {
+    TRACE_MODE_PIPELINE, // "TraceRay" through the shader table
+    TRACE_MODE_RAY_QUERY // inline "RayQuery" in a compute shader
+};
 
 struct QueuedFrame {
     nri::CommandAllocator* commandAllocator;
     nri::CommandBuffer* commandBuffer;
+
+    // Tracing timing
+    int32_t traceMode;
+    bool isTraced;
 };
 
 class Sample : public SampleBase {
@@ -21,34 +36,39 @@ public:
 private:
     bool Initialize(nri::GraphicsAPI graphicsAPI, bool) override;
     void LatencySleep(uint32_t frameIndex) override;
+    void PrepareFrame(uint32_t frameIndex) override;
     void RenderFrame(uint32_t frameIndex) override;
 
     void CreateSwapChain(nri::Format& swapChainFormat);
     void CreateCommandBuffers();
     void CreateRayTracingPipeline();
+    void CreateRayQueryPipeline();
     void CreateRayTracingOutput(nri::Format swapChainFormat);
     void CreateDescriptorSet();
     void CreateBottomLevelAccelerationStructure();
     void CreateTopLevelAccelerationStructure();
     void CreateShaderTable();
+    void CreateTimestamps();
     void CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, nri::Memory*& memory);
-    void CreateScratchBuffer(nri::AccelerationStructure& accelerationStructure, nri::Buffer*& buffer, nri::Memory*& memory);
-    void BuildBottomLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, const nri::BottomLevelGeometryDesc* objects, const uint32_t objectNum);
-    void BuildTopLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, uint32_t instanceNum, nri::Buffer& instanceBuffer);
 
     NRIInterface NRI = {};
     nri::Device* m_Device = nullptr;
     nri::SwapChain* m_SwapChain = nullptr;
     nri::Queue* m_GraphicsQueue = nullptr;
     nri::Fence* m_FrameFence = nullptr;
+    nri::Streamer* m_Streamer = nullptr;
+    AccelerationStructureBuildQueue m_AccelerationStructureBuildQueue;
 
     std::vector<QueuedFrame> m_QueuedFrames = {};
 
     nri::Pipeline* m_Pipeline = nullptr;
     nri::PipelineLayout* m_PipelineLayout = nullptr;
+    nri::Pipeline* m_RayQueryPipeline = nullptr; // same layout and descriptor set
 
     nri::Buffer* m_ShaderTable = nullptr;
     nri::Memory* m_ShaderTableMemory = nullptr;
+    nri::Buffer* m_ShaderTableUploadBuffer = nullptr; // copied in the first frame, released when it's complete
+    nri::Memory* m_ShaderTableUploadMemory = nullptr;
     uint64_t m_ShaderGroupIdentifierSize = 0;
     uint64_t m_MissShaderOffset = 0;
     uint64_t m_HitShaderGroupOffset = 0;
@@ -65,6 +85,14 @@ private:
     nri::Memory* m_BLASMemory = nullptr;
     nri::Memory* m_TLASMemory = nullptr;
 
+    nri::QueryPool* m_TimestampQueryPool = nullptr;
+    nri::Buffer* m_TimestampReadbackBuffer = nullptr;
+    uint64_t m_TimestampSize = 0;
+    double m_TimestampPeriod = 0.0; // ms
+    double m_TraceTimes[2] = {};    // [TraceMode]
+    int32_t m_TraceMode = TRACE_MODE_PIPELINE;
+    bool m_IsRayQuerySupported = false;
+
     const SwapChainTexture* m_BackBuffer = nullptr;
     std::vector<SwapChainTexture> m_SwapChainTextures;
     std::vector<nri::Memory*> m_MemoryAllocations;
@@ -74,6 +102,8 @@ Sample::~Sample() {
     if (NRI.HasCore()) {
         NRI.DeviceWaitIdle(m_Device);
 
+        m_AccelerationStructureBuildQueue.Destroy();
+
         if (NRI.HasRayTracing()) {
             NRI.DestroyAccelerationStructure(m_BLAS);
             NRI.DestroyAccelerationStructure(m_TLAS);
@@ -98,8 +128,13 @@ Sample::~Sample() {
         NRI.DestroyDescriptorPool(m_DescriptorPool);
 
         NRI.DestroyBuffer(m_ShaderTable);
+        NRI.DestroyBuffer(m_ShaderTableUploadBuffer);
+        NRI.DestroyBuffer(m_TimestampReadbackBuffer);
+
+        NRI.DestroyQueryPool(m_TimestampQueryPool);
 
         NRI.DestroyPipeline(m_Pipeline);
+        NRI.DestroyPipeline(m_RayQueryPipeline);
         NRI.DestroyPipelineLayout(m_PipelineLayout);
 
         NRI.DestroyFence(m_FrameFence);
@@ -110,17 +145,23 @@ Sample::~Sample() {
         NRI.FreeMemory(m_BLASMemory);
         NRI.FreeMemory(m_TLASMemory);
         NRI.FreeMemory(m_ShaderTableMemory);
+        NRI.FreeMemory(m_ShaderTableUploadMemory);
     }
 
     if (NRI.HasSwapChain())
         NRI.DestroySwapChain(m_SwapChain);
 
+    if (NRI.HasStreamer())
+        NRI.DestroyStreamer(m_Streamer);
+
     DestroyImgui();
 
     nri::nriDestroyDevice(m_Device);
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -135,6 +176,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
@@ -146,36 +190,120 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::RayTracingInterface), (nri::RayTracingInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
+    NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
+    StartupProfilerEnd();
+
+    // Create streamer
+    nri::StreamerDesc streamerDesc = {};
+    streamerDesc.dynamicBufferMemoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+    streamerDesc.dynamicBufferDesc = {0, 0, nri::BufferUsageBits::VERTEX_BUFFER | nri::BufferUsageBits::INDEX_BUFFER};
+    streamerDesc.constantBufferMemoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+    streamerDesc.queuedFrameNum = GetQueuedFrameNum();
+    NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
 
     NRI_ABORT_ON_FAILURE(NRI.GetQueue(*m_Device, nri::QueueType::GRAPHICS, 0, m_GraphicsQueue));
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
     CreateCommandBuffers();
 
+    StartupProfilerBegin("Swap chain");
     nri::Format swapChainFormat = nri::Format::UNKNOWN;
     CreateSwapChain(swapChainFormat);
+    StartupProfilerEnd();
 
+    StartupProfilerBegin("Pipelines");
     CreateRayTracingPipeline();
+    CreateRayQueryPipeline();
+    StartupProfilerEnd();
+
     CreateDescriptorSet();
     CreateRayTracingOutput(swapChainFormat);
+    CreateTimestamps();
+
+    // Acceleration structures (one batch, waited for at the end of initialization)
+    StartupProfilerBegin("Acceleration structures");
+    m_AccelerationStructureBuildQueue.Initialize(NRI, NRI, *m_Device, *m_GraphicsQueue);
     CreateBottomLevelAccelerationStructure();
     CreateTopLevelAccelerationStructure();
+    m_AccelerationStructureBuildQueue.Submit();
+    StartupProfilerEnd();
+
+    StartupProfilerBegin("Shader table");
     CreateShaderTable();
+    StartupProfilerEnd();
+
+    StartupProfilerBegin("UI");
+    bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    m_AccelerationStructureBuildQueue.Wait();
 
-    return InitImgui(*m_Device);
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
+
+    return initialized;
 }
 
 void Sample::LatencySleep(uint32_t frameIndex) {
     uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
-    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
+    QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
 
     NRI.Wait(*m_FrameFence, frameIndex >= GetQueuedFrameNum() ? 1 + frameIndex - GetQueuedFrameNum() : 0);
     NRI.ResetCommandAllocator(*queuedFrame.commandAllocator);
+
+    // The first frame (the shader table copy) is complete
+    if (frameIndex == GetQueuedFrameNum()) {
+        NRI.DestroyBuffer(m_ShaderTableUploadBuffer);
+        NRI.FreeMemory(m_ShaderTableUploadMemory);
+
+        m_ShaderTableUploadBuffer = nullptr;
+        m_ShaderTableUploadMemory = nullptr;
+    }
+
+    // Tracing timing of the frame, which used this queued frame previously
+    if (queuedFrame.isTraced) {
+        const uint8_t* data = (uint8_t*)NRI.MapBuffer(*m_TimestampReadbackBuffer, queuedFrameIndex * TIMESTAMPS_PER_FRAME * m_TimestampSize, TIMESTAMPS_PER_FRAME * m_TimestampSize);
+        if (data) {
+            uint64_t begin = *(const uint64_t*)data;
+            uint64_t end = *(const uint64_t*)(data + m_TimestampSize);
+            double time = double(end - begin) * m_TimestampPeriod;
+
+            double& smoothedTime = m_TraceTimes[queuedFrame.traceMode];
+            smoothedTime = smoothedTime == 0.0 ? time : smoothedTime * 0.9 + time * 0.1;
+
+            NRI.UnmapBuffer(*m_TimestampReadbackBuffer);
+        }
+
+        queuedFrame.isTraced = false;
+    }
+}
+
+void Sample::PrepareFrame(uint32_t) {
+    ImGui::NewFrame();
+    {
+        ImGui::SetNextWindowPos(ImVec2(30, 30), ImGuiCond_Once);
+        ImGui::SetNextWindowSize(ImVec2(0, 0));
+        ImGui::Begin("Settings", nullptr, ImGuiWindowFlags_NoResize);
+        {
+            ImGui::BeginDisabled(!m_IsRayQuerySupported);
+            {
+                static const char* traceModes[] = {"Ray tracing pipeline", "Inline ray query"};
+                ImGui::Combo("Tracing", &m_TraceMode, traceModes, helper::GetCountOf(traceModes));
+            }
+            ImGui::EndDisabled();
+            ImGui::Text("TraceRay (GPU)        : %.3f ms", m_TraceTimes[TRACE_MODE_PIPELINE]);
+            ImGui::Text("RayQuery (GPU)        : %.3f ms", m_TraceTimes[TRACE_MODE_RAY_QUERY]);
+            if (m_TraceTimes[TRACE_MODE_PIPELINE] != 0.0 && m_TraceTimes[TRACE_MODE_RAY_QUERY] != 0.0)
+                ImGui::Text("RayQuery speedup      : %.2fx", m_TraceTimes[TRACE_MODE_PIPELINE] / m_TraceTimes[TRACE_MODE_RAY_QUERY]);
+        }
+        ImGui::End();
+    }
+    ImGui::EndFrame();
+    ImGui::Render();
 }
 
 void Sample::RenderFrame(uint32_t frameIndex) {
     uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
-    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
+    QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
 
     // Acquire a swap chain texture
     uint32_t recycledSemaphoreIndex = frameIndex % (uint32_t)m_SwapChainTextures.size();
@@ -210,21 +338,64 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         barrierDesc.textures = textureTransitions;
         barrierDesc.textureNum = 2;
 
+        // Shader table upload (no queue idle wait at startup)
+        nri::BufferBarrierDesc bufferBarrier = {};
+        if (frameIndex == 0) {
+            bufferBarrier.buffer = m_ShaderTable;
+            bufferBarrier.after = {nri::AccessBits::COPY_DESTINATION, nri::StageBits::COPY};
+
+            barrierDesc.bufferNum = 1;
+            barrierDesc.buffers = &bufferBarrier;
+        }
+
         NRI.CmdBarrier(commandBuffer, barrierDesc);
-        NRI.CmdSetPipelineLayout(commandBuffer, nri::BindPoint::RAY_TRACING, *m_PipelineLayout);
-        NRI.CmdSetPipeline(commandBuffer, *m_Pipeline);
+
+        if (frameIndex == 0) {
+            NRI.CmdCopyBuffer(commandBuffer, *m_ShaderTable, 0, *m_ShaderTableUploadBuffer, 0, nri::WHOLE_SIZE);
+
+            bufferBarrier.before = bufferBarrier.after;
+            bufferBarrier.after = {nri::AccessBits::SHADER_BINDING_TABLE, nri::StageBits::RAYGEN_SHADER};
+
+            barrierDesc.textureNum = 0;
+            NRI.CmdBarrier(commandBuffer, barrierDesc);
+
+            barrierDesc.bufferNum = 0;
+        }
+
+        // Tracing (the same output, TLAS and descriptor set in both modes)
+        int32_t traceMode = m_IsRayQuerySupported ? m_TraceMode : TRACE_MODE_PIPELINE;
+        nri::BindPoint bindPoint = traceMode == TRACE_MODE_RAY_QUERY ? nri::BindPoint::COMPUTE : nri::BindPoint::RAY_TRACING;
+        uint32_t queryOffset = queuedFrameIndex * TIMESTAMPS_PER_FRAME;
+
+        NRI.CmdResetQueries(commandBuffer, *m_TimestampQueryPool, queryOffset, TIMESTAMPS_PER_FRAME);
+        NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset);
+
+        NRI.CmdSetPipelineLayout(commandBuffer, bindPoint, *m_PipelineLayout);
+        NRI.CmdSetPipeline(commandBuffer, traceMode == TRACE_MODE_RAY_QUERY ? *m_RayQueryPipeline : *m_Pipeline);
 
         nri::SetDescriptorSetDesc descriptorSet0 = {0, m_DescriptorSet};
         NRI.CmdSetDescriptorSet(commandBuffer, descriptorSet0);
 
-        nri::DispatchRaysDesc dispatchRaysDesc = {};
-        dispatchRaysDesc.raygenShader = {m_ShaderTable, 0, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.missShaders = {m_ShaderTable, m_MissShaderOffset, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.hitShaderGroups = {m_ShaderTable, m_HitShaderGroupOffset, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.x = (uint16_t)GetOutputResolution().x;
-        dispatchRaysDesc.y = (uint16_t)GetOutputResolution().y;
-        dispatchRaysDesc.z = 1;
-        NRI.CmdDispatchRays(commandBuffer, dispatchRaysDesc);
+        if (traceMode == TRACE_MODE_RAY_QUERY) {
+            uint32_t nx = (GetOutputResolution().x + RAY_QUERY_GROUP_SIZE - 1) / RAY_QUERY_GROUP_SIZE;
+            uint32_t ny = (GetOutputResolution().y + RAY_QUERY_GROUP_SIZE - 1) / RAY_QUERY_GROUP_SIZE;
+            NRI.CmdDispatch(commandBuffer, {nx, ny, 1});
+        } else {
+            nri::DispatchRaysDesc dispatchRaysDesc = {};
+            dispatchRaysDesc.raygenShader = {m_ShaderTable, 0, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
+            dispatchRaysDesc.missShaders = {m_ShaderTable, m_MissShaderOffset, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
+            dispatchRaysDesc.hitShaderGroups = {m_ShaderTable, m_HitShaderGroupOffset, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
+            dispatchRaysDesc.x = (uint16_t)GetOutputResolution().x;
+            dispatchRaysDesc.y = (uint16_t)GetOutputResolution().y;
+            dispatchRaysDesc.z = 1;
+            NRI.CmdDispatchRays(commandBuffer, dispatchRaysDesc);
+        }
+
+        NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset + 1);
+        NRI.CmdCopyQueries(commandBuffer, *m_TimestampQueryPool, queryOffset, TIMESTAMPS_PER_FRAME, *m_TimestampReadbackBuffer, queryOffset * m_TimestampSize);
+
+        queuedFrame.traceMode = traceMode;
+        queuedFrame.isTraced = true;
 
         // Copy
         textureTransitions[1].before = textureTransitions[1].after;
@@ -236,6 +407,30 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.CmdBarrier(commandBuffer, barrierDesc);
         NRI.CmdCopyTexture(commandBuffer, *m_BackBuffer->texture, nullptr, *m_RayTracingOutput, nullptr);
 
+        // UI
+        CmdCopyImguiData(commandBuffer, *m_Streamer);
+
+        textureTransitions[0].before = textureTransitions[0].after;
+        textureTransitions[0].after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT};
+
+        barrierDesc.textures = textureTransitions;
+        barrierDesc.textureNum = 1;
+
+        NRI.CmdBarrier(commandBuffer, barrierDesc);
+
+        nri::AttachmentDesc colorAttachmentDesc = {};
+        colorAttachmentDesc.descriptor = m_BackBuffer->colorAttachment;
+
+        nri::RenderingDesc renderingDesc = {};
+        renderingDesc.colorNum = 1;
+        renderingDesc.colors = &colorAttachmentDesc;
+
+        NRI.CmdBeginRendering(commandBuffer, renderingDesc);
+        {
+            CmdDrawImgui(commandBuffer, m_BackBuffer->attachmentFormat, 1.0f, true);
+        }
+        NRI.CmdEndRendering(commandBuffer);
+
         // Present
         textureTransitions[0].before = textureTransitions[0].after;
         textureTransitions[0].after = {nri::AccessBits::NONE, nri::Layout::PRESENT, nri::StageBits::NONE};
@@ -272,6 +467,8 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
     }
 
+    NRI.EndStreamerFrame(*m_Streamer);
+
     // Present
     NRI.QueuePresent(*m_SwapChain, *swapChainTexture.releaseSemaphore);
 }
@@ -331,28 +528,28 @@ void Sample::CreateRayTracingPipeline() {
     descriptorRanges[0].descriptorNum = 1;
     descriptorRanges[0].descriptorType = nri::DescriptorType::STORAGE_TEXTURE;
     descriptorRanges[0].baseRegisterIndex = 0;
-    descriptorRanges[0].shaderStages = nri::StageBits::RAYGEN_SHADER;
+    descriptorRanges[0].shaderStages = nri::StageBits::RAYGEN_SHADER | nri::StageBits::COMPUTE_SHADER;
 
     descriptorRanges[1].descriptorNum = 1;
     descriptorRanges[1].descriptorType = nri::DescriptorType::ACCELERATION_STRUCTURE;
     descriptorRanges[1].baseRegisterIndex = 1;
-    descriptorRanges[1].shaderStages = nri::StageBits::RAYGEN_SHADER;
+    descriptorRanges[1].shaderStages = nri::StageBits::RAYGEN_SHADER | nri::StageBits::COMPUTE_SHADER;
 
     nri::DescriptorSetDesc descriptorSetDesc = {0, descriptorRanges, helper::GetCountOf(descriptorRanges)};
 
     nri::PipelineLayoutDesc pipelineLayoutDesc = {};
     pipelineLayoutDesc.descriptorSets = &descriptorSetDesc;
     pipelineLayoutDesc.descriptorSetNum = 1;
-    pipelineLayoutDesc.shaderStages = nri::StageBits::RAYGEN_SHADER;
+    pipelineLayoutDesc.shaderStages = nri::StageBits::RAYGEN_SHADER | nri::StageBits::COMPUTE_SHADER; // + inline ray query
 
     NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_PipelineLayout));
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
     utils::ShaderCodeStorage shaderCodeStorage;
     nri::ShaderDesc shaders[] = {
-        utils::LoadShader(deviceDesc.graphicsAPI, "RayTracingTriangle.rgen", shaderCodeStorage, "raygen"),
-        utils::LoadShader(deviceDesc.graphicsAPI, "RayTracingTriangle.rmiss", shaderCodeStorage, "miss"),
-        utils::LoadShader(deviceDesc.graphicsAPI, "RayTracingTriangle.rchit", shaderCodeStorage, "closest_hit"),
+        LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingTriangle.rgen", shaderCodeStorage, "raygen"),
+        LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingTriangle.rmiss", shaderCodeStorage, "miss"),
+        LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingTriangle.rchit", shaderCodeStorage, "closest_hit"),
     };
 
     nri::ShaderLibraryDesc shaderLibrary = {};
@@ -373,6 +570,24 @@ void Sample::CreateRayTracingPipeline() {
     NRI_ABORT_ON_FAILURE(NRI.CreateRayTracingPipeline(*m_Device, pipelineDesc, m_Pipeline));
 }
 
+void Sample::CreateRayQueryPipeline() {
+    // Inline ray tracing requires DXR 1.1 / "VK_KHR_ray_query"
+    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+    m_IsRayQuerySupported = deviceDesc.tiers.rayTracing >= 2;
+    if (!m_IsRayQuerySupported) {
+        printf("Inline ray tracing is not supported, only the ray tracing pipeline is available\n");
+        return;
+    }
+
+    utils::ShaderCodeStorage shaderCodeStorage;
+
+    nri::ComputePipelineDesc computePipelineDesc = {};
+    computePipelineDesc.pipelineLayout = m_PipelineLayout;
+    computePipelineDesc.shader = LoadPackedShader(deviceDesc.graphicsAPI, "RayTracingTriangleQuery.cs", shaderCodeStorage);
+
+    NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, computePipelineDesc, m_RayQueryPipeline));
+}
+
 void Sample::CreateRayTracingOutput(nri::Format swapChainFormat) {
     nri::TextureDesc rayTracingOutputDesc = {};
     rayTracingOutputDesc.type = nri::TextureType::TEXTURE_2D;
@@ -464,10 +679,9 @@ void Sample::CreateBottomLevelAccelerationStructure() {
     const nri::BindAccelerationStructureMemoryDesc memoryBindingDesc = {m_BLAS, m_BLASMemory};
     NRI_ABORT_ON_FAILURE(NRI.BindAccelerationStructureMemory(&memoryBindingDesc, 1));
 
-    BuildBottomLevelAccelerationStructure(*m_BLAS, &object, 1);
-
-    NRI.DestroyBuffer(buffer);
-    NRI.FreeMemory(memory);
+    // "object" is copied, the geometry buffer is released when the build is done
+    m_AccelerationStructureBuildQueue.AddBottomLevel(*m_BLAS, &object, 1);
+    m_AccelerationStructureBuildQueue.AddTransientBuffer(buffer, memory);
 }
 
 void Sample::CreateTopLevelAccelerationStructure() {
@@ -504,10 +718,8 @@ void Sample::CreateTopLevelAccelerationStructure() {
     memcpy(data, &geometryObjectInstance, sizeof(geometryObjectInstance));
     NRI.UnmapBuffer(*buffer);
 
-    BuildTopLevelAccelerationStructure(*m_TLAS, 1, *buffer);
-
-    NRI.DestroyBuffer(buffer);
-    NRI.FreeMemory(memory);
+    m_AccelerationStructureBuildQueue.AddTopLevel(*m_TLAS, 1, *buffer);
+    m_AccelerationStructureBuildQueue.AddTransientBuffer(buffer, memory);
 
     NRI_ABORT_ON_FAILURE(NRI.CreateAccelerationStructureDescriptor(*m_TLAS, m_TLASDescriptor));
 
@@ -515,30 +727,41 @@ void Sample::CreateTopLevelAccelerationStructure() {
     NRI.UpdateDescriptorRanges(&updateDescriptorRangeDesc, 1);
 }
 
-void Sample::CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, nri::Memory*& memory) {
-    nri::BufferDesc bufferDesc = {size, 0, usage};
-    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+void Sample::CreateTimestamps() {
+    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+
+    nri::QueryPoolDesc queryPoolDesc = {};
+    queryPoolDesc.queryType = nri::QueryType::TIMESTAMP;
+    queryPoolDesc.capacity = GetQueuedFrameNum() * TIMESTAMPS_PER_FRAME;
+    NRI_ABORT_ON_FAILURE(NRI.CreateQueryPool(*m_Device, queryPoolDesc, m_TimestampQueryPool));
+
+    m_TimestampSize = NRI.GetQuerySize(*m_TimestampQueryPool);
+    m_TimestampPeriod = 1000.0 / double(deviceDesc.other.timestampFrequencyHz);
+
+    const nri::BufferDesc readbackBufferDesc = {queryPoolDesc.capacity * m_TimestampSize, 0, nri::BufferUsageBits::NONE};
+    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, readbackBufferDesc, m_TimestampReadbackBuffer));
 
     nri::MemoryDesc memoryDesc = {};
-    NRI.GetBufferMemoryDesc(*buffer, nri::MemoryLocation::HOST_UPLOAD, memoryDesc);
+    NRI.GetBufferMemoryDesc(*m_TimestampReadbackBuffer, nri::MemoryLocation::HOST_READBACK, memoryDesc);
 
     nri::AllocateMemoryDesc allocateMemoryDesc = {};
     allocateMemoryDesc.size = memoryDesc.size;
     allocateMemoryDesc.type = memoryDesc.type;
+
+    nri::Memory* memory = nullptr;
     NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
+    m_MemoryAllocations.push_back(memory);
 
-    nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {buffer, memory};
-    NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(&bufferMemoryBindingDesc, 1));
+    const nri::BindBufferMemoryDesc memoryBindingDesc = {m_TimestampReadbackBuffer, memory};
+    NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(&memoryBindingDesc, 1));
 }
 
-void Sample::CreateScratchBuffer(nri::AccelerationStructure& accelerationStructure, nri::Buffer*& buffer, nri::Memory*& memory) {
-    uint64_t scratchBufferSize = NRI.GetAccelerationStructureBuildScratchBufferSize(accelerationStructure);
-
-    nri::BufferDesc bufferDesc = {scratchBufferSize, 0, nri::BufferUsageBits::SCRATCH_BUFFER};
+void Sample::CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, nri::Memory*& memory) {
+    nri::BufferDesc bufferDesc = {size, 0, usage};
     NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
 
     nri::MemoryDesc memoryDesc = {};
-    NRI.GetBufferMemoryDesc(*buffer, nri::MemoryLocation::DEVICE, memoryDesc);
+    NRI.GetBufferMemoryDesc(*buffer, nri::MemoryLocation::HOST_UPLOAD, memoryDesc);
 
     nri::AllocateMemoryDesc allocateMemoryDesc = {};
     allocateMemoryDesc.size = memoryDesc.size;
@@ -549,80 +772,6 @@ void Sample::CreateScratchBuffer(nri::AccelerationStructure& accelerationStructu
     NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(&bufferMemoryBindingDesc, 1));
 }
 
-void Sample::BuildBottomLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, const nri::BottomLevelGeometryDesc* objects, const uint32_t objectNum) {
-    nri::Buffer* scratchBuffer = nullptr;
-    nri::Memory* scratchBufferMemory = nullptr;
-    CreateScratchBuffer(accelerationStructure, scratchBuffer, scratchBufferMemory);
-
-    nri::CommandAllocator* commandAllocator = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, commandAllocator));
-
-    nri::CommandBuffer* commandBuffer = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*commandAllocator, commandBuffer));
-
-    nri::QueueSubmitDesc queueSubmitDesc = {};
-    queueSubmitDesc.commandBuffers = &commandBuffer;
-    queueSubmitDesc.commandBufferNum = 1;
-
-    NRI.BeginCommandBuffer(*commandBuffer, nullptr);
-    {
-        nri::BuildBottomLevelAccelerationStructureDesc desc = {};
-        desc.dst = &accelerationStructure;
-        desc.geometries = objects;
-        desc.geometryNum = objectNum;
-        desc.scratchBuffer = scratchBuffer;
-
-        NRI.CmdBuildBottomLevelAccelerationStructures(*commandBuffer, &desc, 1);
-    }
-    NRI.EndCommandBuffer(*commandBuffer);
-
-    NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
-    NRI.QueueWaitIdle(m_GraphicsQueue);
-
-    NRI.DestroyCommandBuffer(commandBuffer);
-    NRI.DestroyCommandAllocator(commandAllocator);
-
-    NRI.DestroyBuffer(scratchBuffer);
-    NRI.FreeMemory(scratchBufferMemory);
-}
-
-void Sample::BuildTopLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, uint32_t instanceNum, nri::Buffer& instanceBuffer) {
-    nri::Buffer* scratchBuffer = nullptr;
-    nri::Memory* scratchBufferMemory = nullptr;
-    CreateScratchBuffer(accelerationStructure, scratchBuffer, scratchBufferMemory);
-
-    nri::CommandAllocator* commandAllocator = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, commandAllocator));
-
-    nri::CommandBuffer* commandBuffer = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*commandAllocator, commandBuffer));
-
-    nri::QueueSubmitDesc queueSubmitDesc = {};
-    queueSubmitDesc.commandBuffers = &commandBuffer;
-    queueSubmitDesc.commandBufferNum = 1;
-
-    NRI.BeginCommandBuffer(*commandBuffer, nullptr);
-    {
-        nri::BuildTopLevelAccelerationStructureDesc desc = {};
-        desc.dst = &accelerationStructure;
-        desc.instanceNum = instanceNum;
-        desc.instanceBuffer = &instanceBuffer;
-        desc.scratchBuffer = scratchBuffer;
-
-        NRI.CmdBuildTopLevelAccelerationStructures(*commandBuffer, &desc, 1);
-    }
-    NRI.EndCommandBuffer(*commandBuffer);
-
-    NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
-    NRI.QueueWaitIdle(m_GraphicsQueue);
-
-    NRI.DestroyCommandBuffer(commandBuffer);
-    NRI.DestroyCommandAllocator(commandAllocator);
-
-    NRI.DestroyBuffer(scratchBuffer);
-    NRI.FreeMemory(scratchBufferMemory);
-}
-
 void Sample::CreateShaderTable() {
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
     const uint64_t identifierSize = deviceDesc.shaderStage.rayTracing.shaderGroupIdentifierSize;
@@ -647,53 +796,13 @@ void Sample::CreateShaderTable() {
     const nri::BindBufferMemoryDesc bufferMemoryBindingDesc = {m_ShaderTable, m_ShaderTableMemory};
     NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(&bufferMemoryBindingDesc, 1));
 
-    nri::Buffer* buffer = nullptr;
-    nri::Memory* memory = nullptr;
-    CreateUploadBuffer(shaderTableSize, nri::BufferUsageBits::NONE, buffer, memory);
+    // Copied in the first frame
+    CreateUploadBuffer(shaderTableSize, nri::BufferUsageBits::NONE, m_ShaderTableUploadBuffer, m_ShaderTableUploadMemory);
 
-    uint8_t* data = (uint8_t*)NRI.MapBuffer(*buffer, 0, shaderTableSize);
+    uint8_t* data = (uint8_t*)NRI.MapBuffer(*m_ShaderTableUploadBuffer, 0, shaderTableSize);
     for (uint32_t i = 0; i < 3; i++)
         NRI.WriteShaderGroupIdentifiers(*m_Pipeline, i, 1, data + i * helper::Align(identifierSize, tableAlignment));
-    NRI.UnmapBuffer(*buffer);
-
-    nri::CommandAllocator* commandAllocator = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, commandAllocator));
-
-    nri::CommandBuffer* commandBuffer = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*commandAllocator, commandBuffer));
-
-    nri::QueueSubmitDesc queueSubmitDesc = {};
-    queueSubmitDesc.commandBuffers = &commandBuffer;
-    queueSubmitDesc.commandBufferNum = 1;
-
-    NRI.BeginCommandBuffer(*commandBuffer, nullptr);
-    {
-        nri::BufferBarrierDesc bufferBarrier = {};
-        bufferBarrier.buffer = m_ShaderTable;
-
-        nri::BarrierDesc barrierDesc = {};
-        barrierDesc.bufferNum = 1;
-        barrierDesc.buffers = &bufferBarrier;
-
-        bufferBarrier.after = {nri::AccessBits::COPY_DESTINATION};
-        NRI.CmdBarrier(*commandBuffer, barrierDesc);
-
-        NRI.CmdCopyBuffer(*commandBuffer, *m_ShaderTable, 0, *buffer, 0, shaderTableSize);
-
-        bufferBarrier.before = bufferBarrier.after;
-        bufferBarrier.after = {nri::AccessBits::SHADER_BINDING_TABLE};
-        NRI.CmdBarrier(*commandBuffer, barrierDesc);
-    }
-    NRI.EndCommandBuffer(*commandBuffer);
-
-    NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
-    NRI.QueueWaitIdle(m_GraphicsQueue);
-
-    NRI.DestroyCommandBuffer(commandBuffer);
-    NRI.DestroyCommandAllocator(commandAllocator);
-
-    NRI.DestroyBuffer(buffer);
-    NRI.FreeMemory(memory);
+    NRI.UnmapBuffer(*m_ShaderTableUploadBuffer);
 }
 
 SAMPLE_MAIN(Sample, 0);
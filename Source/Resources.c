@@ -10,6 +10,8 @@
 #include "Extensions/NRIDeviceCreation.h"
 #include "Extensions/NRIHelper.h"
 
+#include "Common/StartupProfiler.h"
+
 #if NRI_ENABLE_AGILITY_SDK_SUPPORT
 #    include "NRIAgilitySDK.h"
 #endif
@@ -34,6 +36,8 @@ int main(int argc, char** argv) {
             graphicsAPI = NriGraphicsAPI_VK;
         else if (!strcmp(argv[i], "--api=WGPU"))
             graphicsAPI = NriGraphicsAPI_WGPU;
+        else if (!strcmp(argv[i], "--api=NONE"))
+            graphicsAPI = NriGraphicsAPI_NONE;
         else if (!strcmp(argv[i], "--debugAPI"))
             debugAPI = true;
         else if (!strcmp(argv[i], "--debugNRI"))
@@ -43,6 +47,7 @@ int main(int argc, char** argv) {
     }
 
     // Create device
+    StartupProfilerBegin("Device");
     NriDevice* device = NULL;
     {
         NriAdapterDesc adapterDescs[2] = {0};
@@ -58,15 +63,20 @@ int main(int argc, char** argv) {
             },
             &device));
     }
+    StartupProfilerEnd();
 
     // Query interfaces
+    StartupProfilerBegin("Interfaces");
     NriCoreInterface iCore = {0};
     {
         NRI_ABORT_ON_FAILURE(nriGetInterface(device, NRI_INTERFACE(NriCoreInterface), &iCore));
     }
+    StartupProfilerEnd();
 
     const NriDeviceDesc* deviceDesc = iCore.GetDeviceDesc(device);
 
+    StartupProfilerBegin("Resources");
+
     // Create a placed buffer
     NriMemory* placedBufferMemory = NULL;
     NriBuffer* placedBuffer = NULL;
@@ -234,6 +244,10 @@ int main(int argc, char** argv) {
         iCore.DestroyDescriptor(depthStencilView_Resource_Stencil);
     }
 
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nriGetGraphicsAPIString(graphicsAPI));
+
     { // Cleanup
         iCore.DestroyTexture(depthStencilTexture);
         iCore.DestroyBuffer(placedBuffer);
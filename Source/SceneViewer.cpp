@@ -3,7 +3,21 @@
 #include "NRI.hlsl"
 #include "NRIFramework.h"
 
+#include "Common/GpuProfiler.h"
+#include "Common/PipelineCache.h"
+#include "Common/PipelineCompiler.h"
+#include "Common/ShaderArchive.h"
+#include "Common/StartupProfiler.h"
+
 #include <array>
+#include <atomic>
+#include <thread>
+
+// Found in sse2neon
+// _mm_pause is already defined in sse2neon.h for ARM platforms
+#if !(defined(__arm__) || defined(__aarch64__) || defined(_M_ARM64) || defined(_M_ARM))
+#    include <xmmintrin.h>
+#endif
 
 constexpr uint32_t GLOBAL_DESCRIPTOR_SET = 0;
 constexpr uint32_t MATERIAL_DESCRIPTOR_SET = 1;
@@ -15,6 +29,16 @@ constexpr uint32_t READBACK_BUFFER = 1;
 constexpr uint32_t INDEX_BUFFER = 2;
 constexpr uint32_t VERTEX_BUFFER = 3;
 
+constexpr size_t QUEUED_FRAME_MAX_NUM = 4;
+constexpr size_t THREAD_MAX_NUM = 32;
+constexpr uint32_t INSTANCES_PER_THREAD_MIN_NUM = 64;
+
+constexpr const char* GPU_TRACE_FILE = "SceneViewerGpuTrace.json";
+
+constexpr uint32_t HALT = 0;
+constexpr uint32_t GO = 1;
+constexpr uint32_t STOP = 2;
+
 struct GlobalConstantBufferLayout {
     float4x4 gWorldToClip;
     float3 gCameraPos;
@@ -23,7 +47,18 @@ struct GlobalConstantBufferLayout {
 struct QueuedFrame {
     nri::CommandAllocator* commandAllocator;
     nri::CommandBuffer* commandBuffer;
+
+    // Used by the main thread only
+    nri::CommandBuffer* commandBufferPre;
+    nri::CommandBuffer* commandBufferPost;
     uint32_t globalConstantBufferViewOffsets;
+    uint32_t queryNum;
+};
+
+struct ThreadContext {
+    std::array<QueuedFrame, QUEUED_FRAME_MAX_NUM> queuedFrames;
+    std::thread thread;
+    std::atomic_uint32_t control;
 };
 
 class Sample : public SampleBase {
@@ -39,6 +74,15 @@ public:
     void RenderFrame(uint32_t frameIndex) override;
 
 private:
+    void UpdateCamera(uint32_t frameIndex);
+    void UpdateConstants(uint32_t queuedFrameIndex);
+    void RenderInstances(nri::CommandBuffer& commandBuffer, uint32_t threadIndex, uint32_t offset, uint32_t number);
+    void ThreadEntryPoint(uint32_t threadIndex);
+    void StartThreads();
+    void StopThreads();
+
+private:
+    std::array<ThreadContext, THREAD_MAX_NUM> m_ThreadContexts = {};
     NRIInterface NRI = {};
     nri::Device* m_Device = nullptr;
     nri::Streamer* m_Streamer = nullptr;
@@ -51,27 +95,53 @@ private:
     nri::Descriptor* m_ShadingRateAttachment = nullptr;
     nri::QueryPool* m_QueryPool = nullptr;
 
-    std::vector<QueuedFrame> m_QueuedFrames = {};
-    std::vector<nri::Pipeline*> m_Pipelines;
+    PersistentPipelineCache m_PipelineCache;
+    PipelineCompiler m_PipelineCompiler;
+    GpuProfiler m_GpuProfiler;
+
     std::vector<SwapChainTexture> m_SwapChainTextures;
     std::vector<nri::DescriptorSet*> m_DescriptorSets;
     std::vector<nri::Texture*> m_Textures;
     std::vector<nri::Buffer*> m_Buffers;
     std::vector<nri::Memory*> m_MemoryAllocations;
     std::vector<nri::Descriptor*> m_Descriptors;
+    std::vector<uint32_t> m_DrawList;
 
+    const SwapChainTexture* m_BackBuffer = nullptr;
+    uint8_t* m_ConstantBufferData = nullptr; // persistently mapped (not on D3D11, where a mapped buffer can't be used by the GPU)
     nri::Format m_DepthFormat = nri::Format::UNKNOWN;
+    double m_CameraLatchTime = 0.0;         // ms
+    double m_CameraLatchToSubmitTime = 0.0; // ms, smoothed
+    uint32_t m_ThreadNum = 1;
+    uint32_t m_InstancesPerThread = 0;
+    uint32_t m_FrameIndex = 0;
+    uint32_t m_ReadbackQueryNum = 0;
+    bool m_MultiThreading = true;
+    bool m_LateLatch = false;
+
+    std::atomic_uint32_t m_ReadyCount;
 
     utils::Scene m_Scene;
 };
 
 Sample::~Sample() {
+    if (m_MultiThreading)
+        StopThreads();
+
     if (NRI.HasCore()) {
         NRI.DeviceWaitIdle(m_Device);
 
-        for (QueuedFrame& queuedFrame : m_QueuedFrames) {
-            NRI.DestroyCommandBuffer(queuedFrame.commandBuffer);
-            NRI.DestroyCommandAllocator(queuedFrame.commandAllocator);
+        for (uint32_t i = 0; i < m_ThreadNum; i++) {
+            ThreadContext& threadContext = m_ThreadContexts[i];
+
+            for (uint32_t j = 0; j < GetQueuedFrameNum(); j++) {
+                QueuedFrame& queuedFrame = threadContext.queuedFrames[j];
+
+                NRI.DestroyCommandBuffer(queuedFrame.commandBuffer);
+                NRI.DestroyCommandBuffer(queuedFrame.commandBufferPre);
+                NRI.DestroyCommandBuffer(queuedFrame.commandBufferPost);
+                NRI.DestroyCommandAllocator(queuedFrame.commandAllocator);
+            }
         }
 
         for (SwapChainTexture& swapChainTexture : m_SwapChainTextures) {
@@ -86,16 +156,24 @@ Sample::~Sample() {
         for (size_t i = 0; i < m_Textures.size(); i++)
             NRI.DestroyTexture(m_Textures[i]);
 
+        if (m_ConstantBufferData)
+            NRI.UnmapBuffer(*m_Buffers[CONSTANT_BUFFER]);
+
         for (size_t i = 0; i < m_Buffers.size(); i++)
             NRI.DestroyBuffer(m_Buffers[i]);
 
         for (size_t i = 0; i < m_MemoryAllocations.size(); i++)
             NRI.FreeMemory(m_MemoryAllocations[i]);
 
-        for (size_t i = 0; i < m_Pipelines.size(); i++)
-            NRI.DestroyPipeline(m_Pipelines[i]);
+        m_PipelineCompiler.Destroy();
 
         NRI.DestroyQueryPool(m_QueryPool);
+
+        m_GpuProfiler.Destroy();
+
+        m_PipelineCache.Save(NRI);
+        m_PipelineCache.Destroy(NRI);
+
         NRI.DestroyPipelineLayout(m_PipelineLayout);
         NRI.DestroyDescriptorPool(m_DescriptorPool);
         NRI.DestroyFence(m_FrameFence);
@@ -113,6 +191,14 @@ Sample::~Sample() {
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    uint32_t concurrentThreadMaxNum = std::thread::hardware_concurrency();
+    m_ThreadNum = std::max(std::min((concurrentThreadMaxNum * 3) / 4, (uint32_t)THREAD_MAX_NUM), 1u);
+
+    for (ThreadContext& threadContext : m_ThreadContexts)
+        threadContext.control.store(HALT, std::memory_order_relaxed);
+
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -128,13 +214,20 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.vkBindingOffsets = VK_BINDING_OFFSETS;
     deviceCreationDesc.adapterDesc = &adapterDesc[std::min(m_AdapterIndex, adapterDescsNum - 1)];
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
+
+    m_PipelineCache.Preload(graphicsAPI, *deviceCreationDesc.adapterDesc);
+
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    StartupProfilerEnd();
 
     // Create streamer
     nri::StreamerDesc streamerDesc = {};
@@ -150,9 +243,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     // Fences
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
+    m_GpuProfiler.Initialize(NRI, *m_Device, GetQueuedFrameNum());
+
     m_DepthFormat = nri::GetSupportedDepthFormat(NRI, *m_Device, 24, true);
 
     { // Swap chain
+        StartupPhase phase("Swap chain");
+
         nri::SwapChainDesc swapChainDesc = {};
         swapChainDesc.window = GetWindow();
         swapChainDesc.queue = m_GraphicsQueue;
@@ -170,12 +267,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
     nri::Format swapChainFormat = NRI.GetTextureDesc(*swapChainTextures[0]).format;
 
-    // Queued frames
-    m_QueuedFrames.resize(GetQueuedFrameNum());
-    for (QueuedFrame& queuedFrame : m_QueuedFrames) {
-        NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, queuedFrame.commandAllocator));
-        NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBuffer));
-    }
+    StartupProfilerBegin("Pipelines");
+    m_PipelineCache.Create(NRI, *m_Device);
+    m_PipelineCompiler.Initialize(NRI, *m_Device);
 
     { // Pipeline layout
         nri::DescriptorRangeDesc globalDescriptorRange[2];
@@ -261,12 +355,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         outputMergerDesc.depth.compareOp = CLEAR_DEPTH == 1.0f ? nri::CompareOp::LESS : nri::CompareOp::GREATER;
 
         nri::ShaderDesc shaderStages[] = {
-            utils::LoadShader(deviceDesc.graphicsAPI, "Forward.vs", shaderCodeStorage),
-            utils::LoadShader(deviceDesc.graphicsAPI, "Forward.fs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "Forward.vs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "Forward.fs", shaderCodeStorage),
         };
 
         nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
         graphicsPipelineDesc.pipelineLayout = m_PipelineLayout;
+        graphicsPipelineDesc.cache = m_PipelineCache.Get();
         graphicsPipelineDesc.vertexInput = &vertexInputDesc;
         graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
         graphicsPipelineDesc.rasterization = rasterizationDesc;
@@ -275,46 +370,77 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         graphicsPipelineDesc.shaders = shaderStages;
         graphicsPipelineDesc.shaderNum = helper::GetCountOf(shaderStages);
 
-        nri::Pipeline* pipeline;
-
-        { // Opaque
-            NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, pipeline));
-            m_Pipelines.push_back(pipeline);
-        }
+        // Opaque pipeline is needed right away. Others are compiled in background without a fallback: the opaque pipeline
+        // has no alpha test, no blending and writes depth, i.e. alpha opaque and transparent draws are skipped until ready
+        m_PipelineCompiler.Compile(graphicsPipelineDesc);
 
         { // Alpha opaque
-            shaderStages[1] = utils::LoadShader(deviceDesc.graphicsAPI, "ForwardDiscard.fs", shaderCodeStorage);
+            shaderStages[1] = LoadPackedShader(deviceDesc.graphicsAPI, "ForwardDiscard.fs", shaderCodeStorage);
 
             rasterizationDesc.cullMode = nri::CullMode::NONE;
             outputMergerDesc.depth.write = true;
             colorAttachmentDesc.blendEnabled = false;
-            NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, pipeline));
-            m_Pipelines.push_back(pipeline);
+            m_PipelineCompiler.Submit(graphicsPipelineDesc);
         }
 
-        shaderStages[1] = utils::LoadShader(deviceDesc.graphicsAPI, "ForwardTransparent.fs", shaderCodeStorage);
+        shaderStages[1] = LoadPackedShader(deviceDesc.graphicsAPI, "ForwardTransparent.fs", shaderCodeStorage);
 
         { // Transparent
             rasterizationDesc.cullMode = nri::CullMode::NONE;
             outputMergerDesc.depth.write = false;
             colorAttachmentDesc.blendEnabled = true;
             colorAttachmentDesc.colorBlend = {nri::BlendFactor::SRC_ALPHA, nri::BlendFactor::ONE_MINUS_SRC_ALPHA, nri::BlendOp::ADD};
-            NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, pipeline));
-            m_Pipelines.push_back(pipeline);
+            m_PipelineCompiler.Submit(graphicsPipelineDesc);
         }
     }
 
+    StartupProfilerEnd();
+
     // Scene
+    StartupProfilerBegin("Scene");
     std::string sceneFile = utils::GetFullPath(m_SceneFile, utils::DataFolder::SCENES);
     NRI_ABORT_ON_FALSE(utils::LoadScene(sceneFile, m_Scene, false));
+    StartupProfilerEnd();
 
     // Camera
     m_Camera.Initialize(m_Scene.aabb.GetCenter(), m_Scene.aabb.vMin, false);
 
+    // Draw list: opaque, alpha opaque, transparent (pipeline order)
+    m_DrawList.reserve(m_Scene.instances.size());
+    for (uint32_t pipelineIndex = 0; pipelineIndex < 3; pipelineIndex++) {
+        for (uint32_t i = 0; i < (uint32_t)m_Scene.instances.size(); i++) {
+            const utils::Material& material = m_Scene.materials[m_Scene.instances[i].materialIndex];
+            if (pipelineIndex == (material.IsAlphaOpaque() ? 1u : (material.IsTransparent() ? 2u : 0u)))
+                m_DrawList.push_back(i);
+        }
+    }
+
+    // Not worth spawning threads for tiny chunks
+    m_ThreadNum = std::min(m_ThreadNum, std::max((uint32_t)m_DrawList.size() / INSTANCES_PER_THREAD_MIN_NUM, 1u));
+    m_InstancesPerThread = ((uint32_t)m_DrawList.size() + m_ThreadNum - 1) / m_ThreadNum;
+
+    // Queued frames (per thread)
+    for (uint32_t i = 0; i < m_ThreadNum; i++) {
+        ThreadContext& threadContext = m_ThreadContexts[i];
+
+        for (uint32_t j = 0; j < GetQueuedFrameNum(); j++) {
+            QueuedFrame& queuedFrame = threadContext.queuedFrames[j];
+
+            NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, queuedFrame.commandAllocator));
+            NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBuffer));
+
+            if (i == 0) {
+                NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBufferPre));
+                NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBufferPost));
+            }
+        }
+    }
+
     const uint32_t textureNum = (uint32_t)m_Scene.textures.size();
     const uint32_t materialNum = (uint32_t)m_Scene.materials.size();
 
     // Textures
+    StartupProfilerBegin("Resources");
     for (const utils::Texture* textureData : m_Scene.textures) {
         nri::TextureDesc textureDesc = {};
         textureDesc.type = nri::TextureType::TEXTURE_2D;
@@ -389,7 +515,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         m_Buffers.push_back(buffer);
 
         // READBACK_BUFFER
-        bufferDesc.size = sizeof(nri::PipelineStatisticsDesc);
+        bufferDesc.size = sizeof(nri::PipelineStatisticsDesc) * m_ThreadNum;
         bufferDesc.usage = nri::BufferUsageBits::NONE;
         NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
         m_Buffers.push_back(buffer);
@@ -417,6 +543,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         m_MemoryAllocations.resize(baseAllocation + 1, nullptr);
         NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
 
+        if (graphicsAPI != nri::GraphicsAPI::D3D11)
+            m_ConstantBufferData = (uint8_t*)NRI.MapBuffer(*m_Buffers[CONSTANT_BUFFER], 0, nri::WHOLE_SIZE);
+
         resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_READBACK;
         resourceGroupDesc.bufferNum = 1;
         resourceGroupDesc.buffers = &m_Buffers[READBACK_BUFFER];
@@ -437,6 +566,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
     }
 
+    StartupProfilerEnd();
+
     // Create descriptors
     nri::Descriptor* anisotropicSampler;
     nri::Descriptor* constantBufferViews[8] = {};
@@ -461,7 +592,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
         // Constant buffer
         for (uint32_t i = 0; i < GetQueuedFrameNum(); i++) {
-            m_QueuedFrames[i].globalConstantBufferViewOffsets = i * constantBufferSize;
+            m_ThreadContexts[0].queuedFrames[i].globalConstantBufferViewOffsets = i * constantBufferSize;
 
             nri::BufferViewDesc bufferViewDesc = {};
             bufferViewDesc.buffer = m_Buffers[CONSTANT_BUFFER];
@@ -555,6 +686,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     { // Upload data
+        StartupPhase phase("Upload");
+
         std::vector<nri::TextureUploadDesc> textureData(textureNum + 2);
 
         uint32_t subresourceNum = 0;
@@ -619,7 +752,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     if (deviceDesc.features.pipelineStatistics) {
         nri::QueryPoolDesc queryPoolDesc = {};
         queryPoolDesc.queryType = nri::QueryType::PIPELINE_STATISTICS;
-        queryPoolDesc.capacity = GetQueuedFrameNum();
+        queryPoolDesc.capacity = GetQueuedFrameNum() * m_ThreadNum; // a query per thread
 
         NRI_ABORT_ON_FAILURE(NRI.CreateQueryPool(*m_Device, queryPoolDesc, m_QueryPool));
     }
@@ -630,32 +763,73 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     if (shadingRateData)
         free(shadingRateData);
 
-    return InitImgui(*m_Device);
+    if (m_MultiThreading)
+        StartThreads();
+
+    StartupProfilerBegin("UI");
+    bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
+
+    return initialized;
 }
 
 void Sample::LatencySleep(uint32_t frameIndex) {
     uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
-    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
-
     NRI.Wait(*m_FrameFence, frameIndex >= GetQueuedFrameNum() ? 1 + frameIndex - GetQueuedFrameNum() : 0);
-    NRI.ResetCommandAllocator(*queuedFrame.commandAllocator);
+
+    m_GpuProfiler.BeginFrame(frameIndex, queuedFrameIndex);
+
+    // All threads, not only the active ones: "m_MultiThreading" can be toggled later in "PrepareFrame" and this slot may be recorded by any thread
+    for (uint32_t i = 0; i < m_ThreadNum; i++) {
+        ThreadContext& threadContext = m_ThreadContexts[i];
+        NRI.ResetCommandAllocator(*threadContext.queuedFrames[queuedFrameIndex].commandAllocator);
+    }
 }
 
 void Sample::PrepareFrame(uint32_t frameIndex) {
+    bool multiThreadingPrev = m_MultiThreading;
+
     ImGui::NewFrame();
     {
-        nri::PipelineStatisticsDesc* pipelineStats = (nri::PipelineStatisticsDesc*)NRI.MapBuffer(*m_Buffers[READBACK_BUFFER], 0, sizeof(nri::PipelineStatisticsDesc));
+        nri::PipelineStatisticsDesc* pipelineStatsPerThread = (nri::PipelineStatisticsDesc*)NRI.MapBuffer(*m_Buffers[READBACK_BUFFER], 0, sizeof(nri::PipelineStatisticsDesc) * m_ThreadNum);
+
+        // Each thread records its own query
+        nri::PipelineStatisticsDesc pipelineStats = {};
+        for (uint32_t i = 0; i < m_ReadbackQueryNum; i++) {
+            pipelineStats.inputVertexNum += pipelineStatsPerThread[i].inputVertexNum;
+            pipelineStats.inputPrimitiveNum += pipelineStatsPerThread[i].inputPrimitiveNum;
+            pipelineStats.vertexShaderInvocationNum += pipelineStatsPerThread[i].vertexShaderInvocationNum;
+            pipelineStats.rasterizerInPrimitiveNum += pipelineStatsPerThread[i].rasterizerInPrimitiveNum;
+            pipelineStats.rasterizerOutPrimitiveNum += pipelineStatsPerThread[i].rasterizerOutPrimitiveNum;
+            pipelineStats.fragmentShaderInvocationNum += pipelineStatsPerThread[i].fragmentShaderInvocationNum;
+        }
 
         ImGui::SetNextWindowPos(ImVec2(30, 30), ImGuiCond_Once);
         ImGui::SetNextWindowSize(ImVec2(0, 0));
         ImGui::Begin("Stats");
         {
-            ImGui::Text("Input vertices               : %" PRIu64, pipelineStats->inputVertexNum);
-            ImGui::Text("Input primitives             : %" PRIu64, pipelineStats->inputPrimitiveNum);
-            ImGui::Text("Vertex shader invocations    : %" PRIu64, pipelineStats->vertexShaderInvocationNum);
-            ImGui::Text("Rasterizer input primitives  : %" PRIu64, pipelineStats->rasterizerInPrimitiveNum);
-            ImGui::Text("Rasterizer output primitives : %" PRIu64, pipelineStats->rasterizerOutPrimitiveNum);
-            ImGui::Text("Fragment shader invocations  : %" PRIu64, pipelineStats->fragmentShaderInvocationNum);
+            ImGui::Text("Input vertices               : %" PRIu64, pipelineStats.inputVertexNum);
+            ImGui::Text("Input primitives             : %" PRIu64, pipelineStats.inputPrimitiveNum);
+            ImGui::Text("Vertex shader invocations    : %" PRIu64, pipelineStats.vertexShaderInvocationNum);
+            ImGui::Text("Rasterizer input primitives  : %" PRIu64, pipelineStats.rasterizerInPrimitiveNum);
+            ImGui::Text("Rasterizer output primitives : %" PRIu64, pipelineStats.rasterizerOutPrimitiveNum);
+            ImGui::Text("Fragment shader invocations  : %" PRIu64, pipelineStats.fragmentShaderInvocationNum);
+            ImGui::Separator();
+            ImGui::Text("Instances per thread         : %u", m_InstancesPerThread);
+            ImGui::BeginDisabled(m_ThreadNum == 1);
+            ImGui::Checkbox("Multi-threading", &m_MultiThreading);
+            ImGui::EndDisabled();
+            ImGui::Checkbox("Late latch (camera)", &m_LateLatch);
+            ImGui::Text("Camera latch - Submit         : %.2f ms", m_CameraLatchToSubmitTime);
+
+            if (ImGui::CollapsingHeader("GPU profiler", ImGuiTreeNodeFlags_DefaultOpen)) {
+                m_GpuProfiler.DrawImgui();
+
+                if (ImGui::Button("Save trace"))
+                    m_GpuProfiler.WriteChromeTrace(GPU_TRACE_FILE);
+            }
         }
         ImGui::End();
 
@@ -670,23 +844,23 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
     ImGui::EndFrame();
     ImGui::Render();
 
-    CameraDesc desc = {};
-    desc.aspectRatio = float(GetOutputResolution().x) / float(GetOutputResolution().y);
-    desc.horizontalFov = 90.0f;
-    desc.nearZ = 0.1f;
-    desc.isReversedZ = (CLEAR_DEPTH == 0.0f);
-    GetCameraDescFromInputDevices(desc);
+    if (m_MultiThreading != multiThreadingPrev) {
+        if (m_MultiThreading)
+            StartThreads();
+        else
+            StopThreads();
+    }
 
-    m_Camera.Update(desc, frameIndex);
+    // With late latch the camera is updated right before "QueueSubmit"
+    if (!m_LateLatch)
+        UpdateCamera(frameIndex);
 }
 
 void Sample::RenderFrame(uint32_t frameIndex) {
     uint32_t queuedFrameIndex = frameIndex % GetQueuedFrameNum();
     const uint32_t nextQueuedFrameIndex = (frameIndex + 1) % GetQueuedFrameNum();
-    const QueuedFrame& queuedFrame = m_QueuedFrames[queuedFrameIndex];
-    const uint32_t windowWidth = GetOutputResolution().x;
-    const uint32_t windowHeight = GetOutputResolution().y;
-    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+    QueuedFrame& queuedFrame = m_ThreadContexts[0].queuedFrames[queuedFrameIndex];
+    const uint32_t threadNum = m_MultiThreading ? m_ThreadNum : 1;
 
     // Acquire a swap chain texture
     uint32_t recycledSemaphoreIndex = frameIndex % (uint32_t)m_SwapChainTextures.size();
@@ -697,66 +871,43 @@ void Sample::RenderFrame(uint32_t frameIndex) {
 
     const SwapChainTexture& swapChainTexture = m_SwapChainTextures[currentSwapChainTextureIndex];
 
+    m_FrameIndex = frameIndex;
+    m_BackBuffer = &swapChainTexture;
+
     // Update constants
-    const uint64_t rangeOffset = m_QueuedFrames[queuedFrameIndex].globalConstantBufferViewOffsets;
-    auto constants = (GlobalConstantBufferLayout*)NRI.MapBuffer(*m_Buffers[CONSTANT_BUFFER], rangeOffset, sizeof(GlobalConstantBufferLayout));
-    if (constants) {
-        constants->gWorldToClip = m_Camera.state.mWorldToClip * m_Scene.mSceneToWorld;
-        constants->gCameraPos = m_Camera.state.position;
+    if (!m_LateLatch)
+        UpdateConstants(queuedFrameIndex);
+
+    // Pass "GO" to workers
+    if (m_MultiThreading) {
+        m_ReadyCount.store(0, std::memory_order_seq_cst);
 
-        NRI.UnmapBuffer(*m_Buffers[CONSTANT_BUFFER]);
+        for (uint32_t i = 1; i < m_ThreadNum; i++) {
+            ThreadContext& threadContext = m_ThreadContexts[i];
+            threadContext.control.store(GO, std::memory_order_relaxed);
+        }
     }
 
-    // Record
-    nri::CommandBuffer& commandBuffer = *queuedFrame.commandBuffer;
-    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
-    {
-        helper::Annotation annotation(NRI, commandBuffer, "Scene");
-
-        nri::TextureBarrierDesc textureBarriers = {};
-        textureBarriers.texture = swapChainTexture.texture;
-        textureBarriers.after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT};
-        textureBarriers.layerNum = 1;
-        textureBarriers.mipNum = 1;
-
-        nri::BarrierDesc barrierDesc = {};
-        barrierDesc.textureNum = 1;
-        barrierDesc.textures = &textureBarriers;
-
-        NRI.CmdBarrier(commandBuffer, barrierDesc);
-
-        // Test PSL // TODO: D3D11 gets DEVICE_REMOVED if VRS is used with PSL...
-        if (deviceDesc.tiers.sampleLocations >= 2 && deviceDesc.graphicsAPI != nri::GraphicsAPI::D3D11) {
-            static const nri::SampleLocation samplePos[4] = {
-                {-6, -2},
-                {-2, 6},
-                {6, 2},
-                {2, -6},
-            };
+    { // Record pre
+        nri::CommandBuffer& commandBufferPre = *queuedFrame.commandBufferPre;
+        NRI.BeginCommandBuffer(commandBufferPre, nullptr);
+        {
+            m_GpuProfiler.CmdBeginFrame(commandBufferPre);
 
-            NRI.CmdSetSampleLocations(commandBuffer, samplePos + (frameIndex % 4), 1, 1);
-        }
+            GpuProfilerScope scope(m_GpuProfiler, NRI, commandBufferPre, "Pre");
 
-        // Test VRS (per pipeline)
-        if (deviceDesc.tiers.shadingRate) {
-            nri::ShadingRateDesc shadingRateDesc = {};
-            if (deviceDesc.tiers.shadingRate >= 2) {
-                shadingRateDesc.shadingRate = nri::ShadingRate::FRAGMENT_SIZE_1X1;
-                shadingRateDesc.primitiveCombiner = nri::ShadingRateCombiner::REPLACE;
-                shadingRateDesc.attachmentCombiner = nri::ShadingRateCombiner::REPLACE;
-            } else
-                shadingRateDesc.shadingRate = nri::ShadingRate::FRAGMENT_SIZE_2X2;
-
-            NRI.CmdSetShadingRate(commandBuffer, shadingRateDesc);
-        }
+            nri::TextureBarrierDesc swapChainTextureTransition = {};
+            swapChainTextureTransition.texture = swapChainTexture.texture;
+            swapChainTextureTransition.after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT};
+            swapChainTextureTransition.layerNum = 1;
+            swapChainTextureTransition.mipNum = 1;
 
-        // Test pipeline stats query
-        if (m_QueryPool) {
-            NRI.CmdResetQueries(commandBuffer, *m_QueryPool, queuedFrameIndex, 1);
-            NRI.CmdBeginQuery(commandBuffer, *m_QueryPool, queuedFrameIndex);
-        }
+            nri::BarrierDesc barrierDesc = {};
+            barrierDesc.textureNum = 1;
+            barrierDesc.textures = &swapChainTextureTransition;
+
+            NRI.CmdBarrier(commandBufferPre, barrierDesc);
 
-        { // Rendering
             nri::AttachmentDesc colorAttachmentDesc = {};
             colorAttachmentDesc.descriptor = swapChainTexture.colorAttachment;
 
@@ -765,10 +916,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
             renderingDesc.colors = &colorAttachmentDesc;
             renderingDesc.depth.descriptor = m_DepthAttachment;
 
-            if (deviceDesc.tiers.shadingRate >= 2)
-                renderingDesc.shadingRate = m_ShadingRateAttachment;
-
-            NRI.CmdBeginRendering(commandBuffer, renderingDesc);
+            NRI.CmdBeginRendering(commandBufferPre, renderingDesc);
             {
                 nri::ClearAttachmentDesc clearDescs[2] = {};
                 clearDescs[0].planes = nri::PlaneBits::COLOR;
@@ -776,87 +924,95 @@ void Sample::RenderFrame(uint32_t frameIndex) {
                 clearDescs[1].planes = nri::PlaneBits::DEPTH;
                 clearDescs[1].value.depthStencil.depth = CLEAR_DEPTH;
 
-                NRI.CmdClearAttachments(commandBuffer, clearDescs, helper::GetCountOf(clearDescs), nullptr, 0);
-
-                const nri::Viewport viewport = {0.0f, 0.0f, (float)windowWidth, (float)windowHeight, 0.0f, 1.0f};
-                NRI.CmdSetViewports(commandBuffer, &viewport, 1);
-
-                const nri::Rect scissor = {0, 0, (nri::Dim_t)windowWidth, (nri::Dim_t)windowHeight};
-                NRI.CmdSetScissors(commandBuffer, &scissor, 1);
+                NRI.CmdClearAttachments(commandBufferPre, clearDescs, helper::GetCountOf(clearDescs), nullptr, 0);
+            }
+            NRI.CmdEndRendering(commandBufferPre);
+        }
+        NRI.EndCommandBuffer(commandBufferPre);
+    }
 
-                NRI.CmdSetIndexBuffer(commandBuffer, *m_Buffers[INDEX_BUFFER], 0, sizeof(utils::Index) == 2 ? nri::IndexType::UINT16 : nri::IndexType::UINT32);
+    { // Record
+        nri::CommandBuffer& commandBuffer = *queuedFrame.commandBuffer;
+        NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
+        {
+            GpuProfilerScope scope(m_GpuProfiler, NRI, commandBuffer, "Scene");
 
-                NRI.CmdSetPipelineLayout(commandBuffer, nri::BindPoint::GRAPHICS, *m_PipelineLayout);
+            uint32_t instanceNum = m_MultiThreading ? std::min(m_InstancesPerThread, (uint32_t)m_DrawList.size()) : (uint32_t)m_DrawList.size();
 
-                nri::SetDescriptorSetDesc globalSet = {GLOBAL_DESCRIPTOR_SET, m_DescriptorSets[queuedFrameIndex]};
-                NRI.CmdSetDescriptorSet(commandBuffer, globalSet);
+            RenderInstances(commandBuffer, 0, 0, instanceNum);
+        }
+        NRI.EndCommandBuffer(commandBuffer);
+    }
 
-                // TODO: no sorting per pipeline / material, transparency is not last
-                for (const utils::Instance& instance : m_Scene.instances) {
-                    const utils::Material& material = m_Scene.materials[instance.materialIndex];
-                    uint32_t pipelineIndex = material.IsAlphaOpaque() ? 1 : (material.IsTransparent() ? 2 : 0);
-                    NRI.CmdSetPipeline(commandBuffer, *m_Pipelines[pipelineIndex]);
+    // Wait for completion
+    if (m_MultiThreading) {
+        while (m_ReadyCount.load(std::memory_order_acquire) != m_ThreadNum - 1)
+            _mm_pause();
+    }
 
-                    nri::VertexBufferDesc vertexBufferDesc = {};
-                    vertexBufferDesc.buffer = m_Buffers[VERTEX_BUFFER];
-                    vertexBufferDesc.offset = 0;
-                    vertexBufferDesc.stride = sizeof(utils::Vertex);
-                    NRI.CmdSetVertexBuffers(commandBuffer, 0, &vertexBufferDesc, 1);
+    queuedFrame.queryNum = threadNum;
 
-                    nri::DescriptorSet* descriptorSet = m_DescriptorSets[GetQueuedFrameNum() + instance.materialIndex];
+    { // Record post
+        nri::CommandBuffer& commandBufferPost = *queuedFrame.commandBufferPost;
+        NRI.BeginCommandBuffer(commandBufferPost, m_DescriptorPool);
+        {
+            {
+                GpuProfilerScope scope(m_GpuProfiler, NRI, commandBufferPost, "Post");
 
-                    nri::SetDescriptorSetDesc materialSet = {MATERIAL_DESCRIPTOR_SET, descriptorSet};
-                    NRI.CmdSetDescriptorSet(commandBuffer, materialSet);
+                // Copy queries of the oldest queued frame
+                if (m_QueryPool && frameIndex >= GetQueuedFrameNum()) {
+                    const QueuedFrame& nextQueuedFrame = m_ThreadContexts[0].queuedFrames[nextQueuedFrameIndex];
+                    NRI.CmdCopyQueries(commandBufferPost, *m_QueryPool, nextQueuedFrameIndex * m_ThreadNum, nextQueuedFrame.queryNum, *m_Buffers[READBACK_BUFFER], 0);
 
-                    const utils::Mesh& mesh = m_Scene.meshes[instance.meshInstanceIndex];
-                    NRI.CmdDrawIndexed(commandBuffer, {mesh.indexNum, 1, mesh.indexOffset, (int32_t)mesh.vertexOffset, 0});
+                    m_ReadbackQueryNum = nextQueuedFrame.queryNum;
                 }
-            }
-            NRI.CmdEndRendering(commandBuffer);
-        }
 
-        // End query
-        if (m_QueryPool) {
-            NRI.CmdEndQuery(commandBuffer, *m_QueryPool, queuedFrameIndex);
-            if (frameIndex >= GetQueuedFrameNum())
-                NRI.CmdCopyQueries(commandBuffer, *m_QueryPool, nextQueuedFrameIndex, 1, *m_Buffers[READBACK_BUFFER], 0);
-        }
+                nri::AttachmentDesc colorAttachmentDesc = {};
+                colorAttachmentDesc.descriptor = swapChainTexture.colorAttachment;
 
-        // Reset VRS
-        if (deviceDesc.tiers.shadingRate) {
-            nri::ShadingRateDesc shadingRateDesc = {};
-            shadingRateDesc.shadingRate = nri::ShadingRate::FRAGMENT_SIZE_1X1;
-            shadingRateDesc.primitiveCombiner = nri::ShadingRateCombiner::KEEP;
-            shadingRateDesc.attachmentCombiner = nri::ShadingRateCombiner::KEEP;
+                nri::RenderingDesc renderingDesc = {};
+                renderingDesc.colorNum = 1;
+                renderingDesc.colors = &colorAttachmentDesc;
 
-            NRI.CmdSetShadingRate(commandBuffer, shadingRateDesc);
-        }
+                CmdCopyImguiData(commandBufferPost, *m_Streamer);
 
-        { // UI
-            nri::AttachmentDesc colorAttachmentDesc = {};
-            colorAttachmentDesc.descriptor = swapChainTexture.colorAttachment;
+                NRI.CmdBeginRendering(commandBufferPost, renderingDesc);
+                {
+                    GpuProfilerScope uiScope(m_GpuProfiler, NRI, commandBufferPost, "UI");
 
-            nri::RenderingDesc renderingDesc = {};
-            renderingDesc.colorNum = 1;
-            renderingDesc.colors = &colorAttachmentDesc;
+                    CmdDrawImgui(commandBufferPost, swapChainTexture.attachmentFormat, 1.0f, true);
+                }
+                NRI.CmdEndRendering(commandBufferPost);
 
-            CmdCopyImguiData(commandBuffer, *m_Streamer);
+                nri::TextureBarrierDesc swapChainTextureTransition = {};
+                swapChainTextureTransition.texture = swapChainTexture.texture;
+                swapChainTextureTransition.before = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT};
+                swapChainTextureTransition.after = {nri::AccessBits::NONE, nri::Layout::PRESENT, nri::StageBits::NONE};
+                swapChainTextureTransition.layerNum = 1;
+                swapChainTextureTransition.mipNum = 1;
 
-            NRI.CmdBeginRendering(commandBuffer, renderingDesc);
-            {
-                CmdDrawImgui(commandBuffer, swapChainTexture.attachmentFormat, 1.0f, true);
+                nri::BarrierDesc barrierDesc = {};
+                barrierDesc.textures = &swapChainTextureTransition;
+                barrierDesc.textureNum = 1;
+
+                NRI.CmdBarrier(commandBufferPost, barrierDesc);
             }
-            NRI.CmdEndRendering(commandBuffer);
+
+            // After all scopes of the frame
+            m_GpuProfiler.CmdEndFrame(commandBufferPost);
         }
+        NRI.EndCommandBuffer(commandBufferPost);
+    }
 
-        textureBarriers.before = textureBarriers.after;
-        textureBarriers.after = {nri::AccessBits::NONE, nri::Layout::PRESENT, nri::StageBits::NONE};
+    { // Submit: pre, threads (in order), post
+        std::array<nri::CommandBuffer*, THREAD_MAX_NUM + 2> commandBuffers = {};
+        uint32_t commandBufferNum = 0;
 
-        NRI.CmdBarrier(commandBuffer, barrierDesc);
-    }
-    NRI.EndCommandBuffer(commandBuffer);
+        commandBuffers[commandBufferNum++] = queuedFrame.commandBufferPre;
+        for (uint32_t i = 0; i < threadNum; i++)
+            commandBuffers[commandBufferNum++] = m_ThreadContexts[i].queuedFrames[queuedFrameIndex].commandBuffer;
+        commandBuffers[commandBufferNum++] = queuedFrame.commandBufferPost;
 
-    { // Submit
         nri::FenceSubmitDesc textureAcquiredFence = {};
         textureAcquiredFence.fence = swapChainAcquireSemaphore;
         textureAcquiredFence.stages = nri::StageBits::COLOR_ATTACHMENT;
@@ -867,11 +1023,21 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         nri::QueueSubmitDesc queueSubmitDesc = {};
         queueSubmitDesc.waitFences = &textureAcquiredFence;
         queueSubmitDesc.waitFenceNum = 1;
-        queueSubmitDesc.commandBuffers = &queuedFrame.commandBuffer;
-        queueSubmitDesc.commandBufferNum = 1;
+        queueSubmitDesc.commandBuffers = commandBuffers.data();
+        queueSubmitDesc.commandBufferNum = commandBufferNum;
         queueSubmitDesc.signalFences = &renderingFinishedFence;
         queueSubmitDesc.signalFenceNum = 1;
 
+        // Late latch: apply the input state (already processed by the framework, events are not pumped here) to the camera as
+        // late as possible and write constants into the slot already referenced by the recorded command buffers (the GPU
+        // doesn't read them until the submission)
+        if (m_LateLatch) {
+            UpdateCamera(frameIndex);
+            UpdateConstants(queuedFrameIndex);
+        }
+
+        m_CameraLatchToSubmitTime += (m_Timer.GetTimeStamp() - m_CameraLatchTime - m_CameraLatchToSubmitTime) * 0.1;
+
         NRI.QueueSubmit(*m_GraphicsQueue, queueSubmitDesc);
     }
 
@@ -893,4 +1059,200 @@ void Sample::RenderFrame(uint32_t frameIndex) {
     }
 }
 
+void Sample::UpdateCamera(uint32_t frameIndex) {
+    CameraDesc desc = {};
+    desc.aspectRatio = float(GetOutputResolution().x) / float(GetOutputResolution().y);
+    desc.horizontalFov = 90.0f;
+    desc.nearZ = 0.1f;
+    desc.isReversedZ = (CLEAR_DEPTH == 0.0f);
+    GetCameraDescFromInputDevices(desc);
+
+    m_Camera.Update(desc, frameIndex);
+
+    m_CameraLatchTime = m_Timer.GetTimeStamp();
+}
+
+void Sample::UpdateConstants(uint32_t queuedFrameIndex) {
+    const uint32_t rangeOffset = m_ThreadContexts[0].queuedFrames[queuedFrameIndex].globalConstantBufferViewOffsets;
+
+    GlobalConstantBufferLayout* constants = nullptr;
+    if (m_ConstantBufferData)
+        constants = (GlobalConstantBufferLayout*)(m_ConstantBufferData + rangeOffset);
+    else
+        constants = (GlobalConstantBufferLayout*)NRI.MapBuffer(*m_Buffers[CONSTANT_BUFFER], rangeOffset, sizeof(GlobalConstantBufferLayout));
+
+    if (constants) {
+        constants->gWorldToClip = m_Camera.state.mWorldToClip * m_Scene.mSceneToWorld;
+        constants->gCameraPos = m_Camera.state.position;
+
+        if (!m_ConstantBufferData)
+            NRI.UnmapBuffer(*m_Buffers[CONSTANT_BUFFER]);
+    }
+}
+
+void Sample::RenderInstances(nri::CommandBuffer& commandBuffer, uint32_t threadIndex, uint32_t offset, uint32_t number) {
+    const uint32_t queuedFrameIndex = m_FrameIndex % GetQueuedFrameNum();
+    const uint32_t queryIndex = queuedFrameIndex * m_ThreadNum + threadIndex;
+    const uint32_t windowWidth = GetOutputResolution().x;
+    const uint32_t windowHeight = GetOutputResolution().y;
+    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+
+    // Test PSL // TODO: D3D11 gets DEVICE_REMOVED if VRS is used with PSL...
+    if (deviceDesc.tiers.sampleLocations >= 2 && deviceDesc.graphicsAPI != nri::GraphicsAPI::D3D11) {
+        static const nri::SampleLocation samplePos[4] = {
+            {-6, -2},
+            {-2, 6},
+            {6, 2},
+            {2, -6},
+        };
+
+        NRI.CmdSetSampleLocations(commandBuffer, samplePos + (m_FrameIndex % 4), 1, 1);
+    }
+
+    // Test VRS (per pipeline)
+    if (deviceDesc.tiers.shadingRate) {
+        nri::ShadingRateDesc shadingRateDesc = {};
+        if (deviceDesc.tiers.shadingRate >= 2) {
+            shadingRateDesc.shadingRate = nri::ShadingRate::FRAGMENT_SIZE_1X1;
+            shadingRateDesc.primitiveCombiner = nri::ShadingRateCombiner::REPLACE;
+            shadingRateDesc.attachmentCombiner = nri::ShadingRateCombiner::REPLACE;
+        } else
+            shadingRateDesc.shadingRate = nri::ShadingRate::FRAGMENT_SIZE_2X2;
+
+        NRI.CmdSetShadingRate(commandBuffer, shadingRateDesc);
+    }
+
+    // Test pipeline stats query (a query per thread)
+    if (m_QueryPool) {
+        NRI.CmdResetQueries(commandBuffer, *m_QueryPool, queryIndex, 1);
+        NRI.CmdBeginQuery(commandBuffer, *m_QueryPool, queryIndex);
+    }
+
+    { // Rendering (attachments are cleared in "pre")
+        nri::AttachmentDesc colorAttachmentDesc = {};
+        colorAttachmentDesc.descriptor = m_BackBuffer->colorAttachment;
+
+        nri::RenderingDesc renderingDesc = {};
+        renderingDesc.colorNum = 1;
+        renderingDesc.colors = &colorAttachmentDesc;
+        renderingDesc.depth.descriptor = m_DepthAttachment;
+
+        if (deviceDesc.tiers.shadingRate >= 2)
+            renderingDesc.shadingRate = m_ShadingRateAttachment;
+
+        NRI.CmdBeginRendering(commandBuffer, renderingDesc);
+        {
+            const nri::Viewport viewport = {0.0f, 0.0f, (float)windowWidth, (float)windowHeight, 0.0f, 1.0f};
+            NRI.CmdSetViewports(commandBuffer, &viewport, 1);
+
+            const nri::Rect scissor = {0, 0, (nri::Dim_t)windowWidth, (nri::Dim_t)windowHeight};
+            NRI.CmdSetScissors(commandBuffer, &scissor, 1);
+
+            NRI.CmdSetIndexBuffer(commandBuffer, *m_Buffers[INDEX_BUFFER], 0, sizeof(utils::Index) == 2 ? nri::IndexType::UINT16 : nri::IndexType::UINT32);
+
+            NRI.CmdSetPipelineLayout(commandBuffer, nri::BindPoint::GRAPHICS, *m_PipelineLayout);
+
+            nri::SetDescriptorSetDesc globalSet = {GLOBAL_DESCRIPTOR_SET, m_DescriptorSets[queuedFrameIndex]};
+            NRI.CmdSetDescriptorSet(commandBuffer, globalSet);
+
+            nri::VertexBufferDesc vertexBufferDesc = {};
+            vertexBufferDesc.buffer = m_Buffers[VERTEX_BUFFER];
+            vertexBufferDesc.offset = 0;
+            vertexBufferDesc.stride = sizeof(utils::Vertex);
+            NRI.CmdSetVertexBuffers(commandBuffer, 0, &vertexBufferDesc, 1);
+
+            // The draw list is sorted by pipeline, transparency is last // TODO: no sorting per material
+            nri::Pipeline* pipelinePrev = nullptr;
+            for (uint32_t i = offset; i < offset + number; i++) {
+                const utils::Instance& instance = m_Scene.instances[m_DrawList[i]];
+                const utils::Material& material = m_Scene.materials[instance.materialIndex];
+
+                uint32_t pipelineIndex = material.IsAlphaOpaque() ? 1 : (material.IsTransparent() ? 2 : 0);
+                nri::Pipeline* pipeline = m_PipelineCompiler.Get(pipelineIndex);
+                if (!pipeline)
+                    continue; // not compiled yet
+
+                if (pipeline != pipelinePrev) {
+                    NRI.CmdSetPipeline(commandBuffer, *pipeline);
+                    pipelinePrev = pipeline;
+                }
+
+                nri::DescriptorSet* descriptorSet = m_DescriptorSets[GetQueuedFrameNum() + instance.materialIndex];
+
+                nri::SetDescriptorSetDesc materialSet = {MATERIAL_DESCRIPTOR_SET, descriptorSet};
+                NRI.CmdSetDescriptorSet(commandBuffer, materialSet);
+
+                const utils::Mesh& mesh = m_Scene.meshes[instance.meshInstanceIndex];
+                NRI.CmdDrawIndexed(commandBuffer, {mesh.indexNum, 1, mesh.indexOffset, (int32_t)mesh.vertexOffset, 0});
+            }
+        }
+        NRI.CmdEndRendering(commandBuffer);
+    }
+
+    // End query
+    if (m_QueryPool)
+        NRI.CmdEndQuery(commandBuffer, *m_QueryPool, queryIndex);
+
+    // Reset VRS
+    if (deviceDesc.tiers.shadingRate) {
+        nri::ShadingRateDesc shadingRateDesc = {};
+        shadingRateDesc.shadingRate = nri::ShadingRate::FRAGMENT_SIZE_1X1;
+        shadingRateDesc.primitiveCombiner = nri::ShadingRateCombiner::KEEP;
+        shadingRateDesc.attachmentCombiner = nri::ShadingRateCombiner::KEEP;
+
+        NRI.CmdSetShadingRate(commandBuffer, shadingRateDesc);
+    }
+}
+
+void Sample::ThreadEntryPoint(uint32_t threadIndex) {
+    ThreadContext& threadContext = m_ThreadContexts[threadIndex];
+
+    while (true) {
+        uint32_t control = threadContext.control.load(std::memory_order_relaxed);
+        if (control == HALT) {
+            _mm_pause();
+            continue;
+        } else if (control == STOP)
+            break;
+
+        threadContext.control.store(HALT, std::memory_order_seq_cst);
+
+        uint32_t queuedFrameIndex = m_FrameIndex % GetQueuedFrameNum();
+        nri::CommandBuffer& commandBuffer = *threadContext.queuedFrames[queuedFrameIndex].commandBuffer;
+
+        // Record
+        NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
+        {
+            GpuProfilerScope scope(m_GpuProfiler, NRI, commandBuffer, "Scene (worker)");
+
+            uint32_t baseInstanceIndex = std::min(threadIndex * m_InstancesPerThread, (uint32_t)m_DrawList.size());
+            uint32_t instanceNum = std::min(m_InstancesPerThread, (uint32_t)m_DrawList.size() - baseInstanceIndex);
+
+            RenderInstances(commandBuffer, threadIndex, baseInstanceIndex, instanceNum);
+        }
+        NRI.EndCommandBuffer(commandBuffer);
+
+        // Signal "done" and stay in "HALT" mode (wait for instructions from the main thread)
+        m_ReadyCount.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void Sample::StartThreads() {
+    for (uint32_t i = 1; i < m_ThreadNum; i++) {
+        ThreadContext& threadContext = m_ThreadContexts[i];
+        threadContext.control.store(HALT);
+        threadContext.thread = std::thread(&Sample::ThreadEntryPoint, this, i);
+    }
+}
+
+void Sample::StopThreads() {
+    for (uint32_t i = 1; i < m_ThreadNum; i++) {
+        ThreadContext& threadContext = m_ThreadContexts[i];
+        if (threadContext.thread.joinable()) {
+            threadContext.control.store(STOP);
+            threadContext.thread.join();
+        }
+    }
+}
+
 SAMPLE_MAIN(Sample, 0);
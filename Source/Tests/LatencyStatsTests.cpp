@@ -0,0 +1,83 @@
+// © 2021 NVIDIA Corporation
+
+#include "NRIFramework.h"
+
+#include "../Common/LatencyStats.h"
+#include "Tests.h"
+
+static void AddFrame(LatencyStats& latencyStats, uint32_t frameIndex, float total) {
+    LatencyStatsFrame frame = {};
+    frame.segments[(size_t)LatencySegment::TOTAL] = total;
+    frame.frameIndex = frameIndex;
+
+    latencyStats.Add(frame);
+}
+
+static void TestPercentiles() {
+    LatencyStats latencyStats;
+    latencyStats.SetWindow(100);
+
+    // 1..100 in a scrambled order, nearest rank
+    for (uint32_t i = 0; i < 100; i++)
+        AddFrame(latencyStats, i, float((i * 37) % 100 + 1));
+
+    const LatencyStatsPercentiles& total = latencyStats.GetPercentiles(LatencySegment::TOTAL);
+    TEST_CHECK(latencyStats.GetFrameNum() == 100);
+    TEST_CHECK(total.p50 == 50.0f);
+    TEST_CHECK(total.p95 == 95.0f);
+    TEST_CHECK(total.p99 == 99.0f);
+    TEST_CHECK(total.max == 100.0f);
+    TEST_CHECK_NEAR(total.mean, 50.5, 1e-4);
+
+    // Other segments are all zeros
+    const LatencyStatsPercentiles& present = latencyStats.GetPercentiles(LatencySegment::RENDER_TO_PRESENT);
+    TEST_CHECK(present.p99 == 0.0f);
+    TEST_CHECK(present.max == 0.0f);
+
+    // A single frame
+    latencyStats.Reset();
+    AddFrame(latencyStats, 0, 7.0f);
+    TEST_CHECK(latencyStats.GetPercentiles(LatencySegment::TOTAL).p50 == 7.0f);
+    TEST_CHECK(latencyStats.GetPercentiles(LatencySegment::TOTAL).p99 == 7.0f);
+}
+
+static void TestWindow() {
+    LatencyStats latencyStats;
+    latencyStats.SetWindow(100);
+
+    for (uint32_t i = 0; i < 100; i++)
+        AddFrame(latencyStats, i, float(i + 1));
+
+    // The last 10 frames: 91..100
+    latencyStats.SetWindow(10);
+    const LatencyStatsPercentiles& total = latencyStats.GetPercentiles(LatencySegment::TOTAL);
+    TEST_CHECK(latencyStats.GetFrameNum() == 10);
+    TEST_CHECK(total.p50 == 95.0f);
+    TEST_CHECK(total.p99 == 100.0f);
+    TEST_CHECK_NEAR(total.mean, 95.5, 1e-4);
+
+    // The ring wraps around
+    latencyStats.SetWindow(LatencyStats::WINDOW_MAX_SIZE);
+    latencyStats.Reset();
+    for (uint32_t i = 0; i < LatencyStats::WINDOW_MAX_SIZE + 50; i++)
+        AddFrame(latencyStats, i, float(i));
+
+    const LatencyStatsPercentiles& wrapped = latencyStats.GetPercentiles(LatencySegment::TOTAL);
+    TEST_CHECK(latencyStats.GetFrameNum() == LatencyStats::WINDOW_MAX_SIZE);
+    TEST_CHECK(wrapped.max == float(LatencyStats::WINDOW_MAX_SIZE + 49));
+    TEST_CHECK(wrapped.p50 == float(LatencyStats::WINDOW_MAX_SIZE / 2 + 49));
+
+    // Empty
+    latencyStats.Reset();
+    TEST_CHECK(latencyStats.GetFrameNum() == 0);
+    TEST_CHECK(latencyStats.GetPercentiles(LatencySegment::TOTAL).max == 0.0f);
+
+    // Clamped
+    latencyStats.SetWindow(0);
+    TEST_CHECK(latencyStats.GetWindow() == 1);
+}
+
+void TestLatencyStats() {
+    TestPercentiles();
+    TestWindow();
+}
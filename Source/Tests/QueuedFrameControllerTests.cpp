@@ -0,0 +1,163 @@
+// © 2021 NVIDIA Corporation
+
+#include "NRIFramework.h"
+
+#include "../Common/QueuedFrameController.h"
+#include "Tests.h"
+
+#include <vector>
+
+// A CPU / GPU pipeline replaying a trace of per-frame CPU and GPU times (ms):
+//  - CPU frame "N" can't start until GPU frame "N - depth" is done (the frame fence)
+//  - GPU frame "N" starts when both CPU frame "N" is submitted and GPU frame "N - 1" is done
+struct QueuedFramePipeline {
+    std::vector<double> gpuDoneTimes;
+    double cpuEndTime = 0.0;
+    double gpuDoneTime = 0.0;
+
+    QueuedFrameControllerSample Step(uint32_t depth, double cpuTime, double gpuTime) {
+        size_t frameNum = gpuDoneTimes.size();
+
+        QueuedFrameControllerSample sample = {};
+
+        double cpuBeginTime = cpuEndTime;
+        if (frameNum >= depth && gpuDoneTimes[frameNum - depth] > cpuBeginTime) {
+            sample.fenceWaitTime = gpuDoneTimes[frameNum - depth] - cpuBeginTime;
+            cpuBeginTime = gpuDoneTimes[frameNum - depth];
+        }
+
+        double submitTime = cpuBeginTime + cpuTime;
+        if (frameNum)
+            sample.gpuIdleTime = std::max(submitTime - gpuDoneTime, 0.0);
+
+        gpuDoneTime = std::max(submitTime, gpuDoneTime) + gpuTime;
+        gpuDoneTimes.push_back(gpuDoneTime);
+
+        sample.frameTime = submitTime - cpuEndTime;
+        cpuEndTime = submitTime;
+
+        return sample;
+    }
+};
+
+struct QueuedFrameReplayResult {
+    uint32_t depth;         // final
+    uint32_t changeNum;     // depth changes
+    uint32_t settledNum[4]; // frames per depth in the second half
+    double frameTime;       // ms, average in the second half
+};
+
+static QueuedFrameReplayResult Replay(uint32_t initialDepth, double cpuTime, double gpuTime, uint32_t frameNum) {
+    QueuedFrameControllerDesc desc = {};
+    desc.minDepth = 1;
+    desc.maxDepth = 3;
+
+    QueuedFrameController controller;
+    controller.Initialize(desc);
+    controller.Reset(initialDepth);
+
+    // Deterministic +-5% jitter
+    uint32_t seed = 1;
+    auto jitter = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return 0.95 + 0.1 * double(seed >> 8) / double(1 << 24);
+    };
+
+    QueuedFramePipeline pipeline;
+    QueuedFrameReplayResult result = {};
+    result.depth = controller.GetDepth();
+
+    for (uint32_t i = 0; i < frameNum; i++) {
+        QueuedFrameControllerSample sample = pipeline.Step(result.depth, cpuTime * jitter(), gpuTime * jitter());
+
+        uint32_t depth = controller.Update(sample);
+        if (depth != result.depth)
+            result.changeNum++;
+        result.depth = depth;
+
+        if (i >= frameNum / 2) {
+            result.settledNum[depth]++;
+            result.frameTime += sample.frameTime;
+        }
+    }
+
+    result.frameTime /= frameNum - frameNum / 2;
+
+    return result;
+}
+
+static void TestGpuBound() {
+    // Frames sit in the queue: 3 -> 2, 1 makes the GPU idle and gets rejected (retried rarely, backoff doubles)
+    QueuedFrameReplayResult result = Replay(3, 4.0, 10.0, 20000);
+    TEST_CHECK(result.depth == 2);
+    TEST_CHECK(result.settledNum[2] > 9500);
+    TEST_CHECK(result.settledNum[3] == 0);
+    TEST_CHECK(result.changeNum < 20);
+    TEST_CHECK_NEAR(result.frameTime, 10.0, 0.2); // throughput is not lost
+
+    // The same with a negligible CPU cost
+    result = Replay(3, 0.5, 10.0, 20000);
+    TEST_CHECK(result.depth == 2);
+    TEST_CHECK(result.settledNum[2] > 9500);
+}
+
+static void TestSerialized() {
+    // Depth 1: the CPU waits for the GPU, the GPU waits for the CPU - the depth grows
+    QueuedFrameReplayResult result = Replay(1, 10.0, 4.0, 20000);
+    TEST_CHECK(result.depth == 2);
+    TEST_CHECK(result.settledNum[1] == 0);
+    TEST_CHECK(result.changeNum == 1);
+    TEST_CHECK_NEAR(result.frameTime, 10.0, 0.2);
+
+    // Synthetic: always waiting and idling - up to "maxDepth", then nothing to do
+    QueuedFrameController controller;
+    controller.Initialize({});
+    controller.Reset(1);
+
+    for (uint32_t i = 0; i < 1000; i++)
+        controller.Update({10.0, 2.0, 2.0});
+
+    TEST_CHECK(controller.GetDepth() == 3);
+    TEST_CHECK(!controller.IsTrial());
+    TEST_CHECK_NEAR(controller.GetAverage().fenceWaitTime, 2.0, 1e-6);
+}
+
+static void TestCpuBound() {
+    // The GPU idles, the CPU doesn't wait: the depth doesn't matter and is left as is
+    for (uint32_t depth = 2; depth <= 3; depth++) {
+        QueuedFrameReplayResult result = Replay(depth, 10.0, 4.0, 20000);
+        TEST_CHECK(result.depth == depth);
+        TEST_CHECK(result.changeNum == 0);
+    }
+
+    QueuedFrameController controller;
+    controller.Initialize({});
+
+    for (uint32_t i = 0; i < 1000; i++)
+        controller.Update({10.0, 0.0, 6.0});
+
+    TEST_CHECK(controller.GetDepth() == 3);
+}
+
+static void TestReset() {
+    QueuedFrameController controller;
+    controller.Initialize({});
+
+    controller.Reset(8);
+    TEST_CHECK(controller.GetDepth() == 3);
+
+    controller.Reset(0);
+    TEST_CHECK(controller.GetDepth() == 1);
+
+    // Nothing happens during settling
+    controller.Reset(3);
+    for (uint32_t i = 0; i < QueuedFrameControllerDesc().settleFrameNum; i++)
+        TEST_CHECK(controller.Update({10.0, 5.0, 0.0}) == 3);
+}
+
+void TestQueuedFrameController() {
+    TestGpuBound();
+    TestSerialized();
+    TestCpuBound();
+    TestReset();
+}
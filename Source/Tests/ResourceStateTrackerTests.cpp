@@ -0,0 +1,253 @@
+// © 2021 NVIDIA Corporation
+
+#include "NRIFramework.h"
+
+#include "../Common/ResourceStateTracker.h"
+#include "Tests.h"
+
+#include <map>
+
+// Fake handles: the tracker never dereferences them, "GetTextureDesc" is the only query
+static std::map<const nri::Texture*, nri::TextureDesc> g_TextureDescs;
+static uint32_t g_CmdBarrierNum = 0;
+
+static const nri::TextureDesc& NRI_CALL GetTextureDesc(const nri::Texture& texture) {
+    return g_TextureDescs[&texture];
+}
+
+static void NRI_CALL CmdBarrier(nri::CommandBuffer&, const nri::BarrierDesc&) {
+    g_CmdBarrierNum++;
+}
+
+static nri::Texture* CreateFakeTexture(uintptr_t handle, nri::Mip_t mipNum, nri::Dim_t layerNum) {
+    nri::Texture* texture = (nri::Texture*)handle;
+
+    nri::TextureDesc textureDesc = {};
+    textureDesc.mipNum = mipNum;
+    textureDesc.layerNum = layerNum;
+    g_TextureDescs[texture] = textureDesc;
+
+    return texture;
+}
+
+static bool IsEqual(const nri::AccessLayoutStage& a, const nri::AccessLayoutStage& b) {
+    return a.access == b.access && a.layout == b.layout && a.stages == b.stages;
+}
+
+static bool IsBarrier(const nri::TextureBarrierDesc& barrier, uint32_t mipOffset, uint32_t mipNum, uint32_t layerOffset, uint32_t layerNum) {
+    return barrier.mipOffset == mipOffset && barrier.mipNum == mipNum && barrier.layerOffset == layerOffset && barrier.layerNum == layerNum;
+}
+
+static const nri::AccessLayoutStage UNDEFINED = {nri::AccessBits::NONE, nri::Layout::UNDEFINED, nri::StageBits::NONE};
+static const nri::AccessLayoutStage COLOR = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT};
+static const nri::AccessLayoutStage COPY_DST = {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION, nri::StageBits::COPY};
+static const nri::AccessLayoutStage COPY_SRC = {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE, nri::StageBits::COPY};
+static const nri::AccessLayoutStage READ_FS = {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE, nri::StageBits::FRAGMENT_SHADER};
+static const nri::AccessLayoutStage READ_CS = {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE, nri::StageBits::COMPUTE_SHADER};
+
+static void TestElision(nri::CoreInterface& NRI) {
+    nri::Texture* texture = CreateFakeTexture(0x100, 1, 1);
+
+    ResourceStateTracker tracker;
+    tracker.Initialize(NRI);
+    tracker.RegisterTexture(*texture, READ_FS);
+
+    // Already in the requested state
+    tracker.RequireState(*texture, READ_FS);
+    TEST_CHECK(!tracker.HasPendingTransitions());
+    TEST_CHECK(tracker.GetStats().elidedNum == 1);
+
+    // A request reverted before "Flush" collapses to nothing
+    tracker.RequireState(*texture, COPY_DST);
+    TEST_CHECK(tracker.HasPendingTransitions());
+    tracker.RequireState(*texture, READ_FS);
+
+    std::vector<nri::TextureBarrierDesc> textureBarriers;
+    std::vector<nri::BufferBarrierDesc> bufferBarriers;
+    tracker.CollectBarriers(textureBarriers, bufferBarriers);
+    TEST_CHECK(textureBarriers.empty());
+    TEST_CHECK(IsEqual(tracker.GetState(*texture), READ_FS));
+
+    // Writes are never elided
+    tracker.RegisterTexture(*texture, COLOR);
+    tracker.RequireState(*texture, COLOR);
+    tracker.CollectBarriers(textureBarriers, bufferBarriers);
+    TEST_CHECK(textureBarriers.size() == 1);
+
+    g_CmdBarrierNum = 0;
+    tracker.RequireState(*texture, COLOR);
+    tracker.Flush(*(nri::CommandBuffer*)0x1);
+    TEST_CHECK(g_CmdBarrierNum == 1);
+
+    // Nothing pending - no "CmdBarrier"
+    tracker.Flush(*(nri::CommandBuffer*)0x1);
+    TEST_CHECK(g_CmdBarrierNum == 1);
+
+    tracker.Destroy();
+}
+
+static void TestReadWidening(nri::CoreInterface& NRI) {
+    nri::Texture* texture = CreateFakeTexture(0x200, 1, 1);
+
+    ResourceStateTracker tracker;
+    tracker.Initialize(NRI);
+    tracker.RegisterTexture(*texture, UNDEFINED);
+
+    std::vector<nri::TextureBarrierDesc> textureBarriers;
+    std::vector<nri::BufferBarrierDesc> bufferBarriers;
+
+    // Write, then read
+    tracker.RequireState(*texture, COLOR);
+    tracker.CollectBarriers(textureBarriers, bufferBarriers);
+    tracker.RequireState(*texture, READ_FS);
+    tracker.CollectBarriers(textureBarriers, bufferBarriers);
+    TEST_CHECK(textureBarriers.size() == 2);
+    TEST_CHECK(IsEqual(textureBarriers[1].before, COLOR));
+    TEST_CHECK(IsEqual(textureBarriers[1].after, READ_FS));
+
+    // A read from another stage in the same layout waits for the last write only and widens the state
+    textureBarriers.clear();
+    tracker.RequireState(*texture, READ_CS);
+    tracker.CollectBarriers(textureBarriers, bufferBarriers);
+    TEST_CHECK(textureBarriers.size() == 1);
+    TEST_CHECK(textureBarriers[0].before.access == nri::AccessBits::COLOR_ATTACHMENT);
+    TEST_CHECK(textureBarriers[0].before.stages == nri::StageBits::COLOR_ATTACHMENT);
+    TEST_CHECK(textureBarriers[0].before.layout == nri::Layout::SHADER_RESOURCE);
+    TEST_CHECK(IsEqual(textureBarriers[0].after, READ_CS));
+
+    const nri::AccessLayoutStage& state = tracker.GetState(*texture);
+    TEST_CHECK(state.access == nri::AccessBits::SHADER_RESOURCE);
+    TEST_CHECK(state.stages == (nri::StageBits::FRAGMENT_SHADER | nri::StageBits::COMPUTE_SHADER));
+
+    // Both readers are covered now
+    uint32_t elidedNum = tracker.GetStats().elidedNum;
+    tracker.RequireState(*texture, READ_FS);
+    tracker.RequireState(*texture, READ_CS);
+    TEST_CHECK(!tracker.HasPendingTransitions());
+    TEST_CHECK(tracker.GetStats().elidedNum == elidedNum + 2);
+
+    // Reads requested between flushes merge into one transition
+    tracker.RegisterTexture(*texture, COLOR);
+    tracker.RequireState(*texture, READ_FS);
+    tracker.RequireState(*texture, READ_CS);
+
+    textureBarriers.clear();
+    tracker.CollectBarriers(textureBarriers, bufferBarriers);
+    TEST_CHECK(textureBarriers.size() == 1);
+    TEST_CHECK(textureBarriers[0].after.stages == (nri::StageBits::FRAGMENT_SHADER | nri::StageBits::COMPUTE_SHADER));
+
+    tracker.Destroy();
+}
+
+static void TestMerging(nri::CoreInterface& NRI) {
+    nri::Texture* texture = CreateFakeTexture(0x300, 4, 3);
+
+    ResourceStateTracker tracker;
+    tracker.Initialize(NRI);
+    tracker.RegisterTexture(*texture, UNDEFINED);
+
+    std::vector<nri::TextureBarrierDesc> textureBarriers;
+    std::vector<nri::BufferBarrierDesc> bufferBarriers;
+
+    // Whole texture: mip runs merge across layers into one barrier
+    tracker.RequireState(*texture, COPY_DST);
+    tracker.CollectBarriers(textureBarriers, bufferBarriers);
+    TEST_CHECK(textureBarriers.size() == 1);
+    TEST_CHECK(IsBarrier(textureBarriers[0], 0, 4, 0, 3));
+    TEST_CHECK(tracker.GetStats().transitionNum == 12);
+
+    // Two mip runs with different transitions, each covering all layers
+    textureBarriers.clear();
+    tracker.RequireState(*texture, READ_FS, 0, 2);
+    tracker.RequireState(*texture, COPY_SRC, 2, 2);
+    tracker.CollectBarriers(textureBarriers, bufferBarriers);
+    TEST_CHECK(textureBarriers.size() == 2);
+    TEST_CHECK(IsBarrier(textureBarriers[0], 0, 2, 0, 3));
+    TEST_CHECK(IsBarrier(textureBarriers[1], 2, 2, 0, 3));
+    TEST_CHECK(IsEqual(textureBarriers[1].before, COPY_DST));
+    TEST_CHECK(IsEqual(textureBarriers[1].after, COPY_SRC));
+
+    // Layers with a gap are not merged
+    textureBarriers.clear();
+    tracker.RequireState(*texture, COPY_DST, 2, 1, 0, 1);
+    tracker.RequireState(*texture, COPY_DST, 2, 1, 2, 1);
+    tracker.CollectBarriers(textureBarriers, bufferBarriers);
+    TEST_CHECK(textureBarriers.size() == 2);
+    TEST_CHECK(IsBarrier(textureBarriers[0], 2, 1, 0, 1));
+    TEST_CHECK(IsBarrier(textureBarriers[1], 2, 1, 2, 1));
+    TEST_CHECK(IsEqual(tracker.GetState(*texture, 2, 1), COPY_SRC));
+    TEST_CHECK(IsEqual(tracker.GetState(*texture, 2, 2), COPY_DST));
+
+    // Subresources starting from different states can't share a barrier
+    textureBarriers.clear();
+    tracker.RequireState(*texture, COLOR, 2, 2);
+    tracker.CollectBarriers(textureBarriers, bufferBarriers);
+    TEST_CHECK(textureBarriers.size() == 5); // layers 0 and 2: mip 2 (copy dst) and mip 3 (copy src), layer 1: mips 2-3 (copy src)
+    for (const nri::TextureBarrierDesc& barrier : textureBarriers)
+        TEST_CHECK(IsEqual(barrier.after, COLOR));
+
+    tracker.Destroy();
+}
+
+static void TestDiscard(nri::CoreInterface& NRI) {
+    nri::Texture* texture = CreateFakeTexture(0x400, 2, 1);
+
+    ResourceStateTracker tracker;
+    tracker.Initialize(NRI);
+    tracker.RegisterTexture(*texture, COLOR);
+
+    // The next transition starts from "UNDEFINED"
+    tracker.Discard(*texture);
+    TEST_CHECK(IsEqual(tracker.GetState(*texture, 1), UNDEFINED));
+
+    std::vector<nri::TextureBarrierDesc> textureBarriers;
+    std::vector<nri::BufferBarrierDesc> bufferBarriers;
+    tracker.RequireState(*texture, COLOR);
+    tracker.CollectBarriers(textureBarriers, bufferBarriers);
+    TEST_CHECK(textureBarriers.size() == 1);
+    TEST_CHECK(IsBarrier(textureBarriers[0], 0, 2, 0, 1));
+    TEST_CHECK(IsEqual(textureBarriers[0].before, UNDEFINED));
+    TEST_CHECK(IsEqual(textureBarriers[0].after, COLOR));
+
+    // A discarded read-only texture can't be elided either (its contents are undefined)
+    tracker.RegisterTexture(*texture, READ_FS);
+    tracker.Discard(*texture);
+    tracker.RequireState(*texture, READ_FS);
+    TEST_CHECK(tracker.HasPendingTransitions());
+
+    tracker.Destroy();
+}
+
+static void TestBuffer(nri::CoreInterface& NRI) {
+    nri::Buffer* buffer = (nri::Buffer*)0x500;
+
+    ResourceStateTracker tracker;
+    tracker.Initialize(NRI);
+    tracker.RegisterBuffer(*buffer, {nri::AccessBits::COPY_DESTINATION, nri::StageBits::COPY});
+
+    tracker.RequireState(*buffer, {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::COMPUTE_SHADER});
+
+    g_CmdBarrierNum = 0;
+    tracker.Flush(*(nri::CommandBuffer*)0x1);
+    TEST_CHECK(g_CmdBarrierNum == 1);
+    TEST_CHECK(tracker.GetStats().flushNum == 1);
+    TEST_CHECK(tracker.GetStats().barrierNum == 1);
+
+    // Covered read
+    tracker.RequireState(*buffer, {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::COMPUTE_SHADER});
+    TEST_CHECK(!tracker.HasPendingTransitions());
+
+    tracker.Destroy();
+}
+
+void TestResourceStateTracker() {
+    nri::CoreInterface NRI = {};
+    NRI.GetTextureDesc = GetTextureDesc;
+    NRI.CmdBarrier = CmdBarrier;
+
+    TestElision(NRI);
+    TestReadWidening(NRI);
+    TestMerging(NRI);
+    TestDiscard(NRI);
+    TestBuffer(NRI);
+}
@@ -0,0 +1,129 @@
+// © 2021 NVIDIA Corporation
+
+#include "NRIFramework.h"
+
+#include "../Common/ShaderArchive.h"
+#include "Tests.h"
+
+#include <cstdio>
+#include <filesystem>
+
+struct ShaderArchiveTestFile {
+    ShaderArchiveHeader header;
+    ShaderArchiveEntry entries[2];
+    uint8_t bytecode[32];
+};
+
+static ShaderArchiveTestFile MakeArchive() {
+    ShaderArchiveTestFile file = {};
+    file.header.magic = SHADER_ARCHIVE_MAGIC;
+    file.header.version = SHADER_ARCHIVE_VERSION;
+    file.header.entryNum = 2;
+
+    strcpy(file.entries[0].name, "A.cs.spirv");
+    file.entries[0].offset = offsetof(ShaderArchiveTestFile, bytecode);
+    file.entries[0].size = 16;
+
+    strcpy(file.entries[1].name, "B.cs.spirv");
+    file.entries[1].offset = offsetof(ShaderArchiveTestFile, bytecode) + 16;
+    file.entries[1].size = 16;
+
+    for (uint8_t i = 0; i < 32; i++)
+        file.bytecode[i] = i;
+
+    return file;
+}
+
+static std::string WriteArchive(const ShaderArchiveTestFile& file) {
+    std::string path = (std::filesystem::temp_directory_path() / "NRISamplesTests.pack").string();
+
+    FILE* handle = fopen(path.c_str(), "wb");
+    if (!handle)
+        return "";
+
+    fwrite(&file, sizeof(file), 1, handle);
+    fclose(handle);
+
+    return path;
+}
+
+static bool OpenArchive(const ShaderArchiveTestFile& file) {
+    std::string path = WriteArchive(file);
+
+    bool isOpen = false;
+    {
+        ShaderArchive shaderArchive;
+        isOpen = shaderArchive.Open(path);
+    }
+
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+
+    return isOpen;
+}
+
+static void TestLookup() {
+    std::string path = WriteArchive(MakeArchive());
+    TEST_CHECK(!path.empty());
+
+    {
+        ShaderArchive shaderArchive;
+        TEST_CHECK(shaderArchive.Open(path));
+
+        const uint8_t* bytecode = nullptr;
+        uint64_t size = 0;
+        TEST_CHECK(shaderArchive.Find("B.cs.spirv", bytecode, size));
+        TEST_CHECK(size == 16);
+        TEST_CHECK(bytecode && bytecode[0] == 16 && bytecode[15] == 31);
+        TEST_CHECK(!shaderArchive.Find("C.cs.spirv", bytecode, size));
+    }
+
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+}
+
+static void TestValidation() {
+    // Last entry ends exactly at the end of the file
+    TEST_CHECK(OpenArchive(MakeArchive()));
+
+    // One byte past the end
+    ShaderArchiveTestFile file = MakeArchive();
+    file.entries[1].size = 17;
+    TEST_CHECK(!OpenArchive(file));
+
+    // "offset + size" wraps around
+    file = MakeArchive();
+    file.entries[1].size = ~0ull - file.entries[1].offset + 1;
+    TEST_CHECK(!OpenArchive(file));
+
+    // Offset past the end
+    file = MakeArchive();
+    file.entries[0].offset = sizeof(file) + 1;
+    file.entries[0].size = 0;
+    TEST_CHECK(!OpenArchive(file));
+
+    // Offset inside the entry table
+    file = MakeArchive();
+    file.entries[0].offset = sizeof(ShaderArchiveHeader);
+    TEST_CHECK(!OpenArchive(file));
+
+    // Name is not null-terminated
+    file = MakeArchive();
+    memset(file.entries[0].name, 'A', SHADER_ARCHIVE_NAME_MAX_LENGTH);
+    TEST_CHECK(!OpenArchive(file));
+
+    // Entry table doesn't fit
+    file = MakeArchive();
+    file.header.entryNum = 1000;
+    TEST_CHECK(!OpenArchive(file));
+
+    // Wrong version
+    file = MakeArchive();
+    file.header.version = SHADER_ARCHIVE_VERSION + 1;
+    TEST_CHECK(!OpenArchive(file));
+}
+
+void TestShaderArchive() {
+    TestLookup();
+    TestValidation();
+}
@@ -0,0 +1,107 @@
+// © 2021 NVIDIA Corporation
+
+#include "NRIFramework.h"
+
+#include "../Common/ShaderBindingTable.h"
+#include "Tests.h"
+
+struct ShaderBindingTableTestCase {
+    uint64_t identifierSize;
+    uint64_t alignment;
+    uint32_t localDataSize; // per hit group record
+    uint64_t expectedStride;
+};
+
+static void TestShaderBindingTableCase(const ShaderBindingTableTestCase& testCase) {
+    uint8_t localData[128] = {};
+
+    ShaderBindingTable shaderBindingTable;
+    shaderBindingTable.AddRecord(ShaderTableRegion::RAYGEN, 0);
+    shaderBindingTable.AddRecord(ShaderTableRegion::MISS, 1);
+    shaderBindingTable.AddRecord(ShaderTableRegion::MISS, 2);
+    shaderBindingTable.AddRecord(ShaderTableRegion::HIT_GROUP, 3);
+    shaderBindingTable.AddRecord(ShaderTableRegion::HIT_GROUP, 4, localData, testCase.localDataSize);
+    shaderBindingTable.AddRecord(ShaderTableRegion::HIT_GROUP, 5, localData, testCase.localDataSize / 2);
+
+    uint64_t size = shaderBindingTable.ComputeLayout(testCase.identifierSize, testCase.alignment);
+
+    const ShaderTableRegionLayout& raygen = shaderBindingTable.GetRegionLayout(ShaderTableRegion::RAYGEN);
+    const ShaderTableRegionLayout& miss = shaderBindingTable.GetRegionLayout(ShaderTableRegion::MISS);
+    const ShaderTableRegionLayout& hitGroup = shaderBindingTable.GetRegionLayout(ShaderTableRegion::HIT_GROUP);
+    const ShaderTableRegionLayout& callable = shaderBindingTable.GetRegionLayout(ShaderTableRegion::CALLABLE);
+
+    // Records without local data are just identifiers
+    uint64_t identifierStride = helper::Align(testCase.identifierSize, testCase.alignment);
+    TEST_CHECK(raygen.stride == identifierStride);
+    TEST_CHECK(miss.stride == identifierStride);
+
+    // The largest record defines the stride
+    TEST_CHECK(hitGroup.stride == testCase.expectedStride);
+    TEST_CHECK(hitGroup.stride % testCase.alignment == 0);
+    TEST_CHECK(hitGroup.stride >= testCase.identifierSize + testCase.localDataSize);
+
+    // Regions go one by one, each starts aligned
+    TEST_CHECK(raygen.offset == 0);
+    TEST_CHECK(raygen.size == raygen.stride);
+    TEST_CHECK(miss.offset == helper::Align(raygen.offset + raygen.size, testCase.alignment));
+    TEST_CHECK(miss.size == miss.stride * 2);
+    TEST_CHECK(hitGroup.offset == helper::Align(miss.offset + miss.size, testCase.alignment));
+    TEST_CHECK(hitGroup.size == hitGroup.stride * 3);
+    TEST_CHECK(miss.offset % testCase.alignment == 0);
+    TEST_CHECK(hitGroup.offset % testCase.alignment == 0);
+
+    // Empty regions take no space
+    TEST_CHECK(callable.stride == 0);
+    TEST_CHECK(callable.size == 0);
+    TEST_CHECK(callable.offset == helper::Align(hitGroup.offset + hitGroup.size, testCase.alignment));
+
+    TEST_CHECK(size == callable.offset);
+    TEST_CHECK(size == shaderBindingTable.GetSize());
+}
+
+static void TestShaderBindingTableEmptyRegions() {
+    ShaderBindingTable shaderBindingTable;
+    shaderBindingTable.AddRecord(ShaderTableRegion::RAYGEN, 0);
+    shaderBindingTable.AddRecord(ShaderTableRegion::HIT_GROUP, 1);
+
+    uint64_t size = shaderBindingTable.ComputeLayout(32, 64);
+
+    const ShaderTableRegionLayout& miss = shaderBindingTable.GetRegionLayout(ShaderTableRegion::MISS);
+    const ShaderTableRegionLayout& hitGroup = shaderBindingTable.GetRegionLayout(ShaderTableRegion::HIT_GROUP);
+
+    // An empty region in the middle doesn't shift the next one
+    TEST_CHECK(miss.stride == 0);
+    TEST_CHECK(miss.size == 0);
+    TEST_CHECK(miss.offset == 64);
+    TEST_CHECK(hitGroup.offset == 64);
+    TEST_CHECK(size == 128);
+
+    // Layout is recomputed from scratch
+    size = shaderBindingTable.ComputeLayout(32, 32);
+    TEST_CHECK(hitGroup.offset == 32);
+    TEST_CHECK(hitGroup.stride == 32);
+    TEST_CHECK(size == 64);
+}
+
+void TestShaderBindingTable() {
+    const ShaderBindingTableTestCase testCases[] = {
+        // Typical: 32 byte identifiers, 64 byte base alignment (NVIDIA, AMD)
+        {32, 64, 0, 64},
+        {32, 64, 8, 64},
+        {32, 64, 32, 64},
+        {32, 64, 40, 128},
+        // Tight alignment
+        {32, 32, 0, 32},
+        {32, 32, 4, 64},
+        {32, 32, 96, 128},
+        // Large identifiers or alignment
+        {64, 64, 1, 128},
+        {32, 256, 8, 256},
+        {32, 256, 232, 512},
+    };
+
+    for (uint32_t i = 0; i < helper::GetCountOf(testCases); i++)
+        TestShaderBindingTableCase(testCases[i]);
+
+    TestShaderBindingTableEmptyRegions();
+}
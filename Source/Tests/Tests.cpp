@@ -0,0 +1,23 @@
+// © 2021 NVIDIA Corporation
+
+#include "Tests.h"
+
+void TestLatencyStats();
+void TestQueuedFrameController();
+void TestResourceStateTracker();
+void TestShaderArchive();
+void TestShaderBindingTable();
+void TestWorkSplitController();
+
+int main() {
+    TestLatencyStats();
+    TestQueuedFrameController();
+    TestResourceStateTracker();
+    TestShaderArchive();
+    TestShaderBindingTable();
+    TestWorkSplitController();
+
+    printf("%u checks, %u failed\n", g_TestCheckNum, g_TestFailureNum);
+
+    return (int)g_TestFailureNum;
+}
@@ -0,0 +1,26 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// Minimal test harness for CPU-only parts of "Source/Common" (no device needed):
+//  - "TEST_CHECK" reports a failed condition with its location and continues
+//  - "TEST_CHECK_NEAR" compares floating point values with a tolerance
+//  - "Tests.cpp" runs all "Test*" functions, the exit code is the number of failed checks
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+inline uint32_t g_TestCheckNum = 0;
+inline uint32_t g_TestFailureNum = 0;
+
+#define TEST_CHECK(condition) \
+    do { \
+        g_TestCheckNum++; \
+        if (!(condition)) { \
+            g_TestFailureNum++; \
+            printf("%s:%d: FAILED '%s'\n", __FILE__, __LINE__, #condition); \
+        } \
+    } while (0)
+
+#define TEST_CHECK_NEAR(a, b, eps) TEST_CHECK(fabs(double(a) - double(b)) <= double(eps))
@@ -0,0 +1,178 @@
+// © 2021 NVIDIA Corporation
+
+#include "NRIFramework.h"
+
+#include "../Common/WorkSplitController.h"
+#include "Tests.h"
+
+#include <deque>
+
+// Queue times for a split, costs of the whole work on each queue are proportional to the work size
+struct WorkSplitTrace {
+    double graphicsCost;
+    double computeCost;
+
+    double GetGraphicsTime(float split) const {
+        return graphicsCost * (1.0 - split);
+    }
+
+    double GetComputeTime(float split) const {
+        return computeCost * split;
+    }
+};
+
+static void TestConvergence() {
+    const WorkSplitTrace traces[] = {
+        {4.0, 12.0},
+        {10.0, 10.0},
+        {6.0, 3.0},
+    };
+
+    for (const WorkSplitTrace& trace : traces) {
+        WorkSplitController controller;
+        controller.Initialize({});
+
+        // Timings arrive 3 frames late
+        std::deque<float> inFlight;
+        float maxDelta = 0.0f;
+
+        for (uint32_t i = 0; i < 300; i++) {
+            inFlight.push_back(controller.GetSplit());
+            if (inFlight.size() <= 3)
+                continue;
+
+            float split = inFlight.front();
+            inFlight.pop_front();
+
+            float prevSplit = controller.GetSplit();
+            float newSplit = controller.Update(trace.GetGraphicsTime(split), trace.GetComputeTime(split), split);
+            maxDelta = std::max(maxDelta, fabsf(newSplit - prevSplit));
+        }
+
+        // Both queues finish together
+        double target = trace.graphicsCost / (trace.graphicsCost + trace.computeCost);
+        TEST_CHECK_NEAR(controller.GetSplit(), target, 0.005);
+        TEST_CHECK(fabs(controller.GetImbalance()) < 0.025);
+        TEST_CHECK(!controller.IsAdjusting());
+
+        // Never faster than "maxStep"
+        TEST_CHECK(maxDelta <= WorkSplitControllerDesc().maxStep + 1e-6f);
+    }
+}
+
+static void TestStepClamp() {
+    WorkSplitControllerDesc desc = {};
+    desc.smoothing = 1.0f;
+
+    WorkSplitController controller;
+    controller.Initialize(desc);
+
+    // Target is 0.1, i.e. far away
+    WorkSplitTrace trace = {1.0, 9.0};
+    float split = controller.GetSplit();
+    for (uint32_t i = 0; i < 5; i++) {
+        float newSplit = controller.Update(trace.GetGraphicsTime(split), trace.GetComputeTime(split), split);
+        TEST_CHECK_NEAR(split - newSplit, desc.maxStep, 1e-6);
+        split = newSplit;
+    }
+
+    // The last step lands exactly on the target
+    desc.initialSplit = 0.11f;
+    controller.Initialize(desc);
+    split = controller.Update(trace.GetGraphicsTime(0.11f), trace.GetComputeTime(0.11f), 0.11f);
+    TEST_CHECK_NEAR(split, 0.1, 1e-6);
+}
+
+static void TestHysteresis() {
+    // Immediate estimates and tiny steps: the split stays at ~0.5, the imbalance is set directly
+    WorkSplitControllerDesc desc = {};
+    desc.smoothing = 1.0f;
+    desc.maxStep = 0.0001f;
+
+    WorkSplitController controller;
+    controller.Initialize(desc);
+
+    // Compute is slower by "imbalance"
+    auto update = [&controller](double imbalance) {
+        float split = controller.GetSplit();
+        WorkSplitTrace trace = {1.0, 1.0 / (1.0 - imbalance)};
+
+        return controller.Update(trace.GetGraphicsTime(split), trace.GetComputeTime(split), split);
+    };
+
+    // Below the start threshold (5%)
+    TEST_CHECK(update(0.04) == 0.5f);
+    TEST_CHECK(!controller.IsAdjusting());
+    TEST_CHECK_NEAR(controller.GetImbalance(), 0.04, 1e-3);
+
+    // Above it: less work for compute
+    TEST_CHECK(update(0.06) < 0.5f);
+    TEST_CHECK(controller.IsAdjusting());
+
+    // Inside the band keeps adjusting
+    float split = controller.GetSplit();
+    TEST_CHECK(update(0.03) < split);
+    TEST_CHECK(controller.IsAdjusting());
+
+    // Below the stop threshold (2.5%)
+    split = controller.GetSplit();
+    TEST_CHECK(update(0.02) == split);
+    TEST_CHECK(!controller.IsAdjusting());
+
+    // Inside the band again, but not adjusting - stays idle
+    TEST_CHECK(update(0.03) == split);
+    TEST_CHECK(!controller.IsAdjusting());
+
+    // The other direction: graphics is slower
+    TEST_CHECK(update(-0.06) > split);
+    TEST_CHECK(controller.IsAdjusting());
+    TEST_CHECK(controller.GetImbalance() < 0.0);
+}
+
+static void TestClamps() {
+    WorkSplitControllerDesc desc = {};
+    desc.minSplit = 0.2f;
+    desc.maxSplit = 0.7f;
+
+    // Compute is hopelessly slow (target ~0.01)
+    WorkSplitController controller;
+    controller.Initialize(desc);
+
+    WorkSplitTrace trace = {1.0, 100.0};
+    for (uint32_t i = 0; i < 100; i++) {
+        float split = controller.GetSplit();
+        controller.Update(trace.GetGraphicsTime(split), trace.GetComputeTime(split), split);
+    }
+
+    TEST_CHECK(controller.GetSplit() == desc.minSplit);
+    TEST_CHECK(controller.IsAdjusting());
+
+    // Graphics is hopelessly slow (target ~0.99)
+    controller.Reset();
+
+    trace = {100.0, 1.0};
+    for (uint32_t i = 0; i < 100; i++) {
+        float split = controller.GetSplit();
+        controller.Update(trace.GetGraphicsTime(split), trace.GetComputeTime(split), split);
+    }
+
+    TEST_CHECK(controller.GetSplit() == desc.maxSplit);
+
+    // Initial split is clamped too
+    desc.initialSplit = 0.95f;
+    controller.Initialize(desc);
+    TEST_CHECK(controller.GetSplit() == desc.maxSplit);
+
+    // Degenerate measurements are ignored
+    TEST_CHECK(controller.Update(0.0, 1.0, 0.5f) == desc.maxSplit);
+    TEST_CHECK(controller.Update(1.0, 1.0, 0.0f) == desc.maxSplit);
+    TEST_CHECK(controller.Update(1.0, 1.0, 1.0f) == desc.maxSplit);
+    TEST_CHECK(!controller.IsAdjusting());
+}
+
+void TestWorkSplitController() {
+    TestConvergence();
+    TestStepClamp();
+    TestHysteresis();
+    TestClamps();
+}
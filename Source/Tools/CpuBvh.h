@@ -0,0 +1,557 @@
+// © 2021 NVIDIA Corporation
+
+#pragma once
+
+// CPU reference BVH (no GPU needed):
+//  - "Build" is a top-down binned SAH build (BVH_BIN_NUM bins per axis) over primitive AABBs
+//  - "TraversePacket" traverses the BVH with a packet of 4 rays (SSE, scalar fallback), leaves are handled by a callback,
+//    which shrinks "tMax" of the lanes it hits (i.e. closest hit)
+//  - "GetSahCost" estimates the trace cost of the result, it allows to compare build settings without a GPU
+// Nodes are 32 bytes, children of an inner node are adjacent
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define CPU_BVH_SSE 1
+#    include <emmintrin.h>
+#else
+#    define CPU_BVH_SSE 0
+#endif
+
+constexpr uint32_t BVH_BIN_NUM = 16;
+constexpr uint32_t BVH_STACK_SIZE = 64;
+constexpr float BVH_TRAVERSAL_COST = 1.0f; // relative to a primitive test
+
+//======================================================================================================================
+// 4-wide SIMD
+//======================================================================================================================
+
+#if CPU_BVH_SSE
+
+struct BvhFloat4 {
+    __m128 v;
+};
+
+struct BvhMask4 {
+    __m128 v;
+};
+
+static inline BvhFloat4 BvhSet(float x) {
+    return {_mm_set1_ps(x)};
+}
+
+static inline BvhFloat4 BvhLoad(const float* p) {
+    return {_mm_loadu_ps(p)};
+}
+
+static inline void BvhStore(float* p, BvhFloat4 a) {
+    _mm_storeu_ps(p, a.v);
+}
+
+static inline BvhFloat4 operator+(BvhFloat4 a, BvhFloat4 b) {
+    return {_mm_add_ps(a.v, b.v)};
+}
+
+static inline BvhFloat4 operator-(BvhFloat4 a, BvhFloat4 b) {
+    return {_mm_sub_ps(a.v, b.v)};
+}
+
+static inline BvhFloat4 operator*(BvhFloat4 a, BvhFloat4 b) {
+    return {_mm_mul_ps(a.v, b.v)};
+}
+
+static inline BvhFloat4 operator/(BvhFloat4 a, BvhFloat4 b) {
+    return {_mm_div_ps(a.v, b.v)};
+}
+
+static inline BvhFloat4 BvhMin(BvhFloat4 a, BvhFloat4 b) {
+    return {_mm_min_ps(a.v, b.v)};
+}
+
+static inline BvhFloat4 BvhMax(BvhFloat4 a, BvhFloat4 b) {
+    return {_mm_max_ps(a.v, b.v)};
+}
+
+static inline BvhMask4 operator<(BvhFloat4 a, BvhFloat4 b) {
+    return {_mm_cmplt_ps(a.v, b.v)};
+}
+
+static inline BvhMask4 operator<=(BvhFloat4 a, BvhFloat4 b) {
+    return {_mm_cmple_ps(a.v, b.v)};
+}
+
+static inline BvhMask4 operator>(BvhFloat4 a, BvhFloat4 b) {
+    return {_mm_cmpgt_ps(a.v, b.v)};
+}
+
+static inline BvhMask4 operator>=(BvhFloat4 a, BvhFloat4 b) {
+    return {_mm_cmpge_ps(a.v, b.v)};
+}
+
+static inline BvhMask4 operator&(BvhMask4 a, BvhMask4 b) {
+    return {_mm_and_ps(a.v, b.v)};
+}
+
+static inline BvhMask4 operator|(BvhMask4 a, BvhMask4 b) {
+    return {_mm_or_ps(a.v, b.v)};
+}
+
+static inline BvhMask4 BvhMaskFromBits(uint32_t bits) {
+    return {_mm_castsi128_ps(_mm_set_epi32(bits & 8 ? -1 : 0, bits & 4 ? -1 : 0, bits & 2 ? -1 : 0, bits & 1 ? -1 : 0))};
+}
+
+static inline uint32_t BvhBits(BvhMask4 m) {
+    return (uint32_t)_mm_movemask_ps(m.v);
+}
+
+static inline BvhFloat4 BvhSelect(BvhMask4 m, BvhFloat4 a, BvhFloat4 b) {
+    return {_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))};
+}
+
+#else
+
+struct BvhFloat4 {
+    float v[4];
+};
+
+struct BvhMask4 {
+    bool v[4];
+};
+
+#    define BVH_LANES(expression) \
+        { \
+            expression(0), expression(1), expression(2), expression(3) \
+        }
+
+static inline BvhFloat4 BvhSet(float x) {
+    return {{x, x, x, x}};
+}
+
+static inline BvhFloat4 BvhLoad(const float* p) {
+    return {{p[0], p[1], p[2], p[3]}};
+}
+
+static inline void BvhStore(float* p, BvhFloat4 a) {
+    for (uint32_t i = 0; i < 4; i++)
+        p[i] = a.v[i];
+}
+
+#    define BVH_OP(i) a.v[i] + b.v[i]
+static inline BvhFloat4 operator+(BvhFloat4 a, BvhFloat4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    define BVH_OP(i) a.v[i] - b.v[i]
+static inline BvhFloat4 operator-(BvhFloat4 a, BvhFloat4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    define BVH_OP(i) a.v[i] * b.v[i]
+static inline BvhFloat4 operator*(BvhFloat4 a, BvhFloat4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    define BVH_OP(i) a.v[i] / b.v[i]
+static inline BvhFloat4 operator/(BvhFloat4 a, BvhFloat4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+// Same NaN behavior as "_mm_min_ps" / "_mm_max_ps" (the second operand is returned)
+#    define BVH_OP(i) a.v[i] < b.v[i] ? a.v[i] : b.v[i]
+static inline BvhFloat4 BvhMin(BvhFloat4 a, BvhFloat4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    define BVH_OP(i) a.v[i] > b.v[i] ? a.v[i] : b.v[i]
+static inline BvhFloat4 BvhMax(BvhFloat4 a, BvhFloat4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    define BVH_OP(i) a.v[i] < b.v[i]
+static inline BvhMask4 operator<(BvhFloat4 a, BvhFloat4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    define BVH_OP(i) a.v[i] <= b.v[i]
+static inline BvhMask4 operator<=(BvhFloat4 a, BvhFloat4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    define BVH_OP(i) a.v[i] > b.v[i]
+static inline BvhMask4 operator>(BvhFloat4 a, BvhFloat4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    define BVH_OP(i) a.v[i] >= b.v[i]
+static inline BvhMask4 operator>=(BvhFloat4 a, BvhFloat4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    define BVH_OP(i) a.v[i] && b.v[i]
+static inline BvhMask4 operator&(BvhMask4 a, BvhMask4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    define BVH_OP(i) a.v[i] || b.v[i]
+static inline BvhMask4 operator|(BvhMask4 a, BvhMask4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    define BVH_OP(i) (bits & (1u << i)) != 0
+static inline BvhMask4 BvhMaskFromBits(uint32_t bits) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+static inline uint32_t BvhBits(BvhMask4 m) {
+    return (m.v[0] ? 1u : 0u) | (m.v[1] ? 2u : 0u) | (m.v[2] ? 4u : 0u) | (m.v[3] ? 8u : 0u);
+}
+
+#    define BVH_OP(i) m.v[i] ? a.v[i] : b.v[i]
+static inline BvhFloat4 BvhSelect(BvhMask4 m, BvhFloat4 a, BvhFloat4 b) {
+    return {BVH_LANES(BVH_OP)};
+}
+#    undef BVH_OP
+
+#    undef BVH_LANES
+
+#endif
+
+static inline float BvhHorizontalMin(BvhFloat4 a) {
+    float lanes[4];
+    BvhStore(lanes, a);
+
+    return std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+}
+
+//======================================================================================================================
+// BVH
+//======================================================================================================================
+
+struct BvhAabb {
+    float min[3];
+    float max[3];
+};
+
+struct BvhNode {
+    float min[3];
+    uint32_t leftOrFirst; // the left child (the right one follows) or the first primitive
+    float max[3];
+    uint32_t primitiveNum; // 0 for inner nodes
+};
+
+// "invDirection" must be set by "BvhFinalizeRayPacket"
+struct BvhRayPacket {
+    BvhFloat4 origin[3];
+    BvhFloat4 direction[3];
+    BvhFloat4 invDirection[3];
+    BvhFloat4 tMin;
+    BvhMask4 active;
+};
+
+static inline void BvhFinalizeRayPacket(BvhRayPacket& packet) {
+    for (uint32_t i = 0; i < 3; i++)
+        packet.invDirection[i] = BvhSet(1.0f) / packet.direction[i];
+}
+
+static inline float BvhGetHalfArea(const float* min, const float* max) {
+    float dx = max[0] - min[0];
+    float dy = max[1] - min[1];
+    float dz = max[2] - min[2];
+
+    return dx * dy + dy * dz + dz * dx;
+}
+
+class CpuBvh {
+public:
+    // Leaves have up to "leafPrimitiveMaxNum" primitives, up to 4x more if SAH finds it cheaper, or more if centroids can't be split
+    inline void Build(const BvhAabb* bounds, uint32_t primitiveNum, uint32_t leafPrimitiveMaxNum) {
+        m_Nodes.clear();
+        m_PrimitiveIndices.resize(primitiveNum);
+        m_Depth = 0;
+
+        if (!primitiveNum)
+            return;
+
+        std::vector<float> centroids(primitiveNum * 3);
+        for (uint32_t i = 0; i < primitiveNum; i++) {
+            m_PrimitiveIndices[i] = i;
+
+            for (uint32_t j = 0; j < 3; j++)
+                centroids[i * 3 + j] = (bounds[i].min[j] + bounds[i].max[j]) * 0.5f;
+        }
+
+        struct BuildTask {
+            uint32_t nodeIndex;
+            uint32_t first;
+            uint32_t num;
+            uint32_t depth;
+        };
+
+        m_Nodes.reserve(primitiveNum * 2 - 1);
+        m_Nodes.push_back({});
+
+        std::vector<BuildTask> tasks;
+        tasks.push_back({0, 0, primitiveNum, 1});
+
+        while (!tasks.empty()) {
+            BuildTask task = tasks.back();
+            tasks.pop_back();
+
+            m_Depth = std::max(m_Depth, task.depth);
+
+            // Bounds
+            BvhAabb nodeBounds = {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+            BvhAabb centroidBounds = nodeBounds;
+
+            for (uint32_t i = task.first; i < task.first + task.num; i++) {
+                uint32_t primitiveIndex = m_PrimitiveIndices[i];
+
+                for (uint32_t j = 0; j < 3; j++) {
+                    nodeBounds.min[j] = std::min(nodeBounds.min[j], bounds[primitiveIndex].min[j]);
+                    nodeBounds.max[j] = std::max(nodeBounds.max[j], bounds[primitiveIndex].max[j]);
+                    centroidBounds.min[j] = std::min(centroidBounds.min[j], centroids[primitiveIndex * 3 + j]);
+                    centroidBounds.max[j] = std::max(centroidBounds.max[j], centroids[primitiveIndex * 3 + j]);
+                }
+            }
+
+            BvhNode& node = m_Nodes[task.nodeIndex];
+            for (uint32_t j = 0; j < 3; j++) {
+                node.min[j] = nodeBounds.min[j];
+                node.max[j] = nodeBounds.max[j];
+            }
+
+            node.leftOrFirst = task.first;
+            node.primitiveNum = task.num;
+
+            if (task.num <= leafPrimitiveMaxNum || task.depth >= BVH_STACK_SIZE)
+                continue;
+
+            // Find the best split
+            float bestCost = FLT_MAX;
+            uint32_t bestAxis = 0;
+            uint32_t bestSplit = 0;
+
+            for (uint32_t axis = 0; axis < 3; axis++) {
+                float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+                if (extent <= 0.0f)
+                    continue;
+
+                BvhAabb binBounds[BVH_BIN_NUM];
+                uint32_t binCounts[BVH_BIN_NUM] = {};
+
+                for (BvhAabb& binBound : binBounds)
+                    binBound = {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+
+                float scale = BVH_BIN_NUM / extent;
+                for (uint32_t i = task.first; i < task.first + task.num; i++) {
+                    uint32_t primitiveIndex = m_PrimitiveIndices[i];
+                    uint32_t bin = GetBin(centroids[primitiveIndex * 3 + axis], centroidBounds.min[axis], scale);
+
+                    binCounts[bin]++;
+                    for (uint32_t j = 0; j < 3; j++) {
+                        binBounds[bin].min[j] = std::min(binBounds[bin].min[j], bounds[primitiveIndex].min[j]);
+                        binBounds[bin].max[j] = std::max(binBounds[bin].max[j], bounds[primitiveIndex].max[j]);
+                    }
+                }
+
+                // Sweep from the right, then from the left
+                float rightAreas[BVH_BIN_NUM] = {};
+                uint32_t rightCounts[BVH_BIN_NUM] = {};
+
+                BvhAabb accumulated = {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+                uint32_t count = 0;
+                for (uint32_t bin = BVH_BIN_NUM - 1; bin > 0; bin--) {
+                    Merge(accumulated, binBounds[bin]);
+                    count += binCounts[bin];
+
+                    rightAreas[bin] = count ? BvhGetHalfArea(accumulated.min, accumulated.max) : 0.0f;
+                    rightCounts[bin] = count;
+                }
+
+                accumulated = {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+                count = 0;
+                for (uint32_t split = 1; split < BVH_BIN_NUM; split++) {
+                    Merge(accumulated, binBounds[split - 1]);
+                    count += binCounts[split - 1];
+
+                    if (!count || !rightCounts[split])
+                        continue;
+
+                    float cost = BvhGetHalfArea(accumulated.min, accumulated.max) * count + rightAreas[split] * rightCounts[split];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = split;
+                    }
+                }
+            }
+
+            // All centroids are in one point
+            if (bestSplit == 0)
+                continue;
+
+            // Leaf, if cheaper (relative to the node area)
+            float nodeArea = BvhGetHalfArea(nodeBounds.min, nodeBounds.max);
+            bestCost = BVH_TRAVERSAL_COST + (nodeArea > 0.0f ? bestCost / nodeArea : 0.0f);
+
+            if (bestCost >= float(task.num) && task.num <= leafPrimitiveMaxNum * 4)
+                continue;
+
+            // Partition
+            float scale = BVH_BIN_NUM / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+            float axisMin = centroidBounds.min[bestAxis];
+
+            uint32_t* begin = m_PrimitiveIndices.data() + task.first;
+            uint32_t* middle = std::partition(begin, begin + task.num, [&](uint32_t primitiveIndex) {
+                return GetBin(centroids[primitiveIndex * 3 + bestAxis], axisMin, scale) < bestSplit;
+            });
+
+            uint32_t leftNum = uint32_t(middle - begin);
+
+            // Children ("node" can't be used after "push_back")
+            uint32_t leftIndex = (uint32_t)m_Nodes.size();
+            m_Nodes[task.nodeIndex].leftOrFirst = leftIndex;
+            m_Nodes[task.nodeIndex].primitiveNum = 0;
+
+            m_Nodes.push_back({});
+            m_Nodes.push_back({});
+
+            tasks.push_back({leftIndex + 1, task.first + leftNum, task.num - leftNum, task.depth + 1});
+            tasks.push_back({leftIndex, task.first, leftNum, task.depth + 1});
+        }
+    }
+
+    template <typename LeafFunc>
+    inline void TraversePacket(const BvhRayPacket& packet, BvhFloat4& tMax, LeafFunc&& leafFunc) const {
+        BvhFloat4 tNear;
+        if (m_Nodes.empty() || !IntersectNode(m_Nodes[0], packet, tMax, tNear))
+            return;
+
+        uint32_t stack[BVH_STACK_SIZE];
+        uint32_t stackSize = 0;
+        uint32_t nodeIndex = 0;
+
+        while (true) {
+            const BvhNode& node = m_Nodes[nodeIndex];
+
+            if (node.primitiveNum) {
+                for (uint32_t i = 0; i < node.primitiveNum; i++)
+                    leafFunc(m_PrimitiveIndices[node.leftOrFirst + i], tMax);
+            } else {
+                uint32_t left = node.leftOrFirst;
+                uint32_t right = node.leftOrFirst + 1;
+
+                BvhFloat4 tNearLeft, tNearRight;
+                bool isLeftHit = IntersectNode(m_Nodes[left], packet, tMax, tNearLeft);
+                bool isRightHit = IntersectNode(m_Nodes[right], packet, tMax, tNearRight);
+
+                if (isLeftHit && isRightHit) {
+                    // The nearest first (for the closest active ray)
+                    bool isLeftFirst = BvhHorizontalMin(tNearLeft) <= BvhHorizontalMin(tNearRight);
+
+                    stack[stackSize++] = isLeftFirst ? right : left;
+                    nodeIndex = isLeftFirst ? left : right;
+
+                    continue;
+                } else if (isLeftHit || isRightHit) {
+                    nodeIndex = isLeftHit ? left : right;
+
+                    continue;
+                }
+            }
+
+            if (!stackSize)
+                break;
+
+            nodeIndex = stack[--stackSize];
+        }
+    }
+
+    // Expected cost of a ray hitting the root, in primitive tests
+    inline float GetSahCost() const {
+        if (m_Nodes.empty())
+            return 0.0f;
+
+        float rootArea = BvhGetHalfArea(m_Nodes[0].min, m_Nodes[0].max);
+        if (rootArea <= 0.0f)
+            return 0.0f;
+
+        float cost = 0.0f;
+        for (const BvhNode& node : m_Nodes) {
+            float area = BvhGetHalfArea(node.min, node.max) / rootArea;
+            cost += area * (node.primitiveNum ? float(node.primitiveNum) : BVH_TRAVERSAL_COST);
+        }
+
+        return cost;
+    }
+
+    inline const BvhNode& GetRoot() const {
+        return m_Nodes[0];
+    }
+
+    inline uint32_t GetNodeNum() const {
+        return (uint32_t)m_Nodes.size();
+    }
+
+    inline uint32_t GetLeafNum() const {
+        return (uint32_t)((m_Nodes.size() + 1) / 2);
+    }
+
+    inline uint32_t GetDepth() const {
+        return m_Depth;
+    }
+
+private:
+    static inline uint32_t GetBin(float centroid, float min, float scale) {
+        return std::min(uint32_t((centroid - min) * scale), BVH_BIN_NUM - 1);
+    }
+
+    static inline void Merge(BvhAabb& dst, const BvhAabb& src) {
+        for (uint32_t j = 0; j < 3; j++) {
+            dst.min[j] = std::min(dst.min[j], src.min[j]);
+            dst.max[j] = std::max(dst.max[j], src.max[j]);
+        }
+    }
+
+    // Slab test, "tNear" is FLT_MAX for missing lanes
+    static inline bool IntersectNode(const BvhNode& node, const BvhRayPacket& packet, BvhFloat4 tMax, BvhFloat4& tNear) {
+        BvhFloat4 tEnter = packet.tMin;
+        BvhFloat4 tExit = tMax;
+
+        for (uint32_t j = 0; j < 3; j++) {
+            BvhFloat4 t0 = (BvhSet(node.min[j]) - packet.origin[j]) * packet.invDirection[j];
+            BvhFloat4 t1 = (BvhSet(node.max[j]) - packet.origin[j]) * packet.invDirection[j];
+
+            tEnter = BvhMax(BvhMin(t0, t1), tEnter);
+            tExit = BvhMin(BvhMax(t0, t1), tExit);
+        }
+
+        BvhMask4 isHit = (tEnter <= tExit) & packet.active;
+        tNear = BvhSelect(isHit, tEnter, BvhSet(FLT_MAX));
+
+        return BvhBits(isHit) != 0;
+    }
+
+private:
+    std::vector<BvhNode> m_Nodes;
+    std::vector<uint32_t> m_PrimitiveIndices;
+    uint32_t m_Depth = 0;
+};
@@ -0,0 +1,360 @@
+// © 2021 NVIDIA Corporation
+
+// CPU reference for "RayTracingBoxes", no GPU needed:
+//  - builds binned SAH BVHs (see "CpuBvh.h") over the box triangles (BLAS) and BOX_NUM box instances (TLAS)
+//  - traces primary rays of "RayTracingBox.rgen.hlsl" in 2x2 packets and shades them as "RayTracingBox.rchit.hlsl" / "RayTracingBox.rmiss.hlsl"
+//  - writes a golden image (binary PPM, 8-bit UNORM as the swap chain of the sample) and reports BVH stats and rays/sec
+// Instances are placed at "time" (0 - the TLAS built at startup), instance masks are ignored (nothing is culled with default settings)
+// Usage: RayTracingBoxesReference [<width> <height> [<output path> [<time>]]]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "../Common/RayTracingBoxesScene.h"
+#include "CpuBvh.h"
+
+constexpr uint32_t BLAS_LEAF_PRIMITIVE_MAX_NUM = 2;
+constexpr uint32_t TLAS_LEAF_PRIMITIVE_MAX_NUM = 1;
+constexpr uint32_t NO_HIT = 0xFFFFFFFF;
+constexpr uint32_t THREAD_NUM_IF_UNKNOWN = 8;
+
+struct Triangle {
+    float v0[3];
+    float e1[3];
+    float e2[3];
+};
+
+struct Instance {
+    float toWorld[3][4];
+    float toObject[3][4];
+    uint32_t material;
+};
+
+struct PacketHit {
+    BvhFloat4 u;
+    BvhFloat4 v;
+    uint32_t instanceIndex[4];
+    uint32_t primitiveIndex[4];
+};
+
+struct Scene {
+    std::vector<Triangle> triangles;
+    std::vector<Instance> instances;
+    CpuBvh blas;
+    CpuBvh tlas;
+};
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double GetElapsedMs(Clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+}
+
+static void InvertAffine(const float m[3][4], float result[3][4]) {
+    float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    float invDet = 1.0f / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+
+    result[0][0] = c00 * invDet;
+    result[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+    result[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+    result[1][0] = c01 * invDet;
+    result[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+    result[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+    result[2][0] = c02 * invDet;
+    result[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+    result[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+
+    for (uint32_t i = 0; i < 3; i++)
+        result[i][3] = -(result[i][0] * m[0][3] + result[i][1] * m[1][3] + result[i][2] * m[2][3]);
+}
+
+static void BuildScene(Scene& scene, float time) {
+    // BLAS
+    const uint32_t triangleNum = sizeof(indices) / sizeof(indices[0]) / 3;
+
+    scene.triangles.resize(triangleNum);
+    std::vector<BvhAabb> bounds(triangleNum);
+
+    for (uint32_t i = 0; i < triangleNum; i++) {
+        const float* v0 = positions + indices[i * 3] * 3;
+        const float* v1 = positions + indices[i * 3 + 1] * 3;
+        const float* v2 = positions + indices[i * 3 + 2] * 3;
+
+        Triangle& triangle = scene.triangles[i];
+        for (uint32_t j = 0; j < 3; j++) {
+            triangle.v0[j] = v0[j];
+            triangle.e1[j] = v1[j] - v0[j];
+            triangle.e2[j] = v2[j] - v0[j];
+
+            bounds[i].min[j] = std::min(std::min(v0[j], v1[j]), v2[j]);
+            bounds[i].max[j] = std::max(std::max(v0[j], v1[j]), v2[j]);
+        }
+    }
+
+    scene.blas.Build(bounds.data(), triangleNum, BLAS_LEAF_PRIMITIVE_MAX_NUM);
+
+    // TLAS
+    const BvhNode& blasRoot = scene.blas.GetRoot();
+
+    scene.instances.resize(BOX_NUM);
+    bounds.resize(BOX_NUM);
+
+    for (uint32_t i = 0; i < BOX_NUM; i++) {
+        BoxObject object = {};
+        GetBoxObject(i, object);
+
+        Instance& instance = scene.instances[i];
+        GetBoxTransform(object, i, time, instance.toWorld);
+        InvertAffine(instance.toWorld, instance.toObject);
+        instance.material = (object.blasIndexMaterialAndMask >> 16) & 0xFF;
+
+        // World space bounds of the transformed BLAS bounds
+        for (uint32_t j = 0; j < 3; j++) {
+            bounds[i].min[j] = instance.toWorld[j][3];
+            bounds[i].max[j] = instance.toWorld[j][3];
+
+            for (uint32_t k = 0; k < 3; k++) {
+                float a = instance.toWorld[j][k] * blasRoot.min[k];
+                float b = instance.toWorld[j][k] * blasRoot.max[k];
+
+                bounds[i].min[j] += std::min(a, b);
+                bounds[i].max[j] += std::max(a, b);
+            }
+        }
+    }
+
+    scene.tlas.Build(bounds.data(), BOX_NUM, TLAS_LEAF_PRIMITIVE_MAX_NUM);
+}
+
+// Möller-Trumbore, barycentrics as in DXR / VK ("u" - the 2nd vertex, "v" - the 3rd vertex)
+static void IntersectTriangle(const Triangle& triangle, const BvhRayPacket& packet, BvhFloat4& tMax, BvhMask4& isHit, BvhFloat4& u, BvhFloat4& v) {
+    BvhFloat4 e1[3] = {BvhSet(triangle.e1[0]), BvhSet(triangle.e1[1]), BvhSet(triangle.e1[2])};
+    BvhFloat4 e2[3] = {BvhSet(triangle.e2[0]), BvhSet(triangle.e2[1]), BvhSet(triangle.e2[2])};
+    const BvhFloat4* d = packet.direction;
+
+    BvhFloat4 p[3] = {d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0]};
+    BvhFloat4 det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    BvhFloat4 invDet = BvhSet(1.0f) / det;
+
+    BvhFloat4 s[3] = {packet.origin[0] - BvhSet(triangle.v0[0]), packet.origin[1] - BvhSet(triangle.v0[1]), packet.origin[2] - BvhSet(triangle.v0[2])};
+    BvhFloat4 q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+
+    u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+    v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * invDet;
+    BvhFloat4 t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+
+    // Double sided (no cull flags), "det == 0" gives "inf" or "NaN", which fail the tests below
+    BvhFloat4 zero = BvhSet(0.0f);
+    isHit = packet.active & (u >= zero) & (v >= zero) & (u + v <= BvhSet(1.0f)) & (t > packet.tMin) & (t < tMax);
+    tMax = BvhSelect(isHit, t, tMax);
+}
+
+static void TracePacket(const Scene& scene, const BvhRayPacket& packet, PacketHit& hit) {
+    BvhFloat4 tMax = BvhSet(CAMERA_T_MAX);
+
+    hit.u = BvhSet(0.0f);
+    hit.v = BvhSet(0.0f);
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        hit.instanceIndex[lane] = NO_HIT;
+        hit.primitiveIndex[lane] = NO_HIT;
+    }
+
+    scene.tlas.TraversePacket(packet, tMax, [&](uint32_t instanceIndex, BvhFloat4& instanceTMax) {
+        const Instance& instance = scene.instances[instanceIndex];
+        const float(*m)[4] = instance.toObject;
+
+        // To object space ("t" is preserved by an affine transform)
+        BvhRayPacket objectPacket = {};
+        for (uint32_t i = 0; i < 3; i++) {
+            objectPacket.origin[i] = BvhSet(m[i][0]) * packet.origin[0] + BvhSet(m[i][1]) * packet.origin[1] + BvhSet(m[i][2]) * packet.origin[2] + BvhSet(m[i][3]);
+            objectPacket.direction[i] = BvhSet(m[i][0]) * packet.direction[0] + BvhSet(m[i][1]) * packet.direction[1] + BvhSet(m[i][2]) * packet.direction[2];
+        }
+
+        objectPacket.tMin = packet.tMin;
+        objectPacket.active = packet.active;
+        BvhFinalizeRayPacket(objectPacket);
+
+        scene.blas.TraversePacket(objectPacket, instanceTMax, [&](uint32_t primitiveIndex, BvhFloat4& triangleTMax) {
+            BvhMask4 isHit;
+            BvhFloat4 u, v;
+            IntersectTriangle(scene.triangles[primitiveIndex], objectPacket, triangleTMax, isHit, u, v);
+
+            uint32_t bits = BvhBits(isHit);
+            if (!bits)
+                return;
+
+            hit.u = BvhSelect(isHit, u, hit.u);
+            hit.v = BvhSelect(isHit, v, hit.v);
+
+            for (uint32_t lane = 0; lane < 4; lane++) {
+                if (bits & (1 << lane)) {
+                    hit.instanceIndex[lane] = instanceIndex;
+                    hit.primitiveIndex[lane] = primitiveIndex;
+                }
+            }
+        });
+    });
+}
+
+static void Shade(const Scene& scene, const PacketHit& hit, uint32_t lane, uint8_t* rgb) {
+    float color[3] = {MISS_COLOR[0], MISS_COLOR[1], MISS_COLOR[2]};
+
+    if (hit.instanceIndex[lane] != NO_HIT) {
+        float u[4], v[4];
+        BvhStore(u, hit.u);
+        BvhStore(v, hit.v);
+
+        const uint16_t* triangle = indices + hit.primitiveIndex[lane] * 3;
+        const float* texCoords0 = texCoords + triangle[0] * 2;
+        const float* texCoords1 = texCoords + triangle[1] * 2;
+        const float* texCoords2 = texCoords + triangle[2] * 2;
+
+        float barycentrics[3] = {1.0f - u[lane] - v[lane], u[lane], v[lane]};
+        float texcoords[2] = {
+            barycentrics[0] * texCoords0[0] + barycentrics[1] * texCoords1[0] + barycentrics[2] * texCoords2[0],
+            barycentrics[0] * texCoords0[1] + barycentrics[1] * texCoords1[1] + barycentrics[2] * texCoords2[1],
+        };
+
+        GetBoxColor(scene.instances[hit.instanceIndex[lane]].material, texcoords, barycentrics, color);
+    }
+
+    for (uint32_t i = 0; i < 3; i++)
+        rgb[i] = (uint8_t)(std::min(std::max(color[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static void TraceRows(const Scene& scene, uint32_t width, uint32_t height, std::atomic_uint32_t& nextRow, uint8_t* image) {
+    while (true) {
+        // 2 rows of 2x2 packets at a time
+        uint32_t y = nextRow.fetch_add(2, std::memory_order_relaxed);
+        if (y >= height)
+            break;
+
+        for (uint32_t x = 0; x < width; x += 2) {
+            BvhRayPacket packet = {};
+            float directions[3][4] = {};
+            uint32_t activeBits = 0;
+
+            for (uint32_t lane = 0; lane < 4; lane++) {
+                uint32_t px = x + (lane & 1);
+                uint32_t py = y + (lane >> 1);
+                if (px >= width || py >= height)
+                    continue;
+
+                float direction[3];
+                GetCameraRayDirection(px, py, width, height, direction);
+
+                for (uint32_t j = 0; j < 3; j++)
+                    directions[j][lane] = direction[j];
+
+                activeBits |= 1 << lane;
+            }
+
+            for (uint32_t j = 0; j < 3; j++) {
+                packet.origin[j] = BvhSet(CAMERA_POSITION[j]);
+                packet.direction[j] = BvhLoad(directions[j]);
+            }
+
+            packet.tMin = BvhSet(CAMERA_T_MIN);
+            packet.active = BvhMaskFromBits(activeBits);
+            BvhFinalizeRayPacket(packet);
+
+            PacketHit hit;
+            TracePacket(scene, packet, hit);
+
+            for (uint32_t lane = 0; lane < 4; lane++) {
+                if (activeBits & (1 << lane)) {
+                    uint32_t px = x + (lane & 1);
+                    uint32_t py = y + (lane >> 1);
+
+                    Shade(scene, hit, lane, image + (py * width + px) * 3);
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 1 && argc != 3 && argc != 4 && argc != 5) {
+        printf("Usage: RayTracingBoxesReference [<width> <height> [<output path> [<time>]]]\n");
+        return 1;
+    }
+
+    uint32_t width = argc >= 3 ? (uint32_t)atoi(argv[1]) : 1920;
+    uint32_t height = argc >= 3 ? (uint32_t)atoi(argv[2]) : 1080;
+    const char* outputPath = argc >= 4 ? argv[3] : "RayTracingBoxes.reference.ppm";
+    float time = argc >= 5 ? (float)atof(argv[4]) : 0.0f;
+
+    if (!width || !height) {
+        printf("RayTracingBoxesReference: invalid resolution\n");
+        return 1;
+    }
+
+    // Build
+    Scene scene;
+
+    Clock::time_point begin = Clock::now();
+    BuildScene(scene, time);
+    double buildTime = GetElapsedMs(begin);
+
+    printf("BLAS: %u nodes, %u leaves, depth %u, SAH cost %.2f\n", scene.blas.GetNodeNum(), scene.blas.GetLeafNum(), scene.blas.GetDepth(), scene.blas.GetSahCost());
+    printf("TLAS: %u nodes, %u leaves, depth %u, SAH cost %.2f\n", scene.tlas.GetNodeNum(), scene.tlas.GetLeafNum(), scene.tlas.GetDepth(), scene.tlas.GetSahCost());
+    printf("Build: %.2f ms\n", buildTime);
+
+    // Trace
+    std::vector<uint8_t> image(width * height * 3);
+    std::atomic_uint32_t nextRow(0);
+
+    // "hardware_concurrency" returns 0 if unknown: oversubscription is cheap (rows are pulled dynamically), a single thread is not.
+    // No more threads than row pairs (a work item)
+    uint32_t hardwareThreadNum = std::thread::hardware_concurrency();
+    uint32_t threadNum = hardwareThreadNum ? hardwareThreadNum : THREAD_NUM_IF_UNKNOWN;
+    threadNum = std::min(threadNum, (height + 1) / 2);
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadNum - 1);
+
+    begin = Clock::now();
+    for (uint32_t i = 1; i < threadNum; i++) {
+        try {
+            threads.emplace_back(TraceRows, std::cref(scene), width, height, std::ref(nextRow), image.data());
+        } catch (const std::system_error&) {
+            break; // can't create more, trace with what we have
+        }
+    }
+
+    TraceRows(scene, width, height, nextRow, image.data());
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    double traceTime = GetElapsedMs(begin);
+    double rayNum = double(width) * double(height);
+    uint32_t usedThreadNum = 1 + (uint32_t)threads.size();
+
+    printf("Trace: %.0f rays in %.2f ms, %.2f MRays/s (%u thread%s, %s)\n", rayNum, traceTime, rayNum / (traceTime * 1000.0), usedThreadNum, usedThreadNum == 1 ? "" : "s", CPU_BVH_SSE ? "SSE" : "scalar");
+    if (!hardwareThreadNum)
+        printf("  (hardware thread count is unknown, %u assumed)\n", THREAD_NUM_IF_UNKNOWN);
+
+    // Write
+    FILE* file = fopen(outputPath, "wb");
+    if (!file) {
+        printf("RayTracingBoxesReference: can't write '%s'\n", outputPath);
+        return 1;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+    fwrite(image.data(), 1, image.size(), file);
+    fclose(file);
+
+    printf("Image: '%s'\n", outputPath);
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+// © 2021 NVIDIA Corporation
+
+// Packs all compiled shaders ("*.dxbc", "*.dxil", "*.spirv") from a directory into a single archive:
+//  ShaderArchiveHeader
+//  ShaderArchiveEntry[entryNum] (sorted by name)
+//  blobs (aligned to SHADER_ARCHIVE_ALIGNMENT)
+// Usage: ShaderPacker <shader directory> <archive path>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../Common/ShaderArchiveFormat.h"
+
+struct Shader {
+    std::string name;
+    std::vector<uint8_t> bytecode;
+};
+
+static bool IsShaderBinary(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+
+    return ext == ".dxbc" || ext == ".dxil" || ext == ".spirv";
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        printf("Usage: ShaderPacker <shader directory> <archive path>\n");
+        return 1;
+    }
+
+    std::filesystem::path shaderDir = argv[1];
+    std::filesystem::path archivePath = argv[2];
+
+    // Gather
+    std::vector<Shader> shaders;
+
+    std::error_code error;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(shaderDir, error)) {
+        if (!entry.is_regular_file() || !IsShaderBinary(entry.path()))
+            continue;
+
+        std::string name = entry.path().filename().string();
+        if (name.size() >= SHADER_ARCHIVE_NAME_MAX_LENGTH) {
+            printf("ShaderPacker: name '%s' is too long, skipped\n", name.c_str());
+            continue;
+        }
+
+        std::ifstream file(entry.path(), std::ios::binary | std::ios::ate);
+        if (!file) {
+            printf("ShaderPacker: can't read '%s'\n", entry.path().string().c_str());
+            return 1;
+        }
+
+        Shader& shader = shaders.emplace_back();
+        shader.name = name;
+        shader.bytecode.resize((size_t)file.tellg());
+
+        file.seekg(0);
+        file.read((char*)shader.bytecode.data(), (std::streamsize)shader.bytecode.size());
+    }
+
+    if (error) {
+        printf("ShaderPacker: can't open '%s' (%s)\n", shaderDir.string().c_str(), error.message().c_str());
+        return 1;
+    }
+
+    std::sort(shaders.begin(), shaders.end(), [](const Shader& a, const Shader& b) { return a.name < b.name; });
+
+    // Layout
+    ShaderArchiveHeader header = {};
+    header.magic = SHADER_ARCHIVE_MAGIC;
+    header.version = SHADER_ARCHIVE_VERSION;
+    header.entryNum = (uint32_t)shaders.size();
+
+    std::vector<ShaderArchiveEntry> entries(shaders.size());
+
+    uint64_t offset = sizeof(header) + entries.size() * sizeof(ShaderArchiveEntry);
+    for (size_t i = 0; i < shaders.size(); i++) {
+        offset = (offset + SHADER_ARCHIVE_ALIGNMENT - 1) & ~uint64_t(SHADER_ARCHIVE_ALIGNMENT - 1);
+
+        ShaderArchiveEntry& entry = entries[i];
+        strncpy(entry.name, shaders[i].name.c_str(), SHADER_ARCHIVE_NAME_MAX_LENGTH - 1);
+        entry.offset = offset;
+        entry.size = shaders[i].bytecode.size();
+
+        offset += entry.size;
+    }
+
+    // Write (temporary file + rename, a failed write never leaves a truncated archive behind)
+    std::filesystem::path tmpPath = archivePath;
+    tmpPath += ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)entries.data(), (std::streamsize)(entries.size() * sizeof(ShaderArchiveEntry)));
+
+        const char padding[SHADER_ARCHIVE_ALIGNMENT] = {};
+        for (size_t i = 0; i < shaders.size(); i++) {
+            uint64_t position = (uint64_t)file.tellp();
+            file.write(padding, (std::streamsize)(entries[i].offset - position));
+            file.write((const char*)shaders[i].bytecode.data(), (std::streamsize)shaders[i].bytecode.size());
+        }
+
+        if (!file) {
+            printf("ShaderPacker: can't write '%s'\n", tmpPath.string().c_str());
+            return 1;
+        }
+    }
+
+    // On Windows a file with a live mapping can't be replaced (a running sample keeps the archive mapped until exit). Fail the step
+    // with a clear message, the output stays out of date and gets repacked by the next build
+    std::filesystem::rename(tmpPath, archivePath, error);
+    if (error) {
+        printf("ShaderPacker: can't replace '%s' (%s), close running samples and rebuild\n", archivePath.string().c_str(), error.message().c_str());
+
+        std::error_code ignored;
+        std::filesystem::remove(tmpPath, ignored);
+
+        return 1;
+    }
+
+    printf("ShaderPacker: %u shaders, %" PRIu64 " bytes -> '%s'\n", header.entryNum, offset, archivePath.string().c_str());
+
+    return 0;
+}
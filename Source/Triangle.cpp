@@ -2,9 +2,9 @@
 
 #include "NRIFramework.h"
 
-#include <fstream>
-
-constexpr const char* PSO_CACHE_PATH = "pso_cache.bin";
+#include "Common/PipelineCache.h"
+#include "Common/ShaderArchive.h"
+#include "Common/StartupProfiler.h"
 
 constexpr uint32_t VIEW_MASK = 0b11;
 constexpr nri::Color32f COLOR_0 = {1.0f, 1.0f, 0.0f, 1.0f};
@@ -59,13 +59,14 @@ private:
     nri::PipelineLayout* m_PipelineLayout = nullptr;
     nri::Pipeline* m_Pipeline = nullptr;
     nri::Pipeline* m_PipelineMultiview = nullptr;
-    nri::PipelineCache* m_PipelineCache = nullptr;
     nri::DescriptorSet* m_TextureDescriptorSet = nullptr;
     nri::Descriptor* m_TextureShaderResource = nullptr;
     nri::Buffer* m_ConstantBuffer = nullptr;
     nri::Buffer* m_GeometryBuffer = nullptr;
     nri::Texture* m_Texture = nullptr;
 
+    PersistentPipelineCache m_PipelineCache;
+
     std::vector<QueuedFrame> m_QueuedFrames = {};
     std::vector<SwapChainTexture> m_SwapChainTextures;
     std::vector<nri::Memory*> m_MemoryAllocations;
@@ -94,6 +95,10 @@ Sample::~Sample() {
 
         NRI.DestroyPipeline(m_Pipeline);
         NRI.DestroyPipeline(m_PipelineMultiview);
+
+        m_PipelineCache.Save(NRI);
+        m_PipelineCache.Destroy(NRI);
+
         NRI.DestroyPipelineLayout(m_PipelineLayout);
         NRI.DestroyDescriptor(m_TextureShaderResource);
         NRI.DestroyBuffer(m_ConstantBuffer);
@@ -104,22 +109,6 @@ Sample::~Sample() {
 
         for (nri::Memory* memory : m_MemoryAllocations)
             NRI.FreeMemory(memory);
-
-        // Pipeline cache
-        if (m_PipelineCache) {
-            uint64_t size = 0;
-            NRI_ABORT_ON_FAILURE(NRI.GetPipelineCacheData(*m_PipelineCache, nullptr, size));
-
-            if (size > 0) {
-                std::vector<uint8_t> blob(size);
-                NRI_ABORT_ON_FAILURE(NRI.GetPipelineCacheData(*m_PipelineCache, blob.data(), size));
-
-                std::ofstream(PSO_CACHE_PATH, std::ios::binary).write((const char*)blob.data(), (std::streamsize)size);
-                printf("Pipeline cache: saved %" PRIu64 " bytes to '%s'\n", size, PSO_CACHE_PATH);
-            }
-
-            NRI.DestroyPipelineCache(m_PipelineCache);
-        }
     }
 
     if (NRI.HasSwapChain())
@@ -134,6 +123,8 @@ Sample::~Sample() {
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
+
     // Adapters
     nri::AdapterDesc adapterDesc[2] = {};
     uint32_t adapterDescsNum = helper::GetCountOf(adapterDesc);
@@ -149,13 +140,20 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     deviceCreationDesc.vkBindingOffsets = VK_BINDING_OFFSETS;
     deviceCreationDesc.adapterDesc = &adapterDesc[std::min(m_AdapterIndex, adapterDescsNum - 1)];
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
+
+    m_PipelineCache.Preload(graphicsAPI, *deviceCreationDesc.adapterDesc);
+
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
+    StartupProfilerEnd();
+
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    StartupProfilerEnd();
 
     // Create streamer
     nri::StreamerDesc streamerDesc = {};
@@ -172,39 +170,12 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
-    { // Pipeline cache
-        nri::PipelineCacheDesc cacheDesc = {};
-        std::vector<uint8_t> blob;
-
-        if (deviceDesc.features.pipelineCache) {
-            std::ifstream f(PSO_CACHE_PATH, std::ios::binary | std::ios::ate);
-            if (f) {
-                uint64_t size = (uint64_t)f.tellg();
-                blob.resize(size);
-
-                f.seekg(0).read((char*)blob.data(), (std::streamsize)size);
-
-                cacheDesc.data = blob.data();
-                cacheDesc.size = size;
-
-                printf("Pipeline cache: loaded %" PRIu64 " bytes from '%s'\n", size, PSO_CACHE_PATH);
-            } else
-                printf("Pipeline cache: '%s' not found, starting empty\n", PSO_CACHE_PATH);
-        } else
-            printf("Pipeline cache: unsupported\n");
-
-        nri::Result result = NRI.CreatePipelineCache(*m_Device, cacheDesc, m_PipelineCache);
-        if (result == nri::Result::OUT_OF_DATE) {
-            printf("Pipeline cache: supplied blob is stale, recreating empty\n");
-
-            nri::PipelineCacheDesc empty = {};
-            NRI.CreatePipelineCache(*m_Device, empty, m_PipelineCache);
-        }
-    }
 
     // Swap chain
     nri::Format swapChainFormat;
     {
+        StartupPhase phase("Swap chain");
+
         nri::SwapChainDesc swapChainDesc = {};
         swapChainDesc.window = GetWindow();
         swapChainDesc.queue = m_GraphicsQueue;
@@ -251,6 +222,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBuffer));
     }
 
+    StartupProfilerBegin("Pipelines");
+    m_PipelineCache.Create(NRI, *m_Device);
+
     { // Pipeline layout
         nri::SamplerDesc samplerDesc = {};
         samplerDesc.addressModes = {nri::AddressMode::MIRRORED_REPEAT, nri::AddressMode::MIRRORED_REPEAT};
@@ -327,19 +301,19 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         outputMergerDesc.colorNum = 1;
 
         nri::ShaderDesc shaderStages[] = {
-            utils::LoadShader(deviceDesc.graphicsAPI, "TriangleFlexibleMultiview.vs", shaderCodeStorage),
-            utils::LoadShader(deviceDesc.graphicsAPI, "Triangle.fs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "TriangleFlexibleMultiview.vs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "Triangle.fs", shaderCodeStorage),
         };
 
         nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
         graphicsPipelineDesc.pipelineLayout = m_PipelineLayout;
+        graphicsPipelineDesc.cache = m_PipelineCache.Get();
         graphicsPipelineDesc.vertexInput = &vertexInputDesc;
         graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
         graphicsPipelineDesc.rasterization = rasterizationDesc;
         graphicsPipelineDesc.outputMerger = outputMergerDesc;
         graphicsPipelineDesc.shaders = shaderStages;
         graphicsPipelineDesc.shaderNum = helper::GetCountOf(shaderStages);
-        graphicsPipelineDesc.cache = m_PipelineCache;
 
         double t0 = m_Timer.GetTimeStamp();
         NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, m_Pipeline));
@@ -358,6 +332,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         }
     }
 
+    StartupProfilerEnd();
+
     { // Descriptor pool
         nri::DescriptorPoolDesc descriptorPoolDesc = {};
         descriptorPoolDesc.descriptorSetMaxNum = GetQueuedFrameNum() + 1;
@@ -369,11 +345,16 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
     // Load texture
     utils::Texture texture;
-    std::string path = utils::GetFullPath("wood.dds", utils::DataFolder::TEXTURES);
-    if (!utils::LoadTexture(path, texture))
-        return false;
+    {
+        StartupPhase startupPhase("Textures"); // also closed on the error path
+
+        std::string path = utils::GetFullPath("wood.dds", utils::DataFolder::TEXTURES);
+        if (!utils::LoadTexture(path, texture))
+            return false;
+    }
 
     // Resources
+    StartupProfilerBegin("Resources");
     const uint32_t constantBufferSize = helper::Align((uint32_t)sizeof(ConstantBufferLayout), deviceDesc.memoryAlignment.constantBufferOffset);
     const uint64_t indexDataSize = sizeof(g_IndexData);
     const uint64_t indexDataAlignedSize = helper::Align(indexDataSize, 16);
@@ -424,6 +405,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     m_MemoryAllocations.resize(1 + NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
     NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + 1));
 
+    StartupProfilerEnd();
+
     { // Descriptors
         // Read-only texture
         nri::TextureViewDesc textureViewDesc = {m_Texture, nri::TextureView::TEXTURE, texture.GetFormat()};
@@ -459,6 +442,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     { // Upload data
+        StartupPhase phase("Upload");
+
         std::vector<uint8_t> geometryBufferData(indexDataAlignedSize + vertexDataSize);
         memcpy(&geometryBufferData[0], g_IndexData, indexDataSize);
         memcpy(&geometryBufferData[indexDataAlignedSize], g_VertexData, vertexDataSize);
@@ -481,7 +466,11 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     // User interface
+    StartupProfilerBegin("UI");
     bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
 
     return initialized;
 }
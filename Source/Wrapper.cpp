@@ -1,6 +1,9 @@
 // © 2021 NVIDIA Corporation
 
 #include "NRIFramework.h"
+
+#include "Common/ShaderArchive.h"
+#include "Common/StartupProfiler.h"
 #undef APIENTRY // defined in GLFW
 
 #define VK_MINOR_VERSION 4
@@ -379,6 +382,7 @@ void Sample::CreateVulkanDevice() {
 }
 
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
+    StartupProfilerBegin("Device");
     switch (graphicsAPI) {
         case nri::GraphicsAPI::VK:
             CreateVulkanDevice();
@@ -390,12 +394,15 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
             CreateD3D11Device();
             break;
     }
+    StartupProfilerEnd();
 
     // NRI
+    StartupProfilerBegin("Interfaces");
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
+    StartupProfilerEnd();
 
     // Create streamer
     nri::StreamerDesc streamerDesc = {};
@@ -414,6 +421,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     // Swap chain
     nri::Format swapChainFormat;
     {
+        StartupPhase phase("Swap chain");
+
         nri::SwapChainDesc swapChainDesc = {};
         swapChainDesc.window = GetWindow();
         swapChainDesc.queue = m_GraphicsQueue;
@@ -460,6 +469,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*queuedFrame.commandAllocator, queuedFrame.commandBuffer));
     }
 
+    StartupProfilerBegin("Pipelines");
+
     { // Pipeline layout
         nri::SamplerDesc samplerDesc = {};
         samplerDesc.addressModes = {nri::AddressMode::MIRRORED_REPEAT, nri::AddressMode::MIRRORED_REPEAT};
@@ -537,8 +548,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         outputMergerDesc.colorNum = 1;
 
         nri::ShaderDesc shaderStages[] = {
-            utils::LoadShader(deviceDesc.graphicsAPI, "Triangle.vs", shaderCodeStorage),
-            utils::LoadShader(deviceDesc.graphicsAPI, "Triangle.fs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "Triangle.vs", shaderCodeStorage),
+            LoadPackedShader(deviceDesc.graphicsAPI, "Triangle.fs", shaderCodeStorage),
         };
 
         nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
@@ -553,6 +564,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
         NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, m_Pipeline));
     }
 
+    StartupProfilerEnd();
+
     { // Descriptor pool
         nri::DescriptorPoolDesc descriptorPoolDesc = {};
         descriptorPoolDesc.descriptorSetMaxNum = GetQueuedFrameNum() + 1;
@@ -564,11 +577,16 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
 
     // Load texture
     utils::Texture texture;
-    std::string path = utils::GetFullPath("wood.dds", utils::DataFolder::TEXTURES);
-    if (!utils::LoadTexture(path, texture))
-        return false;
+    {
+        StartupPhase startupPhase("Textures"); // also closed on the error path
+
+        std::string path = utils::GetFullPath("wood.dds", utils::DataFolder::TEXTURES);
+        if (!utils::LoadTexture(path, texture))
+            return false;
+    }
 
     // Resources
+    StartupProfilerBegin("Resources");
     const uint32_t constantBufferSize = helper::Align((uint32_t)sizeof(ConstantBufferLayout), deviceDesc.memoryAlignment.constantBufferOffset);
     const uint64_t indexDataSize = sizeof(g_IndexData);
     const uint64_t indexDataAlignedSize = helper::Align(indexDataSize, 16);
@@ -619,6 +637,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     m_MemoryAllocations.resize(1 + NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
     NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + 1));
 
+    StartupProfilerEnd();
+
     { // Descriptors
         // Read-only texture
         nri::TextureViewDesc textureViewDesc = {m_Texture, nri::TextureView::TEXTURE, texture.GetFormat()};
@@ -654,6 +674,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     { // Upload data
+        StartupPhase phase("Upload");
+
         std::vector<uint8_t> geometryBufferData(indexDataAlignedSize + vertexDataSize);
         memcpy(&geometryBufferData[0], g_IndexData, indexDataSize);
         memcpy(&geometryBufferData[indexDataAlignedSize], g_VertexData, vertexDataSize);
@@ -676,7 +698,11 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI, bool) {
     }
 
     // User interface
+    StartupProfilerBegin("UI");
     bool initialized = InitImgui(*m_Device);
+    StartupProfilerEnd();
+
+    StartupProfilerReport(nri::nriGetGraphicsAPIString(graphicsAPI));
 
     return initialized;
 }